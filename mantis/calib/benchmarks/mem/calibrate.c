@@ -26,12 +26,15 @@
 #include "utillog.h"
 #include "utilrand.h"
 #include "calibrate.h"
+#include "memworker.h"
 #include "workeropts.h"
 
 unsigned long long callcnt = 0;
 unsigned long long second_count = 0;
 unsigned long long prng_count = 0;
+unsigned long long mem_ceiling = 0;
 unsigned long long select_count = 0;
+double tsc_per_usec = 1000.0;
 
 /*
  * Calibrate this CPU to figure out how high we can count in one second.
@@ -92,6 +95,114 @@ void* calibrate_prng(void *opt)
   return NULL;
 }
 
+/*
+ * Find how many blocks per second a single memory worker thread can
+ *   touch sweeping sequentially through memory.  Requested block
+ *   rates above this will not be met; those below it may still not
+ *   be, with a pattern the prefetcher can't follow.
+ */
+void* calibrate_mem(void *opt)
+{
+  char *buf;
+  cpu_opts *cpu;
+  uint64_t nblks;
+  unsigned long long my_count;
+  struct timeval start;
+  struct timeval finish;
+
+  if(!opt)
+    return NULL;
+
+  cpu = (cpu_opts *)opt;
+
+  nblks = MEM_CEILING_BYTES / MEM_CEILING_BLKSIZE;
+
+  buf = (char *)malloc(MEM_CEILING_BYTES);
+  if(!buf) {
+    s_log(G_WARNING, "Could not allocate memory calibration buffer.\n");
+    mem_ceiling = 0;
+    return NULL;
+  }
+  (void)memwork_bench(buf, nblks, MEM_CEILING_BLKSIZE);
+
+  (void)gettimeofday(&start, NULL);
+  for(my_count = 0;!cpu->shopts.exiting;) {
+    my_count += memwork_bench(buf, nblks, MEM_CEILING_BLKSIZE);
+  }
+  (void)gettimeofday(&finish, NULL);
+
+  {
+    int64_t timediff;
+
+    timediff = calculate_timediff(&start, &finish);
+    if(timediff > 0)
+      mem_ceiling = (my_count * US_SEC) / timediff;
+    else
+      mem_ceiling = 0;
+  }
+
+  free(buf);
+
+  return NULL;
+}
+
+/*
+ * Find the TSC rate against CLOCK_MONOTONIC.  This is quick, so
+ *   it's done every time we start rather than saved with the
+ *   benchmark data.
+ */
+void calibrate_tsc(void)
+{
+  int i;
+  double best;
+
+  /*
+   * Take a few short samples and keep the one with the smallest
+   *   rate.  The TSC reads bracket the clock reads, so a sample
+   *   that got preempted in between can only come out high.
+   */
+  best = 0.0;
+  for(i = 0;i < TSC_CALIBRATE_TRIALS;i++) {
+    uint64_t tsc_start;
+    uint64_t tsc_finish;
+    int64_t nsecs;
+    double rate;
+    struct timespec start;
+    struct timespec finish;
+    struct timeval sleeptv;
+
+    tsc_start = read_tsc();
+    (void)clock_gettime(CLOCK_MONOTONIC, &start);
+
+    sleeptv.tv_sec  = 0;
+    sleeptv.tv_usec = TSC_CALIBRATE_USEC;
+    (void)select(0, (fd_set *)NULL, (fd_set *)NULL, (fd_set *)NULL,
+                 &sleeptv);
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &finish);
+    tsc_finish = read_tsc();
+
+    nsecs  = (int64_t)(finish.tv_sec - start.tv_sec) * 1000000000LL;
+    nsecs += (int64_t)(finish.tv_nsec - start.tv_nsec);
+    if((nsecs <= 0) || (tsc_finish <= tsc_start))
+      continue;
+
+    rate = (double)(tsc_finish - tsc_start) * 1000.0 / (double)nsecs;
+    if(!best || (rate < best))
+      best = rate;
+  }
+
+  if(best > 0.0) {
+    tsc_per_usec = best;
+  }
+  else {
+    s_log(G_WARNING, "Could not calibrate the TSC; assuming 1 GHz.\n");
+    tsc_per_usec = 1000.0;
+  }
+
+  s_log(G_DEBUG, "TSC runs at %.3f ticks per usec.\n", tsc_per_usec);
+}
+
 /*
  * Conduct all of our benchmarks.  We run the benchmarks 'num_trials'
  *   times and take the best from each one.
@@ -101,9 +212,11 @@ void benchmark_delays(unsigned int num_trials)
   uint32_t i;
   unsigned long long best_cpu_count;
   unsigned long long best_prng_count;
+  unsigned long long best_mem_ceiling;
 
-  best_cpu_count  = (signed long long)-1;
-  best_prng_count = (signed long long)-1;
+  best_cpu_count   = (signed long long)-1;
+  best_prng_count  = (signed long long)-1;
+  best_mem_ceiling = (signed long long)-1;
 
   if(!num_trials)
     return;
@@ -148,28 +261,52 @@ void benchmark_delays(unsigned int num_trials)
       goto fail_out;
     }
 
-    s_log(G_INFO, "Trial %i: (%llu, %llu).\n", i, second_count, prng_count);
+    memset(&cpu, 0, sizeof(cpu_opts));
+    rc = pthread_create(&cpu.shopts.t_sync.tid, (pthread_attr_t *)NULL,
+                        calibrate_mem, (void *)&cpu);
+    if(rc) {
+      s_log(G_WARNING, "Error launching memory calibration thread %u.\n", i);
+      goto fail_out;
+    }
+    else {
+      s_log(G_NOTICE, "Launched memory calibration thread %u.\n", i);
+    }
+    sleep(CALIBRATE_SECONDS);
+    cpu.shopts.exiting = 1;
+    rc = pthread_join(cpu.shopts.t_sync.tid, (void **)NULL);
+    if(rc) {
+      s_log(G_WARNING, "Error joining memory calibration thread %u.\n", i);
+      goto fail_out;
+    }
+
+    s_log(G_INFO, "Trial %i: (%llu, %llu, %llu).\n", i, second_count,
+                  prng_count, mem_ceiling);
 
     if(!i) {
-      best_cpu_count  = second_count;
-      best_prng_count = prng_count;
+      best_cpu_count   = second_count;
+      best_prng_count  = prng_count;
+      best_mem_ceiling = mem_ceiling;
     }
     else {
       if(second_count > best_cpu_count)
         best_cpu_count = second_count;
       if(prng_count > best_prng_count)
         best_prng_count = prng_count;
+      if(mem_ceiling > best_mem_ceiling)
+        best_mem_ceiling = mem_ceiling;
     }
   }
 
   second_count        = best_cpu_count;
   prng_count          = best_prng_count;
+  mem_ceiling         = best_mem_ceiling;
 
   return;
 
 fail_out:
   second_count = 0;
   prng_count   = 0;
+  mem_ceiling  = 0;
 
   return;
 }
@@ -15,6 +15,7 @@
 
 #include <stdio.h>
 #include <netdb.h>
+#include <time.h>
 
 /* Calibrate node attributes for some number of seconds each. */
 #define CALIBRATE_SECONDS 1
@@ -28,6 +29,62 @@ extern unsigned long long second_count;
 /* How many 4-byte PRN can we generate in one second? */
 extern unsigned long long prng_count;
 
+/*
+ * Buffer and block size used to find the memory ceiling: one
+ *   sequential write sweep, a byte per cache line, over a buffer
+ *   bigger than the caches.  The prefetcher can follow a sweep like
+ *   that, so it's a best case; random or widely strided patterns
+ *   will top out lower.
+ */
+#define MEM_CEILING_BYTES  (128 * 1024 * 1024)
+#define MEM_CEILING_BLKSIZE 64
+
+/* How many blocks can one thread touch per second in that sweep? */
+extern unsigned long long mem_ceiling;
+
+/* How long to sample the TSC for, and how many times. */
+#define TSC_CALIBRATE_USEC   20000 /* 20 ms */
+#define TSC_CALIBRATE_TRIALS 3
+
+/* How many TSC ticks are there in one microsecond? */
+extern double tsc_per_usec;
+
+/*
+ * Read the CPU's time stamp counter.  Without one, fall back on
+ *   CLOCK_MONOTONIC in nanoseconds; calibrate_tsc() sorts out the rate
+ *   either way.
+ */
+static inline uint64_t read_tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  uint32_t lo;
+  uint32_t hi;
+
+  __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t)hi << 32) | lo;
+#else
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/*
+ * Convert a number of TSC ticks to microseconds.
+ */
+static inline uint64_t tsc_to_usec(uint64_t ticks)
+{
+  return (uint64_t)((double)ticks / tsc_per_usec);
+}
+
+/*
+ * Find the TSC rate against CLOCK_MONOTONIC.  This is quick, so
+ *   it's done every time we start rather than saved with the
+ *   benchmark data.
+ */
+extern void calibrate_tsc(void);
+
 /*
  * Calibrate this CPU to figure out how high we can count in one second.
  * We use this later on for decent CPU burn rates and exact delays for
@@ -41,6 +98,12 @@ extern void* calibrate_cpu(void *opt);
  */
 extern void* calibrate_prng(void *opt);
 
+/*
+ * Find how fast a single memory worker thread can touch memory.
+ *   Requested memory I/O rates above this will not be met.
+ */
+extern void* calibrate_mem(void *opt);
+
 /*
  * Conduct all of our benchmarks.  We run the benchmarks 'num_trials'
  *   times and take the best from each one.
@@ -0,0 +1,508 @@
+/*
+ * Copyright 2005 Justin Moore, justin@cs.duke.edu
+ *
+ * This software may be freely redistributed under the terms of the GNU
+ * public license.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#define _GNU_SOURCE    /* For open_memstream() */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include "cmdserver.h"
+#include "constants.h"
+#include "input.h"
+#include "mainctl.h"
+#include "utillog.h"
+#include "utilnet.h"
+#include "workersync.h"
+
+#define SRV_MAX_CLIENTS 64  /* Clients connected at once */
+#define SRV_MAX_SOCKS   (SRV_MAX_CLIENTS + 4)
+#define SRV_POLL_MS     250 /* How often to look for a shutdown */
+#define SRV_SEND_SEC    10  /* Hang up on a client this slow to read */
+
+/*
+ * One connected client, the thread talking to it, and the partial
+ *   command line it's sent.  The slot is in use while fd >= 0; once
+ *   the thread sets 'done', the server thread collects it.
+ */
+typedef struct {
+  int       fd;
+  pthread_t tid;
+  uint8_t   done;
+  uint32_t  len;
+  char      buf[BUFSIZE + 1];
+  void     *srv;
+} srv_client;
+
+/*
+ * Commands from different clients run one at a time under cmd_lock,
+ *   except "wait", which takes wait_lock instead so it can block
+ *   without holding up everyone else.
+ */
+typedef struct {
+  gamut_opts     *gopts;
+  growArray      *s_arr;     /* Only the server thread touches this */
+  pthread_mutex_t lock;      /* Guards the client slots */
+  pthread_mutex_t cmd_lock;
+  pthread_mutex_t wait_lock;
+  srv_client      client[SRV_MAX_CLIENTS];
+} srv_state;
+
+static srv_state server = {
+  NULL, NULL, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+  PTHREAD_MUTEX_INITIALIZER
+};
+
+static void* serve(void *arg);
+static void* srv_talk(void *arg);
+static void srv_take_new(srv_state *srv);
+static int srv_collect(srv_state *srv);
+static int srv_read(srv_state *srv, srv_client *c);
+static int srv_command(srv_state *srv, srv_client *c, char *line);
+static int srv_reply(srv_client *c, int rc, char *text, size_t len);
+static int srv_send(srv_client *c, char *p, size_t len);
+static void srv_drop(srv_state *srv, srv_client *c);
+
+/*
+ * Fire up the server.  It runs as the input thread, so stop_input()
+ *   would do to stop it, too.
+ */
+void start_server(gamut_opts *gopts, growArray *s_arr)
+{
+  int i;
+  int rc;
+
+  if(!gopts || !s_arr) {
+    exit(EXIT_FAILURE);
+  }
+
+  memset(server.client, 0, sizeof(server.client));
+  server.gopts = gopts;
+  server.s_arr = s_arr;
+  for(i = 0;i < SRV_MAX_CLIENTS;i++) {
+    server.client[i].fd  = -1;
+    server.client[i].srv = (void *)&server;
+  }
+
+  rc = lock_start(gopts);
+  if(rc < 0) {
+    exit(EXIT_FAILURE);
+  }
+
+  rc = pthread_create(&gopts->i_sync.t_sync.tid, (pthread_attr_t *)NULL,
+                      serve, (void *)&server);
+
+  (void)unlock_start(gopts);
+
+  if(rc) {
+    s_log(G_WARNING, "Error starting command server.\n");
+    exit(EXIT_FAILURE);
+  }
+  else {
+    s_log(G_DEBUG, "Started command server (tid %lu).\n",
+                   gopts->i_sync.t_sync.tid);
+  }
+}
+
+void stop_server(gamut_opts *gopts)
+{
+  int i;
+  sockinfo *arr;
+
+  if(!gopts)
+    return;
+
+  stop_input(gopts);
+
+  arr = (sockinfo *)server.s_arr->dat;
+  for(i = 0;i < server.s_arr->currUsed;i++) {
+    (void)close(arr[i].sock);
+  }
+  server.s_arr->currUsed = 0;
+}
+
+/*
+ * The thread we will spawn.
+ *
+ * Each time through, wait for a listening socket to have someone
+ *   to accept, hand each new client a thread of its own, and
+ *   collect the threads of clients that have gone.
+ */
+static void* serve(void *arg)
+{
+  int i;
+  int n;
+  int nfds;
+  srv_state *srv;
+  sockinfo *arr;
+  struct pollfd pfd[SRV_MAX_SOCKS];
+
+  srv = (srv_state *)arg;
+
+  /*
+   * Lock and unlock the start lock so we know
+   *   that our thread ID has been filled in.
+   */
+  if((lock_start(srv->gopts) < 0) || (unlock_start(srv->gopts) < 0))
+    return NULL;
+
+  while(!srv->gopts->i_sync.exiting) {
+    nfds = 0;
+    arr  = (sockinfo *)srv->s_arr->dat;
+    for(i = 0;(i < srv->s_arr->currUsed) && (nfds < SRV_MAX_SOCKS);i++) {
+      pfd[nfds].fd      = arr[i].sock;
+      pfd[nfds].events  = POLLIN;
+      pfd[nfds].revents = 0;
+      nfds++;
+    }
+
+    n = poll(pfd, nfds, SRV_POLL_MS);
+    if(n < 0) {
+      if(errno == EINTR)
+        continue;
+      s_log(G_WARNING, "Command server error waiting: %s.\n",
+                       strerror(errno));
+      break;
+    }
+    else if(n) {
+      (void)accept_connection(srv->s_arr, 1);
+      srv_take_new(srv);
+    }
+
+    (void)srv_collect(srv);
+  }
+
+  /*
+   * Idle clients see that we're exiting and hang up.  One stuck in
+   *   a "wait" needs a nudge, maybe more than one if it hadn't gone
+   *   to sleep yet.
+   */
+  srv->gopts->i_sync.exiting = 1;
+  while(srv_collect(srv)) {
+    if(!lock_waiting(srv->gopts)) {
+      (void)signal_waiting(srv->gopts);
+      (void)unlock_waiting(srv->gopts);
+    }
+    (void)poll(NULL, 0, SRV_POLL_MS);
+  }
+
+  return NULL;
+}
+
+/*
+ * A client's thread: run whatever it sends until it hangs up, says
+ *   "quit" or "shutdown", or the server stops.
+ */
+static void* srv_talk(void *arg)
+{
+  int n;
+  srv_state *srv;
+  srv_client *c;
+  struct pollfd pfd;
+
+  c   = (srv_client *)arg;
+  srv = (srv_state *)c->srv;
+
+  while(!srv->gopts->i_sync.exiting) {
+    pfd.fd      = c->fd;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+
+    n = poll(&pfd, 1, SRV_POLL_MS);
+    if(n < 0) {
+      if(errno == EINTR)
+        continue;
+      s_log(G_WARNING, "Command server error waiting on fd %d: %s.\n",
+                       c->fd, strerror(errno));
+      break;
+    }
+    else if(!n) {
+      continue;
+    }
+
+    if(srv_read(srv, c) <= 0)
+      break;
+  }
+
+  srv_drop(srv, c);
+
+  return NULL;
+}
+
+/*
+ * accept_connection() leaves what it accepted in the socket array
+ *   as NEW_SOCKs; give each one a client slot and a thread, or hang
+ *   up on it.  Either way it leaves the array, which from here on
+ *   holds only the listening sockets.
+ */
+static void srv_take_new(srv_state *srv)
+{
+  int i;
+  int j;
+  int rc;
+  int one;
+  int sock;
+  sockinfo *arr;
+  struct timeval tv;
+
+  one        = 1;
+  tv.tv_sec  = SRV_SEND_SEC;
+  tv.tv_usec = 0;
+
+  arr = (sockinfo *)srv->s_arr->dat;
+  for(i = 0;i < srv->s_arr->currUsed;) {
+    if(arr[i].state != NEW_SOCK) {
+      i++;
+      continue;
+    }
+
+    sock = arr[i].sock;
+    (void)del_socket(srv->s_arr, sock);
+
+    (void)pthread_mutex_lock(&srv->lock);
+    for(j = 0;(j < SRV_MAX_CLIENTS) && (srv->client[j].fd >= 0);j++)
+      ;
+    if(j < SRV_MAX_CLIENTS) {
+      srv->client[j].fd   = sock;
+      srv->client[j].done = 0;
+      srv->client[j].len  = 0;
+    }
+    (void)pthread_mutex_unlock(&srv->lock);
+
+    if(j == SRV_MAX_CLIENTS) {
+      s_log(G_WARNING, "Command server is full; turning a client away.\n");
+      (void)close(sock);
+      continue;
+    }
+
+    (void)setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    /* Replies go out in two pieces; don't hold the second one back. */
+    (void)setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    rc = pthread_create(&srv->client[j].tid, (pthread_attr_t *)NULL,
+                        srv_talk, (void *)&srv->client[j]);
+    if(rc) {
+      s_log(G_WARNING, "Error starting a thread for a client (fd %d).\n",
+                       sock);
+      (void)close(sock);
+      (void)pthread_mutex_lock(&srv->lock);
+      srv->client[j].fd = -1;
+      (void)pthread_mutex_unlock(&srv->lock);
+      continue;
+    }
+
+    s_log(G_NOTICE, "Command server has a new client (fd %d).\n", sock);
+  }
+}
+
+/*
+ * Collect the threads of clients that have hung up.
+ *   Returns the number of clients still connected.
+ */
+static int srv_collect(srv_state *srv)
+{
+  int i;
+  int left;
+  pthread_t tid;
+
+  left = 0;
+  for(i = 0;i < SRV_MAX_CLIENTS;i++) {
+    (void)pthread_mutex_lock(&srv->lock);
+    if((srv->client[i].fd < 0) || !srv->client[i].done) {
+      if(srv->client[i].fd >= 0)
+        left++;
+      (void)pthread_mutex_unlock(&srv->lock);
+      continue;
+    }
+    tid = srv->client[i].tid;
+    (void)pthread_mutex_unlock(&srv->lock);
+
+    (void)pthread_join(tid, (void **)NULL);
+
+    (void)pthread_mutex_lock(&srv->lock);
+    srv->client[i].fd   = -1;
+    srv->client[i].done = 0;
+    (void)pthread_mutex_unlock(&srv->lock);
+  }
+
+  return left;
+}
+
+/*
+ * Take what the client has sent and run every whole line in it.
+ * This function returns  1 if the client is still good,
+ *                        0 if it's gone or said "quit",
+ *                       -1 on error.
+ */
+static int srv_read(srv_state *srv, srv_client *c)
+{
+  char *line;
+  char *nl;
+  int rc;
+  ssize_t n;
+
+  n = recv(c->fd, c->buf + c->len, BUFSIZE - c->len, 0);
+  if(n <= 0) {
+    if(n < 0) {
+      if(errno == EINTR)
+        return 1;
+      s_log(G_WARNING, "Command server error reading from fd %d: %s.\n",
+                       c->fd, strerror(errno));
+      return -1;
+    }
+    return 0;
+  }
+  c->len        += (uint32_t)n;
+  c->buf[c->len] = '\0';
+
+  line = c->buf;
+  while((nl = strchr(line, '\n')) != NULL) {
+    *nl = '\0';
+    rc  = srv_command(srv, c, line);
+    if(rc <= 0)
+      return rc;
+    line = nl + 1;
+  }
+
+  c->len -= (uint32_t)(line - c->buf);
+  memmove(c->buf, line, c->len + 1);
+
+  if(c->len == BUFSIZE) {
+    c->len = 0;
+    if(srv_reply(c, -1, "Command line too long.\n", 23) < 0)
+      return -1;
+  }
+
+  return 1;
+}
+
+/*
+ * Run one line and send back what came of it.
+ */
+static int srv_command(srv_state *srv, srv_client *c, char *line)
+{
+  char *out;
+  int rc;
+  size_t len;
+  FILE *fp;
+  pthread_mutex_t *lock;
+
+  chomp(line);
+  while((*line == ' ') || (*line == '\t'))
+    line++;
+  if(!(*line))
+    return 1;
+
+  if(!strcmp(line, "shutdown")) {
+    s_log(G_NOTICE, "INPUT %s\n", line);
+    (void)srv_reply(c, 0, NULL, 0);
+
+    if(lock_master(srv->gopts) < 0)
+      return -1;
+    if(send_master_cmd(srv->gopts, MCMD_EXIT, NULL) < 0) {
+      s_log(G_WARNING, "Error commanding the master to quit.\n");
+    }
+    (void)unlock_master(srv->gopts);
+
+    return 0;
+  }
+
+  len = strcspn(line, " \t");
+  if((len == 4) && !strncasecmp(line, "wait", 4))
+    lock = &srv->wait_lock;
+  else
+    lock = &srv->cmd_lock;
+
+  out = NULL;
+  len = 0;
+  fp  = open_memstream(&out, &len);
+  (void)pthread_mutex_lock(lock);
+  rc  = input_command(srv->gopts, line, fp);
+  (void)pthread_mutex_unlock(lock);
+  if(fp)
+    (void)fclose(fp);
+
+  if(srv_reply(c, (rc < 0) ? -1 : 0, out, len) < 0)
+    rc = -1;
+  else if(rc > 0)  /* quit */
+    rc = 0;
+  else
+    rc = 1;
+
+  free(out);
+  return rc;
+}
+
+static int srv_reply(srv_client *c, int rc, char *text, size_t len)
+{
+  char hdr[SMBUFSIZE];
+  size_t i;
+  uint32_t nlines;
+
+  nlines = 0;
+  for(i = 0;i < len;i++) {
+    if(text[i] == '\n')
+      nlines++;
+  }
+
+  (void)snprintf(hdr, SMBUFSIZE, "%s %u\n", (rc < 0) ? "ERR" : "OK", nlines);
+  if(srv_send(c, hdr, strlen(hdr)) < 0)
+    return -1;
+
+  return srv_send(c, text, len);
+}
+
+static int srv_send(srv_client *c, char *p, size_t len)
+{
+  ssize_t n;
+
+  while(len) {
+    n = send(c->fd, p, len, MSG_NOSIGNAL);
+    if(n < 0) {
+      if(errno == EINTR)
+        continue;
+      s_log(G_WARNING, "Command server error replying to fd %d: %s.\n",
+                       c->fd, strerror(errno));
+      return -1;
+    }
+    p   += n;
+    len -= (size_t)n;
+  }
+
+  return 0;
+}
+
+/*
+ * Hang up.  The slot stays taken until the server thread has
+ *   collected our thread.
+ */
+static void srv_drop(srv_state *srv, srv_client *c)
+{
+  s_log(G_NOTICE, "Command server lost a client (fd %d).\n", c->fd);
+
+  (void)close(c->fd);
+  c->len = 0;
+
+  (void)pthread_mutex_lock(&srv->lock);
+  c->done = 1;
+  (void)pthread_mutex_unlock(&srv->lock);
+}
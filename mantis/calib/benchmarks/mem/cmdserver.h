@@ -0,0 +1,38 @@
+/*
+ * Copyright 2005 Justin Moore, justin@cs.duke.edu
+ *
+ * This software may be freely redistributed under the terms of the GNU
+ * public license.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef GAMUT_CMDSERVER_H
+#define GAMUT_CMDSERVER_H
+
+#include "utilarr.h"
+#include "workeropts.h"
+
+/*
+ * netgamut's command server.  It takes the place of the input
+ *   thread: clients connect to any listening socket in 's_arr'
+ *   (those in XFER_MODE) and send the same command lines gamut
+ *   reads from stdin.  Each client has its own thread, so a
+ *   "wait" only holds up the client that sent it.  Every line gets
+ *   a reply of
+ *
+ *     OK <n>      or      ERR <n>
+ *
+ *   followed by the <n> lines the command logged.  "quit" ends a
+ *   client's session; "shutdown" stops netgamut.
+ */
+extern void start_server(gamut_opts *gopts, growArray *s_arr);
+
+/*
+ * Shut the server down and hang up on its clients.
+ */
+extern void stop_server(gamut_opts *gopts);
+
+#endif /* GAMUT_CMDSERVER_H */
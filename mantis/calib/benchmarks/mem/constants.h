@@ -27,11 +27,34 @@
 #define MAX_DIOS   32
 #define MAX_NIOS   32
 
+#define MAX_MEM_THREADS 32 /* Threads that can share one memory worker */
+
 #define MAX_WQUEUE  16  /* Queue length for keeping track of workers */
 #define MAX_LINKLEN 16  /* Maximum number of workers per link */
 #define MAX_LINKS   16  /* Maximum number of worker sets */
 #define MAX_AFTERS  8   /* Number of other workers we can follow */
 
+#define DEF_DIO_QDEPTH 32   /* Default queue depth for async disk I/O */
+#define MAX_DIO_QDEPTH 1024 /* Maximum queue depth for async disk I/O */
+#define MIN_DIO_ALIGN  512  /* Smallest alignment O_DIRECT can accept */
+#define MAX_DIO_BATCH  16   /* Blocks in one preadv() or pwritev() */
+#define MAX_DIO_FILES  32   /* Files or devices one disk worker stripes over */
+
+#define DEF_PREP_THREADS 4         /* Threads filling a work file */
+#define MAX_PREP_THREADS 16        /* Most threads filling a work file */
+#define DIO_PREP_CHUNK   (1 << 20) /* Bytes per write when filling */
+
+#define DEF_DIO_POOL       64        /* Random blocks writes rotate through */
+#define MAX_DIO_POOL       4096      /* Most random blocks in the pool */
+#define MAX_DIO_POOL_BYTES (64 << 20) /* Most memory the pool may take */
+#define DIO_STAMP_SPAN     4096      /* Bytes between per-write stamps */
+
+#define DEF_META_WIDTH 16        /* Subdirectories per directory (meta) */
+#define DEF_META_DEPTH 1         /* Levels of subdirectories (meta) */
+#define MAX_META_DEPTH 4
+#define MAX_META_DIRS  65536     /* Most leaf directories in a tree */
+#define MAX_META_FILES (1 << 24) /* Most file names a tree can hold */
+
 /*
  * How many worker epochs per second?
  *   Default is 20, meaning an epoch lasts 50ms.
@@ -39,11 +62,26 @@
 #define WORKER_EPOCHS_PER_SEC 20
 #define US_PER_WORKER_EPOCH   (US_SEC / WORKER_EPOCHS_PER_SEC)
 
+/*
+ * How many epochs of history does a memory worker keep?
+ *   At 20 epochs per second this is the last five minutes.
+ */
+#define MEM_EPOCH_SAMPLES (300 * WORKER_EPOCHS_PER_SEC)
+
 #define DEF_BMARK_TRIALS 10 /* num of benchmark trials for '-b' */
 
 #define LISTEN_BACKLOG 5    /* Backlog size for TCP connections */
 #define CONN_WAIT      3    /* wait 3 seconds for a TCP connection */
 #define MAX_RECV_TRIES 5    /* # of times we try to get UDP data */
+#define DEF_NIO_CONNS  1    /* Sockets per net worker */
+#define MAX_NIO_CONNS  16384 /* Most sockets one net worker holds */
+#define NIO_EVENTS     256  /* Events taken per epoll_wait() */
+#define NIO_TX_FILE    (4 << 20) /* Bytes in the file sendfile/splice use */
+#define MAX_NIO_BATCH  1024 /* Most UDP packets per sendmmsg/recvmmsg */
+#define NIO_GSO_SEGS   64   /* Most packets the kernel splits one send into */
+#define NIO_GRO_BYTES  65535 /* Biggest coalesced UDP read */
+#define DEF_NIO_BURST  1    /* Packets a paced writer lets out at once */
+#define MAX_NIO_BURST  65536
 
 /*
  * Modes for disk worker file creation.
@@ -59,6 +97,68 @@
 #define C_IOWRITE   1  /* Array index for write statistics */
 #define C_IOSEEK    2  /* Array index for seek statistics */
 
+/*
+ * How a disk worker issues its I/O.
+ */
+#define DIO_ENGINE_SYNC  0  /* One read() or write() at a time */
+#define DIO_ENGINE_URING 1  /* Queues of async I/O through io_uring */
+#define DIO_ENGINE_MMAP  2  /* Loads and stores through a shared mapping */
+#define DIO_ENGINE_META  3  /* File system metadata in a directory tree */
+
+/*
+ * The operations the meta engine mixes.
+ */
+#define DIO_META_CREATE  0  /* Create a file and write its data */
+#define DIO_META_STAT    1
+#define DIO_META_RENAME  2  /* Move a file to a free name, maybe elsewhere */
+#define DIO_META_UNLINK  3
+#define NUM_DIO_META_OPS 4
+
+#define DIO_MSYNC_SYNC  0   /* msync() waits for the writeback */
+#define DIO_MSYNC_ASYNC 1   /* msync() only schedules it */
+
+/*
+ * How a disk worker makes its writes durable.  The first three
+ *   are calls made every 'sync' blocks; the others make none.
+ */
+#define DIO_SYNC_FSYNC     0 /* fsync(), data and metadata */
+#define DIO_SYNC_FDATASYNC 1 /* fdatasync(), skipping inessential metadata */
+#define DIO_SYNC_RANGE     2 /* sync_file_range() on the blocks written */
+#define DIO_SYNC_DSYNC     3 /* Open with O_DSYNC; every write is durable */
+#define DIO_SYNC_NONE      4 /* Leave it all to the kernel */
+
+#define DIO_FADV_NONE     0 /* Leave the page cache alone */
+#define DIO_FADV_DONTNEED 1 /* Drop the file's cached pages every epoch */
+
+/*
+ * How a disk worker prepares a new work file.
+ */
+#define DIO_PREP_SPARSE 0  /* Set the size and leave holes */
+#define DIO_PREP_ALLOC  1  /* Allocate every block with fallocate() */
+#define DIO_PREP_FILL   2  /* Allocate, then write random data everywhere */
+
+/*
+ * Who a net worker talks to.
+ */
+#define NIO_PEER_NONE  0  /* Someone started by hand, maybe elsewhere */
+#define NIO_PEER_LOCAL 1  /* A sink or source thread we start ourselves */
+
+/*
+ * How a net worker hands its packets to the kernel.
+ */
+#define NIO_TX_COPY     0  /* send() from a user buffer */
+#define NIO_TX_SENDFILE 1  /* sendfile() from a prepared file */
+#define NIO_TX_SPLICE   2  /* splice() the file through a pipe */
+#define NIO_TX_ZEROCOPY 3  /* send() with MSG_ZEROCOPY */
+
+/*
+ * How a net writer spreads an epoch's packets out.
+ */
+#define NIO_PACE_NONE   0  /* All at the start of the epoch */
+#define NIO_PACE_KERNEL 1  /* SO_MAX_PACING_RATE; TCP itself or fq */
+#define NIO_PACE_USER   2  /* 'burst' packets at a time, evenly spaced */
+#define NIO_PACE_AUTO   3  /* The kernel if it will, or else us */
+
 /*
  * Used for cleaning worker options and copying worker options.
  *   Do we keep or not keep identifying information (label, run-time
@@ -97,4 +197,13 @@
 #define L_ADD 0
 #define L_DEL 1
 
+/*
+ * netgamut's command port, unless told otherwise,
+ *   and what a coordinator (gamut -c) connects to.
+ *   Commands aren't authenticated, so by default only
+ *   this machine may send them.
+ */
+#define NETGAMUT_PORT 5623
+#define NETGAMUT_ADDR "127.0.0.1"
+
 #endif /* GAMUT_CONSTANTS_H */
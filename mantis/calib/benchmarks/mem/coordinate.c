@@ -0,0 +1,406 @@
+/*
+ * Copyright 2005 Justin Moore, justin@cs.duke.edu
+ *
+ * This software may be freely redistributed under the terms of the GNU
+ * public license.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include "constants.h"
+#include "coordinate.h"
+#include "utilio.h"
+#include "utillog.h"
+#include "utilnet.h"
+
+#define COORD_MAX_NODES 64
+#define COORD_SAMPLES   8               /* "time" round trips per node */
+#define COORD_LEAD      (2 * US_SEC)    /* Least time before the start */
+#define COORD_SETTLE    (US_SEC / 4)    /* Then ask how it went */
+#define COORD_TRIES     20              /* Times to ask before giving up */
+
+/*
+ * One node, and what we've learned about its clock.
+ */
+typedef struct {
+  char     host[BUFSIZE];
+  uint16_t port;
+  char     trace[BUFSIZE];
+  int      fd;
+  FILE    *fp;
+  int64_t  offset;   /* Its clock minus ours, usec */
+  int64_t  rtt;      /* Round trip of the sample 'offset' came from */
+  uint64_t started;  /* When it started, on its clock */
+} coord_node;
+
+static int read_coordfile(const char *coordfile, coord_node *nodes);
+static int node_connect(coord_node *n);
+static int node_cmd(coord_node *n, const char *cmd, char *reply, size_t len);
+static int node_sync(coord_node *n);
+static int node_started(coord_node *n);
+static uint64_t now_usec(void);
+
+int coordinate(const char *coordfile)
+{
+  char cmd[BUFSIZE];
+  char reply[BUFSIZE];
+  int i;
+  int nnodes;
+  int rc;
+  int64_t maxrtt;
+  int64_t late;
+  int64_t lo;
+  int64_t hi;
+  uint64_t start;
+  uint64_t now;
+  coord_node *nodes;
+
+  if(!coordfile)
+    return -1;
+
+  rc    = -1;
+  nodes = (coord_node *)calloc(COORD_MAX_NODES, sizeof(coord_node));
+  if(!nodes) {
+    s_log(G_WARNING, "Error allocating coordinator nodes.\n");
+    return -1;
+  }
+  for(i = 0;i < COORD_MAX_NODES;i++) {
+    nodes[i].fd = -1;
+  }
+
+  nnodes = read_coordfile(coordfile, nodes);
+  if(nnodes <= 0)
+    goto clean_out;
+
+  /*
+   * Find out where every node's clock is before we pick a start.
+   */
+  maxrtt = 0;
+  for(i = 0;i < nnodes;i++) {
+    if((node_connect(&nodes[i]) < 0) || (node_sync(&nodes[i]) < 0))
+      goto clean_out;
+    if(nodes[i].rtt > maxrtt)
+      maxrtt = nodes[i].rtt;
+
+    s_log(G_NOTICE, "Node %s:%hu is %lld usec off our clock "
+                    "(+/- %lld).\n", nodes[i].host, nodes[i].port,
+                    (long long)nodes[i].offset,
+                    (long long)(nodes[i].rtt / 2));
+  }
+
+  /*
+   * Leave enough room to tell everyone, one after another,
+   *   even if each takes a few times its best round trip.
+   */
+  start = now_usec() + COORD_LEAD + (uint64_t)(4 * maxrtt * nnodes);
+  s_log(G_NOTICE, "Starting %d traces at %llu.\n",
+                  nnodes, (unsigned long long)start);
+
+  for(i = 0;i < nnodes;i++) {
+    (void)snprintf(cmd, BUFSIZE, "trace file=%s,start=%llu",
+                   nodes[i].trace,
+                   (unsigned long long)((int64_t)start + nodes[i].offset));
+    if(node_cmd(&nodes[i], cmd, reply, BUFSIZE) < 0) {
+      s_log(G_WARNING, "Node %s:%hu would not take the trace: %s",
+                       nodes[i].host, nodes[i].port, reply);
+      goto clean_out;
+    }
+  }
+
+  if(now_usec() >= start) {
+    s_log(G_WARNING, "The start time passed before every node heard "
+                     "about it.\n");
+  }
+
+  now = now_usec();
+  if(now < start + COORD_SETTLE)
+    (void)usleep((useconds_t)(start + COORD_SETTLE - now));
+
+  /*
+   * Each node was handed start + offset on its own clock, so how late
+   *   it started is measured on that clock alone; the offset cancels,
+   *   and this is just how late its sleep woke up.  Where the starts
+   *   really fell relative to each other also depends on how well we
+   *   know each offset: within half of that node's round trip.
+   */
+  lo = hi = 0;
+  for(i = 0;i < nnodes;i++) {
+    if(node_started(&nodes[i]) < 0)
+      goto clean_out;
+
+    late = (int64_t)nodes[i].started
+           - ((int64_t)start + nodes[i].offset);
+    if(!i || (late < lo))
+      lo = late;
+    if(!i || (late > hi))
+      hi = late;
+
+    s_log(G_NOTICE, "Node %s:%hu started %lld usec late by its own "
+                    "clock.\n", nodes[i].host, nodes[i].port,
+                    (long long)late);
+  }
+
+  s_log(G_NOTICE, "Across %d nodes, lateness spans %lld usec; counting "
+                  "offset error, the starts are within %lld usec.\n",
+                  nnodes, (long long)(hi - lo), (long long)(hi - lo + maxrtt));
+  rc = 0;
+
+clean_out:
+  for(i = 0;i < COORD_MAX_NODES;i++) {
+    if(nodes[i].fp) {
+      (void)send(nodes[i].fd, "quit\n", 5, MSG_NOSIGNAL);
+      (void)fclose(nodes[i].fp);
+    }
+    else if(nodes[i].fd >= 0) {
+      (void)close(nodes[i].fd);
+    }
+  }
+  free(nodes);
+
+  return rc;
+}
+
+/*
+ * Fill in 'nodes' from the coordinator file.
+ * This function returns -1 on error, or
+ *                       the number of nodes otherwise.
+ */
+static int read_coordfile(const char *coordfile, coord_node *nodes)
+{
+  char buf[BUFSIZE];
+  char fmt[SMBUFSIZE];
+  char host[BUFSIZE];
+  char trace[BUFSIZE];
+  char *p;
+  char *q;
+  int nnodes;
+  int linenum;
+  unsigned long port;
+  FILE *fp;
+
+  fp = fopen(coordfile, "r");
+  if(!fp) {
+    s_log(G_WARNING, "Could not open %s: %s\n", coordfile, strerror(errno));
+    return -1;
+  }
+
+  /* Both fields fit in BUFSIZE, whatever that is */
+  (void)snprintf(fmt, SMBUFSIZE, "%%%ds %%%ds", BUFSIZE - 1, BUFSIZE - 1);
+
+  nnodes  = 0;
+  linenum = 0;
+  while(fgets(buf, BUFSIZE, fp)) {
+    linenum++;
+
+    p = buf;
+    while((*p == ' ') || (*p == '\t'))
+      p++;
+    if((*p == '#') || (*p == '\n') || !(*p))
+      continue;
+
+    if(sscanf(p, fmt, host, trace) != 2) {
+      s_log(G_WARNING, "%s:%d: expected \"host[:port] tracefile\".\n",
+                       coordfile, linenum);
+      goto fail_out;
+    }
+    if(nnodes == COORD_MAX_NODES) {
+      s_log(G_WARNING, "%s: more than %d nodes.\n",
+                       coordfile, COORD_MAX_NODES);
+      goto fail_out;
+    }
+
+    port = NETGAMUT_PORT;
+    p    = strrchr(host, ':');
+    if(p) {
+      *p++  = '\0';
+      errno = 0;
+      port  = strtoul(p, &q, 10);
+      if(errno || (p == q) || *q || !port || (port > 65535)) {
+        s_log(G_WARNING, "%s:%d: invalid port \"%s\".\n",
+                         coordfile, linenum, p);
+        goto fail_out;
+      }
+    }
+
+    (void)snprintf(nodes[nnodes].host, BUFSIZE, "%s", host);
+    (void)snprintf(nodes[nnodes].trace, BUFSIZE, "%s", trace);
+    nodes[nnodes].port = (uint16_t)port;
+    nnodes++;
+  }
+  (void)fclose(fp);
+
+  if(!nnodes) {
+    s_log(G_WARNING, "%s names no nodes.\n", coordfile);
+  }
+  return nnodes;
+
+fail_out:
+  (void)fclose(fp);
+  return -1;
+}
+
+static int node_connect(coord_node *n)
+{
+  char reply[BUFSIZE];
+  int one;
+
+  n->fd = get_client_sock(n->host, n->port);
+  if(n->fd < 0) {
+    s_log(G_WARNING, "Could not connect to %s:%hu.\n", n->host, n->port);
+    return -1;
+  }
+
+  /* Every round trip counts against how well we know its clock. */
+  one = 1;
+  (void)setsockopt(n->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  n->fp = fdopen(n->fd, "r");
+  if(!n->fp) {
+    s_log(G_WARNING, "Error reading from %s:%hu.\n", n->host, n->port);
+    return -1;
+  }
+
+  if(node_cmd(n, "helo", reply, BUFSIZE) < 0) {
+    s_log(G_WARNING, "%s:%hu did not answer.\n", n->host, n->port);
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Send one command and read the reply, leaving the first line
+ *   of it (if any) in 'reply'.
+ * This function returns  0 on "OK",
+ *                       -1 on "ERR" or a broken connection.
+ */
+static int node_cmd(coord_node *n, const char *cmd, char *reply, size_t len)
+{
+  char buf[BUFSIZE];
+  size_t clen;
+  ssize_t sent;
+  unsigned int i;
+  unsigned int nlines;
+
+  reply[0] = '\0';
+
+  (void)snprintf(buf, BUFSIZE, "%s\n", cmd);
+  clen = strlen(buf);
+  sent = send(n->fd, buf, clen, MSG_NOSIGNAL);
+  if(sent != (ssize_t)clen)
+    return -1;
+
+  if(!fgets(buf, BUFSIZE, n->fp))
+    return -1;
+  if(sscanf(buf, "OK %u", &nlines) == 1) {
+    clen = 0;
+  }
+  else if(sscanf(buf, "ERR %u", &nlines) == 1) {
+    clen = 1;
+  }
+  else {
+    return -1;
+  }
+
+  for(i = 0;i < nlines;i++) {
+    if(!fgets(buf, BUFSIZE, n->fp))
+      return -1;
+    if(!i) {
+      strncpy(reply, buf, len - 1);
+      reply[len - 1] = '\0';
+    }
+  }
+
+  return clen ? -1 : 0;
+}
+
+/*
+ * Take COORD_SAMPLES readings of the node's clock and keep the one
+ *   with the shortest round trip.  Its clock read 't1' somewhere
+ *   between our 't0' and 't3'; call it the middle, give or take
+ *   half the round trip.
+ */
+static int node_sync(coord_node *n)
+{
+  char reply[BUFSIZE];
+  int i;
+  int64_t rtt;
+  uint64_t t0;
+  uint64_t t1;
+  uint64_t t3;
+
+  n->rtt = -1;
+  for(i = 0;i < COORD_SAMPLES;i++) {
+    t0 = now_usec();
+    if(node_cmd(n, "time", reply, BUFSIZE) < 0)
+      goto fail_out;
+    t3 = now_usec();
+
+    if(sscanf(reply, "time=%llu", (unsigned long long *)&t1) != 1)
+      goto fail_out;
+
+    rtt = (int64_t)(t3 - t0);
+    if((n->rtt < 0) || (rtt < n->rtt)) {
+      n->rtt    = rtt;
+      n->offset = (int64_t)t1 - (int64_t)((t0 + t3) / 2);
+    }
+  }
+
+  return 0;
+
+fail_out:
+  s_log(G_WARNING, "Could not read the clock on %s:%hu.\n",
+                   n->host, n->port);
+  return -1;
+}
+
+/*
+ * Ask the node when its trace started, waiting a bit if it's
+ *   running late.
+ */
+static int node_started(coord_node *n)
+{
+  char reply[BUFSIZE];
+  char *p;
+  int i;
+
+  for(i = 0;i < COORD_TRIES;i++) {
+    if(node_cmd(n, "trace", reply, BUFSIZE) < 0)
+      break;
+
+    p = strstr(reply, "started=");
+    if(!p || (sscanf(p, "started=%llu",
+                     (unsigned long long *)&n->started) != 1))
+      break;
+    if(n->started)
+      return 0;
+
+    (void)usleep((useconds_t)COORD_SETTLE);
+  }
+
+  s_log(G_WARNING, "Node %s:%hu did not start its trace.\n",
+                   n->host, n->port);
+  return -1;
+}
+
+static uint64_t now_usec(void)
+{
+  struct timeval tv;
+
+  (void)gettimeofday(&tv, NULL);
+  return (uint64_t)tv.tv_sec * US_SEC + tv.tv_usec;
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright 2005 Justin Moore, justin@cs.duke.edu
+ *
+ * This software may be freely redistributed under the terms of the GNU
+ * public license.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef GAMUT_COORDINATE_H
+#define GAMUT_COORDINATE_H
+
+/*
+ * Start tracefiles on several netgamut nodes at the same instant.
+ *
+ * Each line of 'coordfile' names a node and the tracefile (a path
+ *   on that node) it should run:
+ *
+ *     host[:port] tracefile
+ *
+ *   Blank lines and lines starting with '#' are skipped.  We find
+ *   each node's clock offset from ours with a few "time" commands,
+ *   pick a start time far enough ahead for every node to hear about
+ *   it, and hand each one that time on its own clock with "trace".
+ *   Once they've started, we ask each how late it started by its
+ *   own clock, and report how far apart that, plus what we don't
+ *   know about the offsets, could put them.
+ *
+ * This function returns 0 if every node started, -1 otherwise.
+ */
+extern int coordinate(const char *coordfile);
+
+#endif /* GAMUT_COORDINATE_H */
@@ -0,0 +1,341 @@
+/*
+ * Copyright 2005 Justin Moore, justin@cs.duke.edu
+ *
+ * This software may be freely redistributed under the terms of the GNU
+ * public license.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#define _GNU_SOURCE    /* For syncfs() */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "constants.h"
+#include "diskmeta.h"
+#include "pattern.h"
+#include "utillog.h"
+
+struct dio_meta {
+  char     *root;
+  int       root_fd;    /* Held open for syncfs() */
+  int       made_root;  /* Did we create the root? */
+  int       writable;   /* May we change the tree? */
+  uint32_t  width;
+  uint32_t  depth;
+  uint32_t  ndirs;      /* Leaf directories */
+  uint64_t  nfiles;
+  uint64_t  count;      /* Files that exist */
+  uint8_t  *exists;     /* One byte per file name */
+  uint8_t  *ours;       /* ... and whether we created what's there */
+  char     *path;       /* Room to build names in */
+  char     *path2;
+};
+
+/*
+ * The name of directory 'dir' on level 'level' (1 is just under
+ *   the root): one hex component per level, so the tree is always
+ *   the same for the same width and depth.
+ */
+static void meta_dir_path(dio_meta *dm, char *buf, uint64_t dir,
+                          uint32_t level)
+{
+  uint32_t i;
+  uint64_t div;
+  char *p;
+
+  p  = buf;
+  p += sprintf(p, "%s", dm->root);
+
+  div = 1;
+  for(i = 1;i < level;i++) {
+    div *= dm->width;
+  }
+  for(i = 0;i < level;i++) {
+    p  += sprintf(p, "/%llx", (unsigned long long)((dir / div) % dm->width));
+    div /= dm->width;
+  }
+}
+
+/*
+ * File 'idx' lives in leaf directory idx % ndirs.
+ */
+static void meta_file_path(dio_meta *dm, char *buf, uint64_t idx)
+{
+  meta_dir_path(dm, buf, idx % dm->ndirs, dm->depth);
+  sprintf(buf + strlen(buf), "/f%llx", (unsigned long long)idx);
+}
+
+/*
+ * Pick a file that exists ('want' = 1) or a name that's free
+ *   ('want' = 0), starting from a random spot.  There has to be one.
+ */
+static uint64_t meta_pick(dio_meta *dm, int want, uint64_t *rstate)
+{
+  uint64_t start;
+  uint8_t *p;
+
+  start = pattern_rand_range(rstate, dm->nfiles);
+  p = (uint8_t *)memchr(dm->exists + start, want, dm->nfiles - start);
+  if(!p)
+    p = (uint8_t *)memchr(dm->exists, want, start);
+
+  return (uint64_t)(p - dm->exists);
+}
+
+dio_meta* dio_meta_create(char *root, uint32_t width, uint32_t depth,
+                          uint64_t nfiles, int create)
+{
+  uint32_t i;
+  uint64_t j;
+  uint64_t ndirs;
+  size_t plen;
+  dio_meta *dm;
+  struct stat sbuf;
+
+  if(!root || !width || !depth || (depth > MAX_META_DEPTH) || !nfiles)
+    return NULL;
+
+  dm = (dio_meta *)calloc(1, sizeof(*dm));
+  if(!dm)
+    return NULL;
+  dm->root_fd = -1;
+
+  ndirs = 1;
+  for(i = 0;i < depth;i++) {
+    ndirs *= width;
+  }
+  if(ndirs > MAX_META_DIRS)
+    goto fail_out;
+
+  dm->width    = width;
+  dm->depth    = depth;
+  dm->ndirs    = (uint32_t)ndirs;
+  dm->nfiles   = nfiles;
+  dm->writable = create;
+
+  /* The root, a 9-char component per level, and the file name */
+  plen      = strlen(root) + (depth * 9) + 24;
+  dm->root  = strdup(root);
+  dm->path  = (char *)malloc(plen);
+  dm->path2 = (char *)malloc(plen);
+  dm->exists = (uint8_t *)calloc(nfiles, 1);
+  dm->ours   = (uint8_t *)calloc(nfiles, 1);
+  if(!dm->root || !dm->path || !dm->path2 || !dm->exists || !dm->ours)
+    goto fail_out;
+
+  if(stat(root, &sbuf) < 0) {
+    if(!create || (mkdir(root, 0750) < 0)) {
+      s_log(G_WARNING, "Error making directory \"%s\": %s.\n",
+                       root, strerror(errno));
+      goto fail_out;
+    }
+    dm->made_root = 1;
+  }
+  else if(!S_ISDIR(sbuf.st_mode)) {
+    s_log(G_WARNING, "\"%s\" is not a directory.\n", root);
+    goto fail_out;
+  }
+
+  dm->root_fd = open(root, O_RDONLY | O_DIRECTORY);
+  if(dm->root_fd < 0)
+    goto fail_out;
+
+  /*
+   * Make the tree one level at a time, then see what's in it.
+   */
+  if(create) {
+    ndirs = 1;
+    for(i = 1;i <= depth;i++) {
+      ndirs *= width;
+      for(j = 0;j < ndirs;j++) {
+        meta_dir_path(dm, dm->path, j, i);
+        if((mkdir(dm->path, 0750) < 0) && (errno != EEXIST)) {
+          s_log(G_WARNING, "Error making directory \"%s\": %s.\n",
+                           dm->path, strerror(errno));
+          goto fail_out;
+        }
+      }
+    }
+  }
+
+  for(j = 0;j < nfiles;j++) {
+    meta_file_path(dm, dm->path, j);
+    if(!stat(dm->path, &sbuf)) {
+      dm->exists[j] = 1;
+      dm->count++;
+    }
+  }
+
+  s_log(G_DEBUG, "Tree at %s has %u leaf directories and %llu of "
+                 "%llu files.\n", root, dm->ndirs,
+                 (unsigned long long)dm->count, (unsigned long long)nfiles);
+
+  return dm;
+
+fail_out:
+  dio_meta_destroy(dm, 0);
+  return NULL;
+}
+
+void dio_meta_destroy(dio_meta *dm, int remove)
+{
+  uint32_t i;
+  uint64_t j;
+  uint64_t ndirs;
+
+  if(!dm)
+    return;
+
+  /*
+   * Files first, then the directories from the bottom up.  Only
+   *   the files we created go; rmdir() leaves any directory that
+   *   still holds someone else's.
+   */
+  if(remove && dm->exists && dm->ours) {
+    for(j = 0;j < dm->nfiles;j++) {
+      if(dm->exists[j] && dm->ours[j]) {
+        meta_file_path(dm, dm->path, j);
+        (void)unlink(dm->path);
+      }
+    }
+
+    ndirs = dm->ndirs;
+    for(i = dm->depth;i > 0;i--) {
+      for(j = 0;j < ndirs;j++) {
+        meta_dir_path(dm, dm->path, j, i);
+        (void)rmdir(dm->path);
+      }
+      ndirs /= dm->width;
+    }
+
+    if(dm->made_root)
+      (void)rmdir(dm->root);
+  }
+
+  if(dm->root_fd >= 0)
+    (void)close(dm->root_fd);
+  if(dm->root)
+    free(dm->root);
+  if(dm->path)
+    free(dm->path);
+  if(dm->path2)
+    free(dm->path2);
+  if(dm->exists)
+    free(dm->exists);
+  if(dm->ours)
+    free(dm->ours);
+  free(dm);
+}
+
+uint64_t dio_meta_count(dio_meta *dm)
+{
+  return dm ? dm->count : 0;
+}
+
+int dio_meta_op(dio_meta *dm, int op, uint64_t *rstate,
+                char *data, uint32_t len)
+{
+  int fd;
+  uint64_t idx;
+  uint64_t to;
+  struct stat sbuf;
+
+  if(!dm || !rstate || (len && !data))
+    return -1;
+
+  /*
+   * Turn the operation around if there's nothing for it to do.
+   */
+  if(op == DIO_META_CREATE) {
+    if(dm->count >= dm->nfiles)
+      op = DIO_META_UNLINK;
+  }
+  else if(!dm->count) {
+    op = DIO_META_CREATE;
+  }
+  if((op != DIO_META_STAT) && !dm->writable) {
+    if(!dm->count) {
+      s_log(G_WARNING, "Nothing to stat under \"%s\", and we may not "
+                       "change it.\n", dm->root);
+      return -1;
+    }
+    op = DIO_META_STAT;
+  }
+  if((op == DIO_META_RENAME) && (dm->count >= dm->nfiles))
+    op = DIO_META_STAT;
+
+  idx = meta_pick(dm, (op != DIO_META_CREATE), rstate);
+  meta_file_path(dm, dm->path, idx);
+
+  switch(op) {
+    case DIO_META_CREATE:
+      /* Always open in mode 640 for security reasons */
+      fd = open(dm->path, O_WRONLY | O_CREAT | O_EXCL,
+                S_IRUSR | S_IWUSR | S_IRGRP);
+      if(fd < 0)
+        goto fail_out;
+      if(len && (write(fd, data, len) != (ssize_t)len)) {
+        (void)close(fd);
+        goto fail_out;
+      }
+      if(close(fd) < 0)
+        goto fail_out;
+      dm->exists[idx] = 1;
+      dm->ours[idx]   = 1;
+      dm->count++;
+      break;
+
+    case DIO_META_STAT:
+      if(stat(dm->path, &sbuf) < 0)
+        goto fail_out;
+      break;
+
+    case DIO_META_RENAME:
+      to = meta_pick(dm, 0, rstate);
+      meta_file_path(dm, dm->path2, to);
+      if(rename(dm->path, dm->path2) < 0)
+        goto fail_out;
+      dm->exists[idx] = 0;
+      dm->exists[to]  = 1;
+      dm->ours[to]    = dm->ours[idx];
+      dm->ours[idx]   = 0;
+      break;
+
+    case DIO_META_UNLINK:
+      if(unlink(dm->path) < 0)
+        goto fail_out;
+      dm->exists[idx] = 0;
+      dm->ours[idx]   = 0;
+      dm->count--;
+      break;
+
+    default:
+      return -1;
+  }
+
+  return op;
+
+fail_out:
+  s_log(G_WARNING, "Metadata operation %d on \"%s\" failed: %s.\n",
+                   op, dm->path, strerror(errno));
+  return -1;
+}
+
+int dio_meta_sync(dio_meta *dm)
+{
+  if(!dm)
+    return -1;
+
+  return syncfs(dm->root_fd);
+}
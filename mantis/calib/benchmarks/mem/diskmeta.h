@@ -0,0 +1,63 @@
+/*
+ * Copyright 2005 Justin Moore, justin@cs.duke.edu
+ *
+ * This software may be freely redistributed under the terms of the GNU
+ * public license.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef GAMUT_DISKMETA_H
+#define GAMUT_DISKMETA_H
+
+#include <netdb.h>  /* for uint{32,64}_t */
+
+/*
+ * A directory tree for the meta engine.  There's a fixed set of
+ *   file names, spread evenly over the leaf directories, and we
+ *   keep track of which of them exist so every operation can be
+ *   done without a failed lookup.
+ */
+typedef struct dio_meta dio_meta;
+
+/*
+ * Set up a tree under 'root' with 'width' subdirectories per
+ *   directory, 'depth' levels deep, holding up to 'nfiles' files.
+ *   With 'create', the root and the directories are made as
+ *   needed.  Whatever files are already there are kept.  Returns
+ *   NULL on failure.
+ */
+extern dio_meta* dio_meta_create(char *root, uint32_t width, uint32_t depth,
+                                 uint64_t nfiles, int create);
+
+/*
+ * Let go of the tree.  With 'remove', delete the files we created
+ *   and any directories that are then empty, and the root too if
+ *   we made it.  Files that were there before are left alone.
+ */
+extern void dio_meta_destroy(dio_meta *dm, int remove);
+
+/*
+ * How many of the files exist right now?
+ */
+extern uint64_t dio_meta_count(dio_meta *dm);
+
+/*
+ * Do one DIO_META_* operation on a file picked with 'rstate'.
+ *   A create writes 'len' bytes of 'data' to the new file.  When
+ *   there's no file to act on (or no free name to create), the
+ *   opposite operation is done instead, so the rate holds.  On a
+ *   tree we may not change, everything is done as a stat.
+ *   Returns the operation that was done, or -1 on error.
+ */
+extern int dio_meta_op(dio_meta *dm, int op, uint64_t *rstate,
+                       char *data, uint32_t len);
+
+/*
+ * Commit the file system the tree is on.  Returns -1 on error.
+ */
+extern int dio_meta_sync(dio_meta *dm);
+
+#endif /* GAMUT_DISKMETA_H */
@@ -0,0 +1,384 @@
+/*
+ * Copyright 2005 Justin Moore, justin@cs.duke.edu
+ *
+ * This software may be freely redistributed under the terms of the GNU
+ * public license.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "disktrace.h"
+#include "utilio.h"
+#include "utillog.h"
+
+#define TRACE_MIN_RECS 4096  /* Records to make room for at first */
+#define TRACE_MAX_DEVS 256   /* Devices a blkparse trace can name */
+#define TRACE_QUEUED   0x100 /* A blkparse Q, until we pick D or Q */
+#define TRACE_SECTOR   512   /* Bytes per LBA or sector */
+
+/*
+ * Everything the text parsers need to keep between lines.
+ */
+typedef struct {
+  uint32_t devs[TRACE_MAX_DEVS]; /* blkparse major:minor, by ASU */
+  uint32_t ndevs;
+  uint64_t nissued;              /* blkparse D records */
+  uint64_t nqueued;              /* blkparse Q records */
+} trace_state;
+
+static int trace_add(dio_trace *dt, uint64_t *room, dio_trace_rec *rec);
+static int trace_parse_spc(char *line, dio_trace_rec *rec);
+static int trace_parse_blkparse(char *line, dio_trace_rec *rec,
+                                trace_state *ts);
+static int trace_load_text(FILE *fp, dio_trace *dt, trace_state *ts);
+static int trace_load_binary(FILE *fp, dio_trace *dt);
+static int trace_rec_cmp(const void *a, const void *b);
+static uint64_t get_le(unsigned char *p, int nbytes);
+
+dio_trace* dio_trace_load(char *path)
+{
+  FILE *fp;
+  char magic[sizeof(DIO_TRACE_MAGIC) - 1];
+  int rc;
+  uint64_t i;
+  uint64_t j;
+  uint64_t base;
+  dio_trace *dt;
+  trace_state ts;
+
+  if(!path)
+    return NULL;
+
+  dt = (dio_trace *)calloc(1, sizeof(*dt));
+  if(!dt)
+    return NULL;
+  memset(&ts, 0, sizeof(ts));
+
+  fp = fopen(path, "rb");
+  if(!fp) {
+    s_log(G_WARNING, "Error opening trace \"%s\": %s.\n",
+                     path, strerror(errno));
+    goto fail_out;
+  }
+
+  if((fread(magic, 1, sizeof(magic), fp) == sizeof(magic))
+     && !memcmp(magic, DIO_TRACE_MAGIC, sizeof(magic)))
+  {
+    rc = trace_load_binary(fp, dt);
+  }
+  else {
+    rewind(fp);
+    rc = trace_load_text(fp, dt, &ts);
+  }
+  (void)fclose(fp);
+  if(rc < 0)
+    goto fail_out;
+
+  /*
+   * A blkparse trace usually has every request twice, once when
+   *   it's queued and once when it goes to the driver.  The second
+   *   is what the device saw, so use those if there are any.
+   */
+  if(ts.nqueued) {
+    for(i = 0, j = 0;i < dt->nrecs;i++) {
+      if(ts.nissued && (dt->recs[i].ioname & TRACE_QUEUED))
+        continue;
+      dt->recs[j] = dt->recs[i];
+      dt->recs[j].ioname &= ~TRACE_QUEUED;
+      j++;
+    }
+    dt->nrecs = j;
+  }
+
+  if(!dt->nrecs) {
+    s_log(G_WARNING, "Found nothing to replay in trace \"%s\".\n", path);
+    goto fail_out;
+  }
+
+  /*
+   * Traces taken on several CPUs are only mostly in order.
+   */
+  for(i = 1;i < dt->nrecs;i++) {
+    if(dt->recs[i].usec < dt->recs[i - 1].usec) {
+      qsort(dt->recs, dt->nrecs, sizeof(dio_trace_rec), trace_rec_cmp);
+      break;
+    }
+  }
+
+  base = dt->recs[0].usec;
+  for(i = 0;i < dt->nrecs;i++) {
+    dt->recs[i].usec -= base;
+    dt->nbytes       += dt->recs[i].len;
+    if(dt->recs[i].ioname == C_IOWRITE)
+      dt->nwrites++;
+    if(dt->recs[i].len > dt->maxlen)
+      dt->maxlen = dt->recs[i].len;
+    if((uint32_t)dt->recs[i].asu + 1 > dt->nasu)
+      dt->nasu = (uint32_t)dt->recs[i].asu + 1;
+  }
+
+  s_log(G_DEBUG, "Trace \"%s\" has %llu I/Os (%llu writes) on %u ASUs "
+                 "over %.3f sec.\n", path, (unsigned long long)dt->nrecs,
+                 (unsigned long long)dt->nwrites,
+                 dt->nasu, (double)dt->recs[dt->nrecs - 1].usec / US_SEC);
+
+  return dt;
+
+fail_out:
+  dio_trace_free(dt);
+  return NULL;
+}
+
+void dio_trace_free(dio_trace *dt)
+{
+  if(!dt)
+    return;
+
+  if(dt->recs)
+    free(dt->recs);
+  free(dt);
+}
+
+/*
+ * Append a record, making more room as needed.
+ */
+static int trace_add(dio_trace *dt, uint64_t *room, dio_trace_rec *rec)
+{
+  if(dt->nrecs == *room) {
+    dio_trace_rec *recs;
+    uint64_t nroom;
+
+    nroom = *room ? (*room * 2) : TRACE_MIN_RECS;
+    recs  = (dio_trace_rec *)realloc(dt->recs,
+                                     nroom * sizeof(dio_trace_rec));
+    if(!recs) {
+      s_log(G_WARNING, "Unable to hold %llu trace records.\n",
+                       (unsigned long long)nroom);
+      return -1;
+    }
+    dt->recs = recs;
+    *room    = nroom;
+  }
+
+  dt->recs[dt->nrecs++] = *rec;
+  return 0;
+}
+
+/*
+ * ASU,LBA,size,opcode,timestamp.  Returns 1 for a record,
+ *   0 for anything else.
+ */
+static int trace_parse_spc(char *line, dio_trace_rec *rec)
+{
+  char op;
+  unsigned int asu;
+  unsigned int size;
+  unsigned long long lba;
+  double secs;
+
+  if(sscanf(line, "%u ,%llu ,%u , %c ,%lf",
+            &asu, &lba, &size, &op, &secs) != 5)
+  {
+    return 0;
+  }
+  if((asu > 0xffff) || !size || (secs < 0))
+    return 0;
+
+  if((op == 'r') || (op == 'R'))
+    rec->ioname = C_IOREAD;
+  else if((op == 'w') || (op == 'W'))
+    rec->ioname = C_IOWRITE;
+  else
+    return 0;
+
+  rec->usec   = (uint64_t)((secs * US_SEC) + 0.5);
+  rec->offset = (uint64_t)lba * TRACE_SECTOR;
+  rec->len    = size;
+  rec->asu    = (uint16_t)asu;
+
+  return 1;
+}
+
+/*
+ *   8,0    3        1     0.000000000   697  D  WS 1234 + 8 [proc]
+ *
+ * Returns 1 for a read or write that was queued or issued,
+ *   0 for anything else.
+ */
+static int trace_parse_blkparse(char *line, dio_trace_rec *rec,
+                                trace_state *ts)
+{
+  char act[8];
+  char rwbs[8];
+  unsigned int maj;
+  unsigned int min;
+  unsigned int nsec;
+  unsigned long long sector;
+  uint32_t dev;
+  uint32_t i;
+  double secs;
+
+  if(sscanf(line, "%u,%u %*u %*u %lf %*u %7s %7s %llu + %u",
+            &maj, &min, &secs, act, rwbs, &sector, &nsec) != 7)
+  {
+    return 0;
+  }
+  if(!nsec || (secs < 0))
+    return 0;
+  if(strcmp(act, "D") && strcmp(act, "Q"))
+    return 0;
+
+  if(strchr(rwbs, 'W'))
+    rec->ioname = C_IOWRITE;
+  else if(strchr(rwbs, 'R'))
+    rec->ioname = C_IOREAD;
+  else
+    return 0;
+
+  dev = ((uint32_t)maj << 20) | (uint32_t)min;
+  for(i = 0;(i < ts->ndevs) && (ts->devs[i] != dev);i++)
+    ;
+  if(i == ts->ndevs) {
+    if(ts->ndevs == TRACE_MAX_DEVS)
+      return 0;
+    ts->devs[ts->ndevs++] = dev;
+  }
+
+  rec->usec   = (uint64_t)((secs * US_SEC) + 0.5);
+  rec->offset = (uint64_t)sector * TRACE_SECTOR;
+  rec->len    = nsec * TRACE_SECTOR;
+  rec->asu    = (uint16_t)i;
+
+  if(!strcmp(act, "Q")) {
+    rec->ioname |= TRACE_QUEUED;
+    ts->nqueued++;
+  }
+  else {
+    ts->nissued++;
+  }
+
+  return 1;
+}
+
+/*
+ * One record per line, in either text form.  Blank lines, comments
+ *   and lines we don't understand (blkparse's summary, say) are
+ *   passed over.
+ */
+static int trace_load_text(FILE *fp, dio_trace *dt, trace_state *ts)
+{
+  char line[BUFSIZE];
+  char *p;
+  int rc;
+  size_t len;
+  uint64_t room;
+  uint64_t nskip;
+  dio_trace_rec rec;
+
+  room  = 0;
+  nskip = 0;
+  while(fgets(line, sizeof(line), fp)) {
+    len = strlen(line);
+    if(len && (line[len - 1] != '\n') && !feof(fp)) {
+      int c;
+
+      /* Nothing we read runs this long; skip the rest of it */
+      while(((c = fgetc(fp)) != EOF) && (c != '\n'))
+        ;
+      nskip++;
+      continue;
+    }
+
+    for(p = line;(*p == ' ') || (*p == '\t');p++)
+      ;
+    if(!*p || (*p == '\n') || (*p == '\r') || (*p == '#'))
+      continue;
+
+    memset(&rec, 0, sizeof(rec));
+    rc = trace_parse_spc(p, &rec);
+    if(!rc)
+      rc = trace_parse_blkparse(p, &rec, ts);
+    if(!rc) {
+      nskip++;
+      continue;
+    }
+
+    if(trace_add(dt, &room, &rec) < 0)
+      return -1;
+  }
+  if(ferror(fp)) {
+    s_log(G_WARNING, "Error reading trace: %s.\n", strerror(errno));
+    return -1;
+  }
+
+  if(nskip) {
+    s_log(G_DEBUG, "Passed over %llu lines of the trace.\n",
+                   (unsigned long long)nskip);
+  }
+
+  return 0;
+}
+
+static int trace_load_binary(FILE *fp, dio_trace *dt)
+{
+  unsigned char raw[DIO_TRACE_RECSIZE];
+  size_t n;
+  uint64_t room;
+  dio_trace_rec rec;
+
+  room = 0;
+  while((n = fread(raw, 1, sizeof(raw), fp)) == sizeof(raw)) {
+    rec.usec   = get_le(raw, 8);
+    rec.offset = get_le(raw + 8, 8);
+    rec.len    = (uint32_t)get_le(raw + 16, 4);
+    rec.asu    = (uint16_t)get_le(raw + 20, 2);
+    rec.ioname = (get_le(raw + 22, 2) & 1) ? C_IOWRITE : C_IOREAD;
+    if(!rec.len)
+      continue;
+
+    if(trace_add(dt, &room, &rec) < 0)
+      return -1;
+  }
+  if(ferror(fp)) {
+    s_log(G_WARNING, "Error reading trace: %s.\n", strerror(errno));
+    return -1;
+  }
+  if(n) {
+    s_log(G_WARNING, "Trace ends with %u bytes of a partial record.\n",
+                     (uint32_t)n);
+  }
+
+  return 0;
+}
+
+static int trace_rec_cmp(const void *a, const void *b)
+{
+  const dio_trace_rec *ra;
+  const dio_trace_rec *rb;
+
+  ra = (const dio_trace_rec *)a;
+  rb = (const dio_trace_rec *)b;
+  if(ra->usec < rb->usec)
+    return -1;
+  return (ra->usec > rb->usec);
+}
+
+static uint64_t get_le(unsigned char *p, int nbytes)
+{
+  uint64_t v;
+
+  v = 0;
+  while(nbytes--) {
+    v = (v << 8) | p[nbytes];
+  }
+
+  return v;
+}
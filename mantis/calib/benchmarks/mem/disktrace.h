@@ -0,0 +1,66 @@
+/*
+ * Copyright 2005 Justin Moore, justin@cs.duke.edu
+ *
+ * This software may be freely redistributed under the terms of the GNU
+ * public license.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef GAMUT_DISKTRACE_H
+#define GAMUT_DISKTRACE_H
+
+#include <netdb.h>  /* for uint{16,32,64}_t */
+
+/*
+ * A block I/O trace for a disk worker to replay.  Three forms are
+ *   read, and told apart by their contents:
+ *
+ *   SPC (UMass) text:  ASU,LBA,size,opcode,timestamp[,...]
+ *       with 512-byte LBAs, the size in bytes, an opcode of R or W,
+ *       and the timestamp in seconds.
+ *   blkparse text:     the default output of blkparse(1).  Only the
+ *       requests issued to the driver (D) are used, or the ones
+ *       queued (Q) if there are none; each device is an ASU.
+ *   Binary:            the 8 bytes DIO_TRACE_MAGIC, then 24-byte
+ *       little-endian records of a 64-bit time in usec, a 64-bit
+ *       byte offset, a 32-bit length in bytes, a 16-bit ASU and a
+ *       16-bit flag word whose low bit marks a write.
+ */
+#define DIO_TRACE_MAGIC   "GAMUTBT1"
+#define DIO_TRACE_RECSIZE 24
+
+/*
+ * One I/O from the trace.  Times start at zero and never go back.
+ */
+typedef struct {
+  uint64_t usec;   /* When to issue it */
+  uint64_t offset; /* Byte offset on its ASU */
+  uint32_t len;    /* Bytes */
+  uint16_t asu;    /* Which device (application storage unit) */
+  uint16_t ioname; /* C_IOREAD or C_IOWRITE */
+} dio_trace_rec;
+
+typedef struct {
+  dio_trace_rec *recs;
+  uint64_t nrecs;
+  uint64_t nbytes;  /* Bytes over all the records */
+  uint64_t nwrites; /* How many of them write */
+  uint32_t maxlen;  /* Longest record */
+  uint32_t nasu;    /* Highest ASU, plus one */
+} dio_trace;
+
+/*
+ * Read the trace in 'path', sorted by time.  Returns NULL on
+ *   failure or if there's nothing in it to replay.
+ */
+extern dio_trace* dio_trace_load(char *path);
+
+/*
+ * Free a trace.
+ */
+extern void dio_trace_free(dio_trace *dt);
+
+#endif /* GAMUT_DISKTRACE_H */
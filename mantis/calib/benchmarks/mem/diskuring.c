@@ -0,0 +1,526 @@
+/*
+ * Copyright 2005 Justin Moore, justin@cs.duke.edu
+ *
+ * This software may be freely redistributed under the terms of the GNU
+ * public license.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "calibrate.h"
+#include "constants.h"
+#include "diskuring.h"
+#include "utillog.h"
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+/*
+ * What's going on in each slot.
+ */
+typedef struct {
+  int32_t  ioname;
+  uint32_t file;
+  uint32_t len;
+  uint64_t tsc;     /* When it was queued */
+} dio_uring_slot;
+
+struct dio_uring {
+  int       ring_fd;
+  int       fds[MAX_DIO_FILES]; /* The files we're doing I/O on */
+  uint32_t  nfds;
+  uint32_t  qdepth;
+  uint32_t  blksize;
+  uint32_t  queued;      /* In the SQ but not yet submitted */
+  uint32_t  inflight;    /* Submitted but not yet reaped */
+  uint8_t   fixed_bufs;  /* Are the buffers registered? */
+  uint8_t   fixed_file;  /* Are the files registered? */
+  uint8_t   ext_arg;     /* Can we wait with a timeout? */
+
+  /* Submission queue */
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  struct io_uring_sqe *sqes;
+
+  /* Completion queue */
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  void     *sq_ring;
+  size_t    sq_ring_len;
+  void     *cq_ring;
+  size_t    cq_ring_len;
+  size_t    sqes_len;
+
+  char           *bufs;       /* qdepth buffers of blksize bytes */
+  dio_uring_slot *slots;
+  uint32_t       *free_slots; /* Stack of unused slots */
+  uint32_t        nfree;
+};
+
+static int uring_setup(unsigned entries, struct io_uring_params *p)
+{
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int ring_fd, unsigned to_submit,
+                       unsigned min_complete, unsigned flags)
+{
+  return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                      min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int ring_fd, unsigned opcode,
+                          void *arg, unsigned nr_args)
+{
+  return (int)syscall(__NR_io_uring_register, ring_fd, opcode,
+                      arg, nr_args);
+}
+
+/*
+ * Is io_uring support compiled in?
+ */
+int dio_uring_supported(void)
+{
+  return 1;
+}
+
+/*
+ * Set up a ring of 'qdepth' entries on the 'nfds' files in 'fds',
+ *   with a 'blksize'-byte buffer per entry.  Returns NULL on failure.
+ */
+dio_uring* dio_uring_create(int *fds, uint32_t nfds,
+                            uint32_t qdepth, uint32_t blksize)
+{
+  int rc;
+  uint32_t i;
+  dio_uring *ur;
+  struct io_uring_params p;
+
+  if(!fds || !nfds || (nfds > MAX_DIO_FILES) || !qdepth || !blksize)
+    return NULL;
+  for(i = 0;i < nfds;i++) {
+    if(fds[i] < 0)
+      return NULL;
+  }
+
+  ur = (dio_uring *)calloc(1, sizeof(dio_uring));
+  if(!ur)
+    return NULL;
+  ur->ring_fd = -1;
+  memcpy(ur->fds, fds, nfds * sizeof(int));
+  ur->nfds    = nfds;
+  ur->qdepth  = qdepth;
+  ur->blksize = blksize;
+  ur->sq_ring = MAP_FAILED;
+  ur->cq_ring = MAP_FAILED;
+  ur->sqes    = MAP_FAILED;
+
+  memset(&p, 0, sizeof(p));
+  ur->ring_fd = uring_setup(qdepth, &p);
+  if(ur->ring_fd < 0) {
+    s_log(G_WARNING, "Could not set up an io_uring of depth %u: %s.\n",
+                     qdepth, strerror(errno));
+    goto fail_out;
+  }
+#ifdef IORING_FEAT_EXT_ARG
+  ur->ext_arg = !!(p.features & IORING_FEAT_EXT_ARG);
+#endif
+
+  /*
+   * Map the two rings and the submission entries.
+   */
+  ur->sq_ring_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  ur->cq_ring_len = p.cq_off.cqes
+                    + p.cq_entries * sizeof(struct io_uring_cqe);
+  ur->sqes_len    = p.sq_entries * sizeof(struct io_uring_sqe);
+
+  ur->sq_ring = mmap(NULL, ur->sq_ring_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ur->ring_fd,
+                     IORING_OFF_SQ_RING);
+  ur->cq_ring = mmap(NULL, ur->cq_ring_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ur->ring_fd,
+                     IORING_OFF_CQ_RING);
+  ur->sqes    = mmap(NULL, ur->sqes_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ur->ring_fd,
+                     IORING_OFF_SQES);
+  if((ur->sq_ring == MAP_FAILED) || (ur->cq_ring == MAP_FAILED)
+     || (ur->sqes == MAP_FAILED))
+  {
+    s_log(G_WARNING, "Could not map the io_uring: %s.\n", strerror(errno));
+    goto fail_out;
+  }
+
+  ur->sq_head  = (unsigned *)((char *)ur->sq_ring + p.sq_off.head);
+  ur->sq_tail  = (unsigned *)((char *)ur->sq_ring + p.sq_off.tail);
+  ur->sq_mask  = (unsigned *)((char *)ur->sq_ring + p.sq_off.ring_mask);
+  ur->sq_array = (unsigned *)((char *)ur->sq_ring + p.sq_off.array);
+  ur->cq_head  = (unsigned *)((char *)ur->cq_ring + p.cq_off.head);
+  ur->cq_tail  = (unsigned *)((char *)ur->cq_ring + p.cq_off.tail);
+  ur->cq_mask  = (unsigned *)((char *)ur->cq_ring + p.cq_off.ring_mask);
+  ur->cqes     = (struct io_uring_cqe *)((char *)ur->cq_ring
+                                         + p.cq_off.cqes);
+
+  /*
+   * One page-aligned buffer per slot.
+   */
+  rc = posix_memalign((void **)&ur->bufs, DIO_URING_ALIGN,
+                      (size_t)qdepth * blksize);
+  if(rc) {
+    ur->bufs = NULL;
+    s_log(G_WARNING, "Could not allocate %u %u-byte buffers: %s.\n",
+                     qdepth, blksize, strerror(rc));
+    goto fail_out;
+  }
+  memset(ur->bufs, 0, (size_t)qdepth * blksize);
+
+  ur->slots      = (dio_uring_slot *)calloc(qdepth, sizeof(dio_uring_slot));
+  ur->free_slots = (uint32_t *)calloc(qdepth, sizeof(uint32_t));
+  if(!ur->slots || !ur->free_slots)
+    goto fail_out;
+  for(i = 0;i < qdepth;i++) {
+    ur->free_slots[i] = qdepth - 1 - i;
+  }
+  ur->nfree = qdepth;
+
+  /*
+   * Registering the buffers and the files saves the kernel from
+   *   looking them up on every I/O.  Registered buffers count against
+   *   RLIMIT_MEMLOCK on older kernels, so carry on without them if
+   *   we have to.
+   */
+  {
+    struct iovec *iov;
+
+    iov = (struct iovec *)calloc(qdepth, sizeof(struct iovec));
+    if(!iov)
+      goto fail_out;
+    for(i = 0;i < qdepth;i++) {
+      iov[i].iov_base = ur->bufs + ((size_t)i * blksize);
+      iov[i].iov_len  = blksize;
+    }
+    rc = uring_register(ur->ring_fd, IORING_REGISTER_BUFFERS, iov, qdepth);
+    free(iov);
+    if(rc < 0) {
+      s_log(G_INFO, "Could not register io_uring buffers (%s); "
+                    "using unregistered ones.\n", strerror(errno));
+    }
+    else {
+      ur->fixed_bufs = 1;
+    }
+  }
+
+  rc = uring_register(ur->ring_fd, IORING_REGISTER_FILES, ur->fds, nfds);
+  if(rc >= 0)
+    ur->fixed_file = 1;
+
+  return ur;
+
+fail_out:
+  dio_uring_destroy(ur);
+  return NULL;
+}
+
+/*
+ * Wait for anything in flight and tear the ring down.
+ */
+void dio_uring_destroy(dio_uring *ur)
+{
+  dio_uring_done done[DIO_URING_REAP];
+
+  if(!ur)
+    return;
+
+  while((ur->ring_fd >= 0) && (ur->queued || ur->inflight)) {
+    if(dio_uring_submit(ur, 1) < 0)
+      break;
+    (void)dio_uring_reap(ur, done, DIO_URING_REAP);
+  }
+
+  if(ur->sqes != MAP_FAILED)
+    (void)munmap(ur->sqes, ur->sqes_len);
+  if(ur->cq_ring != MAP_FAILED)
+    (void)munmap(ur->cq_ring, ur->cq_ring_len);
+  if(ur->sq_ring != MAP_FAILED)
+    (void)munmap(ur->sq_ring, ur->sq_ring_len);
+  if(ur->ring_fd >= 0)
+    (void)close(ur->ring_fd);
+
+  if(ur->bufs)
+    free(ur->bufs);
+  if(ur->slots)
+    free(ur->slots);
+  if(ur->free_slots)
+    free(ur->free_slots);
+  free(ur);
+}
+
+/*
+ * The buffer belonging to a slot (0 <= slot < qdepth).
+ */
+char* dio_uring_buf(dio_uring *ur, uint32_t slot)
+{
+  if(!ur || (slot >= ur->qdepth))
+    return NULL;
+
+  return ur->bufs + ((size_t)slot * ur->blksize);
+}
+
+/*
+ * How many I/Os are queued or in flight?
+ */
+uint32_t dio_uring_busy(dio_uring *ur)
+{
+  if(!ur)
+    return 0;
+
+  return ur->queued + ur->inflight;
+}
+
+/*
+ * Queue a read or write of 'len' bytes at 'offset' in file number
+ *   'file' (0 <= file < nfds).  Nothing is
+ *   sent to the kernel until dio_uring_submit(), so a write's
+ *   buffer can still be changed until then.  Returns the slot
+ *   used, or -1 if every slot is busy.
+ */
+int dio_uring_queue(dio_uring *ur, uint32_t file, int ioname,
+                    uint64_t offset, uint32_t len)
+{
+  unsigned tail;
+  unsigned idx;
+  uint32_t slot;
+  struct io_uring_sqe *sqe;
+
+  if(!ur || !ur->nfree || (file >= ur->nfds) || (len > ur->blksize))
+    return -1;
+
+  slot = ur->free_slots[--ur->nfree];
+  tail = *ur->sq_tail;
+  idx  = tail & *ur->sq_mask;
+  sqe  = &ur->sqes[idx];
+
+  memset(sqe, 0, sizeof(*sqe));
+  if(ioname == C_IOREAD)
+    sqe->opcode = ur->fixed_bufs ? IORING_OP_READ_FIXED : IORING_OP_READ;
+  else
+    sqe->opcode = ur->fixed_bufs ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+  if(ur->fixed_file) {
+    sqe->fd     = (int32_t)file;
+    sqe->flags |= IOSQE_FIXED_FILE;
+  }
+  else {
+    sqe->fd     = ur->fds[file];
+  }
+  sqe->addr      = (uint64_t)(unsigned long)dio_uring_buf(ur, slot);
+  sqe->len       = len;
+  sqe->off       = offset;
+  sqe->buf_index = (uint16_t)slot;
+  sqe->user_data = slot;
+
+  ur->sq_array[idx]      = idx;
+  ur->slots[slot].ioname = ioname;
+  ur->slots[slot].file   = file;
+  ur->slots[slot].len    = len;
+  ur->slots[slot].tsc    = read_tsc();
+
+  __atomic_store_n(ur->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ur->queued++;
+
+  return (int)slot;
+}
+
+/*
+ * Hand everything queued to the kernel, then wait until at least
+ *   'wait_nr' I/Os have completed.  Returns -1 on error.
+ */
+int dio_uring_submit(dio_uring *ur, uint32_t wait_nr)
+{
+  int rc;
+
+  if(!ur)
+    return -1;
+
+  if(wait_nr > (ur->queued + ur->inflight))
+    wait_nr = ur->queued + ur->inflight;
+
+  do {
+    rc = uring_enter(ur->ring_fd, ur->queued, wait_nr,
+                     wait_nr ? IORING_ENTER_GETEVENTS : 0);
+  } while((rc < 0) && (errno == EINTR));
+
+  if(rc < 0) {
+    s_log(G_WARNING, "Error submitting to the io_uring: %s.\n",
+                     strerror(errno));
+    return -1;
+  }
+
+  ur->queued   -= (uint32_t)rc;
+  ur->inflight += (uint32_t)rc;
+
+  return 0;
+}
+
+/*
+ * Hand everything queued to the kernel, then wait until something
+ *   completes or 'usec' microseconds go by, whichever is first.
+ *   Kernels before 5.11 can't put a timeout on the wait, so there
+ *   we sleep in short steps instead.  Returns -1 on error.
+ */
+int dio_uring_wait(dio_uring *ur, uint64_t usec)
+{
+  int rc;
+  struct timespec ts;
+
+  if(!ur)
+    return -1;
+
+  rc = dio_uring_submit(ur, 0);
+  if(rc < 0)
+    return -1;
+
+#ifdef IORING_ENTER_EXT_ARG
+  if(ur->ext_arg && ur->inflight) {
+    struct __kernel_timespec kts;
+    struct io_uring_getevents_arg arg;
+
+    kts.tv_sec  = (int64_t)(usec / US_SEC);
+    kts.tv_nsec = (long long)(usec % US_SEC) * 1000;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t)(unsigned long)&kts;
+
+    rc = (int)syscall(__NR_io_uring_enter, ur->ring_fd, 0, 1,
+                      IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                      &arg, sizeof(arg));
+    if((rc < 0) && (errno != ETIME) && (errno != EINTR)) {
+      s_log(G_WARNING, "Error waiting on the io_uring: %s.\n",
+                       strerror(errno));
+      return -1;
+    }
+    return 0;
+  }
+#endif
+
+  /*
+   * With nothing in flight there's nothing to wake us early.
+   */
+  if(ur->inflight && (usec > DIO_URING_POLL_US))
+    usec = DIO_URING_POLL_US;
+  ts.tv_sec  = (time_t)(usec / US_SEC);
+  ts.tv_nsec = (long)(usec % US_SEC) * 1000;
+  (void)nanosleep(&ts, NULL);
+
+  return 0;
+}
+
+/*
+ * Collect up to 'max' completions.  Returns how many were collected.
+ */
+int dio_uring_reap(dio_uring *ur, dio_uring_done *done, int max)
+{
+  int n;
+  unsigned head;
+  unsigned tail;
+  uint64_t now;
+
+  if(!ur || !done || (max <= 0))
+    return 0;
+
+  n    = 0;
+  now  = read_tsc();
+  head = *ur->cq_head;
+  tail = __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE);
+  while((head != tail) && (n < max)) {
+    struct io_uring_cqe *cqe;
+    uint32_t slot;
+
+    cqe  = &ur->cqes[head & *ur->cq_mask];
+    slot = (uint32_t)cqe->user_data;
+
+    done[n].ioname = ur->slots[slot].ioname;
+    done[n].file   = ur->slots[slot].file;
+    done[n].len    = ur->slots[slot].len;
+    done[n].res    = cqe->res;
+    done[n].usec   = tsc_to_usec(now - ur->slots[slot].tsc);
+    n++;
+
+    ur->free_slots[ur->nfree++] = slot;
+    ur->inflight--;
+    head++;
+  }
+  __atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
+
+  return n;
+}
+
+#else /* !HAVE_IO_URING */
+
+/*
+ * Without the kernel headers there's no io_uring engine; the option
+ *   parser refuses engine=uring before we ever get here.
+ */
+int dio_uring_supported(void)
+{
+  return 0;
+}
+
+dio_uring* dio_uring_create(int *fds, uint32_t nfds,
+                            uint32_t qdepth, uint32_t blksize)
+{
+  s_log(G_WARNING, "This gamut was built without io_uring support.\n");
+  return NULL;
+}
+
+void dio_uring_destroy(dio_uring *ur)
+{
+}
+
+char* dio_uring_buf(dio_uring *ur, uint32_t slot)
+{
+  return NULL;
+}
+
+uint32_t dio_uring_busy(dio_uring *ur)
+{
+  return 0;
+}
+
+int dio_uring_queue(dio_uring *ur, uint32_t file, int ioname,
+                    uint64_t offset, uint32_t len)
+{
+  return -1;
+}
+
+int dio_uring_submit(dio_uring *ur, uint32_t wait_nr)
+{
+  return -1;
+}
+
+int dio_uring_wait(dio_uring *ur, uint64_t usec)
+{
+  return -1;
+}
+
+int dio_uring_reap(dio_uring *ur, dio_uring_done *done, int max)
+{
+  return 0;
+}
+
+#endif /* HAVE_IO_URING */
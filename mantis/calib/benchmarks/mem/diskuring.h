@@ -0,0 +1,95 @@
+/*
+ * Copyright 2005 Justin Moore, justin@cs.duke.edu
+ *
+ * This software may be freely redistributed under the terms of the GNU
+ * public license.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef GAMUT_DISKURING_H
+#define GAMUT_DISKURING_H
+
+#include <netdb.h>  /* for uint{32,64}_t */
+
+/*
+ * A small wrapper around an io_uring for the disk workers.  Each
+ *   slot in the queue has its own registered buffer, so there can be
+ *   up to 'qdepth' reads and writes in flight at once, spread over
+ *   one or more files.  We talk to the kernel directly rather than
+ *   pull in liburing.
+ */
+typedef struct dio_uring dio_uring;
+
+#define DIO_URING_ALIGN   4096 /* Alignment of the slot buffers */
+#define DIO_URING_REAP    64   /* Completions collected at a time */
+#define DIO_URING_POLL_US 1000 /* Longest nap when a wait has no timeout */
+
+/*
+ * One finished I/O.
+ */
+typedef struct {
+  int32_t  ioname; /* C_IOREAD or C_IOWRITE */
+  uint32_t file;   /* Which of the ring's files it was on */
+  uint32_t len;    /* Bytes asked for */
+  int32_t  res;    /* Bytes transferred, or -errno */
+  uint64_t usec;   /* Time from submission to completion */
+} dio_uring_done;
+
+/*
+ * Is io_uring support compiled in?
+ */
+extern int dio_uring_supported(void);
+
+/*
+ * Set up a ring of 'qdepth' entries on the 'nfds' files in 'fds',
+ *   with a 'blksize'-byte buffer per entry.  Returns NULL on failure.
+ */
+extern dio_uring* dio_uring_create(int *fds, uint32_t nfds,
+                                   uint32_t qdepth, uint32_t blksize);
+
+/*
+ * Wait for anything in flight and tear the ring down.
+ */
+extern void dio_uring_destroy(dio_uring *ur);
+
+/*
+ * The buffer belonging to a slot (0 <= slot < qdepth).
+ */
+extern char* dio_uring_buf(dio_uring *ur, uint32_t slot);
+
+/*
+ * How many I/Os are queued or in flight?
+ */
+extern uint32_t dio_uring_busy(dio_uring *ur);
+
+/*
+ * Queue a read or write of 'len' bytes at 'offset' in file number
+ *   'file' (0 <= file < nfds).  Nothing is
+ *   sent to the kernel until dio_uring_submit(), so a write's
+ *   buffer can still be changed until then.  Returns the slot
+ *   used, or -1 if every slot is busy.
+ */
+extern int dio_uring_queue(dio_uring *ur, uint32_t file, int ioname,
+                           uint64_t offset, uint32_t len);
+
+/*
+ * Hand everything queued to the kernel, then wait until at least
+ *   'wait_nr' I/Os have completed.  Returns -1 on error.
+ */
+extern int dio_uring_submit(dio_uring *ur, uint32_t wait_nr);
+
+/*
+ * Hand everything queued to the kernel, then wait until something
+ *   completes or 'usec' microseconds go by.  Returns -1 on error.
+ */
+extern int dio_uring_wait(dio_uring *ur, uint64_t usec);
+
+/*
+ * Collect up to 'max' completions.  Returns how many were collected.
+ */
+extern int dio_uring_reap(dio_uring *ur, dio_uring_done *done, int max);
+
+#endif /* GAMUT_DISKURING_H */
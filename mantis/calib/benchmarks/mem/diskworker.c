@@ -10,21 +10,37 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define _GNU_SOURCE    /* For O_DIRECT */
+
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <linux/fs.h>       /* BLKSSZGET */
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h>  /* major(), minor() */
+#endif
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/xattr.h>
 
 #include "calibrate.h"
 #include "constants.h"
+#include "diskmeta.h"
+#include "disktrace.h"
+#include "diskuring.h"
 #include "diskworker.h"
 #include "linklib.h"
+#include "pattern.h"
 #include "utilrand.h"
 #include "utillog.h"
 #include "workerctl.h"
@@ -32,22 +48,171 @@
 #include "workeropts.h"
 #include "workersync.h"
 
+/*
+ * Entries in a worker's offset ring.  Each lap around it is shifted,
+ *   so this only needs to be big enough to hide the repetition.
+ */
+#define DIO_RING_ENTRIES 32768
+
+/*
+ * Marks a work file that prep=alloc or prep=fill has finished with.
+ */
+#define DIO_PREP_XATTR "user.gamut.prep"
+
+/*
+ * Where a worker is in its file.  The position lives here rather
+ *   than in the kernel, so a seek is just an assignment.
+ */
+typedef struct {
+  uint64_t currblk;     /* Next block to read or write */
+  int32_t  next_iotype; /* Operation already drawn from the mix, or -1 */
+  uint64_t rstate;      /* PRNG state for picking seek targets */
+  uint16_t use_offs;    /* Take offsets from 'offs' instead? */
+  pattern_ring offs;    /* Precomputed byte offsets (offset=) */
+  char    *pool;        /* Random blocks that writes rotate through */
+  uint32_t pool_next;   /* Pool block the next write uses */
+  uint64_t stamp;       /* Counter stamped into every write */
+  uint64_t flt_seen[2]; /* Minor and major faults counted so far */
+  uint64_t trace_next;  /* Next record of the trace to queue */
+  uint32_t trace_done;  /* Bytes of it already queued */
+  uint64_t trace_start; /* When the replay began, in usec */
+  uint32_t busy[MAX_DIO_FILES]; /* Trace I/Os in flight on each file */
+} dio_cursor;
+
+/*
+ * The files a worker does its I/O on.  With more than one, block
+ *   'b' of the work is in stripe unit b / sblks, and the units go
+ *   round-robin over the files, as in RAID-0.
+ */
+typedef struct {
+  uint16_t nfiles;
+  uint64_t sblks;               /* Blocks per stripe unit */
+  uint64_t dev_nblks;           /* Blocks used on each file */
+  char    *list;                /* Our copy of the file list, split up */
+  char    *name[MAX_DIO_FILES];
+  int      fd[MAX_DIO_FILES];
+  char    *map[MAX_DIO_FILES];  /* Mappings for the mmap engine */
+  size_t   map_len;
+  uint64_t dirty[MAX_DIO_FILES][2]; /* Bytes written since the last sync */
+  uint64_t flush[MAX_DIO_FILES][2]; /* The ones before that (sync=range) */
+  dio_meta *meta;               /* The tree, for the meta engine */
+  dio_trace *trace;             /* The trace we're replaying, if any */
+} dio_files;
+
+/*
+ * Which file holds block 'blk' of the work, and where in it?
+ */
+static inline uint32_t dio_map(dio_files *df, uint64_t blk, uint64_t *devblk)
+{
+  uint64_t unit;
+
+  if(df->nfiles == 1) {
+    *devblk = blk;
+    return 0;
+  }
+
+  unit    = blk / df->sblks;
+  *devblk = ((unit / df->nfiles) * df->sblks) + (blk % df->sblks);
+  return (uint32_t)(unit % df->nfiles);
+}
+
+/*
+ * The time of day in usec, as the deadlines are kept.
+ */
+static inline uint64_t dio_now_usec(void)
+{
+  struct timeval tv;
+
+  (void)gettimeofday(&tv, NULL);
+  return ((uint64_t)tv.tv_sec * US_SEC) + (uint64_t)tv.tv_usec;
+}
+
+/*
+ * Widen a file's dirty window to take in a write of 'len' bytes
+ *   at 'pos'.  Only sync=range looks at it.
+ */
+static inline void dio_dirty(dio_files *df, uint32_t file,
+                             uint64_t pos, uint64_t len)
+{
+  uint64_t *w;
+
+  w = df->dirty[file];
+  if(w[1] <= w[0]) {
+    w[0] = pos;
+    w[1] = pos + len;
+  }
+  else {
+    if(pos < w[0])
+      w[0] = pos;
+    if(pos + len > w[1])
+      w[1] = pos + len;
+  }
+}
+
 /*
  * Do the work for this epoch.
  */
 static int diskwork(gamut_opts *gopts, dio_opts *dio,
-                    int fd, char *buf, iorange *iomix,
+                    dio_files *df, char *buf, iorange *iomix,
                     int64_t *target_diskio, double blocks_per_epoch,
-                    double *curr_blocks, uint32_t *sync_count);
+                    double *curr_blocks, uint32_t *sync_count,
+                    dio_cursor *cur);
+
+/*
+ * Do the work for this epoch with the io_uring engine.
+ */
+static int diskwork_uring(gamut_opts *gopts, dio_opts *dio,
+                          dio_files *df, dio_uring *ring, iorange *iomix,
+                          int64_t *target_diskio, double blocks_per_epoch,
+                          double *curr_blocks, uint32_t *sync_count,
+                          dio_cursor *cur);
 
-static int init_workfile(dio_opts *dio);
-static int next_dio_operation(int fd, char *buf, dio_opts *dio,
-                              iorange *ior);
-static int close_workfile(int fd, dio_opts *dio);
-static void print_iostats(int64_t total_usec, dio_opts *dio, char *tag);
+/*
+ * Do the work for this epoch with the mmap engine.
+ */
+static int diskwork_mmap(gamut_opts *gopts, dio_opts *dio,
+                         dio_files *df, char *buf, iorange *iomix,
+                         int64_t *target_diskio, double blocks_per_epoch,
+                         double *curr_blocks, uint32_t *sync_count,
+                         dio_cursor *cur);
+
+/*
+ * Do the work for this epoch with the meta engine.
+ */
+static int diskwork_meta(gamut_opts *gopts, dio_opts *dio,
+                         dio_files *df, int64_t *target_diskio,
+                         double blocks_per_epoch, double *curr_blocks,
+                         uint32_t *sync_count, dio_cursor *cur);
 
-static void create_random_block(char *buf, uint32_t blksize);
-static uint64_t time_create_random_block(char *buf, uint32_t blksize);
+/*
+ * Replay a block trace for this epoch with the io_uring engine.
+ */
+static int diskwork_trace(gamut_opts *gopts, dio_opts *dio,
+                          dio_files *df, dio_uring *ring,
+                          int64_t *target_diskio, uint64_t deadline,
+                          uint32_t *sync_count, uint32_t align,
+                          dio_cursor *cur);
+
+static int open_workfiles(dio_opts *dio, dio_files *df);
+static int map_workfiles(dio_opts *dio, dio_files *df);
+static void count_faults(dio_opts *dio, dio_cursor *cur, int record);
+static void close_workfiles(dio_opts *dio, dio_files *df, int remove);
+static void sync_workfiles(dio_opts *dio, dio_files *df, int final);
+static void drop_workfiles_cache(dio_files *df);
+static int init_workfile(dio_opts *dio, char *fname, uint64_t nblks);
+static int prep_workfile(dio_opts *dio, char *fname, uint64_t nblks);
+static uint32_t get_direct_align(int fd);
+static int next_dio_operation(dio_files *df, char *buf, dio_opts *dio,
+                              iorange *ior, dio_cursor *cur,
+                              uint32_t maxblks);
+static int close_workfile(int fd, dio_opts *dio, char *fname);
+static void print_iostats(int64_t total_usec, dio_opts *dio,
+                          dio_files *df, char *tag);
+static void print_metastats(int64_t total_usec, dio_opts *dio, char *tag);
+
+static int fill_random_pool(char *pool, size_t len, uint64_t seed);
+static void stamp_block(char *blk, uint32_t blksize, uint64_t stamp);
+static char* next_pool_block(dio_opts *dio, dio_cursor *cur);
 
 /*
  * Fire off an I/O worker to do a certain number of I/Os per second.
@@ -55,7 +220,7 @@ static uint64_t time_create_random_block(char *buf, uint32_t blksize);
 void* diskworker(void *opts)
 {
   char *buf;
-  int fd;
+  int i;
   int rc;
   int dio_index;
   int32_t target_epochs;
@@ -63,12 +228,17 @@ void* diskworker(void *opts)
   int64_t link_waittime;
   int64_t target_diskio;
   uint64_t next_deadline;
+  dio_cursor cursor;
+  dio_files files;
+  uint32_t align;
+  uint32_t unit;
   double blocks_per_epoch;
   double curr_blocks;
   double epochs_per_link;
   double curr_epochs;
   iorange iomix;
   dio_opts *dio;
+  dio_uring *ring;
   gamut_opts *gopts;
   struct timeval start;
   struct timeval finish;
@@ -102,18 +272,52 @@ void* diskworker(void *opts)
   dio->shopts.missed_usecs     = 0;
   dio->shopts.total_deadlines  = 0;
   memset(dio->num_diskio, 0, sizeof(dio->num_diskio));
+  memset(dio->io_calls,   0, sizeof(dio->io_calls));
   memset(dio->io_usec,    0, sizeof(dio->io_usec));
+  lat_hist_reset(&dio->io_lat[C_IOREAD]);
+  lat_hist_reset(&dio->io_lat[C_IOWRITE]);
+  memset(dio->dev, 0, sizeof(dio->dev));
+  memset(dio->faults, 0, sizeof(dio->faults));
+  dio->num_syncs = 0;
+  dio->sync_usec = 0;
+  memset(dio->num_meta,  0, sizeof(dio->num_meta));
+  memset(dio->meta_usec, 0, sizeof(dio->meta_usec));
+  for(i = 0;i < NUM_DIO_META_OPS;i++) {
+    lat_hist_reset(&dio->meta_lat[i]);
+  }
+  memset(dio->trace_bytes, 0, sizeof(dio->trace_bytes));
+  dio->trace_lag_usec = 0;
+  dio->trace_lag_max  = 0;
 
   buf           = NULL;
-  fd            = -1;
+  ring          = NULL;
+  memset(&cursor, 0, sizeof(cursor));
+  memset(&files, 0, sizeof(files));
   link_waittime = 0;
 
 restart:
   (void)gettimeofday(&dio->shopts.mod_time, NULL);
-  test_and_close(fd);
+  dio_uring_destroy(ring);
+  ring = NULL;
+  pattern_ring_free(&cursor.offs);
+  cursor.use_offs = 0;
+  if(cursor.pool)
+    free(cursor.pool);
+  cursor.pool = NULL;
+  close_workfiles(dio, &files, 0);
   dio->shopts.dirty = 0;
 
   sync_count       = 0;
+  cursor.currblk     = 0;
+  cursor.next_iotype = -1;
+  cursor.rstate      = ((uint64_t)RandInt(0x7fffffff) << 32)
+                       | (uint64_t)(dio_index + 1);
+  cursor.pool_next   = 0;
+  cursor.stamp       = cursor.rstate;
+  cursor.trace_next  = 0;
+  cursor.trace_done  = 0;
+  cursor.trace_start = 0;
+  memset(cursor.busy, 0, sizeof(cursor.busy));
   target_diskio    = 0;
   epochs_per_link  = 0.0;
   curr_epochs      = 0.0;
@@ -150,18 +354,67 @@ restart:
     next_deadline += tv.tv_sec * US_SEC;
   }
 
+  /* Initialize the work files */
+  rc = open_workfiles(dio, &files);
+  if(rc < 0) {
+    goto clean_out;
+  }
+
+  /*
+   * O_DIRECT wants the buffer, the size and the offset of every
+   *   I/O lined up on the device's logical blocks.  Offsets are
+   *   always whole blocks, so checking the blocksize is enough.
+   */
+  align = sizeof(void *);
+  if(dio->direct) {
+    for(i = 0;i < files.nfiles;i++) {
+      if(get_direct_align(files.fd[i]) > align)
+        align = get_direct_align(files.fd[i]);
+    }
+    if(dio->blksize % align) {
+      s_log(G_WARNING, "%s: Block size %u is not a multiple of the "
+                       "%u-byte alignment O_DIRECT needs.\n",
+                       dio->shopts.label, dio->blksize, align);
+      goto clean_out;
+    }
+    if((dio->engine == DIO_ENGINE_URING) && (align > DIO_URING_ALIGN)) {
+      s_log(G_WARNING, "%s: io_uring buffers cannot meet the %u-byte "
+                       "alignment O_DIRECT needs.\n",
+                       dio->shopts.label, align);
+      goto clean_out;
+    }
+    s_log(G_DEBUG, "%s using O_DIRECT with %u-byte alignment.\n",
+                   dio->shopts.label, align);
+  }
+
   /*
-   * We do a 'realloc' here instead of a malloc, since it
-   *   will work the first time through (when buf is NULL)
-   *   and during subsequent passes (when buf is not NULL).
+   * The block may have a different size or alignment than it did
+   *   the last time through, so start over with a fresh one.
    */
-  buf = (char *)realloc(buf, (size_t)dio->blksize);
-  if(!buf) {
+  if(buf)
+    free(buf);
+  buf = NULL;
+  if(posix_memalign((void **)&buf, (size_t)align, (size_t)dio->blksize)) {
+    buf = NULL;
     s_log(G_WARNING, "%s unable to allocate a %u-byte block.\n",
                      dio->shopts.label, dio->blksize);
     goto clean_out;
   }
 
+  /*
+   * Work out the offsets for the chosen distribution up front.
+   */
+  if(dio->offset.type != PAT_DEFAULT) {
+    rc = pattern_ring_init(&cursor.offs, &dio->offset, dio->nblks,
+                           dio->blksize, DIO_RING_ENTRIES, cursor.rstate);
+    if(rc < 0) {
+      s_log(G_WARNING, "%s could not build a %s offset pattern.\n",
+                       dio->shopts.label, get_pattern_label(dio->offset.type));
+      goto clean_out;
+    }
+    cursor.use_offs = 1;
+  }
+
   /*
    * Calculate the ranges for the different I/O types
    *   so we can perform the random mix as specified.
@@ -177,35 +430,108 @@ restart:
   /*
    * With the blocksize and the I/O rate we can figure out
    *   how many blocks we need to perform I/O on per epoch.
+   *   The meta engine's rate is in operations instead, and a
+   *   trace's is whatever it averages out to, in bytes.
    */
-  blocks_per_epoch  = (float)dio->iorate / dio->blksize;
+  unit = dio->blksize;
+  if((dio->engine == DIO_ENGINE_META) || files.trace)
+    unit = 1;
+  blocks_per_epoch  = (double)dio->iorate / unit;
   blocks_per_epoch /= WORKER_EPOCHS_PER_SEC;
+  if(files.trace) {
+    double span;
+
+    span = (double)files.trace->recs[files.trace->nrecs - 1].usec
+           * dio->tscale;
+    if(span < US_PER_WORKER_EPOCH)
+      span = US_PER_WORKER_EPOCH;
+    blocks_per_epoch = (double)files.trace->nbytes * US_PER_WORKER_EPOCH
+                       / span;
+  }
 
   s_log(G_DEBUG, "%s disk I/O rate of %.4f blocks/epoch.\n",
                  dio->shopts.label, blocks_per_epoch);
 
   /*
-   * How long does it take to fill a block with random stuff?
-   *
-   * NOTE: At some point we might think about randomly re-filling
-   *       the buffer at different times.
+   * Writes rotate through a pool of random blocks, and each one
+   *   gets a fresh stamp on its way out, so nothing below us can
+   *   compress or dedup what we write.  Reads land in 'buf' and
+   *   never touch the pool.
    */
   {
-    uint64_t tcrb;
+    size_t plen;
+    struct timeval pt_start;
+    struct timeval pt_finish;
+
+    plen = (size_t)dio->pool * dio->blksize;
+    if(posix_memalign((void **)&cursor.pool, (size_t)align, plen)) {
+      cursor.pool = NULL;
+      s_log(G_WARNING, "%s unable to allocate a %u-block data pool.\n",
+                       dio->shopts.label, dio->pool);
+      goto clean_out;
+    }
 
-    tcrb = time_create_random_block(buf, dio->blksize);
-    s_log(G_DEBUG, "Took %llu usec to fill random %u-byte block.\n",
-                   tcrb, dio->blksize);
+    (void)gettimeofday(&pt_start, NULL);
+    rc = fill_random_pool(cursor.pool, plen, cursor.rstate);
+    (void)gettimeofday(&pt_finish, NULL);
+    if(rc < 0) {
+      s_log(G_WARNING, "%s could not fill its data pool.\n",
+                       dio->shopts.label);
+      goto clean_out;
+    }
+    s_log(G_DEBUG, "Took %lld usec to fill a pool of %u random "
+                   "%u-byte blocks.\n",
+                   (long long)calculate_timediff(&pt_start, &pt_finish),
+                   dio->pool, dio->blksize);
   }
 
-  /* Initialize the work file */
-  fd = init_workfile(dio);
-  if(fd < 0) {
-    goto clean_out;
+  /*
+   * The async engine has a buffer for every I/O it can have in
+   *   flight, which writes fill from the pool as they go.
+   */
+  if(dio->engine == DIO_ENGINE_URING) {
+    ring = dio_uring_create(files.fd, files.nfiles,
+                            dio->qdepth * files.nfiles, dio->blksize);
+    if(!ring) {
+      s_log(G_WARNING, "%s could not set up its io_uring.\n",
+                       dio->shopts.label);
+      goto clean_out;
+    }
+    s_log(G_DEBUG, "%s using io_uring with queue depth %u on %u file(s).\n",
+                   dio->shopts.label, dio->qdepth, files.nfiles);
+  }
+  else if(dio->engine == DIO_ENGINE_MMAP) {
+    rc = map_workfiles(dio, &files);
+    if(rc < 0)
+      goto clean_out;
+    count_faults(dio, &cursor, 0);
+  }
+  else if((dio->engine == DIO_ENGINE_META) && (dio->prep == DIO_PREP_FILL)) {
+    struct timeval pt_start;
+    struct timeval pt_finish;
+
+    /*
+     * Start with half the names taken, so every operation in
+     *   the mix has something to work on.
+     */
+    (void)gettimeofday(&pt_start, NULL);
+    while(dio_meta_count(files.meta) < dio->nblks / 2) {
+      rc = dio_meta_op(files.meta, DIO_META_CREATE, &cursor.rstate,
+                       next_pool_block(dio, &cursor), dio->blksize);
+      if(rc < 0)
+        goto clean_out;
+    }
+    (void)gettimeofday(&pt_finish, NULL);
+    s_log(G_DEBUG, "Took %lld usec to fill %s with %llu files.\n",
+                   (long long)calculate_timediff(&pt_start, &pt_finish),
+                   dio->file,
+                   (unsigned long long)dio_meta_count(files.meta));
   }
 
   /*
-   * See how often we have to sync the buffers to disk.
+   * See how often we have to sync the buffers to disk.  With
+   *   sync=dsync or sync=none there are no sync points, and the
+   *   count is never used.
    */
   if(dio->sync_f)
   {
@@ -223,7 +549,7 @@ restart:
    */
   if(dio->shopts.max_work)
   {
-    target_diskio = dio->shopts.max_work / dio->blksize;
+    target_diskio = dio->shopts.max_work / unit;
     if(!target_diskio)
       target_diskio = 1;
   }
@@ -242,7 +568,7 @@ restart:
     shared_opts *link_shopts;
 
     epochs_per_link = (double)dio->shopts.link_work
-                      / (blocks_per_epoch * dio->blksize);
+                      / (blocks_per_epoch * unit);
     curr_epochs     = epochs_per_link;
     target_epochs   = (int32_t)curr_epochs;
 
@@ -275,8 +601,30 @@ restart:
       next_deadline += US_PER_WORKER_EPOCH;
 
       /* Step 2 */
-      rc = diskwork(gopts, dio, fd, buf, &iomix, &target_diskio,
-                    blocks_per_epoch, &curr_blocks, &sync_count);
+      if(files.trace) {
+        rc = diskwork_trace(gopts, dio, &files, ring, &target_diskio,
+                            next_deadline, &sync_count, align, &cursor);
+      }
+      else if(ring) {
+        rc = diskwork_uring(gopts, dio, &files, ring, &iomix, &target_diskio,
+                            blocks_per_epoch, &curr_blocks, &sync_count,
+                            &cursor);
+      }
+      else if(dio->engine == DIO_ENGINE_MMAP) {
+        rc = diskwork_mmap(gopts, dio, &files, buf, &iomix, &target_diskio,
+                           blocks_per_epoch, &curr_blocks, &sync_count,
+                           &cursor);
+      }
+      else if(dio->engine == DIO_ENGINE_META) {
+        rc = diskwork_meta(gopts, dio, &files, &target_diskio,
+                           blocks_per_epoch, &curr_blocks, &sync_count,
+                           &cursor);
+      }
+      else {
+        rc = diskwork(gopts, dio, &files, buf, &iomix, &target_diskio,
+                      blocks_per_epoch, &curr_blocks, &sync_count,
+                      &cursor);
+      }
       if(rc < 0) {
         s_log(G_WARNING, "Error doing diskwork.  Exiting.\n");
         dio->shopts.exiting = 1;
@@ -293,8 +641,30 @@ restart:
         next_deadline += US_PER_WORKER_EPOCH;
 
         /* Step 2 */
-        rc = diskwork(gopts, dio, fd, buf, &iomix, &target_diskio,
-                      blocks_per_epoch, &curr_blocks, &sync_count);
+        if(files.trace) {
+          rc = diskwork_trace(gopts, dio, &files, ring, &target_diskio,
+                              next_deadline, &sync_count, align, &cursor);
+        }
+        else if(ring) {
+          rc = diskwork_uring(gopts, dio, &files, ring, &iomix, &target_diskio,
+                              blocks_per_epoch, &curr_blocks, &sync_count,
+                              &cursor);
+        }
+        else if(dio->engine == DIO_ENGINE_MMAP) {
+          rc = diskwork_mmap(gopts, dio, &files, buf, &iomix,
+                             &target_diskio, blocks_per_epoch,
+                             &curr_blocks, &sync_count, &cursor);
+        }
+        else if(dio->engine == DIO_ENGINE_META) {
+          rc = diskwork_meta(gopts, dio, &files, &target_diskio,
+                             blocks_per_epoch, &curr_blocks, &sync_count,
+                             &cursor);
+        }
+        else {
+          rc = diskwork(gopts, dio, &files, buf, &iomix, &target_diskio,
+                        blocks_per_epoch, &curr_blocks, &sync_count,
+                        &cursor);
+        }
         if(rc < 0) {
           s_log(G_WARNING, "Error doing diskwork.  Exiting.\n");
           dio->shopts.exiting = 1;
@@ -337,12 +707,17 @@ restart:
           timediff = calculate_timediff(&b_link, &f_link);
           next_deadline += timediff;
           link_waittime += timediff;
+          if(cursor.trace_start)
+            cursor.trace_start += timediff;
           s_log(G_DEBUG, "Moved next deadline backward by %lld usec.\n",
                          timediff);
         }
       }
     }
 
+    /* Redraw a zipf or hotcold offset ring between epochs. */
+    pattern_ring_refill(&cursor.offs);
+
     /* Step 4 & 5 */
     (void)gettimeofday(&now, NULL);
 
@@ -397,12 +772,9 @@ restart:
   /*
    * If we did any sort of I/O, make sure we sync before exit.
    */
-  if(dio->num_diskio[C_IOREAD] || dio->num_diskio[C_IOWRITE]) {
+  if(dio->total_diskio) {
     s_log(G_DEBUG, "Starting to sync %s.\n", dio->file);
-    rc = fsync(fd);
-    if(rc < 0) {
-      s_log(G_WARNING, "Error sync'ing file %s.\n", dio->file);
-    }
+    sync_workfiles(dio, &files, 1);
     s_log(G_DEBUG, "Sync of %s done.\n", dio->file);
   }
 
@@ -424,14 +796,18 @@ clean_out:
    */
   if(buf)
     free(buf);
+  if(cursor.pool)
+    free(cursor.pool);
 
-  (void)close_workfile(fd, dio);
+  dio_uring_destroy(ring);
+  pattern_ring_free(&cursor.offs);
+  close_workfiles(dio, &files, 1);
 
   if(dio->file)
     free(dio->file);
   dio->file = NULL;
 
-  if(dio->num_diskio[C_IOREAD] || dio->num_diskio[C_IOWRITE])
+  if(dio->total_diskio)
   {
     int64_t total_usec;
     uint64_t avg_miss_time;
@@ -445,16 +821,18 @@ clean_out:
       avg_miss_time = 0;
     }
 
-    print_iostats(total_usec, dio, "total");
+    print_iostats(total_usec, dio, &files, "total");
 
     if(link_waittime) {
-      print_iostats(total_usec - link_waittime, dio, "work");
+      print_iostats(total_usec - link_waittime, dio, &files, "work");
     }
 
     s_log(G_INFO, "%s missed %llu of %llu deadlines by %llu usecs (avg).\n",
                   dio->shopts.label, dio->shopts.missed_deadlines,
                   dio->shopts.total_deadlines, avg_miss_time);
   }
+  if(files.list)
+    free(files.list);
 
   /*
    * Remove ourselves from any links.
@@ -471,23 +849,28 @@ clean_out:
 }
 
 /*
- * Do the work for this epoch.
+ * Do the work for this epoch.  The file position lives in 'cur'
+ *   rather than in the kernel, so every read or write is a single
+ *   pread() or pwrite() and a seek is free.
  */
 static int diskwork(gamut_opts *gopts, dio_opts *dio,
-                    int fd, char *buf, iorange *iomix,
+                    dio_files *df, char *buf, iorange *iomix,
                     int64_t *target_diskio, double blocks_per_epoch,
-                    double *curr_blocks, uint32_t *sync_count)
+                    double *curr_blocks, uint32_t *sync_count,
+                    dio_cursor *cur)
 {
   int      rc;
-  off_t    endoffile;
+  uint32_t maxblks;
   uint32_t num_seeks;
   uint32_t l_sync_count;
+  int      periodic;
   int64_t  l_target_diskio;
   uint64_t target_blocks;
   double   l_curr_blocks;
 
-  if(!gopts || !dio || (fd < 0) || !buf || !iomix || !target_diskio
+  if(!gopts || !dio || !df || !buf || !iomix || !target_diskio
      || (blocks_per_epoch < 0) || !curr_blocks || !sync_count
+     || !cur
     )
   {
     return -1;
@@ -497,16 +880,28 @@ static int diskwork(gamut_opts *gopts, dio_opts *dio,
    * Make local copies of the variables
    */
   l_sync_count    = *sync_count;
+  periodic        = (dio->sync_mode < DIO_SYNC_DSYNC);
   l_curr_blocks   = *curr_blocks;
   l_target_diskio = *target_diskio;
 
   num_seeks      = 0;
-  endoffile      = (off_t)(dio->blksize * dio->nblks);
   l_curr_blocks += blocks_per_epoch;
   target_blocks  = (uint64_t)l_curr_blocks;
 
   while(target_blocks && (num_seeks < MAX_DISK_SEEKS)) {
-    rc = next_dio_operation(fd, buf, dio, iomix);
+    /*
+     * Don't let a batch run past this epoch, the next sync point,
+     *   or the total amount of work we were asked to do.
+     */
+    maxblks = MAX_DIO_BATCH;
+    if(target_blocks < maxblks)
+      maxblks = (uint32_t)target_blocks;
+    if(periodic && (l_sync_count < maxblks))
+      maxblks = l_sync_count;
+    if((l_target_diskio > 0) && ((uint64_t)l_target_diskio < maxblks))
+      maxblks = (uint32_t)l_target_diskio;
+
+    rc = next_dio_operation(df, buf, dio, iomix, cur, maxblks);
     if(rc < 0) {
       s_log(G_WARNING, "%s: Error in I/O operation.\n",
                        dio->shopts.label);
@@ -514,36 +909,22 @@ static int diskwork(gamut_opts *gopts, dio_opts *dio,
     }
     else {
       if(rc > 0) { /* Actual I/O */
-        dio->total_diskio += dio->blksize;
-        target_blocks--;
-        l_sync_count--;
+        dio->total_diskio += (int64_t)rc * dio->blksize;
+        target_blocks     -= rc;
 
         /*
-         * See if we need to fsync() this time around.
+         * See if we need to sync this time around.
          */
-        if(!l_sync_count) {
-          (void)fsync(fd);
-          l_sync_count = dio->sync_f;
-        }
-
-        /*
-         * Make sure we're not at the end of the file,
-         *   as the next read will fail.
-         */
-        {
-          off_t currpos;
-          
-          currpos = lseek(fd, (off_t)0, SEEK_CUR);
-          if(currpos >= endoffile) {
-            s_log(G_DLOOP, "%s: Resetting fd position%s.\n",
-                           dio->shopts.label,
-                           ((currpos == endoffile) ? "" : " HARD"));
-            (void)lseek(fd, (off_t)0, SEEK_SET);
+        if(periodic) {
+          l_sync_count -= rc;
+          if(!l_sync_count) {
+            sync_workfiles(dio, df, 0);
+            l_sync_count = dio->sync_f;
           }
         }
 
         if(l_target_diskio > 0) {
-          l_target_diskio--;
+          l_target_diskio -= rc;
           if(!l_target_diskio) {
             dio->shopts.exiting = 1;
             break;
@@ -558,6 +939,12 @@ static int diskwork(gamut_opts *gopts, dio_opts *dio,
 
   l_curr_blocks -= (uint64_t)l_curr_blocks;
 
+  /*
+   * Don't let the next epoch be served out of the page cache.
+   */
+  if(dio->fadvise == DIO_FADV_DONTNEED)
+    drop_workfiles_cache(df);
+
   /*
    * Copy all local variables back.
    */
@@ -583,173 +970,1520 @@ static int diskwork(gamut_opts *gopts, dio_opts *dio,
   }
 }
 
-static int init_workfile(dio_opts *dio)
+/*
+ * Do the work for this epoch with the mmap engine.  A read copies
+ *   a block out of the mapping and a write copies one in, so the
+ *   cost is in the page faults and the writeback, not in system
+ *   calls.  Every 'sync_f' blocks the mappings are msync()ed.
+ */
+static int diskwork_mmap(gamut_opts *gopts, dio_opts *dio,
+                         dio_files *df, char *buf, iorange *iomix,
+                         int64_t *target_diskio, double blocks_per_epoch,
+                         double *curr_blocks, uint32_t *sync_count,
+                         dio_cursor *cur)
 {
-  int fd;
-  int flags;
-  mode_t mode;
+  char    *p;
+  char    *wbuf;
+  int      ioname;
+  int32_t  iotype;
+  uint32_t file;
+  uint32_t num_seeks;
+  uint32_t l_sync_count;
+  int      periodic;
+  int64_t  l_target_diskio;
+  int64_t  usec;
+  uint64_t blk;
+  uint64_t devblk;
+  uint64_t target_blocks;
+  double   l_curr_blocks;
+  struct timeval bt, ft;
 
-  if(!dio)
+  if(!gopts || !dio || !df || !buf || !iomix || !target_diskio
+     || (blocks_per_epoch < 0) || !curr_blocks || !sync_count
+     || !cur || !cur->pool
+    )
+  {
     return -1;
-
-  if(dio->iomix.numrds) {
-    if(dio->iomix.numwrs)
-      flags = O_RDWR;
-    else
-      flags = O_RDONLY;
-  }
-  else {
-    flags = O_WRONLY;
   }
 
-  /* What other flags should be in place? */
-  if(flags != O_RDONLY) {
-    flags |= O_CREAT;
-    flags |= O_TRUNC;
-  }
+  /*
+   * Make local copies of the variables
+   */
+  l_sync_count    = *sync_count;
+  periodic        = (dio->sync_mode < DIO_SYNC_DSYNC);
+  l_curr_blocks   = *curr_blocks;
+  l_target_diskio = *target_diskio;
 
-  /* Always open in mode 640 for security reasons */
-  mode = S_IRUSR | S_IWUSR | S_IRGRP;
+  num_seeks      = 0;
+  l_curr_blocks += blocks_per_epoch;
+  target_blocks  = (uint64_t)l_curr_blocks;
 
-  errno = 0;
-  fd = open(dio->file, flags, mode);
-  if(fd < 0) {
-    s_log(G_WARNING, "%s: Error opening file \"%s\" "
-                     "with flags %x and mode %x: %s.\n", dio->shopts.label,
-                     dio->file, flags, mode, strerror(errno));
-    return -1;
-  }
+  while(target_blocks && (num_seeks < MAX_DISK_SEEKS)) {
+    iotype = RandInt(iomix->maxval);
+    if((iotype >= iomix->seeks.min) && (iotype <= iomix->seeks.max)) {
+      cur->currblk = pattern_rand_range(&cur->rstate, dio->nblks);
+      dio->num_diskio[C_IOSEEK] += 1;
+      num_seeks++;
+      continue;
+    }
+    ioname = (iotype <= iomix->reads.max) ? C_IOREAD : C_IOWRITE;
 
-  /*
-   * If this is a new file we're creating, fill it with junk
-   *   so reads don't return nothing.
-   */
-  if(flags & O_CREAT)
-  {
-    off_t eof;
-    off_t currpos;
-    size_t rc;
+    if(cur->use_offs) {
+      blk = pattern_ring_next(&cur->offs) / dio->blksize;
+    }
+    else {
+      blk = cur->currblk;
+      cur->currblk++;
+      if(cur->currblk >= dio->nblks)
+        cur->currblk = 0;
+    }
+    file = dio_map(df, blk, &devblk);
+    p    = df->map[file] + (devblk * dio->blksize);
 
-    eof = dio->nblks * dio->blksize;
-    currpos = lseek(fd, eof, SEEK_SET);
-    if(currpos != eof) {
-      s_log(G_WARNING, "%s: Seek error initializing file "
-                       "contents (position %d of %d).\n",
-                       dio->shopts.label, (int)currpos, (int)eof);
-      goto fail_out;
+    if(ioname == C_IOREAD) {
+      (void)gettimeofday(&bt, NULL);
+      memcpy(buf, p, dio->blksize);
+      (void)gettimeofday(&ft, NULL);
+    }
+    else {
+      wbuf = next_pool_block(dio, cur);
+      (void)gettimeofday(&bt, NULL);
+      memcpy(p, wbuf, dio->blksize);
+      (void)gettimeofday(&ft, NULL);
     }
 
-    rc = write(fd, "x", 1);
-    if(rc != 1) {
-      s_log(G_WARNING, "%s: Write error initializing file "
-                       "contents (byte %d of %d).\n",
-                       dio->shopts.label, rc, 1);
-      goto fail_out;
+    usec = calculate_timediff(&bt, &ft);
+    dio->num_diskio[ioname] += 1;
+    dio->io_calls[ioname]   += 1;
+    dio->io_usec[ioname]    += usec;
+    lat_hist_record(&dio->io_lat[ioname], usec);
+    dio->dev[file].num_diskio[ioname] += 1;
+    dio->dev[file].io_calls[ioname]   += 1;
+    dio->dev[file].io_usec[ioname]    += usec;
+    dio->total_diskio       += dio->blksize;
+    target_blocks--;
+
+    if(periodic) {
+      l_sync_count--;
+      if(!l_sync_count) {
+        sync_workfiles(dio, df, 0);
+        l_sync_count = dio->sync_f;
+      }
     }
 
-    /* Reset the file descriptor to the start of the file */
-    (void)lseek(fd, (off_t)0, SEEK_SET);
+    if(l_target_diskio > 0) {
+      l_target_diskio--;
+      if(!l_target_diskio) {
+        dio->shopts.exiting = 1;
+        break;
+      }
+    }
   }
 
-  return fd;
+  l_curr_blocks -= (uint64_t)l_curr_blocks;
 
-fail_out:
-  (void)close(fd);
-  (void)unlink(dio->file);
+  /*
+   * Don't let the next epoch be served out of the page cache.
+   */
+  if(dio->fadvise == DIO_FADV_DONTNEED)
+    drop_workfiles_cache(df);
 
-  return -1;
+  count_faults(dio, cur, 1);
+
+  /*
+   * Copy all local variables back.
+   */
+  *sync_count    = l_sync_count;
+  *curr_blocks   = l_curr_blocks;
+  *target_diskio = l_target_diskio;
+
+  if(dio->shopts.exiting) {
+    return 0;
+  }
+  else {
+    return 1;
+  }
 }
 
-static int next_dio_operation(int fd, char *buf, dio_opts *dio,
-                              iorange *ior)
+/*
+ * Do the work for this epoch with the meta engine.  Each "block"
+ *   is one create, stat, rename or unlink, drawn from the mix.
+ *   A create writes one block from the pool into its new file.
+ *   Every 'sync_f' operations the file system is committed.
+ */
+static int diskwork_meta(gamut_opts *gopts, dio_opts *dio,
+                         dio_files *df, int64_t *target_diskio,
+                         double blocks_per_epoch, double *curr_blocks,
+                         uint32_t *sync_count, dio_cursor *cur)
 {
-  int frc;
-  int operr;
-  int ioname;
-  int32_t iotype;
-  uint32_t blksize;
-  uint32_t numblks;
-  size_t numbytes;
+  int      i;
+  int      op;
+  int32_t  draw;
+  uint32_t total;
+  uint32_t l_sync_count;
+  int      periodic;
+  int64_t  l_target_diskio;
+  int64_t  usec;
+  uint64_t target_blocks;
+  double   l_curr_blocks;
   struct timeval bt, ft;
 
-  if((fd < 0) || !buf || !ior || !dio)
+  if(!gopts || !dio || !df || !df->meta || !target_diskio
+     || (blocks_per_epoch < 0) || !curr_blocks || !sync_count
+     || !cur || !cur->pool
+    )
   {
     return -1;
   }
 
-  frc      = -1;
-  blksize  = dio->blksize;
-  numblks  = dio->nblks;
-  errno    = 0;
-  ioname   = -1;
-  iotype   = RandInt(ior->maxval);
-  numbytes = 0;
-  if((iotype >= ior->seeks.min) && (iotype <= ior->seeks.max)) {
-    uint32_t newblk;
-    off_t pos;
-    off_t newpos;
+  /*
+   * Make local copies of the variables
+   */
+  l_sync_count    = *sync_count;
+  periodic        = (dio->sync_mode < DIO_SYNC_DSYNC);
+  l_curr_blocks   = *curr_blocks;
+  l_target_diskio = *target_diskio;
 
-    ioname = C_IOSEEK;
-    newblk = RandInt(numblks - 1);
-    pos    = newblk * blksize;
+  l_curr_blocks += blocks_per_epoch;
+  target_blocks  = (uint64_t)l_curr_blocks;
 
-    (void)gettimeofday(&bt, NULL);
-    newpos = lseek(fd, pos, SEEK_SET);
-    operr  = errno;
-    (void)gettimeofday(&ft, NULL);
-    if(newpos != pos) {
-      s_log(G_WARNING, "%s: Error seeking to %u (%u): %s.\n",
-                       dio->shopts.label, (uint32_t)pos,
-                       (uint32_t)newpos, strerror(operr));
-      goto fail_out;
-    }
+  total = 0;
+  for(i = 0;i < NUM_DIO_META_OPS;i++) {
+    total += dio->metamix[i];
   }
-  else if((iotype >= ior->reads.min) && (iotype <= ior->reads.max)) {
-    ioname = C_IOREAD;
 
-    (void)gettimeofday(&bt, NULL);
-    numbytes = read(fd, buf, (size_t)blksize);
-    operr    = errno;
-    (void)gettimeofday(&ft, NULL);
-  }
-  else if((iotype >= ior->writes.min) && (iotype <= ior->writes.max)) {
-    ioname = C_IOWRITE;
+  op = 0;
+  while(target_blocks) {
+    draw = RandInt((int)total - 1);
+    for(op = 0;op < NUM_DIO_META_OPS - 1;op++) {
+      if(draw < dio->metamix[op])
+        break;
+      draw -= dio->metamix[op];
+    }
 
     (void)gettimeofday(&bt, NULL);
-    numbytes = write(fd, buf, (size_t)blksize);
-    operr    = errno;
+    op = dio_meta_op(df->meta, op, &cur->rstate,
+                     next_pool_block(dio, cur), dio->blksize);
     (void)gettimeofday(&ft, NULL);
-  }
-  else {
-    s_log(G_WARNING, "%s: Unknown I/O type created: %d.\n",
-                     dio->shopts.label, iotype);
-    goto fail_out;
-  }
+    if(op < 0)
+      break;
 
-  if((ioname != C_IOSEEK) && (numbytes != blksize)) {
-    s_log(G_WARNING, "%s: Only %s %d of %u bytes: %s.\n",
-                     dio->shopts.label, (ioname ? "wrote" : "read"),
-                     numbytes, blksize, strerror(operr));
-    goto fail_out;
+    usec = calculate_timediff(&bt, &ft);
+    dio->num_meta[op]  += 1;
+    dio->meta_usec[op] += usec;
+    lat_hist_record(&dio->meta_lat[op], usec);
+    dio->total_diskio  += 1;
+    target_blocks--;
+
+    if(periodic) {
+      l_sync_count--;
+      if(!l_sync_count) {
+        sync_workfiles(dio, df, 0);
+        l_sync_count = dio->sync_f;
+      }
+    }
+
+    if(l_target_diskio > 0) {
+      l_target_diskio--;
+      if(!l_target_diskio) {
+        dio->shopts.exiting = 1;
+        break;
+      }
+    }
+  }
+
+  l_curr_blocks -= (uint64_t)l_curr_blocks;
+
+  /*
+   * Copy all local variables back.
+   */
+  *sync_count    = l_sync_count;
+  *curr_blocks   = l_curr_blocks;
+  *target_diskio = l_target_diskio;
+
+  if(op < 0) {
+    s_log(G_WARNING, "%s: Error in metadata operation.\n",
+                     dio->shopts.label);
+    return -1;
+  }
+  else if(dio->shopts.exiting) {
+    return 0;
+  }
+  else {
+    return 1;
+  }
+}
+
+/*
+ * Do the work for this epoch with the io_uring engine.  Up to
+ *   'qdepth' I/Os are kept in flight on each file, but we never
+ *   queue more than are left in this epoch, so the rate is the rate
+ *   of completed I/O.  The file position lives in 'cur' rather than
+ *   in the kernel; a seek just moves it.
+ */
+static int diskwork_uring(gamut_opts *gopts, dio_opts *dio,
+                          dio_files *df, dio_uring *ring, iorange *iomix,
+                          int64_t *target_diskio, double blocks_per_epoch,
+                          double *curr_blocks, uint32_t *sync_count,
+                          dio_cursor *cur)
+{
+  int      i;
+  int      n;
+  int      rc;
+  uint32_t depth;
+  uint32_t busy[MAX_DIO_FILES];
+  uint32_t num_seeks;
+  uint32_t l_sync_count;
+  int      periodic;
+  int64_t  l_target_diskio;
+  uint64_t l_currblk;
+  uint64_t target_blocks;
+  uint64_t done_blocks;
+  double   l_curr_blocks;
+  dio_uring_done done[DIO_URING_REAP];
+
+  if(!gopts || !dio || !df || !ring || !iomix || !target_diskio
+     || (blocks_per_epoch < 0) || !curr_blocks || !sync_count || !cur
+    )
+  {
+    return -1;
+  }
+
+  /*
+   * Make local copies of the variables
+   */
+  l_sync_count    = *sync_count;
+  periodic        = (dio->sync_mode < DIO_SYNC_DSYNC);
+  l_curr_blocks   = *curr_blocks;
+  l_target_diskio = *target_diskio;
+  l_currblk       = cur->currblk;
+
+  num_seeks      = 0;
+  done_blocks    = 0;
+  l_curr_blocks += blocks_per_epoch;
+  target_blocks  = (uint64_t)l_curr_blocks;
+  depth          = dio->qdepth * df->nfiles;
+  memset(busy, 0, sizeof(busy));
+
+  /*
+   * Don't go past the total amount of work we were asked to do.
+   */
+  if((l_target_diskio > 0) && (target_blocks > (uint64_t)l_target_diskio))
+    target_blocks = (uint64_t)l_target_diskio;
+
+  rc = 0;
+  while((done_blocks < target_blocks)
+        && ((num_seeks < MAX_DISK_SEEKS) || dio_uring_busy(ring)))
+  {
+    /*
+     * Fill the queue with as much as is left in this epoch.
+     */
+    while((num_seeks < MAX_DISK_SEEKS)
+          && (dio_uring_busy(ring) < depth)
+          && ((done_blocks + dio_uring_busy(ring)) < target_blocks))
+    {
+      int ioname;
+      int32_t iotype;
+      uint32_t file;
+      uint64_t devblk;
+
+      if(cur->next_iotype >= 0) {
+        iotype           = cur->next_iotype;
+        cur->next_iotype = -1;
+      }
+      else {
+        iotype = RandInt(iomix->maxval);
+      }
+      if((iotype >= iomix->seeks.min) && (iotype <= iomix->seeks.max)) {
+        l_currblk = pattern_rand_range(&cur->rstate, dio->nblks);
+        dio->num_diskio[C_IOSEEK]++;
+        num_seeks++;
+        continue;
+      }
+
+      ioname = (iotype <= iomix->reads.max) ? C_IOREAD : C_IOWRITE;
+      file   = dio_map(df, (cur->use_offs
+                            ? pattern_ring_peek(&cur->offs) / dio->blksize
+                            : l_currblk), &devblk);
+
+      /*
+       * If this file's queue is full, hold on to the operation
+       *   until something on it finishes.
+       */
+      if(busy[file] >= dio->qdepth) {
+        cur->next_iotype = iotype;
+        break;
+      }
+
+      rc = dio_uring_queue(ring, file, ioname,
+                           devblk * (uint64_t)dio->blksize, dio->blksize);
+      if(rc < 0)
+        break;
+      busy[file]++;
+
+      /*
+       * Slots get reused right away, so rotate the pool through
+       *   them; the copy is cheap next to the write it feeds.
+       */
+      if(ioname == C_IOWRITE) {
+        memcpy(dio_uring_buf(ring, (uint32_t)rc),
+               next_pool_block(dio, cur), dio->blksize);
+        dio_dirty(df, file, devblk * (uint64_t)dio->blksize, dio->blksize);
+      }
+      rc = 0;
+      if(cur->use_offs) {
+        (void)pattern_ring_next(&cur->offs);
+        continue;
+      }
+
+      l_currblk++;
+      if(l_currblk >= dio->nblks)
+        l_currblk = 0;
+    }
+
+    if(!dio_uring_busy(ring))
+      break;
+
+    rc = dio_uring_submit(ring, 1);
+    if(rc < 0)
+      break;
+
+    n = dio_uring_reap(ring, done, DIO_URING_REAP);
+    for(i = 0;i < n;i++) {
+      busy[done[i].file]--;
+      if(done[i].res != (int32_t)dio->blksize) {
+        s_log(G_WARNING, "%s: Only %s %d of %u bytes: %s.\n",
+                         dio->shopts.label,
+                         (done[i].ioname ? "wrote" : "read"),
+                         ((done[i].res < 0) ? 0 : done[i].res),
+                         dio->blksize,
+                         ((done[i].res < 0) ? strerror(-done[i].res)
+                                            : "short I/O"));
+        rc = -1;
+        continue;
+      }
+
+      dio->num_diskio[done[i].ioname] += 1;
+      dio->io_calls[done[i].ioname]   += 1;
+      dio->io_usec[done[i].ioname]    += done[i].usec;
+      lat_hist_record(&dio->io_lat[done[i].ioname], done[i].usec);
+      dio->total_diskio               += dio->blksize;
+      done_blocks++;
+
+      dio->dev[done[i].file].num_diskio[done[i].ioname] += 1;
+      dio->dev[done[i].file].io_calls[done[i].ioname]   += 1;
+      dio->dev[done[i].file].io_usec[done[i].ioname]    += done[i].usec;
+
+      if(periodic) {
+        l_sync_count--;
+        if(!l_sync_count) {
+          sync_workfiles(dio, df, 0);
+          l_sync_count = dio->sync_f;
+        }
+      }
+    }
+    if(rc < 0)
+      break;
+  }
+
+  if(l_target_diskio > 0) {
+    l_target_diskio -= done_blocks;
+    if(l_target_diskio <= 0) {
+      l_target_diskio = 0;
+      dio->shopts.exiting = 1;
+    }
+  }
+
+  l_curr_blocks -= (uint64_t)l_curr_blocks;
+
+  /*
+   * Don't let the next epoch be served out of the page cache.
+   */
+  if(dio->fadvise == DIO_FADV_DONTNEED)
+    drop_workfiles_cache(df);
+
+  /*
+   * Copy all local variables back.
+   */
+  *sync_count    = l_sync_count;
+  *curr_blocks   = l_curr_blocks;
+  *target_diskio = l_target_diskio;
+  cur->currblk   = l_currblk;
+
+  if(rc < 0) {
+    s_log(G_WARNING, "%s: Error in I/O operation.\n", dio->shopts.label);
+    return -1;
+  }
+  else if(dio->shopts.exiting) {
+    return 0;
+  }
+  else {
+    return 1;
+  }
+}
+
+/*
+ * Replay the trace for this epoch with the io_uring engine.  Each
+ *   record goes out when its (scaled) time comes, to the file for
+ *   its ASU, as long as that file's queue has room; one bigger than
+ *   a block goes out a block at a time.  In between we wait on the
+ *   ring rather than sleep, so completions are timed as closely as
+ *   with the mix.  Offsets past the end of a file wrap around.
+ */
+static int diskwork_trace(gamut_opts *gopts, dio_opts *dio,
+                          dio_files *df, dio_uring *ring,
+                          int64_t *target_diskio, uint64_t deadline,
+                          uint32_t *sync_count, uint32_t align,
+                          dio_cursor *cur)
+{
+  int      i;
+  int      n;
+  int      rc;
+  int      periodic;
+  uint32_t file;
+  uint32_t len;
+  uint32_t l_sync_count;
+  int64_t  l_target_diskio;
+  uint64_t now;
+  uint64_t due;
+  uint64_t end;
+  uint64_t off;
+  uint64_t fsize;
+  dio_trace *dt;
+  dio_trace_rec *rec;
+  dio_uring_done done[DIO_URING_REAP];
+
+  if(!gopts || !dio || !df || !df->trace || !ring || !target_diskio
+     || !sync_count || !cur)
+  {
+    return -1;
+  }
+
+  /*
+   * Make local copies of the variables
+   */
+  dt              = df->trace;
+  l_sync_count    = *sync_count;
+  periodic        = (dio->sync_mode < DIO_SYNC_DSYNC);
+  l_target_diskio = *target_diskio;
+  fsize           = df->dev_nblks * (uint64_t)dio->blksize;
+  if(!dio->direct)
+    align = 1;
+
+  /*
+   * Stop short enough of the deadline that the main loop comes
+   *   straight back instead of sleeping; we do our own waiting.
+   */
+  end = deadline - MIN_SLEEP_US;
+  now = dio_now_usec();
+  if(!cur->trace_start)
+    cur->trace_start = now;
+
+  rc = 0;
+  for(;;) {
+    /*
+     * Queue everything that's due, in order.
+     */
+    while((cur->trace_next < dt->nrecs) && l_target_diskio) {
+      rec = &dt->recs[cur->trace_next];
+      due = cur->trace_start + (uint64_t)(rec->usec * dio->tscale);
+      if(due > now)
+        break;
+
+      file = rec->asu % df->nfiles;
+      if(cur->busy[file] >= dio->qdepth)
+        break;
+
+      len = rec->len - cur->trace_done;
+      if(len > dio->blksize)
+        len = dio->blksize;
+      off  = (rec->offset + cur->trace_done) % fsize;
+      off -= off % align;
+      len  = ((len + align - 1) / align) * align;
+      if(off + len > fsize)
+        off = fsize - len;
+
+      n = dio_uring_queue(ring, file, rec->ioname, off, len);
+      if(n < 0)
+        break;
+      cur->busy[file]++;
+
+      if(rec->ioname == C_IOWRITE) {
+        memcpy(dio_uring_buf(ring, (uint32_t)n),
+               next_pool_block(dio, cur), len);
+        dio_dirty(df, file, off, len);
+      }
+
+      /* How far behind the trace are we? */
+      dio->trace_lag_usec += (int64_t)(now - due);
+      if((int64_t)(now - due) > dio->trace_lag_max)
+        dio->trace_lag_max = (int64_t)(now - due);
+
+      if(l_target_diskio > 0) {
+        l_target_diskio -= len;
+        if(l_target_diskio < 0)
+          l_target_diskio = 0;
+      }
+
+      cur->trace_done += len;
+      if(cur->trace_done >= rec->len) {
+        cur->trace_next++;
+        cur->trace_done = 0;
+      }
+    }
+
+    /*
+     * We're done when the trace (or the work) has run out and
+     *   the last of it has come back.
+     */
+    if(!dio_uring_busy(ring)
+       && ((cur->trace_next >= dt->nrecs) || !l_target_diskio))
+    {
+      dio->shopts.exiting = 1;
+      break;
+    }
+    if(now >= end) {
+      rc = dio_uring_submit(ring, 0);
+      break;
+    }
+
+    /*
+     * Wait for the next record to come due or for something to
+     *   finish.  If it's due already, its queue is full, and only
+     *   a completion will help.
+     */
+    due = end;
+    if((cur->trace_next < dt->nrecs) && l_target_diskio) {
+      rec = &dt->recs[cur->trace_next];
+      if(cur->trace_start + (uint64_t)(rec->usec * dio->tscale) < due)
+        due = cur->trace_start + (uint64_t)(rec->usec * dio->tscale);
+    }
+    if(due <= now)
+      rc = dio_uring_submit(ring, 1);
+    else
+      rc = dio_uring_wait(ring, due - now);
+    if(rc < 0)
+      break;
+
+    n = dio_uring_reap(ring, done, DIO_URING_REAP);
+    for(i = 0;i < n;i++) {
+      cur->busy[done[i].file]--;
+      if(done[i].res != (int32_t)done[i].len) {
+        s_log(G_WARNING, "%s: Only %s %d of %u bytes: %s.\n",
+                         dio->shopts.label,
+                         (done[i].ioname ? "wrote" : "read"),
+                         ((done[i].res < 0) ? 0 : done[i].res),
+                         done[i].len,
+                         ((done[i].res < 0) ? strerror(-done[i].res)
+                                            : "short I/O"));
+        rc = -1;
+        continue;
+      }
+
+      dio->num_diskio[done[i].ioname]  += 1;
+      dio->io_calls[done[i].ioname]    += 1;
+      dio->io_usec[done[i].ioname]     += done[i].usec;
+      lat_hist_record(&dio->io_lat[done[i].ioname], done[i].usec);
+      dio->trace_bytes[done[i].ioname] += done[i].len;
+      dio->total_diskio                += done[i].len;
+
+      dio->dev[done[i].file].num_diskio[done[i].ioname] += 1;
+      dio->dev[done[i].file].io_calls[done[i].ioname]   += 1;
+      dio->dev[done[i].file].io_usec[done[i].ioname]    += done[i].usec;
+
+      if(periodic) {
+        l_sync_count--;
+        if(!l_sync_count) {
+          sync_workfiles(dio, df, 0);
+          l_sync_count = dio->sync_f;
+        }
+      }
+    }
+    if(rc < 0)
+      break;
+
+    now = dio_now_usec();
+  }
+
+  /*
+   * Don't let the next epoch be served out of the page cache.
+   */
+  if(dio->fadvise == DIO_FADV_DONTNEED)
+    drop_workfiles_cache(df);
+
+  /*
+   * Copy all local variables back.
+   */
+  *sync_count    = l_sync_count;
+  *target_diskio = l_target_diskio;
+
+  if(rc < 0) {
+    s_log(G_WARNING, "%s: Error in I/O operation.\n", dio->shopts.label);
+    return -1;
+  }
+  else if(dio->shopts.exiting) {
+    return 0;
+  }
+  else {
+    return 1;
+  }
+}
+
+/*
+ * Open every file in the worker's list, each sized for its share
+ *   of the blocks.  Returns 0 on success, -1 on error.
+ */
+static int open_workfiles(dio_opts *dio, dio_files *df)
+{
+  int i;
+  uint64_t units;
+
+  if(!dio || !df || !dio->file)
+    return -1;
+
+  if(df->list)
+    free(df->list);
+  memset(df, 0, sizeof(*df));
+  for(i = 0;i < MAX_DIO_FILES;i++) {
+    df->fd[i] = -1;
+  }
+
+  if(dio->engine == DIO_ENGINE_META) {
+    df->meta = dio_meta_create(dio->file, dio->meta_width, dio->meta_depth,
+                               dio->nblks, (dio->create != C_RDONLY));
+    return df->meta ? 0 : -1;
+  }
+
+  df->list = strdup(dio->file);
+  if(!df->list)
+    return -1;
+  i = split_dio_files(df->list, df->name);
+  if(i < 1)
+    return -1;
+  df->nfiles = (uint16_t)i;
+
+  /*
+   * ASU 'n' of a trace is file n % nfiles.  Read it before we
+   *   touch any files, since it may not be one we can replay.
+   */
+  if(dio->trace[0]) {
+    df->trace = dio_trace_load(dio->trace);
+    if(!df->trace)
+      return -1;
+    if(df->trace->nwrites && (dio->create == C_RDONLY)) {
+      s_log(G_WARNING, "%s: Trace \"%s\" has %llu writes, but mode 0 "
+                       "only reads.\n", dio->shopts.label, dio->trace,
+                       (unsigned long long)df->trace->nwrites);
+      return -1;
+    }
+    if(df->trace->nasu > df->nfiles) {
+      s_log(G_INFO, "%s: Trace has %u ASUs for %u file(s); some "
+                    "will share.\n", dio->shopts.label,
+                    df->trace->nasu, df->nfiles);
+    }
+  }
+
+  /*
+   * Every file gets the same number of stripe units, enough
+   *   for the one that gets the most.
+   */
+  df->sblks = dio->stripe / dio->blksize;
+  if(!df->sblks)
+    df->sblks = 1;
+  if(df->nfiles == 1) {
+    df->dev_nblks = dio->nblks;
+  }
+  else {
+    units         = (dio->nblks + df->sblks - 1) / df->sblks;
+    df->dev_nblks = ((units + df->nfiles - 1) / df->nfiles) * df->sblks;
+  }
+
+  for(i = 0;i < df->nfiles;i++) {
+    df->fd[i] = init_workfile(dio, df->name[i], df->dev_nblks);
+    if(df->fd[i] < 0)
+      return -1;
+  }
+
+  if(df->nfiles > 1) {
+    s_log(G_DEBUG, "%s striping %llu-block units over %u files, "
+                   "%llu blocks each.\n", dio->shopts.label,
+                   (unsigned long long)df->sblks, df->nfiles,
+                   (unsigned long long)df->dev_nblks);
+  }
+
+  return 0;
+}
+
+/*
+ * Close all the worker's files.  With 'remove', also delete the
+ *   ones we created.
+ */
+static void close_workfiles(dio_opts *dio, dio_files *df, int remove)
+{
+  int i;
+
+  if(!dio || !df)
+    return;
+
+  if(df->meta) {
+    dio_meta_destroy(df->meta, remove && (dio->create == C_IFNEXIST));
+    df->meta = NULL;
+  }
+  dio_trace_free(df->trace);
+  df->trace = NULL;
+
+  for(i = 0;i < df->nfiles;i++) {
+    if(df->map[i])
+      (void)munmap(df->map[i], df->map_len);
+    df->map[i] = NULL;
+    if(remove)
+      (void)close_workfile(df->fd[i], dio, df->name[i]);
+    else
+      test_and_close(df->fd[i]);
+    df->fd[i] = -1;
+  }
+}
+
+/*
+ * Make what's been written durable, the way sync= asks.  The
+ *   'final' sync before exit waits for everything, even with
+ *   sync=range or the mmap engine's msync=async.  The time spent
+ *   here is kept apart from the time spent on the data I/O.
+ */
+static void sync_workfiles(dio_opts *dio, dio_files *df, int final)
+{
+  int i;
+  int rc;
+  uint64_t *w;
+  struct timeval bt, ft;
+
+  if(!dio || !df)
+    return;
+
+  if((dio->sync_mode == DIO_SYNC_DSYNC) || (dio->sync_mode == DIO_SYNC_NONE))
+    return;
+
+  (void)gettimeofday(&bt, NULL);
+  if(df->meta && (dio_meta_sync(df->meta) < 0)) {
+    s_log(G_WARNING, "Error sync'ing the file system under %s: %s.\n",
+                     dio->file, strerror(errno));
+  }
+  for(i = 0;i < df->nfiles;i++) {
+    rc = 0;
+    if(df->map[i] && !final) {
+      rc = msync(df->map[i], df->map_len,
+                 (dio->msync == DIO_MSYNC_ASYNC) ? MS_ASYNC : MS_SYNC);
+    }
+    else if(dio->sync_mode == DIO_SYNC_FDATASYNC) {
+      rc = fdatasync(df->fd[i]);
+    }
+    else if(dio->sync_mode == DIO_SYNC_RANGE) {
+      /*
+       * Wait for the last window to reach the disk, and start
+       *   writeback on this one, so writes never stall on more
+       *   than one window's worth.  At the end, flush it all.
+       */
+      if(final) {
+        rc = sync_file_range(df->fd[i], (off_t)0, (off_t)0,
+                             SYNC_FILE_RANGE_WAIT_BEFORE
+                             | SYNC_FILE_RANGE_WRITE
+                             | SYNC_FILE_RANGE_WAIT_AFTER);
+      }
+      else {
+        w = df->flush[i];
+        if(w[1] > w[0])
+          rc = sync_file_range(df->fd[i], (off_t)w[0], (off_t)(w[1] - w[0]),
+                               SYNC_FILE_RANGE_WAIT_BEFORE
+                               | SYNC_FILE_RANGE_WRITE
+                               | SYNC_FILE_RANGE_WAIT_AFTER);
+        w = df->dirty[i];
+        if((rc >= 0) && (w[1] > w[0]))
+          rc = sync_file_range(df->fd[i], (off_t)w[0], (off_t)(w[1] - w[0]),
+                               SYNC_FILE_RANGE_WRITE);
+      }
+      df->flush[i][0] = df->dirty[i][0];
+      df->flush[i][1] = df->dirty[i][1];
+      df->dirty[i][0] = 0;
+      df->dirty[i][1] = 0;
+    }
+    else {
+      rc = fsync(df->fd[i]);
+    }
+
+    if(rc < 0) {
+      s_log(G_WARNING, "Error sync'ing file %s: %s.\n", df->name[i],
+                       strerror(errno));
+    }
+  }
+  (void)gettimeofday(&ft, NULL);
+
+  dio->num_syncs++;
+  dio->sync_usec += calculate_timediff(&bt, &ft);
+}
+
+static void drop_workfiles_cache(dio_files *df)
+{
+  int i;
+
+  for(i = 0;i < df->nfiles;i++) {
+    /* Mapped pages have to be unmapped before they can be dropped */
+    if(df->map[i])
+      (void)madvise(df->map[i], df->map_len, MADV_DONTNEED);
+    (void)posix_fadvise(df->fd[i], (off_t)0, (off_t)0, POSIX_FADV_DONTNEED);
+  }
+}
+
+/*
+ * Map every work file for the mmap engine, and tell the kernel
+ *   what sort of access to expect.  Returns 0 on success, -1 on error.
+ */
+static int map_workfiles(dio_opts *dio, dio_files *df)
+{
+  int i;
+  int prot;
+  int advice;
+
+  if(!dio || !df)
+    return -1;
+
+  prot = PROT_READ;
+  if(dio->iomix.numwrs)
+    prot |= PROT_WRITE;
+
+  switch(dio->offset.type) {
+    case PAT_DEFAULT:
+      advice = dio->iomix.numsks ? MADV_NORMAL : MADV_SEQUENTIAL;
+      break;
+    case PAT_SEQ:
+      advice = MADV_SEQUENTIAL;
+      break;
+    case PAT_UNIFORM:
+    case PAT_ZIPF:
+    case PAT_HOTCOLD:
+      advice = MADV_RANDOM;
+      break;
+    default:
+      advice = MADV_NORMAL;
+      break;
+  }
+
+  df->map_len = (size_t)(df->dev_nblks * dio->blksize);
+  for(i = 0;i < df->nfiles;i++) {
+    df->map[i] = (char *)mmap(NULL, df->map_len, prot, MAP_SHARED,
+                              df->fd[i], (off_t)0);
+    if(df->map[i] == (char *)MAP_FAILED) {
+      df->map[i] = NULL;
+      s_log(G_WARNING, "%s: Error mapping %llu bytes of \"%s\": %s.\n",
+                       dio->shopts.label, (unsigned long long)df->map_len,
+                       df->name[i], strerror(errno));
+      return -1;
+    }
+    (void)madvise(df->map[i], df->map_len, advice);
+  }
+
+  s_log(G_DEBUG, "%s mapped %u file(s) of %llu bytes.\n",
+                 dio->shopts.label, df->nfiles,
+                 (unsigned long long)df->map_len);
+
+  return 0;
+}
+
+/*
+ * Add the page faults this thread has taken since last time to
+ *   the worker's totals; without 'record', just start counting.
+ */
+static void count_faults(dio_opts *dio, dio_cursor *cur, int record)
+{
+  struct rusage ru;
+
+  if(getrusage(RUSAGE_THREAD, &ru) < 0)
+    return;
+
+  if(record) {
+    dio->faults[0] += (int64_t)((uint64_t)ru.ru_minflt - cur->flt_seen[0]);
+    dio->faults[1] += (int64_t)((uint64_t)ru.ru_majflt - cur->flt_seen[1]);
+  }
+  cur->flt_seen[0] = (uint64_t)ru.ru_minflt;
+  cur->flt_seen[1] = (uint64_t)ru.ru_majflt;
+}
+
+/*
+ * Open (and create, if we should) one work file of 'nblks' blocks.
+ *   A device is used as it is.  Returns the descriptor, or -1.
+ */
+static int init_workfile(dio_opts *dio, char *fname, uint64_t nblks)
+{
+  int fd;
+  int flags;
+  int is_dev;
+  mode_t mode;
+  struct stat sbuf;
+
+  if(!dio || !fname)
+    return -1;
+
+  is_dev = (!stat(fname, &sbuf) && S_ISBLK(sbuf.st_mode));
+
+  if(dio->iomix.numrds) {
+    if(dio->iomix.numwrs)
+      flags = O_RDWR;
+    else
+      flags = O_RDONLY;
+  }
+  else {
+    flags = O_WRONLY;
+  }
+
+  /* A trace can do either, unless mode 0 holds it to reads */
+  if(dio->trace[0])
+    flags = (dio->create == C_RDONLY) ? O_RDONLY : O_RDWR;
+
+  /* A writable shared mapping needs a descriptor we can read too */
+  if((dio->engine == DIO_ENGINE_MMAP) && (flags == O_WRONLY))
+    flags = O_RDWR;
+
+  /*
+   * What other flags should be in place?  A prepared file is
+   *   already there and the right size.
+   */
+  if(is_dev) {
+    if(dio->prep != DIO_PREP_SPARSE) {
+      s_log(G_WARNING, "%s: Device \"%s\" can't be prepared; "
+                       "use prep=sparse.\n", dio->shopts.label, fname);
+      return -1;
+    }
+  }
+  else if(dio->prep != DIO_PREP_SPARSE) {
+    if(prep_workfile(dio, fname, nblks) < 0)
+      return -1;
+  }
+  else if(flags != O_RDONLY) {
+    flags |= O_CREAT;
+    flags |= O_TRUNC;
+  }
+  if(dio->direct) {
+    flags |= O_DIRECT;
+  }
+  if(dio->sync_mode == DIO_SYNC_DSYNC) {
+    flags |= O_DSYNC;
+  }
+
+  /* Always open in mode 640 for security reasons */
+  mode = S_IRUSR | S_IWUSR | S_IRGRP;
+
+  errno = 0;
+  fd = open(fname, flags, mode);
+  if(fd < 0) {
+    s_log(G_WARNING, "%s: Error opening file \"%s\" "
+                     "with flags %x and mode %x: %s.\n", dio->shopts.label,
+                     fname, flags, mode, strerror(errno));
+    if(dio->direct && (errno == EINVAL)) {
+      s_log(G_WARNING, "%s: The file system may not support O_DIRECT.\n",
+                       dio->shopts.label);
+    }
+    return -1;
+  }
+
+  /*
+   * If this is a new file we're creating, fill it with junk
+   *   so reads don't return nothing.
+   */
+  if(flags & O_CREAT)
+  {
+    off_t eof;
+    off_t currpos;
+    size_t rc;
+
+    eof = (off_t)nblks * dio->blksize;
+
+    /*
+     * A one-byte write isn't allowed with O_DIRECT, so just
+     *   set the size instead.
+     */
+    if(dio->direct) {
+      if(ftruncate(fd, eof) < 0) {
+        s_log(G_WARNING, "%s: Error sizing file to %lld bytes: %s.\n",
+                         dio->shopts.label, (long long)eof, strerror(errno));
+        goto fail_out;
+      }
+      return fd;
+    }
+
+    currpos = lseek(fd, eof, SEEK_SET);
+    if(currpos != eof) {
+      s_log(G_WARNING, "%s: Seek error initializing file "
+                       "contents (position %lld of %lld).\n",
+                       dio->shopts.label, (long long)currpos,
+                       (long long)eof);
+      goto fail_out;
+    }
+
+    rc = write(fd, "x", 1);
+    if(rc != 1) {
+      s_log(G_WARNING, "%s: Write error initializing file "
+                       "contents (byte %d of %d).\n",
+                       dio->shopts.label, rc, 1);
+      goto fail_out;
+    }
+  }
+
+  return fd;
+
+fail_out:
+  (void)close(fd);
+  (void)unlink(fname);
+
+  return -1;
+}
+
+/*
+ * Find the alignment O_DIRECT needs for this file: the logical
+ *   block size of the device underneath it.  If we can't find
+ *   that (or don't know how to ask), fall back to the file
+ *   system's block size.
+ */
+static uint32_t get_direct_align(int fd)
+{
+  uint32_t align;
+  struct stat sbuf;
+#ifdef __linux__
+  int ssz;
+  FILE *fp;
+  char path[BUFSIZE];
+#endif
+
+  if((fd < 0) || (fstat(fd, &sbuf) < 0))
+    return MIN_DIO_ALIGN;
+
+  align = 0;
+#ifdef __linux__
+  if(S_ISBLK(sbuf.st_mode)) {
+    if(!ioctl(fd, BLKSSZGET, &ssz) && (ssz > 0))
+      align = (uint32_t)ssz;
+  }
+  else {
+    /* Whole disks have a queue/ dir.; partitions find it one level up */
+    snprintf(path, BUFSIZE, "/sys/dev/block/%u:%u/queue/logical_block_size",
+             major(sbuf.st_dev), minor(sbuf.st_dev));
+    fp = fopen(path, "r");
+    if(!fp) {
+      snprintf(path, BUFSIZE,
+               "/sys/dev/block/%u:%u/../queue/logical_block_size",
+               major(sbuf.st_dev), minor(sbuf.st_dev));
+      fp = fopen(path, "r");
+    }
+    if(fp) {
+      if((fscanf(fp, "%d", &ssz) == 1) && (ssz > 0))
+        align = (uint32_t)ssz;
+      (void)fclose(fp);
+    }
+  }
+#endif
+
+  if(!align)
+    align = (uint32_t)sbuf.st_blksize;
+  if(align < MIN_DIO_ALIGN)
+    align = MIN_DIO_ALIGN;
+
+  return align;
+}
+
+/*
+ * A piece of the work file for one filling thread.
+ */
+typedef struct {
+  int      fd;
+  off_t    start;
+  off_t    end;
+  uint64_t seed;
+  int      err;
+} prep_range;
+
+/*
+ * Write random data over one piece of the work file, a large
+ *   chunk at a time.
+ */
+static void* prep_fill_range(void *arg)
+{
+  char *chunk;
+  off_t pos;
+  size_t len;
+  ssize_t rc;
+  uint32_t i;
+  uint64_t v;
+  prep_range *pr;
+
+  pr = (prep_range *)arg;
+
+  chunk = (char *)malloc(DIO_PREP_CHUNK);
+  if(!chunk) {
+    pr->err = ENOMEM;
+    return NULL;
+  }
+
+  for(pos = pr->start;pos < pr->end;pos += len) {
+    len = DIO_PREP_CHUNK;
+    if(pos + (off_t)len > pr->end)
+      len = (size_t)(pr->end - pos);
+
+    /* Fresh contents each time, so nothing can dedup or compress it */
+    for(i = 0;i < len / sizeof(v);i++) {
+      v = pattern_rand(&pr->seed);
+      memcpy(&chunk[i * sizeof(v)], &v, sizeof(v));
+    }
+
+    rc = pwrite(pr->fd, chunk, len, pos);
+    if(rc != (ssize_t)len) {
+      pr->err = (rc < 0) ? errno : EIO;
+      break;
+    }
+  }
+
+  free(chunk);
+  return NULL;
+}
+
+/*
+ * Get a work file ready for a run with prep=alloc or prep=fill.
+ *   The file is marked when it's done, so a later run that wants
+ *   a file of the same size can use it again as-is.
+ *   Returns 0 on success, -1 on error.
+ */
+static int prep_workfile(dio_opts *dio, char *fname, uint64_t nblks)
+{
+  int i;
+  int fd;
+  int rc;
+  int started;
+  int created;
+  int nthreads;
+  char *label;
+  char mark[SMBUFSIZE];
+  off_t eof;
+  off_t per;
+  mode_t mode;
+  struct stat sbuf;
+  struct timeval bt, ft;
+  pthread_t tids[MAX_PREP_THREADS];
+  prep_range ranges[MAX_PREP_THREADS];
+
+  if(!dio || !fname || (dio->prep == DIO_PREP_SPARSE))
+    return -1;
+
+  label = ((dio->prep == DIO_PREP_FILL) ? "fill" : "alloc");
+  eof   = (off_t)nblks * dio->blksize;
+  mode  = S_IRUSR | S_IWUSR | S_IRGRP;
+
+  /*
+   * Note whether the file is ours, so a failure only ever removes
+   *   what we created, never a file (or device) that was there.
+   */
+  created = 1;
+  fd = open(fname, O_RDWR | O_CREAT | O_EXCL, mode);
+  if((fd < 0) && (errno == EEXIST)) {
+    created = 0;
+    fd = open(fname, O_RDWR);
+  }
+  if(fd < 0) {
+    s_log(G_WARNING, "%s: Error opening file \"%s\" to prepare it: %s.\n",
+                     dio->shopts.label, fname, strerror(errno));
+    return -1;
+  }
+
+  /*
+   * A filled file will do for an allocated one, but not the other
+   *   way around.
+   */
+  memset(mark, 0, sizeof(mark));
+  if(!fstat(fd, &sbuf) && (sbuf.st_size == eof)
+     && (fgetxattr(fd, DIO_PREP_XATTR, mark, sizeof(mark) - 1) > 0)
+     && (!strcmp(mark, label) || !strcmp(mark, "fill"))
+    )
+  {
+    s_log(G_INFO, "%s reusing %s file \"%s\".\n",
+                  dio->shopts.label, mark, fname);
+    (void)close(fd);
+    return 0;
+  }
+
+  (void)gettimeofday(&bt, NULL);
+
+  (void)fremovexattr(fd, DIO_PREP_XATTR);
+  if(ftruncate(fd, (off_t)0) < 0) {
+    s_log(G_WARNING, "%s: Error truncating \"%s\": %s.\n",
+                     dio->shopts.label, fname, strerror(errno));
+    goto fail_out;
+  }
+
+  /*
+   * Filling the file allocates it anyway, so a file system that
+   *   can't fallocate() only matters when that's all we're doing.
+   */
+  rc = fallocate(fd, 0, (off_t)0, eof);
+  if(rc < 0) {
+    if(dio->prep == DIO_PREP_ALLOC) {
+      s_log(G_WARNING, "%s: Error allocating %lld bytes for \"%s\": %s.\n",
+                       dio->shopts.label, (long long)eof, fname,
+                       strerror(errno));
+      goto fail_out;
+    }
+    if(ftruncate(fd, eof) < 0) {
+      s_log(G_WARNING, "%s: Error sizing \"%s\": %s.\n",
+                       dio->shopts.label, fname, strerror(errno));
+      goto fail_out;
+    }
+  }
+
+  if(dio->prep == DIO_PREP_FILL) {
+    /*
+     * Split the file into one piece per thread, each a whole
+     *   number of chunks except the last.
+     */
+    nthreads = dio->prep_threads;
+    per = ((eof / nthreads) + DIO_PREP_CHUNK - 1)
+          / DIO_PREP_CHUNK * DIO_PREP_CHUNK;
+    for(i = 0;i < nthreads;i++) {
+      ranges[i].fd    = fd;
+      ranges[i].start = (off_t)i * per;
+      ranges[i].end   = ranges[i].start + per;
+      if(ranges[i].start > eof)
+        ranges[i].start = eof;
+      if(ranges[i].end > eof)
+        ranges[i].end = eof;
+      ranges[i].seed  = ((uint64_t)RandInt(0x7fffffff) << 32)
+                        | (uint64_t)(i + 1);
+      ranges[i].err   = 0;
+    }
+
+    for(i = 0;i < nthreads;i++) {
+      if(pthread_create(&tids[i], NULL, prep_fill_range, &ranges[i]))
+        break;
+    }
+    started = i;
+
+    /* Anything we couldn't hand off, we do ourselves */
+    for(;i < nthreads;i++) {
+      (void)prep_fill_range(&ranges[i]);
+    }
+    for(i = 0;i < started;i++) {
+      (void)pthread_join(tids[i], NULL);
+    }
+
+    for(i = 0;i < nthreads;i++) {
+      if(ranges[i].err) {
+        s_log(G_WARNING, "%s: Error filling \"%s\": %s.\n",
+                         dio->shopts.label, fname,
+                         strerror(ranges[i].err));
+        goto fail_out;
+      }
+    }
+  }
+
+  /*
+   * Get it all onto the device, and don't leave it in the page
+   *   cache for the reads that follow.
+   */
+  (void)fsync(fd);
+  (void)posix_fadvise(fd, (off_t)0, (off_t)0, POSIX_FADV_DONTNEED);
+  (void)fsetxattr(fd, DIO_PREP_XATTR, label, strlen(label), 0);
+  (void)close(fd);
+
+  (void)gettimeofday(&ft, NULL);
+  s_log(G_INFO, "%s prepared \"%s\" (%s, %lld bytes) in %.4f sec.\n",
+                dio->shopts.label, fname, label, (long long)eof,
+                (double)calculate_timediff(&bt, &ft) / US_SEC);
+
+  return 0;
+
+fail_out:
+  (void)close(fd);
+  if(created)
+    (void)unlink(fname);
+
+  return -1;
+}
+
+/*
+ * Perform the next operation in the mix at the cursor.  A run
+ *   of reads or writes drawn back to back is done with one call,
+ *   up to 'maxblks' blocks, as long as the blocks are contiguous
+ *   in the file and in one stripe unit.  The draw that ends the
+ *   run is kept in the cursor for next time, so the mix isn't
+ *   skewed.  Returns the number of blocks moved, 0 for a seek,
+ *   -1 on error.
+ */
+static int next_dio_operation(dio_files *df, char *buf, dio_opts *dio,
+                              iorange *ior, dio_cursor *cur,
+                              uint32_t maxblks)
+{
+  int i;
+  int fd;
+  int frc;
+  int operr;
+  int ioname;
+  int32_t iotype;
+  char *wbuf;
+  uint64_t blksize;
+  uint64_t numblks;
+  uint32_t runblks;
+  uint32_t limit;
+  uint32_t file;
+  uint64_t blk;
+  uint64_t devblk;
+  off_t pos;
+  ssize_t numbytes;
+  int64_t usec;
+  struct timeval bt, ft;
+  struct iovec iov[MAX_DIO_BATCH];
+
+  if(!df || !buf || !ior || !dio || !cur || !cur->pool || !maxblks)
+  {
+    return -1;
+  }
+
+  frc      = -1;
+  wbuf     = buf;
+  blksize  = dio->blksize;
+  numblks  = dio->nblks;
+  errno    = 0;
+  numbytes = 0;
+
+  if(cur->next_iotype >= 0) {
+    iotype           = cur->next_iotype;
+    cur->next_iotype = -1;
+  }
+  else {
+    iotype = RandInt(ior->maxval);
+  }
+
+  if((iotype >= ior->seeks.min) && (iotype <= ior->seeks.max)) {
+    cur->currblk = pattern_rand_range(&cur->rstate, numblks);
+    dio->num_diskio[C_IOSEEK] += 1;
+    return 0;
+  }
+  else if((iotype >= ior->reads.min) && (iotype <= ior->reads.max)) {
+    ioname = C_IOREAD;
+  }
+  else if((iotype >= ior->writes.min) && (iotype <= ior->writes.max)) {
+    ioname = C_IOWRITE;
+  }
+  else {
+    s_log(G_WARNING, "%s: Unknown I/O type created: %d.\n",
+                     dio->shopts.label, iotype);
+    goto fail_out;
+  }
+
+  /*
+   * Gather up any more of the same operation.  An offset pattern
+   *   has to line up too.
+   */
+  limit = maxblks;
+  if(limit > MAX_DIO_BATCH)
+    limit = MAX_DIO_BATCH;
+  /* Every block of one pwritev() needs its own pool block */
+  if((ioname == C_IOWRITE) && (limit > dio->pool))
+    limit = dio->pool;
+
+  if(cur->use_offs) {
+    pos = (off_t)pattern_ring_next(&cur->offs);
+    blk = (uint64_t)pos / blksize;
+  }
+  else {
+    blk = cur->currblk;
+    pos = (off_t)(blk * blksize);
+    if(limit > numblks - blk)
+      limit = (uint32_t)(numblks - blk);
+  }
+  if((df->nfiles > 1) && (limit > df->sblks - (blk % df->sblks)))
+    limit = (uint32_t)(df->sblks - (blk % df->sblks));
+
+  runblks = 1;
+  while(runblks < limit) {
+    if(cur->use_offs
+       && (pattern_ring_peek(&cur->offs) != pos + runblks * blksize))
+      break;
+
+    iotype = RandInt(ior->maxval);
+    if((ioname == C_IOREAD)
+       ? ((iotype < ior->reads.min) || (iotype > ior->reads.max))
+       : ((iotype < ior->writes.min) || (iotype > ior->writes.max)))
+    {
+      cur->next_iotype = iotype;
+      break;
+    }
+    if(cur->use_offs)
+      (void)pattern_ring_next(&cur->offs);
+    runblks++;
   }
 
-  dio->num_diskio[ioname] += 1;
-  dio->io_usec[ioname]    += calculate_timediff(&bt, &ft);
+  /* Only now do we care which file it's in */
+  file = dio_map(df, blk, &devblk);
+  fd   = df->fd[file];
+  pos  = (off_t)(devblk * blksize);
 
-  if(ioname == C_IOSEEK) {
-    frc = 0;
+  if(runblks == 1) {
+    if(ioname == C_IOWRITE)
+      wbuf = next_pool_block(dio, cur);
+
+    (void)gettimeofday(&bt, NULL);
+    if(ioname == C_IOREAD)
+      numbytes = pread(fd, buf, (size_t)blksize, pos);
+    else
+      numbytes = pwrite(fd, wbuf, (size_t)blksize, pos);
+    operr = errno;
+    (void)gettimeofday(&ft, NULL);
   }
   else {
-    frc = 1;
+    for(i = 0;i < (int)runblks;i++) {
+      iov[i].iov_base = (ioname == C_IOREAD) ? buf
+                                             : next_pool_block(dio, cur);
+      iov[i].iov_len  = blksize;
+    }
+
+    (void)gettimeofday(&bt, NULL);
+    if(ioname == C_IOREAD)
+      numbytes = preadv(fd, iov, (int)runblks, pos);
+    else
+      numbytes = pwritev(fd, iov, (int)runblks, pos);
+    operr = errno;
+    (void)gettimeofday(&ft, NULL);
+  }
+
+  if(numbytes != (ssize_t)runblks * blksize) {
+    s_log(G_WARNING, "%s: Only %s %lld of %llu bytes: %s.\n",
+                     dio->shopts.label, (ioname ? "wrote" : "read"),
+                     (long long)numbytes,
+                     (unsigned long long)(runblks * blksize),
+                     strerror(operr));
+    goto fail_out;
+  }
+
+  usec = calculate_timediff(&bt, &ft);
+  dio->num_diskio[ioname] += runblks;
+  dio->io_calls[ioname]   += 1;
+  dio->io_usec[ioname]    += usec;
+  lat_hist_record(&dio->io_lat[ioname], usec);
+  dio->dev[file].num_diskio[ioname] += runblks;
+  dio->dev[file].io_calls[ioname]   += 1;
+  dio->dev[file].io_usec[ioname]    += usec;
+  if(ioname == C_IOWRITE)
+    dio_dirty(df, file, (uint64_t)pos, runblks * blksize);
+
+  if(!cur->use_offs) {
+    cur->currblk += runblks;
+    if(cur->currblk >= numblks)
+      cur->currblk = 0;
   }
 
+  frc = (int)runblks;
+
 fail_out:
   return frc;
 }
 
-static int close_workfile(int fd, dio_opts *dio)
+static int close_workfile(int fd, dio_opts *dio, char *fname)
 {
-  if((fd < 0) || !dio)
+  if((fd < 0) || !dio || !fname)
     return -1;
 
   (void)close(fd);
@@ -759,17 +2493,21 @@ static int close_workfile(int fd, dio_opts *dio)
    *   If we wrote to the file and created it because it didn't exist,
    *   then it shouldn't exist when we exit.
    */
-  if((dio->create == C_IFNEXIST) && dio->iomix.numwrs) {
-    (void)unlink(dio->file);
+  if((dio->create == C_IFNEXIST) && (dio->iomix.numwrs || dio->trace[0])) {
+    (void)unlink(fname);
   }
 
   return 0;
 }
 
-static void print_iostats(int64_t total_usec, dio_opts *dio, char *tag)
+static void print_iostats(int64_t total_usec, dio_opts *dio,
+                          dio_files *df, char *tag)
 {
+  int i;
+  char lat[BUFSIZE];
   char iorate[SMBUFSIZE];
   int64_t total_io;
+  int64_t io_size;
   double iotime;
 
   if(!dio || !tag)
@@ -782,6 +2520,11 @@ static void print_iostats(int64_t total_usec, dio_opts *dio, char *tag)
     tag = "total";
   }
 
+  if(dio->engine == DIO_ENGINE_META) {
+    print_metastats(total_usec, dio, tag);
+    return;
+  }
+
   /*
    * Print a number of statistics about the I/O rates
    * 1. Overall I/O and I/O rates
@@ -789,10 +2532,24 @@ static void print_iostats(int64_t total_usec, dio_opts *dio, char *tag)
    * 3. Read I/O and I/O rates
    * 4. Write I/O and I/O rates
    * 5. Seek time and seek rates
+   * 6. Read and write latencies, per call
+   * 7. I/O and average latency per call on each file, if we striped
+   * 8. Page faults, for the mmap engine
+   * 9. Time spent making writes durable, apart from the I/O
+   * 10. How far behind a trace we fell
+   *
+   * A trace's I/Os come in all sizes, so count its bytes as they are.
    */
 
   total_io  = dio->num_diskio[C_IOREAD] + dio->num_diskio[C_IOWRITE];
+  io_size   = dio->blksize;
+  if(dio->trace[0] && total_io) {
+    io_size = (dio->trace_bytes[C_IOREAD] + dio->trace_bytes[C_IOWRITE])
+              / total_io;
+  }
   total_io *= dio->blksize;
+  if(dio->trace[0])
+    total_io = dio->trace_bytes[C_IOREAD] + dio->trace_bytes[C_IOWRITE];
   iotime    = (double)total_usec / US_SEC;
 
   /* Number 1 */
@@ -822,6 +2579,8 @@ static void print_iostats(int64_t total_usec, dio_opts *dio, char *tag)
     int64_t read_io;
 
     read_io  = dio->num_diskio[C_IOREAD] * dio->blksize;
+    if(dio->trace[0])
+      read_io = dio->trace_bytes[C_IOREAD];
     readtime = (double)dio->io_usec[C_IOREAD] / US_SEC;
     print_scaled_number(iorate, SMBUFSIZE,
                         (uint64_t)(read_io / readtime), 1);
@@ -837,6 +2596,8 @@ static void print_iostats(int64_t total_usec, dio_opts *dio, char *tag)
     int64_t write_io;
 
     write_io  = dio->num_diskio[C_IOWRITE] * dio->blksize;
+    if(dio->trace[0])
+      write_io = dio->trace_bytes[C_IOWRITE];
     writetime = (double)dio->io_usec[C_IOWRITE] / US_SEC;
     print_scaled_number(iorate, SMBUFSIZE,
                         (uint64_t)(write_io / writetime), 1);
@@ -859,49 +2620,250 @@ static void print_iostats(int64_t total_usec, dio_opts *dio, char *tag)
                     "at %s seeks/sec (%s).\n", dio->shopts.label,
                     seek_io, seektime, iorate, tag);
   }
+
+  /*
+   * Number 6
+   *
+   * The sync engine reads or writes a run of blocks with one call,
+   *   so latency is per call, not per block.
+   */
+  if(dio->io_lat[C_IOREAD].count) {
+    lat_hist_print(&dio->io_lat[C_IOREAD], lat, BUFSIZE);
+    s_log(G_NOTICE, "%s read latency %s (%s).\n",
+                    dio->shopts.label, lat, tag);
+    s_log(G_NOTICE, "%s made %llu read calls of %.2f blocks, "
+                    "%.1f usec avg (%s).\n", dio->shopts.label,
+                    (unsigned long long)dio->io_calls[C_IOREAD],
+                    (double)dio->num_diskio[C_IOREAD]
+                    / dio->io_calls[C_IOREAD],
+                    (double)dio->io_usec[C_IOREAD]
+                    / dio->io_calls[C_IOREAD], tag);
+  }
+  if(dio->io_lat[C_IOWRITE].count) {
+    lat_hist_print(&dio->io_lat[C_IOWRITE], lat, BUFSIZE);
+    s_log(G_NOTICE, "%s write latency %s (%s).\n",
+                    dio->shopts.label, lat, tag);
+    s_log(G_NOTICE, "%s made %llu write calls of %.2f blocks, "
+                    "%.1f usec avg (%s).\n", dio->shopts.label,
+                    (unsigned long long)dio->io_calls[C_IOWRITE],
+                    (double)dio->num_diskio[C_IOWRITE]
+                    / dio->io_calls[C_IOWRITE],
+                    (double)dio->io_usec[C_IOWRITE]
+                    / dio->io_calls[C_IOWRITE], tag);
+  }
+
+  /* Number 7 */
+  for(i = 0;df && (df->nfiles > 1) && (i < df->nfiles);i++) {
+    int64_t dev_ops;
+    int64_t dev_calls;
+    int64_t dev_usec;
+
+    dev_ops   = dio->dev[i].num_diskio[C_IOREAD]
+                + dio->dev[i].num_diskio[C_IOWRITE];
+    dev_calls = dio->dev[i].io_calls[C_IOREAD]
+                + dio->dev[i].io_calls[C_IOWRITE];
+    dev_usec = dio->dev[i].io_usec[C_IOREAD] + dio->dev[i].io_usec[C_IOWRITE];
+    print_scaled_number(iorate, SMBUFSIZE,
+                        (uint64_t)(dev_ops * io_size / iotime), 1);
+    s_log(G_NOTICE, "%s file %s did %llu reads and %llu writes "
+                    "at %sps, %.1f usec avg (%s).\n", dio->shopts.label,
+                    df->name[i],
+                    (unsigned long long)dio->dev[i].num_diskio[C_IOREAD],
+                    (unsigned long long)dio->dev[i].num_diskio[C_IOWRITE],
+                    iorate,
+                    (dev_calls ? (double)dev_usec / dev_calls : 0.0), tag);
+  }
+
+  /* Number 8 */
+  if(dio->engine == DIO_ENGINE_MMAP) {
+    s_log(G_NOTICE, "%s took %llu minor and %llu major page faults, "
+                    "%.1f/sec (%s).\n", dio->shopts.label,
+                    (unsigned long long)dio->faults[0],
+                    (unsigned long long)dio->faults[1],
+                    (double)(dio->faults[0] + dio->faults[1]) / iotime, tag);
+  }
+
+  /* Number 9 */
+  if(dio->num_syncs) {
+    char *how;
+
+    how = get_sync_label(dio->sync_mode);
+    if(dio->engine == DIO_ENGINE_MMAP)
+      how = "msync";
+    s_log(G_NOTICE, "%s did %llu syncs (%s) in %.4f sec, "
+                    "%.1f usec avg (%s).\n", dio->shopts.label,
+                    (unsigned long long)dio->num_syncs, how,
+                    (double)dio->sync_usec / US_SEC,
+                    (double)dio->sync_usec / dio->num_syncs, tag);
+  }
+
+  /* Number 10 */
+  if(dio->trace[0] && (dio->num_diskio[C_IOREAD]
+                       + dio->num_diskio[C_IOWRITE]))
+  {
+    s_log(G_NOTICE, "%s issued trace I/O %.1f usec late on average, "
+                    "%lld usec at worst (%s).\n", dio->shopts.label,
+                    (double)dio->trace_lag_usec
+                    / (dio->num_diskio[C_IOREAD]
+                       + dio->num_diskio[C_IOWRITE]),
+                    (long long)dio->trace_lag_max, tag);
+  }
 }
 
-static void create_random_block(char *buf, uint32_t blksize)
+/*
+ * The meta engine's version of print_iostats: the rate of all the
+ *   operations together, then the count, rate and latency of each.
+ */
+static void print_metastats(int64_t total_usec, dio_opts *dio, char *tag)
 {
-  uint32_t i;
-  uint32_t v;
-  uint32_t num_rand;
+  int i;
+  char lat[BUFSIZE];
+  char oprate[SMBUFSIZE];
+  int64_t total_ops;
+  double optime;
+  static char *op_names[NUM_DIO_META_OPS] = {
+    "creates", "stats", "renames", "unlinks"
+  };
+
+  total_ops = 0;
+  for(i = 0;i < NUM_DIO_META_OPS;i++) {
+    total_ops += dio->num_meta[i];
+  }
+  optime = (double)total_usec / US_SEC;
+
+  print_scaled_number(oprate, SMBUFSIZE, (uint64_t)(total_ops / optime), 0);
+  s_log(G_NOTICE, "%s did %llu metadata ops in %.4f sec "
+                  "at %s ops/sec (%s).\n", dio->shopts.label,
+                  (unsigned long long)total_ops, optime, oprate, tag);
+
+  for(i = 0;i < NUM_DIO_META_OPS;i++) {
+    if(!dio->num_meta[i])
+      continue;
+
+    lat_hist_print(&dio->meta_lat[i], lat, BUFSIZE);
+    s_log(G_NOTICE, "%s did %llu %s in %.4f sec, latency %s (%s).\n",
+                    dio->shopts.label, (unsigned long long)dio->num_meta[i],
+                    op_names[i],
+                    (double)dio->meta_usec[i] / US_SEC, lat, tag);
+  }
 
-  if(!buf || !blksize)
-    return;
+  if(dio->num_syncs) {
+    s_log(G_NOTICE, "%s did %llu syncs (syncfs) in %.4f sec, "
+                    "%.1f usec avg (%s).\n", dio->shopts.label,
+                    (unsigned long long)dio->num_syncs,
+                    (double)dio->sync_usec / US_SEC,
+                    (double)dio->sync_usec / dio->num_syncs, tag);
+  }
+}
+
+/*
+ * A piece of the data pool for one filling thread.
+ */
+typedef struct {
+  char    *start;
+  size_t   len;
+  uint64_t seed;
+} pool_range;
+
+static void* pool_fill_range(void *arg)
+{
+  size_t i;
+  uint64_t v;
+  pool_range *pr;
 
-  num_rand = blksize / sizeof(uint32_t);
-  for(i = 0;i < num_rand;i++) {
-    v = randomMT();
-    memcpy((uint32_t *)&buf[i * sizeof(uint32_t)], &v, sizeof(uint32_t));
+  pr = (pool_range *)arg;
+
+  for(i = 0;i + sizeof(v) <= pr->len;i += sizeof(v)) {
+    v = pattern_rand(&pr->seed);
+    memcpy(&pr->start[i], &v, sizeof(v));
+  }
+  if(i < pr->len) {
+    v = pattern_rand(&pr->seed);
+    memcpy(&pr->start[i], &v, pr->len - i);
   }
+
+  return NULL;
 }
 
 /*
- * Return the amount of time, in microseconds, that this took.
+ * Fill the data pool with random bytes.  A big pool is split up
+ *   among a few threads so a large block size doesn't hold up
+ *   the start of the run.  Returns 0 on success, -1 on error.
  */
-static uint64_t time_create_random_block(char *buf, uint32_t blksize)
+static int fill_random_pool(char *pool, size_t len, uint64_t seed)
 {
-  uint64_t us_time;
-  struct timeval start;
-  struct timeval finish;
+  int i;
+  int started;
+  int nthreads;
+  size_t piece;
+  pthread_t tids[DEF_PREP_THREADS];
+  pool_range ranges[DEF_PREP_THREADS];
+
+  if(!pool || !len)
+    return -1;
+
+  nthreads = (int)(len / DIO_PREP_CHUNK);
+  if(nthreads < 1)
+    nthreads = 1;
+  else if(nthreads > DEF_PREP_THREADS)
+    nthreads = DEF_PREP_THREADS;
+
+  /* Whole words per thread; the last one picks up the rest */
+  piece = (len / nthreads) & ~(sizeof(uint64_t) - 1);
+  for(i = 0;i < nthreads;i++) {
+    ranges[i].start = pool + (i * piece);
+    ranges[i].len   = (i == nthreads - 1) ? (len - (i * piece)) : piece;
+    ranges[i].seed  = seed ^ ((uint64_t)(i + 1) << 56);
+  }
 
-  gettimeofday(&start, NULL);
-  create_random_block(buf, blksize);
-  gettimeofday(&finish, NULL);
+  for(i = 1;i < nthreads;i++) {
+    if(pthread_create(&tids[i], NULL, pool_fill_range, &ranges[i]))
+      break;
+  }
+  started = i;
 
-  {
-    uint64_t istart;
-    uint64_t ifinish;
+  /* We always do the first piece, and anything we couldn't hand off */
+  (void)pool_fill_range(&ranges[0]);
+  for(i = started;i < nthreads;i++) {
+    (void)pool_fill_range(&ranges[i]);
+  }
+  for(i = 1;i < started;i++) {
+    (void)pthread_join(tids[i], NULL);
+  }
+
+  return 0;
+}
 
-    istart   = start.tv_usec;
-    istart  += start.tv_sec * US_SEC;
+/*
+ * Write 'stamp' at the start of every DIO_STAMP_SPAN bytes of the
+ *   block.  That's enough to make each write differ from every
+ *   other one at any dedup granularity down to the span.
+ */
+static void stamp_block(char *blk, uint32_t blksize, uint64_t stamp)
+{
+  uint32_t off;
 
-    ifinish  = finish.tv_usec;
-    ifinish += finish.tv_sec * US_SEC;
+  if(!blk || (blksize < sizeof(stamp)))
+    return;
 
-    us_time = ifinish - istart;
+  for(off = 0;off + sizeof(stamp) <= blksize;off += DIO_STAMP_SPAN) {
+    memcpy(&blk[off], &stamp, sizeof(stamp));
   }
+}
+
+/*
+ * Hand out the next block of the data pool, freshly stamped.
+ */
+static char* next_pool_block(dio_opts *dio, dio_cursor *cur)
+{
+  char *blk;
+
+  blk = &cur->pool[(size_t)cur->pool_next * dio->blksize];
+  stamp_block(blk, dio->blksize, ++cur->stamp);
+
+  cur->pool_next++;
+  if(cur->pool_next >= dio->pool)
+    cur->pool_next = 0;
 
-  return us_time;
+  return blk;
 }
@@ -22,6 +22,7 @@
 
 #include "calibrate.h"
 #include "constants.h"
+#include "coordinate.h"
 #include "input.h"
 #include "mainctl.h"
 #include "opts.h"
@@ -57,6 +58,7 @@ int main(int argc, char *argv[])
   /*
    * In this order, perform these steps (if necessary)
    * 1. Redirect to a log file
+   *    (Coordinate other nodes and exit)
    * 2. Restore benchmark data from a file
    * 3. Run the benchmarks
    * 4. Save the new benchmark data
@@ -73,6 +75,15 @@ int main(int argc, char *argv[])
     redirect_output();
   }
 
+  /*
+   *    A coordinator doesn't run anything itself,
+   *    so it has no need to calibrate.
+   */
+  if(strlen(coord_file)) {
+    rc = coordinate(coord_file);
+    exit((rc < 0) ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
+
   /*
    * 2. Restore benchmark data from a file
    */
@@ -115,6 +126,11 @@ int main(int argc, char *argv[])
     s_log(G_NOTICE, "done.\n");
   }
 
+  /*
+   * The TSC rate is never saved; it only takes a moment to find.
+   */
+  calibrate_tsc();
+
   init_opts(&opts);
   start_reaper(&opts);
   start_input(&opts);
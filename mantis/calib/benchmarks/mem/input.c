@@ -18,6 +18,7 @@
 #include <unistd.h>
 
 #include <sys/time.h>
+#include <time.h>
 
 #include "constants.h"
 #include "input.h"
@@ -38,19 +39,46 @@ static void* input(void *opts);
  * Will each command come with a timestamp, or will we execute
  *   them 'live', as they arrive?
  */
-static void parse_input_timed(gamut_opts *gopts, FILE *infp);
+static void parse_input_timed(gamut_opts *gopts, FILE *infp,
+                              struct timeval *start);
 static void parse_input_live(gamut_opts *gopts, FILE *infp);
 
+/*
+ * A tracefile run by the "trace" command, in its own thread, from
+ *   an agreed-on start time.  One at a time.
+ */
+typedef struct {
+  gamut_opts      *gopts;
+  pthread_mutex_t  lock;
+  int              state;          /* TRACE_* */
+  FILE            *fp;
+  char             file[BUFSIZE];
+  uint64_t         target;         /* When to start, usec since the epoch */
+  uint64_t         started;        /* When we did */
+} trace_run;
+
+#define TRACE_NONE    0
+#define TRACE_WAITING 1
+#define TRACE_RUNNING 2
+#define TRACE_DONE    3
+
+static trace_run tracer = { NULL, PTHREAD_MUTEX_INITIALIZER, TRACE_NONE };
+
+static void* run_trace(void *arg);
+
 /*
  * Main functions that actually do stuff
   */
 #define create_handler(h) \
 static int (h)(gamut_opts *gopts, char *cmdstr)
 
+create_handler(do_dump);
 create_handler(do_helo);
 create_handler(do_info);
 create_handler(do_load);
 create_handler(do_opts);
+create_handler(do_time);
+create_handler(do_trace);
 create_handler(do_wait);
 
 /*
@@ -61,11 +89,14 @@ create_handler(do_wait);
  */
 static cmd_handler c_handlers[] = {
   { "wctl", NULL    },
+  { "dump", do_dump },
   { "helo", do_helo },
   { "info", do_info },
   { "link", NULL    },
   { "load", do_load },
   { "opts", do_opts },
+  { "time", do_time },
+  { "trace", do_trace },
   { "wait", do_wait }
 };
 static int num_handlers = sizeof(c_handlers) / sizeof(c_handlers[0]);
@@ -150,7 +181,7 @@ void parse_input(gamut_opts *gopts, char *infname, uint8_t timed)
   }
 
   if(timed) {
-    parse_input_timed(gopts, infp);
+    parse_input_timed(gopts, infp, NULL);
   }
   else {
     parse_input_live(gopts, infp);
@@ -202,6 +233,60 @@ fail_out:
   return;
 }
 
+/*
+ * Run one command line and wait for it to finish.
+ */
+int input_command(gamut_opts *gopts, char *cmdline, FILE *out)
+{
+  char *args[2];
+  int rc;
+  int nargs;
+  cmd_handler *c_handle;
+
+  if(!gopts || !cmdline)
+    return -1;
+
+  s_log(G_NOTICE, "INPUT %s\n", cmdline);
+
+  rc = -1;
+  set_log_tee(out);
+
+  nargs = split(NULL, cmdline, args, 2, ws_is_delim);
+  if(nargs < 1) {
+    s_log(G_WARNING, "Invalid command string: \"%s\".\n", cmdline);
+    goto clean_out;
+  }
+
+  if(!strcmp(args[0], "quit")) {
+    rc = 1;
+    goto clean_out;
+  }
+
+  c_handle = get_handler_by_msg(args[0]);
+  if(!c_handle) {
+    s_log(G_WARNING, "Invalid command: \"%s\".\n", args[0]);
+    goto clean_out;
+  }
+
+  if(c_handle->func) {
+    rc = c_handle->func(gopts, args[1]);
+  }
+  else { /* Send to the master, which copies its own output */
+    char mbuf[BUFSIZE];
+
+    (void)snprintf(mbuf, BUFSIZE, "%s %s", args[0],
+                   args[1] ? args[1] : "");
+    set_log_tee(NULL);
+    rc = run_master_cmd(gopts, mbuf, out);
+  }
+  if(rc > 0)
+    rc = 0;
+
+clean_out:
+  set_log_tee(NULL);
+  return rc;
+}
+
 /*
  * The thread we will spawn.
  */
@@ -248,7 +333,11 @@ fail_out:
   return NULL;
 }
 
-static void parse_input_timed(gamut_opts *gopts, FILE *infp)
+/*
+ * Times in the file are from 'start', or from now if it's NULL.
+ */
+static void parse_input_timed(gamut_opts *gopts, FILE *infp,
+                              struct timeval *start)
 {
   int rc;
   int linenum;
@@ -264,7 +353,10 @@ static void parse_input_timed(gamut_opts *gopts, FILE *infp)
    *   commands on that time.
    */
   linenum = 0;
-  (void)gettimeofday(&start_timetv, NULL);
+  if(start)
+    start_timetv = *start;
+  else
+    (void)gettimeofday(&start_timetv, NULL);
   while(!gopts->i_sync.exiting) {
     char buf[BUFSIZE+1];
     char *args[2];
@@ -487,6 +579,64 @@ clean_out:
 }
 
 /********************** Begin worker functions ************************/
+static int do_dump(gamut_opts *gopts, char *cmdstr)
+{
+  int i;
+  int nargs;
+  int widx;
+  char *fname;
+  char *args[2];
+
+  if(!gopts)
+    return -1;
+
+  widx  = -1;
+  fname = NULL;
+  if(!cmdstr || !strlen(cmdstr)) {
+    s_log(G_WARNING, "Usage: dump worker=<mem worker>,file=<file>\n");
+    goto fail_out;
+  }
+
+  nargs = split(",", cmdstr, args, 2, ws_is_delim);
+  for(i = 0;i < nargs;i++) {
+    char *sargs[2];
+    char *q;
+    int nsargs;
+
+    nsargs = split("=", args[i], sargs, 2, ws_is_delim);
+    if(nsargs != 2) {
+      s_log(G_WARNING, "Invalid dump options: \"%s\"\n", args[i]);
+      goto fail_out;
+    }
+
+    if(!strcmp("worker", sargs[0])) {
+      errno = 0;
+      widx = (int)strtoul(sargs[1], &q, 10);
+      if(errno || (sargs[1] == q)) {
+        s_log(G_WARNING, "Invalid worker ID: \"%s\"\n", sargs[1]);
+        goto fail_out;
+      }
+    }
+    else if(!strcmp("file", sargs[0])) {
+      fname = sargs[1];
+    }
+    else {
+      s_log(G_WARNING, "Invalid dump tag: \"%s\"\n", sargs[0]);
+      goto fail_out;
+    }
+  }
+
+  if((widx < 0) || !fname) {
+    s_log(G_WARNING, "Usage: dump worker=<mem worker>,file=<file>\n");
+    goto fail_out;
+  }
+
+  return dump_mem_epochs(gopts, widx, fname);
+
+fail_out:
+  return -1;
+}
+
 static int do_helo(gamut_opts *gopts, char *cmdstr)
 {
   if(!gopts)
@@ -601,6 +751,194 @@ static int do_opts(gamut_opts *gopts, char *cmdstr)
   return -1;
 }
 
+/*
+ * Our clock, in usec since the epoch, for a coordinator working out
+ *   how far it is from its own.
+ */
+static int do_time(gamut_opts *gopts, char *cmdstr)
+{
+  struct timeval tv;
+
+  if(!gopts)
+    return -1;
+
+  (void)gettimeofday(&tv, NULL);
+  s_log(G_INFO, "time=%llu\n",
+                (unsigned long long)tv.tv_sec * US_SEC + tv.tv_usec);
+
+  return 0;
+}
+
+/*
+ * trace file=<tracefile>[,start=<usec since the epoch>|+<sec>]
+ *
+ * Run a tracefile in the background with its times counted from
+ *   'start' (default now).  With no options, say how the last one
+ *   went.
+ */
+static int do_trace(gamut_opts *gopts, char *cmdstr)
+{
+  char *fname;
+  int rc;
+  uint64_t target;
+  pthread_t tid;
+  struct timeval tv;
+
+  if(!gopts)
+    return -1;
+
+  fname = NULL;
+  (void)gettimeofday(&tv, NULL);
+  target = (uint64_t)tv.tv_sec * US_SEC + tv.tv_usec;
+
+  if(!cmdstr || !strlen(cmdstr)) {
+    static char *states[] = { "none", "waiting", "running", "done" };
+
+    (void)pthread_mutex_lock(&tracer.lock);
+    s_log(G_INFO, "trace file=%s target=%llu started=%llu late=%lld "
+                  "state=%s\n", tracer.file[0] ? tracer.file : "-",
+                  (unsigned long long)tracer.target,
+                  (unsigned long long)tracer.started,
+                  tracer.started ? ((long long)tracer.started
+                                    - (long long)tracer.target) : 0LL,
+                  states[tracer.state]);
+    (void)pthread_mutex_unlock(&tracer.lock);
+    return 0;
+  }
+
+  {
+    char *args[2];
+    int i;
+    int nargs;
+
+    nargs = split(",", cmdstr, args, 2, ws_is_delim);
+    for(i = 0;i < nargs;i++) {
+      char *sargs[2];
+      char *q;
+      int nsargs;
+
+      nsargs = split("=", args[i], sargs, 2, ws_is_delim);
+      if(nsargs != 2) {
+        s_log(G_WARNING, "Invalid trace options: \"%s\"\n", args[i]);
+        goto fail_out;
+      }
+
+      if(!strcmp("file", sargs[0])) {
+        fname = sargs[1];
+      }
+      else if(!strcmp("start", sargs[0])) {
+        errno = 0;
+        if(sargs[1][0] == '+') {
+          double dval;
+
+          dval = strtod(sargs[1] + 1, &q);
+          if(errno || (sargs[1] + 1 == q) || (dval < 0)) {
+            s_log(G_WARNING, "Invalid start: \"%s\"\n", sargs[1]);
+            goto fail_out;
+          }
+          target += (uint64_t)(dval * US_SEC);
+        }
+        else {
+          target = (uint64_t)strtoull(sargs[1], &q, 10);
+          if(errno || (sargs[1] == q)) {
+            s_log(G_WARNING, "Invalid start: \"%s\"\n", sargs[1]);
+            goto fail_out;
+          }
+        }
+      }
+      else {
+        s_log(G_WARNING, "Invalid trace tag: \"%s\"\n", sargs[0]);
+        goto fail_out;
+      }
+    }
+  }
+
+  if(!fname) {
+    s_log(G_WARNING, "Usage: trace file=<tracefile>[,start=<usec>|+<sec>]\n");
+    goto fail_out;
+  }
+
+  (void)pthread_mutex_lock(&tracer.lock);
+  if((tracer.state == TRACE_WAITING) || (tracer.state == TRACE_RUNNING)) {
+    (void)pthread_mutex_unlock(&tracer.lock);
+    s_log(G_WARNING, "Trace \"%s\" is still going.\n", tracer.file);
+    goto fail_out;
+  }
+
+  tracer.fp = fopen(fname, "r");
+  if(!tracer.fp) {
+    (void)pthread_mutex_unlock(&tracer.lock);
+    s_log(G_WARNING, "Could not open trace %s: %s\n",
+                     fname, strerror(errno));
+    goto fail_out;
+  }
+  tracer.gopts   = gopts;
+  tracer.target  = target;
+  tracer.started = 0;
+  tracer.state   = TRACE_WAITING;
+  strncpy(tracer.file, fname, BUFSIZE - 1);
+
+  rc = pthread_create(&tid, (pthread_attr_t *)NULL, run_trace, &tracer);
+  if(rc) {
+    (void)fclose(tracer.fp);
+    tracer.state = TRACE_NONE;
+    (void)pthread_mutex_unlock(&tracer.lock);
+    s_log(G_WARNING, "Error starting trace thread.\n");
+    goto fail_out;
+  }
+  (void)pthread_detach(tid);
+  (void)pthread_mutex_unlock(&tracer.lock);
+
+  s_log(G_INFO, "trace file=%s target=%llu state=waiting\n",
+                fname, (unsigned long long)target);
+  return 0;
+
+fail_out:
+  return -1;
+}
+
+/*
+ * Sleep until the trace's start time, note how close we came,
+ *   and run it from there.  The times in the file count from the
+ *   start time, not from when we woke up.
+ */
+static void* run_trace(void *arg)
+{
+  trace_run *tr;
+  struct timespec ts;
+  struct timeval start;
+  struct timeval now;
+
+  tr = (trace_run *)arg;
+
+  ts.tv_sec  = (time_t)(tr->target / US_SEC);
+  ts.tv_nsec = (long)(tr->target % US_SEC) * 1000;
+  while(clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    ;
+  (void)gettimeofday(&now, NULL);
+
+  (void)pthread_mutex_lock(&tr->lock);
+  tr->started = (uint64_t)now.tv_sec * US_SEC + now.tv_usec;
+  tr->state   = TRACE_RUNNING;
+  (void)pthread_mutex_unlock(&tr->lock);
+
+  s_log(G_NOTICE, "Trace \"%s\" started %lld usec after its start time.\n",
+                  tr->file, (long long)(tr->started - tr->target));
+
+  start.tv_sec  = ts.tv_sec;
+  start.tv_usec = (suseconds_t)(tr->target % US_SEC);
+  parse_input_timed(tr->gopts, tr->fp, &start);
+  (void)fclose(tr->fp);
+
+  (void)pthread_mutex_lock(&tr->lock);
+  tr->fp    = NULL;
+  tr->state = TRACE_DONE;
+  (void)pthread_mutex_unlock(&tr->lock);
+
+  s_log(G_NOTICE, "Trace \"%s\" is done.\n", tr->file);
+  return NULL;
+}
+
 static int do_wait(gamut_opts *gopts, char *cmdstr)
 {
   int rc;
@@ -50,4 +50,14 @@ extern void parse_input(gamut_opts *gopts, char *infname,
  */
 extern void stop_input(gamut_opts *gopts);
 
+/*
+ * Run one command line and wait for it to finish, copying what it
+ *   logs to 'out' (if not NULL).  For callers other than the input
+ *   thread, such as netgamut's command server.
+ * This function returns  1 on "quit",
+ *                        0 if the command succeeded,
+ *                       -1 otherwise.
+ */
+extern int input_command(gamut_opts *gopts, char *cmdline, FILE *out);
+
 #endif /* GAMUT_INPUT_H */
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2005 Justin Moore, justin@cs.duke.edu
+ *
+ * This software may be freely redistributed under the terms of the GNU
+ * public license.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lathist.h"
+
+/*
+ * The middle of a bucket, which is what we report for it.
+ */
+static uint64_t lat_hist_value(uint32_t idx)
+{
+  uint32_t mag;
+
+  if(idx < 2 * LAT_SUB)
+    return idx;
+
+  mag = (idx / LAT_SUB) - 1;
+  return ((uint64_t)(idx - (mag * LAT_SUB)) << mag)
+         + (((uint64_t)1 << mag) >> 1);
+}
+
+void lat_hist_reset(lat_hist *h)
+{
+  if(!h)
+    return;
+
+  memset(h, 0, sizeof(*h));
+}
+
+uint64_t lat_hist_percentile(lat_hist *h, double pct)
+{
+  uint32_t i;
+  uint64_t seen;
+  uint64_t target;
+
+  if(!h || !h->count)
+    return 0;
+
+  target = (uint64_t)((pct / 100.0) * (double)h->count + 0.5);
+  if(!target)
+    target = 1;
+  if(target > h->count)
+    target = h->count;
+
+  seen = 0;
+  for(i = 0;i < LAT_BUCKETS;i++) {
+    seen += h->buckets[i];
+    if(seen >= target)
+      break;
+  }
+  if(i == LAT_BUCKETS)
+    return h->max;
+
+  /* The top bucket, at least, we know exactly */
+  if(lat_hist_value(i) > h->max)
+    return h->max;
+
+  return lat_hist_value(i);
+}
+
+void lat_hist_print(lat_hist *h, char *buf, int len)
+{
+  if(!h || !buf || (len <= 0))
+    return;
+
+  if(!h->count) {
+    snprintf(buf, len, "none");
+    return;
+  }
+
+  snprintf(buf, len, "p50 %llu  p90 %llu  p99 %llu  p99.9 %llu  "
+                     "max %llu usec (%llu samples)",
+           (unsigned long long)lat_hist_percentile(h, 50.0),
+           (unsigned long long)lat_hist_percentile(h, 90.0),
+           (unsigned long long)lat_hist_percentile(h, 99.0),
+           (unsigned long long)lat_hist_percentile(h, 99.9),
+           (unsigned long long)h->max,
+           (unsigned long long)h->count);
+}
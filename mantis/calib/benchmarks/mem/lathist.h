@@ -0,0 +1,78 @@
+/*
+ * Copyright 2005 Justin Moore, justin@cs.duke.edu
+ *
+ * This software may be freely redistributed under the terms of the GNU
+ * public license.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef GAMUT_LATHIST_H
+#define GAMUT_LATHIST_H
+
+#include <netdb.h>  /* for uint{32,64}_t */
+
+/*
+ * A log-linear latency histogram, in microseconds.  Values below
+ *   2 * LAT_SUB get a bucket each; above that, every power of two
+ *   is split into LAT_SUB buckets, so a bucket is never more than
+ *   1/LAT_SUB of its value wide.  The size is fixed, and only the
+ *   worker that owns a histogram writes to it, so recording needs
+ *   no locks.
+ */
+#define LAT_SUB_BITS 4
+#define LAT_SUB      (1 << LAT_SUB_BITS)
+#define LAT_MAX_BITS 32  /* Anything longer lands in the last bucket */
+#define LAT_BUCKETS  (LAT_SUB * (LAT_MAX_BITS - LAT_SUB_BITS + 1))
+
+typedef struct {
+  uint64_t count;               /* Samples recorded */
+  uint64_t max;                 /* Longest sample */
+  uint64_t buckets[LAT_BUCKETS];
+} lat_hist;
+
+/*
+ * Which bucket does a latency fall into?
+ */
+static inline uint32_t lat_hist_index(uint64_t usec)
+{
+  uint32_t mag;
+
+  if(usec < 2 * LAT_SUB)
+    return (uint32_t)usec;
+  if(usec >> LAT_MAX_BITS)
+    return LAT_BUCKETS - 1;
+
+  mag = (uint32_t)(63 - __builtin_clzll(usec)) - LAT_SUB_BITS;
+  return (mag * LAT_SUB) + (uint32_t)(usec >> mag);
+}
+
+/*
+ * Add one sample.
+ */
+static inline void lat_hist_record(lat_hist *h, uint64_t usec)
+{
+  h->buckets[lat_hist_index(usec)]++;
+  h->count++;
+  if(usec > h->max)
+    h->max = usec;
+}
+
+/*
+ * Empty a histogram.
+ */
+extern void lat_hist_reset(lat_hist *h);
+
+/*
+ * Get the latency below which 'pct' percent of the samples fall.
+ */
+extern uint64_t lat_hist_percentile(lat_hist *h, double pct);
+
+/*
+ * Print p50/p90/p99/p99.9 and the maximum into 'buf'.
+ */
+extern void lat_hist_print(lat_hist *h, char *buf, int len);
+
+#endif /* GAMUT_LATHIST_H */
@@ -69,9 +69,13 @@ void execute_gamut(gamut_opts *opts)
     goto fail_out;
   }
 
+  /*
+   * Besides us, threads waiting for the command slot or for their
+   *   command to finish sleep on the master cond, so wake them all.
+   */
   exiting = 0;
   while(!exiting) {
-    rc = signal_master(opts);
+    rc = broadcast_master(opts);
     if(rc < 0) {
       goto master_out;
     }
@@ -120,7 +124,13 @@ void execute_gamut(gamut_opts *opts)
      * Now that we've executed the command, clean everything out
      *   and prepare for the next command.
      */
+    if(opts->mctl.mcmd == MCMD_INPUT) {
+      opts->mctl.mrc   = rc;
+      opts->mctl.mdone = opts->mctl.mseq;
+      (void)broadcast_master(opts);
+    }
     opts->mctl.mcmd = MCMD_FREE;
+    opts->mctl.mout = NULL;
     memset(opts->mctl.mbuf, 0, sizeof(opts->mctl.mbuf));
   }
 
@@ -166,8 +176,10 @@ int send_master_cmd(gamut_opts *gopts, worker_cmd wcmd,
       if(cmdstr) {
         strncpy(gopts->mctl.mbuf, cmdstr, BUFSIZE);
       }
+      gopts->mctl.mout = NULL;
+      gopts->mctl.mseq++;
 
-      rc = signal_master(gopts);
+      rc = broadcast_master(gopts);
       if(rc < 0) {
         goto fail_out;
       }
@@ -203,6 +215,45 @@ fail_out:
   return frc;
 }
 
+int run_master_cmd(gamut_opts *gopts, char *cmdstr, FILE *out)
+{
+  int rc;
+  int frc;
+  uint64_t seq;
+
+  if(!gopts || !cmdstr)
+    return -1;
+
+  rc = lock_master(gopts);
+  if(rc < 0) {
+    return -1;
+  }
+
+  frc = -1;
+  rc  = send_master_cmd(gopts, MCMD_INPUT, cmdstr);
+  if(rc < 0) {
+    goto master_out;
+  }
+
+  /*
+   * The master can't pick the command up until we let go of the
+   *   lock, so it's safe to hand it 'out' now.
+   */
+  gopts->mctl.mout = out;
+  seq              = gopts->mctl.mseq;
+  while(gopts->mctl.mdone < seq) {
+    rc = wait_master(gopts);
+    if(rc < 0) {
+      goto master_out;
+    }
+  }
+  frc = gopts->mctl.mrc;
+
+master_out:
+  (void)unlock_master(gopts);
+  return frc;
+}
+
 static int run_input_cmd(gamut_opts *gopts)
 {
   char *cbuf;
@@ -230,11 +281,15 @@ static int run_input_cmd(gamut_opts *gopts)
    */
   func = get_handler_by_msg(args[0]);
   if(!func) {
+    set_log_tee(gopts->mctl.mout);
     s_log(G_WARNING, "Invalid command: \"%s\".\n", args[0]);
+    set_log_tee(NULL);
     goto clean_out;
   }
 
+  set_log_tee(gopts->mctl.mout);
   frc = func(gopts, args[1]);
+  set_log_tee(NULL);
   if(frc < 0) {
     s_log(G_WARNING, "MASTER: Error executing command.\n");
   }
@@ -307,10 +362,11 @@ static int do_link(gamut_opts *gopts, char *cmdstr)
       break;
 
     default:
+      rc = -1;
       break;
   }
 
-  return 0;
+  return rc;
 }
 
 static int do_wctl(gamut_opts *gopts, char *cmdstr)
@@ -372,10 +428,11 @@ static int do_wctl(gamut_opts *gopts, char *cmdstr)
       break;
 
     default:
+      rc = -1;
       break;
   }
 
-  return 0;
+  return rc;
 }
 
 static link_cmd get_lcmd(const char *cmdstr)
@@ -59,4 +59,14 @@ extern void execute_gamut(gamut_opts *opts);
 extern int send_master_cmd(gamut_opts *gopts, worker_cmd wcmd,
                            char *cmdstr);
 
+/*
+ * Have the master run an input command and wait for it to finish,
+ *   copying what it logs to 'out' (if not NULL).
+ * This function returns what the command returned, or -1 if
+ *   we couldn't get it to the master.
+ *
+ * NOTE: We must NOT have the master lock upon entering this function.
+ */
+extern int run_master_cmd(gamut_opts *gopts, char *cmdstr, FILE *out);
+
 #endif /* GAMUT_MAIN_CTL_H */
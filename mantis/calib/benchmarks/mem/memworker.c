@@ -10,7 +10,13 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE    /* For the CPU affinity calls */
+#endif
+
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,6 +29,7 @@
 #include "constants.h"
 #include "linklib.h"
 #include "memworker.h"
+#include "pattern.h"
 #include "utilrand.h"
 #include "utillog.h"
 #include "workerctl.h"
@@ -30,13 +37,323 @@
 #include "workeropts.h"
 #include "workersync.h"
 
+/*
+ * Blocks are handed out and touched in batches of this many.
+ */
+#define MEM_BATCH_BLKS 64
+
+/*
+ * Entries in each thread's pattern ring.  Big enough that the ring
+ *   doesn't repeat too often, small enough to stay in the cache.
+ */
+#define MEM_RING_ENTRIES 32768
+
+/*
+ * One of the threads sharing a memory worker's buffer.
+ *   Thread 0 is always the worker thread itself.
+ */
+typedef struct {
+  pthread_t tid;
+  uint32_t  tidx;          /* Index of this thread in the team */
+  char     *tbuf;          /* Start of our slice of the allocation */
+  uint64_t  ntblks;        /* Blocks in our slice of the allocation */
+  char     *wbuf;          /* Start of our slice of the working set */
+  uint64_t  nwblks;        /* Blocks in our slice of the working set */
+  uint64_t  currpos;       /* Current block in our working set */
+  int64_t   stride;        /* Sequential blocks per random jump (-1: never) */
+  int64_t   stride_left;   /* How long before a random block? */
+  uint8_t   use_ring;      /* Take offsets from the ring, not currpos */
+  pattern_ring ring;       /* Precomputed offsets into our working set */
+  uint64_t  rstate;        /* Private PRNG state for random blocks */
+  uint64_t  target_blocks; /* Blocks to touch this epoch */
+  uint64_t  mix_len[2];    /* Length of read and write runs */
+  uint64_t  mix_left;      /* Accesses left in the current run */
+  uint32_t  mix_dir;       /* Direction of the current run */
+  uint32_t  sink;          /* Keeps the loads from being optimized out */
+  mem_opts *mem;
+  void     *team;          /* The mem_team we belong to */
+} mem_thread;
+
+/*
+ * All the threads working for one memory worker.  Each epoch the
+ *   worker thread hands out the blocks to touch, does its own share,
+ *   and then waits for the rest of the team to finish.  This keeps
+ *   a single deadline and I/O rate for the whole worker.
+ */
+typedef struct {
+  pthread_mutex_t  lock;
+  pthread_cond_t   go_cond;   /* Helpers wait here for work */
+  pthread_cond_t   done_cond; /* Worker thread waits here for helpers */
+  uint64_t         epoch;     /* Bumped every time work is handed out */
+  uint32_t         busy;      /* Helpers still working on this epoch */
+  uint32_t         nthreads;  /* Threads in the team (0 if not started) */
+  volatile uint8_t exiting;   /* Tell the helpers to go away */
+  uint64_t         tsc_base;  /* TSC when the worker started ... */
+  uint64_t         usec_base; /* ... and the time of day then (usecs) */
+  mem_thread       thr[MAX_MEM_THREADS];
+#ifdef __linux__
+  cpu_set_t        allowed;   /* CPUs we were allowed to use at startup */
+#endif
+} mem_team;
+
 /*
  * Do the work for this epoch.
  */
-static int memwork(gamut_opts *gopts, mem_opts *mem, char *buf,
-                   uint64_t *currpos, int64_t *target_memio,
-                   double blocks_per_epoch, double *curr_blocks,
-                   int64_t *stride_left);
+static int memwork(gamut_opts *gopts, mem_opts *mem, int mem_index,
+                   mem_team *team, int64_t *target_memio,
+                   double blocks_per_epoch, double *curr_blocks);
+
+/*
+ * Add an epoch to the worker's history.
+ */
+static void memwork_record(gamut_opts *gopts, mem_opts *mem, int mem_index,
+                           mem_team *team, uint64_t tsc_start,
+                           uint64_t tsc_finish, uint64_t bytes);
+
+/*
+ * Split the buffer among the threads, start the helpers, and have
+ *   everyone touch their slice of memory.
+ */
+static int memteam_start(mem_opts *mem, mem_team *team, char *buf);
+
+/*
+ * Tell the helper threads to exit and wait for them.
+ */
+static void memteam_stop(mem_team *team);
+
+/*
+ * Main loop for the helper threads.
+ */
+static void* memhelper(void *arg);
+
+/*
+ * Pin a team thread to a CPU, if there's more than one of us.
+ */
+static void memthread_pin(mem_thread *thr);
+
+/*
+ * Touch every block in a thread's slice of the allocation.
+ */
+static void memthread_touch(mem_thread *thr);
+
+/*
+ * Touch this thread's share of the blocks for the epoch.
+ */
+static void memthread_work(mem_thread *thr);
+
+/*
+ * Read from or write to the next 'nblks' blocks.
+ */
+static void memthread_read(mem_thread *thr, uint64_t nblks);
+static void memthread_write(mem_thread *thr, uint64_t nblks);
+
+/*
+ * Find the next run of contiguous blocks to touch, up to 'nblks'
+ *   long.  A run ends at the end of our slice or when the stride runs
+ *   out, at which point we jump to a random block.
+ */
+static inline uint64_t memthread_segment(mem_thread *thr, uint64_t nblks,
+                                         uint64_t *pos, int64_t *stride_left)
+{
+  uint64_t run;
+
+  if(!*stride_left) {
+    *pos = pattern_rand(&thr->rstate) % thr->nwblks;
+    *stride_left = thr->stride;
+  }
+
+  run = thr->nwblks - *pos;
+  if((*stride_left > 0) && (run > (uint64_t)*stride_left))
+    run = (uint64_t)*stride_left;
+  if(run > nblks)
+    run = nblks;
+
+  return run;
+}
+
+/*
+ * Move past a run returned by memthread_segment().
+ */
+static inline void memthread_advance(mem_thread *thr, uint64_t run,
+                                     uint64_t *pos, int64_t *stride_left)
+{
+  *pos += run;
+  if(*pos == thr->nwblks)
+    *pos = 0;
+
+  if(*stride_left > 0)
+    *stride_left -= run;
+}
+
+/*
+ * The kernels: touch the first byte of 'n' blocks starting at 'p'.
+ *   These are unrolled eight ways with independent loads/stores so
+ *   the CPU can keep several misses in flight.
+ */
+static inline uint32_t memkernel_read(char *p, uint64_t n, uint64_t blksize)
+{
+  uint32_t s0, s1, s2, s3;
+
+  s0 = s1 = s2 = s3 = 0;
+  while(n >= 8) {
+    s0 += (unsigned char)p[0];
+    s1 += (unsigned char)p[blksize];
+    s2 += (unsigned char)p[2 * blksize];
+    s3 += (unsigned char)p[3 * blksize];
+    s0 += (unsigned char)p[4 * blksize];
+    s1 += (unsigned char)p[5 * blksize];
+    s2 += (unsigned char)p[6 * blksize];
+    s3 += (unsigned char)p[7 * blksize];
+    p += 8 * blksize;
+    n -= 8;
+  }
+  while(n--) {
+    s0 += (unsigned char)*p;
+    p  += blksize;
+  }
+
+  return s0 + s1 + s2 + s3;
+}
+
+static inline void memkernel_write(char *p, uint64_t n, uint64_t blksize,
+                                   uint8_t v)
+{
+  while(n >= 8) {
+    p[0]           = (char)v;
+    p[blksize]     = (char)(v + 1);
+    p[2 * blksize] = (char)(v + 2);
+    p[3 * blksize] = (char)(v + 3);
+    p[4 * blksize] = (char)(v + 4);
+    p[5 * blksize] = (char)(v + 5);
+    p[6 * blksize] = (char)(v + 6);
+    p[7 * blksize] = (char)(v + 7);
+    p += 8 * blksize;
+    v += 8;
+    n -= 8;
+  }
+  while(n--) {
+    *p = (char)v++;
+    p += blksize;
+  }
+}
+
+/*
+ * The same kernels for offsets taken from a pattern ring.  Each
+ *   chunk stops at the end of the ring, so the lap shift is the
+ *   same for every entry in it.
+ */
+static inline uint32_t memkernel_ring_read(char *base, pattern_ring *pr,
+                                           uint64_t n)
+{
+  uint32_t s0, s1, s2, s3;
+  uint64_t *e;
+  uint64_t chunk;
+  uint64_t shift;
+  uint64_t span;
+
+  s0 = s1 = s2 = s3 = 0;
+  span = pr->span;
+  while(n) {
+    e     = pr->ring + pr->pos;
+    shift = pr->shift;
+    chunk = pr->size - pr->pos;
+    if(chunk > n)
+      chunk = n;
+    pr->pos += (uint32_t)chunk;
+    n       -= chunk;
+
+    while(chunk >= 4) {
+      uint64_t o0, o1, o2, o3;
+
+      o0 = e[0] + shift;
+      o1 = e[1] + shift;
+      o2 = e[2] + shift;
+      o3 = e[3] + shift;
+      o0 -= (o0 >= span) ? span : 0;
+      o1 -= (o1 >= span) ? span : 0;
+      o2 -= (o2 >= span) ? span : 0;
+      o3 -= (o3 >= span) ? span : 0;
+      s0 += (unsigned char)base[o0];
+      s1 += (unsigned char)base[o1];
+      s2 += (unsigned char)base[o2];
+      s3 += (unsigned char)base[o3];
+      e     += 4;
+      chunk -= 4;
+    }
+    while(chunk--) {
+      s0 += (unsigned char)base[pattern_offset(pr, *e)];
+      e++;
+    }
+
+    if(pr->pos == pr->size)
+      pattern_ring_lap(pr);
+  }
+
+  return s0 + s1 + s2 + s3;
+}
+
+static inline void memkernel_ring_write(char *base, pattern_ring *pr,
+                                        uint64_t n, uint8_t v)
+{
+  uint64_t *e;
+  uint64_t chunk;
+  uint64_t shift;
+  uint64_t span;
+
+  span = pr->span;
+  while(n) {
+    e     = pr->ring + pr->pos;
+    shift = pr->shift;
+    chunk = pr->size - pr->pos;
+    if(chunk > n)
+      chunk = n;
+    pr->pos += (uint32_t)chunk;
+    n       -= chunk;
+
+    while(chunk >= 4) {
+      uint64_t o0, o1, o2, o3;
+
+      o0 = e[0] + shift;
+      o1 = e[1] + shift;
+      o2 = e[2] + shift;
+      o3 = e[3] + shift;
+      o0 -= (o0 >= span) ? span : 0;
+      o1 -= (o1 >= span) ? span : 0;
+      o2 -= (o2 >= span) ? span : 0;
+      o3 -= (o3 >= span) ? span : 0;
+      base[o0] = (char)v;
+      base[o1] = (char)(v + 1);
+      base[o2] = (char)(v + 2);
+      base[o3] = (char)(v + 3);
+      e     += 4;
+      v     += 4;
+      chunk -= 4;
+    }
+    while(chunk--) {
+      base[pattern_offset(pr, *e)] = (char)v++;
+      e++;
+    }
+
+    if(pr->pos == pr->size)
+      pattern_ring_lap(pr);
+  }
+}
+
+/*
+ * Greatest common divisor, used to shorten read/write runs.
+ */
+static uint64_t memthread_gcd(uint64_t a, uint64_t b)
+{
+  while(b) {
+    uint64_t t;
+
+    t = a % b;
+    a = b;
+    b = t;
+  }
+
+  return a;
+}
 
 /*
  * Allocate memory of a given size, then cycle through the working
@@ -45,20 +362,19 @@ static int memwork(gamut_opts *gopts, mem_opts *mem, char *buf,
 void* memworker(void *opts)
 {
   char *buf;
-  int i;
   int rc;
   int mem_index;
   int32_t target_epochs;
+  mem_epoch_sample *epochs;
   int64_t link_waittime;    /* Total time waiting on links (usecs) */
-  int64_t stride_left;      /* How long before a random block? */
   int64_t target_memio;     /* Target number of epochs */
-  uint64_t currpos;         /* Current position (bytes) */
   uint64_t next_deadline;   /* Next deadline (usecs) */
   double blocks_per_epoch;  /* Blocks we touch per epoch */
   double curr_blocks;       /* Blocks this epoch */
   double curr_epochs;       /* How many epochs for this link */
   double epochs_per_link;   /* Epochs per link (if any) */
   mem_opts *mem;
+  mem_team team;
   gamut_opts *gopts;
   struct timeval start;
   struct timeval finish;
@@ -91,11 +407,59 @@ void* memworker(void *opts)
   mem->shopts.missed_deadlines = 0;
   mem->shopts.missed_usecs     = 0;
   mem->shopts.total_deadlines  = 0;
+  memset(mem->tstats, 0, sizeof(mem->tstats));
 
   buf           = NULL;
   link_waittime = 0;
 
+  memset(&team, 0, sizeof(team));
+  (void)pthread_mutex_init(&team.lock, (pthread_mutexattr_t *)NULL);
+  (void)pthread_cond_init(&team.go_cond, (pthread_condattr_t *)NULL);
+  (void)pthread_cond_init(&team.done_cond, (pthread_condattr_t *)NULL);
+#ifdef __linux__
+  if(pthread_getaffinity_np(pthread_self(), sizeof(team.allowed),
+                            &team.allowed))
+  {
+    CPU_ZERO(&team.allowed);
+  }
+#endif
+
+  /*
+   * Set up the epoch history.  The TSC and the time of day are read
+   *   together once here; after that each epoch only needs the TSC.
+   */
+  {
+    struct timeval tv;
+
+    team.tsc_base  = read_tsc();
+    (void)gettimeofday(&tv, NULL);
+    team.usec_base = (uint64_t)tv.tv_sec * US_SEC + tv.tv_usec;
+  }
+  epochs = (mem_epoch_sample *)calloc(MEM_EPOCH_SAMPLES,
+                                      sizeof(mem_epoch_sample));
+  if(!epochs) {
+    s_log(G_WARNING, "%s could not allocate its epoch history.\n",
+                     mem->shopts.label);
+  }
+  rc = lock_worker(gopts, CLS_MEM, mem_index);
+  if(rc < 0) {
+    if(epochs)
+      free(epochs);
+    epochs = NULL;
+  }
+  else {
+    mem->epochs  = epochs;
+    mem->nepochs = 0;
+    (void)unlock_worker(gopts, CLS_MEM, mem_index);
+  }
+
 restart:
+  /*
+   * The helpers are working in the old buffer, so get rid of them
+   *   before we go moving it around.
+   */
+  memteam_stop(&team);
+
   (void)gettimeofday(&mem->shopts.mod_time, NULL);
   mem->shopts.dirty = 0;
 
@@ -111,30 +475,6 @@ restart:
     goto clean_out;
   }
 
-  /*
-   * Calculate the first deadline and the final deadline (if necessary).
-   */
-  {
-    struct timeval tv;
-
-    (void)gettimeofday(&tv, NULL);
-
-    /*
-     * If there's a time limit, let's calculate it.
-     */
-    if(mem->shopts.exec_time) {
-      finish_time.tv_sec  = tv.tv_sec + mem->shopts.exec_time;
-      finish_time.tv_usec = tv.tv_usec;
-    }
-    else {
-      finish_time.tv_sec  = 0;
-      finish_time.tv_usec = 0;
-    }
-
-    next_deadline  = tv.tv_usec;
-    next_deadline += tv.tv_sec * US_SEC;
-  }
-
   /*
    * We call 'realloc' here instead of malloc, since this
    *   handles the situation where we're coming through the
@@ -158,21 +498,41 @@ restart:
 
   /*
    * The first step is to go through and touch all the blocks,
-   *   forcing the OS to actually allocate them.
+   *   forcing the OS to actually allocate them.  Each thread touches
+   *   its own slice so the pages end up close to the CPU using them.
    */
-  for(i = 0;i < mem->ntblks;i++) {
-    buf[i * mem->blksize] = (char)(0xff & i);
+  rc = memteam_start(mem, &team, buf);
+  if(rc < 0) {
+    s_log(G_WARNING, "%s could not start its threads.\n",
+                     mem->shopts.label);
+    goto clean_out;
   }
 
   /*
-   * Should we start the random stride counter?  This counts down how
-   *   long before we jump to a random address.  Until then, simply go
-   *   to the next address.
+   * Calculate the first deadline and the final deadline (if necessary).
+   *   Do this after touching the buffer, which can take a while for
+   *   a big one, so we don't start out behind on every deadline.
    */
-  if(mem->stride)
-    stride_left = 0;
-  else
-    stride_left = -1;
+  {
+    struct timeval tv;
+
+    (void)gettimeofday(&tv, NULL);
+
+    /*
+     * If there's a time limit, let's calculate it.
+     */
+    if(mem->shopts.exec_time) {
+      finish_time.tv_sec  = tv.tv_sec + mem->shopts.exec_time;
+      finish_time.tv_usec = tv.tv_usec;
+    }
+    else {
+      finish_time.tv_sec  = 0;
+      finish_time.tv_usec = 0;
+    }
+
+    next_deadline  = tv.tv_usec;
+    next_deadline += tv.tv_sec * US_SEC;
+  }
 
   /*
    * Calculate the total number of memory accesses this worker will
@@ -225,7 +585,6 @@ restart:
    * 4. See if it's time to exit
    * 5. Sleep, if there's enough time
    */
-  currpos     = 0;   /* Start at the beginning of the buffer */
   curr_blocks = 0.0; /* We haven't touched anything yet */
   (void)gettimeofday(&start, NULL);
   while(!mem->shopts.exiting) {
@@ -237,8 +596,8 @@ restart:
       next_deadline += US_PER_WORKER_EPOCH;
 
       /* Step 2 */
-      rc = memwork(gopts, mem, buf, &currpos, &target_memio,
-                   blocks_per_epoch, &curr_blocks, &stride_left);
+      rc = memwork(gopts, mem, mem_index, &team, &target_memio,
+                   blocks_per_epoch, &curr_blocks);
       if(rc < 0) {
         s_log(G_WARNING, "Error doing memwork.  Exiting.\n");
         mem->shopts.exiting = 1;
@@ -254,8 +613,8 @@ restart:
         /* Step 1 */
         next_deadline += US_PER_WORKER_EPOCH;
 
-        rc = memwork(gopts, mem, buf, &currpos, &target_memio,
-                     blocks_per_epoch, &curr_blocks, &stride_left);
+        rc = memwork(gopts, mem, mem_index, &team, &target_memio,
+                     blocks_per_epoch, &curr_blocks);
         if(rc < 0) {
           s_log(G_WARNING, "Error doing memwork.  Exiting.\n");
           mem->shopts.exiting = 1;
@@ -396,14 +755,68 @@ clean_out:
                       mem->total_memio, iotime, iorate);
     }
 
+    {
+      uint32_t t;
+      uint64_t memio[2];
+      char rdrate[SMBUFSIZE];
+      char wrrate[SMBUFSIZE];
+
+      memio[C_IOREAD]  = 0;
+      memio[C_IOWRITE] = 0;
+      for(t = 0;t < MAX_MEM_THREADS;t++) {
+        memio[C_IOREAD]  += mem->tstats[t].memio[C_IOREAD];
+        memio[C_IOWRITE] += mem->tstats[t].memio[C_IOWRITE];
+      }
+
+      print_scaled_number(rdrate, SMBUFSIZE,
+                          (uint64_t)(memio[C_IOREAD] / totaltime), 1);
+      print_scaled_number(wrrate, SMBUFSIZE,
+                          (uint64_t)(memio[C_IOWRITE] / totaltime), 1);
+      s_log(G_NOTICE, "%s read %llu at %sps, wrote %llu at %sps.\n",
+                      mem->shopts.label,
+                      (unsigned long long)memio[C_IOREAD], rdrate,
+                      (unsigned long long)memio[C_IOWRITE], wrrate);
+    }
+
     s_log(G_NOTICE, "%s missed %llu of %llu deadlines by %llu usecs (avg).\n",
                     mem->shopts.label, mem->shopts.missed_deadlines,
                     mem->shopts.total_deadlines, avg_miss_time);
+
+    if(mem->nthreads > 1) {
+      uint32_t t;
+      uint64_t memio;
+
+      for(t = 0;t < mem->nthreads;t++) {
+        memio = mem->tstats[t].memio[C_IOREAD]
+                + mem->tstats[t].memio[C_IOWRITE];
+        print_scaled_number(iorate, SMBUFSIZE,
+                            (uint64_t)(memio / totaltime), 1);
+        s_log(G_INFO, "%s thread %u (CPU %d) did %llu I/O at %sps.\n",
+                      mem->shopts.label, t, mem->tstats[t].cpu,
+                      (unsigned long long)memio, iorate);
+      }
+    }
   }
 
+  memteam_stop(&team);
+  (void)pthread_cond_destroy(&team.done_cond);
+  (void)pthread_cond_destroy(&team.go_cond);
+  (void)pthread_mutex_destroy(&team.lock);
+
   if(buf)
     free(buf);
 
+  /*
+   * Someone may be looking at the history, so take it away
+   *   under the lock.
+   */
+  if(epochs && !lock_worker(gopts, CLS_MEM, mem_index)) {
+    mem->epochs  = NULL;
+    mem->nepochs = 0;
+    (void)unlock_worker(gopts, CLS_MEM, mem_index);
+    free(epochs);
+  }
+
   /*
    * Remove ourselves from any links.
    */
@@ -421,81 +834,572 @@ clean_out:
 /*
  * Do the work for this epoch.
  */
-static int memwork(gamut_opts *gopts, mem_opts *mem, char *buf,
-                   uint64_t *currpos, int64_t *target_memio,
-                   double blocks_per_epoch, double *curr_blocks,
-                   int64_t *stride_left)
+static int memwork(gamut_opts *gopts, mem_opts *mem, int mem_index,
+                   mem_team *team, int64_t *target_memio,
+                   double blocks_per_epoch, double *curr_blocks)
 {
-  int64_t l_stride_left;
-  int64_t l_target_memio;
-  uint64_t l_currpos;
+  uint32_t t;
+  uint32_t extra;
+  uint64_t share;
+  uint64_t total;
   uint64_t target_blocks;
+  uint64_t tsc_start;
+  uint64_t prev_memio;
   double l_curr_blocks;
 
-  if(!gopts || !mem || !buf || !currpos || !target_memio
-     || (blocks_per_epoch < 0) || !curr_blocks || !stride_left)
+  if(!gopts || !mem || !team || !team->nthreads || !target_memio
+     || (blocks_per_epoch < 0) || !curr_blocks)
   {
     return -1;
   }
 
-  /*
-   * Create local copies of all these variables.
-   */
-  l_currpos      = *currpos;
   l_curr_blocks  = *curr_blocks;
-  l_stride_left  = *stride_left;
-  l_target_memio = *target_memio;
-
   l_curr_blocks += blocks_per_epoch;
   target_blocks  = (uint64_t)l_curr_blocks;
 
+  /*
+   * At high rates, only hand out whole batches and carry the rest
+   *   over to the next epoch.  The kernels then run full unrolled
+   *   batches and never check the rate themselves.
+   */
+  if(blocks_per_epoch >= (MEM_BATCH_BLKS * team->nthreads)) {
+    target_blocks -= target_blocks % MEM_BATCH_BLKS;
+  }
+  l_curr_blocks -= target_blocks;
+
+  /*
+   * Don't go past the total amount of work we were asked to do.
+   */
+  if((*target_memio > 0) && (target_blocks >= (uint64_t)*target_memio)) {
+    target_blocks = (uint64_t)*target_memio;
+    mem->shopts.exiting = 1;
+  }
+  if(*target_memio > 0) {
+    *target_memio -= target_blocks;
+  }
+
   s_log(G_DLOOP, "Target blocks: %llu.\n", target_blocks);
 
-  while(target_blocks) {
-    if(!l_stride_left) {
+  tsc_start  = read_tsc();
+  prev_memio = mem->total_memio;
+
+  /*
+   * Split the batches evenly, rotating who gets the leftovers.
+   *   Anything short of a full batch goes to whoever gets the
+   *   first leftover.
+   */
+  {
+    uint64_t nbatches;
+    uint64_t partial;
+
+    nbatches = target_blocks / MEM_BATCH_BLKS;
+    partial  = target_blocks % MEM_BATCH_BLKS;
+    share    = nbatches / team->nthreads;
+    extra    = (uint32_t)(nbatches % team->nthreads);
+    for(t = 0;t < team->nthreads;t++) {
+      uint32_t slot;
+
+      slot = (uint32_t)((t + team->epoch) % team->nthreads);
+      team->thr[t].target_blocks = (share + ((slot < extra) ? 1 : 0))
+                                   * MEM_BATCH_BLKS;
+      if(slot == extra)
+        team->thr[t].target_blocks += partial;
+    }
+  }
+
+  if(team->nthreads > 1) {
+    (void)pthread_mutex_lock(&team->lock);
+    team->busy = team->nthreads - 1;
+    team->epoch++;
+    (void)pthread_cond_broadcast(&team->go_cond);
+    (void)pthread_mutex_unlock(&team->lock);
+  }
+  else {
+    team->epoch++;
+  }
+
+  memthread_work(&team->thr[0]);
+
+  if(team->nthreads > 1) {
+    (void)pthread_mutex_lock(&team->lock);
+    while(team->busy) {
+      (void)pthread_cond_wait(&team->done_cond, &team->lock);
+    }
+    (void)pthread_mutex_unlock(&team->lock);
+  }
+
+  total = 0;
+  for(t = 0;t < MAX_MEM_THREADS;t++) {
+    total += mem->tstats[t].memio[C_IOREAD];
+    total += mem->tstats[t].memio[C_IOWRITE];
+  }
+  mem->total_memio = total;
+
+  memwork_record(gopts, mem, mem_index, team, tsc_start, read_tsc(),
+                 total - prev_memio);
+
+  /*
+   * Zipf and hotcold rings are redrawn off the clock, while the
+   *   helpers are waiting for the next epoch.
+   */
+  for(t = 0;t < team->nthreads;t++) {
+    if(team->thr[t].use_ring)
+      pattern_ring_refill(&team->thr[t].ring);
+  }
+
+  *curr_blocks = l_curr_blocks;
+
+  if(mem->shopts.exiting)
+    return 0;
+  else
+    return 1;
+}
+
+/*
+ * Add an epoch to the worker's history.  Once the ring has wrapped,
+ *   the slot we fill is one a reader may be copying, so the sample
+ *   and the count move together under the worker lock.
+ */
+static void memwork_record(gamut_opts *gopts, mem_opts *mem, int mem_index,
+                           mem_team *team, uint64_t tsc_start,
+                           uint64_t tsc_finish, uint64_t bytes)
+{
+  mem_epoch_sample *sample;
+
+  if(!mem->epochs)
+    return;
+
+  if(lock_worker(gopts, CLS_MEM, mem_index) < 0)
+    return;
+
+  sample = &mem->epochs[mem->nepochs % MEM_EPOCH_SAMPLES];
+  sample->start_usec = team->usec_base
+                       + tsc_to_usec(tsc_start - team->tsc_base);
+  sample->bytes      = bytes;
+  sample->busy_usec  = (uint32_t)tsc_to_usec(tsc_finish - tsc_start);
+  mem->nepochs++;
+
+  (void)unlock_worker(gopts, CLS_MEM, mem_index);
+}
+
+/*
+ * Split the buffer among the threads, start the helpers, and have
+ *   everyone touch their slice of memory.
+ */
+static int memteam_start(mem_opts *mem, mem_team *team, char *buf)
+{
+  int rc;
+  uint32_t t;
+  uint32_t nthreads;
+
+  if(!mem || !team || !buf)
+    return -1;
+
+  nthreads = mem->nthreads ? mem->nthreads : 1;
+
+  team->exiting = 0;
+  team->epoch   = 0;
+  team->busy    = nthreads - 1;
+
+  for(t = 0;t < nthreads;t++) {
+    mem_thread *thr;
+    uint64_t tstart;
+    uint64_t wstart;
+
+    thr = &team->thr[t];
+    memset(thr, 0, sizeof(*thr));
+
+    tstart = (mem->ntblks * t) / nthreads;
+    wstart = (mem->nwblks * t) / nthreads;
+
+    thr->tidx   = t;
+    thr->mem    = mem;
+    thr->team   = (void *)team;
+    thr->tbuf   = buf + (tstart * mem->blksize);
+    thr->ntblks = ((mem->ntblks * (t + 1)) / nthreads) - tstart;
+    thr->wbuf   = buf + (wstart * mem->blksize);
+    thr->nwblks = ((mem->nwblks * (t + 1)) / nthreads) - wstart;
+
+    /*
+     * Should we start the random stride counter?  This counts down how
+     *   long before we jump to a random address.  Until then, simply go
+     *   to the next address.
+     */
+    switch(mem->pattern.type) {
+      case PAT_SEQ:
+        thr->stride = -1;
+        break;
+      case PAT_RUNS:
+        thr->stride = (int64_t)mem->pattern.step;
+        break;
+      default:
+        thr->stride = mem->stride ? (int64_t)mem->stride : -1;
+        break;
+    }
+    thr->stride_left = (thr->stride > 0) ? 0 : -1;
+    thr->rstate      = ((uint64_t)randomMT() << 32) | randomMT() | 1;
+
+    /*
+     * Everything else comes from a precomputed ring of offsets,
+     *   so the kernels don't spend their time generating them.
+     */
+    if((mem->pattern.type != PAT_DEFAULT) && (mem->pattern.type != PAT_SEQ)
+       && (mem->pattern.type != PAT_RUNS))
+    {
+      rc = pattern_ring_init(&thr->ring, &mem->pattern, thr->nwblks,
+                             mem->blksize, MEM_RING_ENTRIES, thr->rstate);
+      if(rc < 0) {
+        s_log(G_WARNING, "%s could not build a %s pattern for thread %u.\n",
+                         mem->shopts.label,
+                         get_pattern_label(mem->pattern.type), t);
+        memteam_stop(team);
+        return -1;
+      }
+      thr->use_ring = 1;
+    }
+
+    /*
+     * Reads and writes are done in runs, shortened as much as the
+     *   ratio allows (3/6 becomes one read, then two writes) and
+     *   then stretched to fill a batch.  We start at the end of a
+     *   write run, so the first run is reads.
+     */
+    {
+      uint64_t g;
+      uint64_t scale;
+
+      g = memthread_gcd(mem->rwmix.numrds, mem->rwmix.numwrs);
+      if(!g)
+        g = 1;
+      thr->mix_len[C_IOREAD]  = mem->rwmix.numrds / g;
+      thr->mix_len[C_IOWRITE] = mem->rwmix.numwrs / g;
+
       /*
-       * Generate a random block address
+       * Stretch short runs out to a batch so the kernels don't
+       *   get called for one or two blocks at a time.
        */
-      l_currpos = (long)RandInt(mem->nwblks - 1);
-      l_stride_left = mem->stride;
+      scale = MEM_BATCH_BLKS
+              / (thr->mix_len[C_IOREAD] + thr->mix_len[C_IOWRITE]);
+      if(scale > 1) {
+        thr->mix_len[C_IOREAD]  *= scale;
+        thr->mix_len[C_IOWRITE] *= scale;
+      }
+      thr->mix_dir  = C_IOWRITE;
+      thr->mix_left = 0;
     }
-    else {
-      l_currpos++;
-      if(l_currpos == mem->nwblks)
-        l_currpos = 0;
+
+    mem->tstats[t].cpu = -1;
+  }
+
+  /*
+   * Don't count the helpers until they're all running; the last
+   *   thing we want is memwork() waiting on threads that never started.
+   */
+  team->nthreads = 1;
+  for(t = 1;t < nthreads;t++) {
+    rc = pthread_create(&team->thr[t].tid, (pthread_attr_t *)NULL,
+                        memhelper, (void *)&team->thr[t]);
+    if(rc) {
+      s_log(G_WARNING, "%s could not create thread %u: %s.\n",
+                       mem->shopts.label, t, strerror(rc));
+      (void)pthread_mutex_lock(&team->lock);
+      team->busy -= (nthreads - t);
+      (void)pthread_mutex_unlock(&team->lock);
+      memteam_stop(team);
+      return -1;
     }
+    team->nthreads++;
+  }
+
+  memthread_pin(&team->thr[0]);
+  memthread_touch(&team->thr[0]);
 
+  (void)pthread_mutex_lock(&team->lock);
+  while(team->busy) {
+    (void)pthread_cond_wait(&team->done_cond, &team->lock);
+  }
+  (void)pthread_mutex_unlock(&team->lock);
+
+  s_log(G_DEBUG, "%s touched %llu blocks with %u threads.\n",
+                 mem->shopts.label, (unsigned long long)mem->ntblks,
+                 team->nthreads);
+
+  return 0;
+}
+
+/*
+ * Tell the helper threads to exit and wait for them.
+ */
+static void memteam_stop(mem_team *team)
+{
+  uint32_t t;
+
+  if(!team)
+    return;
+
+  if(!team->nthreads) {
     /*
-     * Mask the 8 lowest bits and write to memory.
+     * We may have built some rings before giving up on starting.
      */
-    buf[l_currpos * mem->blksize] = (char)(l_currpos & 0xff);
-    mem->total_memio += mem->blksize;
-    target_blocks--;
+    for(t = 0;t < MAX_MEM_THREADS;t++) {
+      pattern_ring_free(&team->thr[t].ring);
+    }
+    return;
+  }
 
-    if(l_stride_left > 0)
-      l_stride_left--;
+  (void)pthread_mutex_lock(&team->lock);
+  team->exiting = 1;
+  (void)pthread_cond_broadcast(&team->go_cond);
+  (void)pthread_mutex_unlock(&team->lock);
 
-    if(l_target_memio > 0) {
-      l_target_memio--;
-      if(!l_target_memio) {
-        mem->shopts.exiting = 1;
-        break;
-      }
+  for(t = 1;t < team->nthreads;t++) {
+    (void)pthread_join(team->thr[t].tid, NULL);
+  }
+  for(t = 0;t < MAX_MEM_THREADS;t++) {
+    pattern_ring_free(&team->thr[t].ring);
+  }
+  team->nthreads = 0;
+}
+
+/*
+ * Main loop for the helper threads.
+ */
+static void* memhelper(void *arg)
+{
+  uint64_t last_epoch;
+  mem_team *team;
+  mem_thread *thr;
+
+  if(!arg)
+    return NULL;
+
+  thr  = (mem_thread *)arg;
+  team = (mem_team *)thr->team;
+
+  memthread_pin(thr);
+  memthread_touch(thr);
+
+  (void)pthread_mutex_lock(&team->lock);
+  last_epoch = team->epoch;
+  team->busy--;
+  if(!team->busy) {
+    (void)pthread_cond_signal(&team->done_cond);
+  }
+
+  while(1) {
+    while(!team->exiting && (team->epoch == last_epoch)) {
+      (void)pthread_cond_wait(&team->go_cond, &team->lock);
+    }
+    if(team->exiting)
+      break;
+
+    last_epoch = team->epoch;
+    (void)pthread_mutex_unlock(&team->lock);
+
+    memthread_work(thr);
+
+    (void)pthread_mutex_lock(&team->lock);
+    team->busy--;
+    if(!team->busy) {
+      (void)pthread_cond_signal(&team->done_cond);
     }
   }
+  (void)pthread_mutex_unlock(&team->lock);
 
-  l_curr_blocks -= (uint64_t)l_curr_blocks;
+  return NULL;
+}
+
+/*
+ * Pin a team thread to a CPU, if there's more than one of us.
+ *   We spread the threads over the CPUs we were allowed to use when
+ *   the worker started.  A lone thread gets all of them back.
+ */
+static void memthread_pin(mem_thread *thr)
+{
+#ifdef __linux__
+  int cpu;
+  int ncpus;
+  int nth;
+  mem_opts *mem;
+  mem_team *team;
+  cpu_set_t cset;
+
+  if(!thr)
+    return;
+
+  mem  = thr->mem;
+  team = (mem_team *)thr->team;
+
+  ncpus = CPU_COUNT(&team->allowed);
+  if(!ncpus)
+    return;
+
+  if(mem->nthreads <= 1) {
+    (void)pthread_setaffinity_np(pthread_self(), sizeof(team->allowed),
+                                 &team->allowed);
+    return;
+  }
 
   /*
-   * Now copy the local variables back out to the calling variables.
+   * Find the (tidx % ncpus)'th allowed CPU.
    */
-  *currpos      = l_currpos;
-  *curr_blocks  = l_curr_blocks;
-  *stride_left  = l_stride_left;
-  *target_memio = l_target_memio;
+  nth = (int)(thr->tidx % ncpus);
+  for(cpu = 0;cpu < CPU_SETSIZE;cpu++) {
+    if(CPU_ISSET(cpu, &team->allowed)) {
+      if(!nth)
+        break;
+      nth--;
+    }
+  }
+  if(cpu == CPU_SETSIZE)
+    return;
+
+  CPU_ZERO(&cset);
+  CPU_SET(cpu, &cset);
+  if(pthread_setaffinity_np(pthread_self(), sizeof(cset), &cset)) {
+    s_log(G_WARNING, "%s could not pin thread %u to CPU %d.\n",
+                     mem->shopts.label, thr->tidx, cpu);
+    return;
+  }
+  mem->tstats[thr->tidx].cpu = cpu;
+#endif
+}
 
-  if(mem->shopts.exiting)
+/*
+ * Touch every block in a thread's slice of the allocation.
+ */
+static void memthread_touch(mem_thread *thr)
+{
+  uint64_t i;
+  uint64_t blksize;
+
+  if(!thr)
+    return;
+
+  blksize = thr->mem->blksize;
+  for(i = 0;i < thr->ntblks;i++) {
+    thr->tbuf[i * blksize] = (char)(0xff & i);
+  }
+}
+
+/*
+ * Touch this thread's share of the blocks for the epoch.
+ *   The read/write decision is made once per run, not per access;
+ *   the kernels below never look at the mix.
+ */
+static void memthread_work(mem_thread *thr)
+{
+  uint64_t run;
+  uint64_t target_blocks;
+  mem_thread_stats *tstats;
+
+  if(!thr)
+    return;
+
+  tstats        = &thr->mem->tstats[thr->tidx];
+  target_blocks = thr->target_blocks;
+
+  while(target_blocks) {
+    if(!thr->mix_left) {
+      thr->mix_dir  = (thr->mix_dir == C_IOREAD) ? C_IOWRITE : C_IOREAD;
+      thr->mix_left = thr->mix_len[thr->mix_dir];
+      continue;
+    }
+
+    run = thr->mix_left;
+    if(run > target_blocks)
+      run = target_blocks;
+
+    if(thr->mix_dir == C_IOREAD)
+      memthread_read(thr, run);
+    else
+      memthread_write(thr, run);
+
+    tstats->memio[thr->mix_dir] += run * thr->mem->blksize;
+    thr->mix_left -= run;
+    target_blocks -= run;
+  }
+}
+
+/*
+ * Read the first byte of the next 'nblks' blocks.
+ */
+static void memthread_read(mem_thread *thr, uint64_t nblks)
+{
+  char *wbuf;
+  int64_t l_stride_left;
+  uint64_t l_currpos;
+  uint64_t blksize;
+  uint64_t run;
+  uint32_t sum;
+
+  wbuf          = thr->wbuf;
+  blksize       = thr->mem->blksize;
+  l_currpos     = thr->currpos;
+  l_stride_left = thr->stride_left;
+  sum           = 0;
+
+  if(thr->use_ring) {
+    thr->sink += memkernel_ring_read(wbuf, &thr->ring, nblks);
+    return;
+  }
+
+  while(nblks) {
+    run  = memthread_segment(thr, nblks, &l_currpos, &l_stride_left);
+    sum += memkernel_read(wbuf + (l_currpos * blksize), run, blksize);
+    memthread_advance(thr, run, &l_currpos, &l_stride_left);
+    nblks -= run;
+  }
+
+  thr->sink       += sum;
+  thr->currpos     = l_currpos;
+  thr->stride_left = l_stride_left;
+}
+
+/*
+ * Write the first byte of the next 'nblks' blocks.  The value
+ *   written is the low 8 bits of the block number.
+ */
+static void memthread_write(mem_thread *thr, uint64_t nblks)
+{
+  char *wbuf;
+  int64_t l_stride_left;
+  uint64_t l_currpos;
+  uint64_t blksize;
+  uint64_t run;
+
+  wbuf          = thr->wbuf;
+  blksize       = thr->mem->blksize;
+  l_currpos     = thr->currpos;
+  l_stride_left = thr->stride_left;
+
+  if(thr->use_ring) {
+    memkernel_ring_write(wbuf, &thr->ring, nblks, (uint8_t)thr->ring.pos);
+    return;
+  }
+
+  while(nblks) {
+    run = memthread_segment(thr, nblks, &l_currpos, &l_stride_left);
+    memkernel_write(wbuf + (l_currpos * blksize), run, blksize,
+                    (uint8_t)l_currpos);
+    memthread_advance(thr, run, &l_currpos, &l_stride_left);
+    nblks -= run;
+  }
+
+  thr->currpos     = l_currpos;
+  thr->stride_left = l_stride_left;
+}
+
+/*
+ * Make one pass over a buffer with the write kernel.  This is
+ *   used to benchmark how fast a single thread can touch memory.
+ */
+uint64_t memwork_bench(char *buf, uint64_t nblks, uint64_t blksize)
+{
+  if(!buf || !blksize)
     return 0;
-  else
-    return 1;
+
+  memkernel_write(buf, nblks, blksize, 0);
+
+  return nblks;
 }
@@ -12,10 +12,18 @@
 #ifndef GAMUT_MEMWORKER_H
 #define GAMUT_MEMWORKER_H
 
+#include <netdb.h>  /* for uint64_t */
+
 /*
  * Allocate memory of a given size, then cycle through the working
  *   set size, touching each page to force it back into memory.
  */
 extern void* memworker(void *opts);
 
+/*
+ * Make one pass over a buffer with the write kernel.  This is
+ *   used to benchmark how fast a single thread can touch memory.
+ */
+extern uint64_t memwork_bench(char *buf, uint64_t nblks, uint64_t blksize);
+
 #endif /* GAMUT_MEMWORKER_H */
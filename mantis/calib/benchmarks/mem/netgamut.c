@@ -12,6 +12,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,6 +25,7 @@
 #include <sys/types.h>
 
 #include "calibrate.h"
+#include "cmdserver.h"
 #include "constants.h"
 #include "input.h"
 #include "mainctl.h"
@@ -36,10 +38,10 @@
 #include "workerlib.h"
 #include "workeropts.h"
 
-#define NETGAMUT_PORT 5623
 #define NETGAMUT_FILE "/tmp/netgamut.err"
 
 static void get_servsock(growArray *s_arr);
+static void get_unix_servsock(growArray *s_arr, const char *path);
 
 int main(int argc, char *argv[])
 {
@@ -47,6 +49,8 @@ int main(int argc, char *argv[])
   gamut_opts opts;
   growArray *sockets;
 
+  signal(SIGPIPE, SIG_IGN);
+
   memset(&opts, 0, sizeof(opts));
 
   sockets = NULL;
@@ -138,22 +142,40 @@ int main(int argc, char *argv[])
     s_log(G_NOTICE, "done.\n");
   }
 
+  /*
+   * The TSC rate is never saved; it only takes a moment to find.
+   */
+  calibrate_tsc();
+
+  /*
+   * 8. Accept commands from the network until someone says "shutdown"
+   */
   get_servsock(sockets);
+  if(strlen(server_path))
+    get_unix_servsock(sockets, server_path);
 
   init_opts(&opts);
   start_reaper(&opts);
-  start_input(&opts);
+  start_server(&opts, sockets);
 
-  stop_input(&opts);
+  execute_gamut(&opts);
+
+  stop_server(&opts);
   killall_workers(&opts);
   stop_reaper(&opts);
 
+  if(strlen(server_path))
+    (void)unlink(server_path);
+  del_socket_arr(&sockets);
+
   return 0;
 }
 
 void get_servsock(growArray *s_arr)
 {
+  char *host;
   uint16_t port;
+  uint32_t addr;
   int rc;
   int servsock;
  
@@ -162,10 +184,20 @@ void get_servsock(growArray *s_arr)
     exit(EXIT_FAILURE);
   }
 
-  port = NETGAMUT_PORT; 
-  servsock = get_server_sock(port);
+  /*
+   * Anyone who can reach this socket can run workers, so it's only
+   *   on loopback unless we're told otherwise.
+   */
+  host = strlen(server_addr) ? server_addr : NETGAMUT_ADDR;
+  if(host_lookup(host, &addr) < 0) {
+    s_log(G_EMERG, "Unable to look up address \"%s\".\n", host);
+    exit(EXIT_FAILURE);
+  }
+
+  port = server_port ? (uint16_t)server_port : NETGAMUT_PORT;
+  servsock = get_server_sock(addr, port);
   if(servsock < 0) {
-    s_log(G_EMERG, "Unable to get server socket on port %hd.\n", port);
+    s_log(G_EMERG, "Unable to get server socket on %s:%hu.\n", host, port);
     exit(EXIT_FAILURE);
   }
  
@@ -177,4 +209,30 @@ void get_servsock(growArray *s_arr)
  
   /* This socket is ready to accept connections */
   ((sockinfo *)(s_arr->dat))[0].state = XFER_MODE;
+  s_log(G_NOTICE, "Serving commands on %s:%hu.\n", host, port);
+}
+
+/*
+ * The same, on a Unix socket, for controllers on this machine.
+ */
+void get_unix_servsock(growArray *s_arr, const char *path)
+{
+  int rc;
+  int servsock;
+
+  servsock = get_unix_server_sock(path);
+  if(servsock < 0) {
+    s_log(G_EMERG, "Unable to get server socket at \"%s\": %s.\n",
+                   path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  rc = add_socket(s_arr, servsock, AF_UNIX);
+  if(rc < 0) {
+    s_log(G_EMERG, "Unable to add socket %d to sockets array.\n", servsock);
+    exit(EXIT_FAILURE);
+  }
+
+  (void)activate_socket(s_arr, servsock);
+  s_log(G_NOTICE, "Serving commands on \"%s\".\n", path);
 }
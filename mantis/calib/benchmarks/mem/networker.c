@@ -10,8 +10,11 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define _GNU_SOURCE    /* For accept4() */
+
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,45 +22,150 @@
 #include <unistd.h>
 
 #include <arpa/inet.h>
+#ifdef __linux__
+#include <linux/errqueue.h> /* SO_EE_ORIGIN_ZEROCOPY */
+#endif
 #include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
 
 #include "calibrate.h"
 #include "constants.h"
 #include "linklib.h"
 #include "networker.h"
+#include "pattern.h"
 #include "utillog.h"
+#include "utilrand.h"
 #include "workerctl.h"
 #include "workerlib.h"
 #include "workeropts.h"
 #include "workersync.h"
 
+#define NIO_LISTEN_TAG 0xffffffffU /* epoll tag of the listening socket */
+#define NIO_SPARE_FDS  64          /* Descriptors to leave for the rest */
+#define NIO_SINK_PKTS  1e9         /* A local sink's "no limit" per epoch */
+#define NIO_QDISC_FILE "/proc/sys/net/core/default_qdisc"
+#define NIO_UDP_HDRS   28          /* IPv4 and UDP headers */
+
 /*
- * Do the work for this epoch.
+ * tx=zerocopy needs headers from Linux 4.14 or later; the option
+ *   parser refuses it without them, so the flag is never used.
  */
-static int network(gamut_opts *gopts, nio_opts *nio, int sock,
-                   char *buf, int64_t *target_netio,
-                   double pkts_per_epoch, double *curr_pkts);
+#if defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define HAVE_ZEROCOPY
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0
+#endif
+
+/*
+ * One socket.  Readiness is edge-triggered, so 'ready' stays set
+ *   until a call on the socket comes back with EAGAIN.
+ */
+typedef struct {
+  int      fd;
+  int      ready;   /* May have room (send) or data (recv) */
+  uint32_t done;    /* Packets moved this epoch */
+  uint32_t partial; /* Bytes of the current packet moved so far */
+  int64_t  usec;    /* Time spent on the current packet */
+  uint64_t foff;    /* Where in the tx file the current packet starts */
+  int      pipe[2]; /* tx=splice: file to pipe to socket */
+  uint32_t piped;   /* tx=splice: bytes sitting in the pipe */
+} nio_conn;
+
+/*
+ * Every socket a worker holds, and the epoll set watching them.
+ */
+typedef struct {
+  int       ep;
+  int       lsock;    /* Listening socket (TCP readers), or -1 */
+  uint32_t  events;   /* What we wait for on each socket */
+  uint32_t  nconns;   /* Sockets in use */
+  uint32_t  accepted; /* Connections accepted so far (TCP readers) */
+  nio_conn *conn;     /* Room for nio->conns of them */
+  int       txfd;     /* tx=sendfile or splice: the file sent from */
+  uint64_t  txsize;
+  uint64_t  txoff;    /* Where the next packet starts in it */
+  struct mmsghdr     *msgs;  /* batch > 1, gso or gro: one per message */
+  struct iovec       *iov;
+  struct sockaddr_in *names; /* Who sent each one (readers) */
+  char               *ctl;   /* Room for each one's UDP_GRO size */
+  uint32_t  segs;     /* Packets per message (GSO), otherwise 1 */
+} nio_conns;
 
-static int get_socket(nio_opts *nio);
+/*
+ * The other end of a worker with 'peer=local': a thread in this
+ *   process that drains what a writer sends, or feeds a reader.
+ */
+typedef struct {
+  gamut_opts *gopts;
+  nio_opts    nio;      /* The worker's options, turned around */
+  nio_conns   nc;
+  pthread_t   tid;
+  int         running;
+} nio_peer;
 
-static int do_dataio(int sock, char *buf, nio_opts *nio);
-static int send_data(int sock, char *buf, nio_opts *nio);
-static int recv_data(int sock, char *buf, nio_opts *nio);
+/*
+ * Do the work for this epoch.
+ */
+static int network(gamut_opts *gopts, nio_opts *nio, nio_conns *nc,
+                   char *buf, int64_t *target_netio,
+                   double pkts_per_epoch, double *curr_pkts,
+                   uint64_t deadline);
+
+static int open_conns(nio_opts *nio, nio_conns *nc);
+static void close_conns(nio_conns *nc);
+static int add_conn(nio_conns *nc, int fd);
+static void drop_conn(nio_conns *nc, uint32_t idx);
+static int wait_connects(nio_opts *nio, nio_conns *nc);
+static int accept_conns(nio_opts *nio, nio_conns *nc);
+static int raise_fd_limit(nio_opts *nio);
+
+static int tx_file_open(nio_opts *nio, nio_conns *nc);
+static int conn_setup(nio_opts *nio, nio_conn *c);
+static int batch_open(nio_opts *nio, nio_conns *nc);
+static uint32_t nio_buf_size(nio_opts *nio);
+static ssize_t tx_send(nio_opts *nio, nio_conns *nc, nio_conn *c,
+                       char *buf);
+static void zc_reap(nio_opts *nio, nio_conn *c);
+static void update_cpu(nio_opts *nio, struct rusage *base);
+static char* get_tx_label(uint16_t tx);
+static uint16_t pace_pick(nio_opts *nio);
+static void ts_add(struct timespec *ts, uint64_t nsec);
+static int ts_passed(struct timespec *ts, struct timespec *now);
+
+static int start_peer(gamut_opts *gopts, nio_opts *nio, nio_peer *peer);
+static void stop_peer(nio_peer *peer);
+static void* run_peer(void *arg);
+
+static int conn_io(nio_opts *nio, nio_conns *nc, nio_conn *c, char *buf,
+                   uint32_t share, uint64_t *budget,
+                   int64_t *target_netio);
+static int conn_io_batch(nio_opts *nio, nio_conns *nc, nio_conn *c,
+                         char *buf, uint32_t share, uint64_t *budget,
+                         int64_t *target_netio);
+static void count_pkts(nio_opts *nio, uint32_t npkts,
+                       uint64_t *budget, int64_t *target_netio);
 
 static void print_iostats(int64_t total_usec, nio_opts *nio, char *tag);
 
 /*
- * Establish a socket to do a certain number of I/Os per second.
+ * Hold 'conns' sockets and do a certain number of I/Os per second
+ *   over them.
  */
 void* networker(void *opts)
 {
   char *buf;
   int rc;
-  int sock;
   int nio_index;
   int32_t target_epochs;
   int64_t link_waittime;
@@ -68,7 +176,10 @@ void* networker(void *opts)
   double curr_epochs;
   double pkts_per_epoch;
   nio_opts *nio;
+  nio_conns nc;
+  nio_peer peer;
   gamut_opts *gopts;
+  struct rusage cpu_base;
   struct timeval start;
   struct timeval finish;
   struct timeval finish_time;
@@ -101,16 +212,34 @@ void* networker(void *opts)
   nio->netio_bytes[C_IOWRITE]  = 0;
   nio->io_usec[C_IOREAD]       = 0;
   nio->io_usec[C_IOWRITE]      = 0;
+  lat_hist_reset(&nio->io_lat[C_IOREAD]);
+  lat_hist_reset(&nio->io_lat[C_IOWRITE]);
   nio->shopts.missed_deadlines = 0;
   nio->shopts.missed_usecs     = 0;
   nio->shopts.total_deadlines  = 0;
+  nio->live_conns              = 0;
+  nio->conns_closed            = 0;
+  nio->cpu_usec[0]             = 0;
+  nio->cpu_usec[1]             = 0;
+  nio->zc_sends                = 0;
+  nio->zc_done                 = 0;
+  nio->zc_copied               = 0;
+  nio->batches[C_IOREAD]       = 0;
+  nio->batches[C_IOWRITE]      = 0;
+  nio->pace_waits              = 0;
+  (void)getrusage(RUSAGE_THREAD, &cpu_base);
 
   buf           = NULL;
-  sock          = -1;
   link_waittime = 0;
+  memset(&nc, 0, sizeof(nc));
+  nc.ep         = -1;
+  nc.lsock      = -1;
+  nc.txfd       = -1;
+  memset(&peer, 0, sizeof(peer));
 restart:
   (void)gettimeofday(&nio->shopts.mod_time, NULL);
-  test_and_close(sock);
+  stop_peer(&peer);
+  close_conns(&nc);
   nio->shopts.dirty = 0;
 
   target_netio      = 0;
@@ -156,7 +285,7 @@ restart:
    *   like malloc) and when we're here because of a 'dirty'
    *   tag (buf will not be NULL, but realloc works anyway).
    */
-  buf = (char *)realloc(buf, nio->pktsize);
+  buf = (char *)realloc(buf, nio_buf_size(nio));
   if(!buf) {
     s_log(G_WARNING, "%s could not allocate buffer: %s\n",
                      nio->shopts.label, strerror(errno));
@@ -170,8 +299,9 @@ restart:
   pkts_per_epoch  = (float)nio->iorate / nio->pktsize;
   pkts_per_epoch /= WORKER_EPOCHS_PER_SEC;
 
-  s_log(G_DEBUG, "%s net I/O rate of %.4f packets/epoch.\n",
-                 nio->shopts.label, pkts_per_epoch);
+  s_log(G_DEBUG, "%s net I/O rate of %.4f packets/epoch over %u "
+                 "sockets.\n", nio->shopts.label, pkts_per_epoch,
+                 nio->conns);
 
   /*
    * Calculate the total number of network I/O operations
@@ -212,19 +342,46 @@ restart:
     target_epochs = -1;
   }
 
+  nio->paced = (nio->pace == NIO_PACE_AUTO) ? pace_pick(nio) : nio->pace;
+  if(nio->pace != NIO_PACE_NONE) {
+    s_log(G_DEBUG, "%s paces with pace=%s, burst %u.\n", nio->shopts.label,
+                   (nio->paced == NIO_PACE_KERNEL) ? "kernel" : "user",
+                   nio->burst);
+  }
+
   /*
    * Now that we've done everything necessary on our side,
-   *   get the remote end.
+   *   get the remote end.  A local peer has to be listening before
+   *   a writer connects, and can't connect until a reader listens.
    */
-  sock = get_socket(nio);
-  if(sock < 0) {
+  if((nio->peer == NIO_PEER_LOCAL) && (nio->mode == O_WRONLY)
+     && (start_peer(gopts, nio, &peer) < 0))
+  {
+    goto clean_out;
+  }
+  if(open_conns(nio, &nc) < 0) {
+    goto clean_out;
+  }
+  if((nio->peer == NIO_PEER_LOCAL) && (nio->mode != O_WRONLY)
+     && (start_peer(gopts, nio, &peer) < 0))
+  {
     goto clean_out;
   }
 
   /*
-   * We've got the socket; start doing I/O at the correct intervals.
-   *   Just send data for now.  Perhaps later we'll set up a
-   *   listening daemon.
+   * Thousands of connects can take a while; don't count that
+   *   against the first few deadlines.
+   */
+  {
+    struct timeval tv;
+
+    (void)gettimeofday(&tv, NULL);
+    next_deadline  = tv.tv_usec;
+    next_deadline += tv.tv_sec * US_SEC;
+  }
+
+  /*
+   * We've got the sockets; start doing I/O at the correct intervals.
    *
    * Each time through, perform these operations in this order:
    * 1. Calculate the next deadline
@@ -244,8 +401,8 @@ restart:
       next_deadline += US_PER_WORKER_EPOCH;
 
       /* Step 2 */
-      rc = network(gopts, nio, sock, buf, &target_netio,
-                   pkts_per_epoch, &curr_pkts);
+      rc = network(gopts, nio, &nc, buf, &target_netio,
+                   pkts_per_epoch, &curr_pkts, next_deadline);
       if(rc < 0) {
         s_log(G_WARNING, "Error doing network.  Exiting.\n");
         nio->shopts.exiting = 1;
@@ -262,8 +419,8 @@ restart:
         next_deadline += US_PER_WORKER_EPOCH;
 
         /* Step 2 */
-        rc = network(gopts, nio, sock, buf, &target_netio,
-                     pkts_per_epoch, &curr_pkts);
+        rc = network(gopts, nio, &nc, buf, &target_netio,
+                     pkts_per_epoch, &curr_pkts, next_deadline);
         if(rc < 0) {
           s_log(G_WARNING, "Error doing network.  Exiting.\n");
           nio->shopts.exiting = 1;
@@ -313,6 +470,7 @@ restart:
     }
 
     /* Step 4 */
+    update_cpu(nio, &cpu_base);
     (void)gettimeofday(&now, NULL);
 
     if(!finish_time.tv_sec
@@ -365,6 +523,14 @@ restart:
   }
 
   (void)gettimeofday(&finish, NULL);
+  update_cpu(nio, &cpu_base);
+  if(nio->tx == NIO_TX_ZEROCOPY) {
+    uint32_t j;
+
+    for(j = 0;j < nc.nconns;j++) {
+      zc_reap(nio, &nc.conn[j]);
+    }
+  }
 
   rc = lock_stats(gopts);
   if(rc < 0) {
@@ -374,8 +540,9 @@ restart:
   (void)unlock_stats(gopts);
 
 clean_out:
-  if(sock >= 0)
-    close(sock);
+  stop_peer(&peer);
+  close_conns(&nc);
+  nio->live_conns = 0;
   if(buf)
     free(buf);
 
@@ -420,17 +587,42 @@ clean_out:
 
 /*
  * Do the work for this epoch.
+ *
+ * Each socket gets an even share of the epoch's packets, so one
+ *   fast connection can't starve the rest.  Once every socket that
+ *   can still move data has had its share, what's left of the budget
+ *   is split among those.  We give up on the rest of the budget when
+ *   there's no longer time to sleep before the deadline.
+ *
+ * With pace=user the budget is let out 'burst' packets at a time,
+ *   spread evenly up to the deadline.  A burst that comes due while
+ *   we're late goes out with the one before it, so the rate holds.
  */
-static int network(gamut_opts *gopts, nio_opts *nio, int sock,
+static int network(gamut_opts *gopts, nio_opts *nio, nio_conns *nc,
                    char *buf, int64_t *target_netio,
-                   double pkts_per_epoch, double *curr_pkts)
+                   double pkts_per_epoch, double *curr_pkts,
+                   uint64_t deadline)
 {
+  int      i;
   int      rc;
+  int      nev;
+  int      timeout;
+  uint32_t j;
+  uint32_t share;
+  uint32_t nfull;
   int64_t  l_target_netio;
-  uint64_t target_pkts;
+  uint64_t budget;
+  uint64_t end;
+  uint64_t now;
+  uint64_t held;
+  uint64_t gap;
   double   l_curr_pkts;
+  struct timeval tv;
+  struct timespec next;
+  struct timespec mono;
+  struct epoll_event ev[NIO_EVENTS];
 
-  if(!gopts || !nio || (sock < 0) || !buf || !target_netio
+  if(!gopts || !nio || !nc || (nc->ep < 0) || !buf || !target_netio
      || (pkts_per_epoch < 0) || !curr_pkts
     )
   {
@@ -441,35 +633,153 @@ static int network(gamut_opts *gopts, nio_opts *nio, int sock,
   l_target_netio = *target_netio;
 
   l_curr_pkts += pkts_per_epoch;
-  target_pkts  = (uint64_t)l_curr_pkts;
+  budget       = (uint64_t)l_curr_pkts;
+  l_curr_pkts -= (uint64_t)l_curr_pkts;
 
-  while(target_pkts) {
-    rc = do_dataio(sock, buf, nio);
-    if(rc < 0) {  /* Error */
-      s_log(G_WARNING, "%s: Error in network I/O.\n",
-                       nio->shopts.label);
-      break;
+  for(j = 0;j < nc->nconns;j++) {
+    nc->conn[j].done = 0;
+  }
+
+  share   = 0;
+  end     = deadline - MIN_SLEEP_US;
+  timeout = 0;
+
+  held = 0;
+  gap  = 0;
+  if((nio->paced == NIO_PACE_USER) && (budget > nio->burst)) {
+    (void)gettimeofday(&tv, NULL);
+    now = (uint64_t)tv.tv_sec * US_SEC + tv.tv_usec;
+    if(end > now) {
+      gap    = (end - now) * 1000 / ((budget + nio->burst - 1) / nio->burst);
+      held   = budget - nio->burst;
+      budget = nio->burst;
+      (void)clock_gettime(CLOCK_MONOTONIC, &next);
+      ts_add(&next, gap);
     }
-    else if(!rc) { /* Remote end closed (TCP only) */
-      s_log(G_WARNING, "%s: TCP connection closed.\n",
-                       nio->shopts.label);
-      break;
+  }
+
+  while((budget || held) && !nio->shopts.exiting) {
+    nev = epoll_wait(nc->ep, ev, NIO_EVENTS, timeout);
+    if(nev < 0) {
+      if(errno != EINTR) {
+        s_log(G_WARNING, "%s error waiting on its sockets: %s.\n",
+                         nio->shopts.label, strerror(errno));
+        return -1;
+      }
+      nev = 0;
     }
-    else {        /* Some I/O actually performed */
-      target_pkts--;
-      nio->total_netio += nio->pktsize;
 
-      if(l_target_netio > 0) {
-        target_netio--;
-        if(!target_netio) {
-          nio->shopts.exiting = 1;
-          break;
+    /* Let out every burst that has come due */
+    if(held) {
+      (void)clock_gettime(CLOCK_MONOTONIC, &mono);
+      if(ts_passed(&next, &mono)) {
+        while(held && ts_passed(&next, &mono)) {
+          j       = (held < nio->burst) ? (uint32_t)held : nio->burst;
+          budget += j;
+          held   -= j;
+          ts_add(&next, gap);
         }
+        for(j = 0;j < nc->nconns;j++) {
+          nc->conn[j].done = 0;
+        }
+        share = 0;
       }
-    }  /* END, Full packet */
-  }
+    }
 
-  l_curr_pkts -= (uint64_t)l_curr_pkts;
+    for(i = 0;i < nev;i++) {
+      if(ev[i].data.u32 == NIO_LISTEN_TAG) {
+        if(accept_conns(nio, nc) < 0)
+          return -1;
+      }
+      else if(ev[i].data.u32 < nc->nconns) {
+        nc->conn[ev[i].data.u32].ready = 1;
+        if((ev[i].events & EPOLLERR) && (nio->tx == NIO_TX_ZEROCOPY))
+          zc_reap(nio, &nc->conn[ev[i].data.u32]);
+      }
+    }
+
+    if(nc->nconns) {
+      if(!share)
+        share = (uint32_t)((budget + nc->nconns - 1) / nc->nconns);
+
+      nfull = 0;
+      for(j = 0;j < nc->nconns;) {
+        rc = conn_io(nio, nc, &nc->conn[j], buf, share, &budget,
+                     &l_target_netio);
+        if(rc <= 0) {
+          if(rc < 0) {
+            s_log(G_WARNING, "%s error on a connection: %s.\n",
+                             nio->shopts.label, strerror(errno));
+          }
+          nio->conns_closed++;
+          drop_conn(nc, j);
+          continue;
+        }
+
+        if(nc->conn[j].ready && (nc->conn[j].done >= share))
+          nfull++;
+        j++;
+      }
+      nio->live_conns = nc->nconns;
+
+      if(budget && nfull) {
+        share  += (uint32_t)((budget + nfull - 1) / nfull);
+        timeout = 0;
+        continue;
+      }
+    }
+
+    /*
+     * A writer with nothing left to write to is done; so is a
+     *   reader once everyone it was waiting for has come and gone.
+     */
+    if(!nc->nconns) {
+      if(nio->mode == O_WRONLY) {
+        s_log(G_WARNING, "%s has lost all its connections.\n",
+                         nio->shopts.label);
+        nio->shopts.exiting = 1;
+        break;
+      }
+      else if((nc->lsock >= 0) && (nc->accepted >= nio->conns)) {
+        s_log(G_NOTICE, "%s: every connection has closed.\n",
+                        nio->shopts.label);
+        nio->shopts.exiting = 1;
+        break;
+      }
+    }
+
+    (void)gettimeofday(&tv, NULL);
+    now = (uint64_t)tv.tv_sec * US_SEC + tv.tv_usec;
+    if(now >= end)
+      break;
+    timeout = (int)((end - now + 999) / 1000);
+
+    /*
+     * Between bursts, sleep to the next one if there's nothing to
+     *   do, or wait on the sockets no longer than that if there is.
+     */
+    if(held) {
+      (void)clock_gettime(CLOCK_MONOTONIC, &mono);
+      if(!budget) {
+        if(!ts_passed(&next, &mono)) {
+          (void)clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+          nio->pace_waits++;
+        }
+        timeout = 0;
+      }
+      else if(!ts_passed(&next, &mono)) {
+        int64_t wait;
+
+        wait = (int64_t)(next.tv_sec - mono.tv_sec) * 1000
+               + (next.tv_nsec / 1000000) - (mono.tv_nsec / 1000000) + 1;
+        if(wait < timeout)
+          timeout = (int)wait;
+      }
+      else {
+        timeout = 0;
+      }
+    }
+  }
 
   /*
    * Copy all local variables back.
@@ -480,484 +790,1281 @@ static int network(gamut_opts *gopts, nio_opts *nio, int sock,
   if(nio->shopts.exiting) {
     return 0;
   }
-  else if(target_pkts) {
-    /* We bailed out early.  There's a problem. */
-    return -1;
-  }
   else {
     return 1;
   }
 }
 
-
-
-static int get_socket(nio_opts *nio)
+/*
+ * Move packets on one socket until it would block, it has had its
+ *   share for this epoch, or the epoch's budget is spent.
+ * This function returns  1 if the socket is still good,
+ *                        0 if the other end closed it,
+ *                       -1 on error.
+ */
+static int conn_io(nio_opts *nio, nio_conns *nc, nio_conn *c, char *buf,
+                   uint32_t share, uint64_t *budget,
+                   int64_t *target_netio)
 {
-  int sock;
-  int socktype;
-
-  if(!nio) {
-    return -1;
-  }
-
-  sock = -1;
-
-  switch(nio->protocol) {
-    case IPPROTO_TCP:
-      socktype = SOCK_STREAM;
-      break;
-
-    case IPPROTO_UDP:
-      socktype = SOCK_DGRAM;
-      break;
-
-    default:
-      goto fail_out;
-  }
-
-  if((nio->mode != O_RDONLY) && (nio->mode != O_WRONLY)) {
-    goto fail_out;
-  }
+  int err;
+  int ioname;
+  ssize_t rc;
+  int64_t timediff;
+  struct timeval bt;
+  struct timeval ft;
 
-  /*
-   * Use the correct kind of protocol.
-   */
-  sock = socket(AF_INET, socktype, nio->protocol);
-  if(sock < 0) {
-    s_log(G_WARNING, "%s error getting socket.\n", nio->shopts.label);
-    goto fail_out;
-  }
+  if(nc->msgs)
+    return conn_io_batch(nio, nc, c, buf, share, budget, target_netio);
 
-  /*
-   * If the socket is write-only, then try to connect to the other end
-   *   if it's a TCP connection.
-   * Otherwise, the socket is read-only, and we need to wait for data.
-   *   If it's a TCP socket, listen and wait for data a connection.
-   */
-  if(nio->mode == O_WRONLY) {
-    int rc;
-    int flags;
+  ioname = (nio->mode == O_WRONLY) ? C_IOWRITE : C_IOREAD;
 
-    /*
-     * If this is a TCP socket, try to connect to the remote end.
-     */
-    if(socktype == SOCK_STREAM) {
-      int ecode;  /* potential error code for getsockopt */
-      fd_set conn;
-      socklen_t rlen;
-      socklen_t optlen;
-      struct timeval tv;
-      struct sockaddr_in remote;
+  while(c->ready && (c->done < share) && *budget) {
+    (void)gettimeofday(&bt, NULL);
+    if(ioname == C_IOWRITE) {
+      rc = tx_send(nio, nc, c, buf);
+    }
+    else if(nio->protocol == IPPROTO_TCP) {
+      rc = recv(c->fd, buf + c->partial, nio->pktsize - c->partial, 0);
+    }
+    else {
+      socklen_t slen;
+      struct sockaddr_in cdata;
 
       /*
-       * We will set the socket to be non-blocking, then try to connect
-       *   to the remote end with a CONN_WAIT-second delay.
+       * Datagrams from the wrong host, or of the wrong size, are
+       *   read and thrown away.
        */
-      flags = fcntl(sock, F_GETFL);
-      if(flags < 0) {
-        goto fail_out;
+      slen = sizeof(cdata);
+      memset(&cdata, 0, sizeof(cdata));
+      rc = recvfrom(c->fd, buf, nio->pktsize, 0,
+                    (struct sockaddr *)&cdata, &slen);
+      if((rc >= 0)
+         && ((rc != (ssize_t)nio->pktsize)
+             || ((nio->addr != INADDR_ANY)
+                 && (cdata.sin_addr.s_addr != nio->addr))))
+      {
+        continue;
       }
+    }
+    err = (rc < 0) ? errno : 0;
+    (void)gettimeofday(&ft, NULL);
+    s_log(G_DLOOP, "%s(%d, %p, %u) = %d (%d).\n",
+                   (ioname == C_IOWRITE) ? "send" : "recv", c->fd,
+                   buf, nio->pktsize - c->partial, (int)rc, err);
 
-      flags |= O_NONBLOCK;
-      rc     = fcntl(sock, F_SETFL, &flags);
-      if(rc < 0) {
-        goto fail_out;
+    if(rc < 0) {
+      if((err == EAGAIN) || (err == EWOULDBLOCK)) {
+        c->ready = 0;
+        break;
       }
-
-      memset(&remote, 0, sizeof(remote));
-
-      remote.sin_addr.s_addr = nio->addr;
-      remote.sin_port        = htons(nio->port);
-      remote.sin_family      = AF_INET;
-      rlen                   = sizeof(remote);
-
-      rc = connect(sock, (struct sockaddr *)&remote, rlen);
-      if(rc < 0) {
-        if(errno != EINPROGRESS) {
-          goto fail_out;
-        }
+      else if(err == EINTR) {
+        continue;
       }
-      else /* Success */
-        goto clean_out;
-
-      /*
-       * At this point we're waiting for the connection.  We need to
-       *   test the socket for writability, then check the error code.
-       */
-      FD_ZERO(&conn);
-      FD_SET(sock, &conn);
-
-      tv.tv_sec  = CONN_WAIT;
-      tv.tv_usec = 0;
-      rc = select(sock+1, (fd_set *)NULL, &conn, (fd_set *)NULL, &tv);
-      if(rc <= 0) {
-        goto fail_out;
+      else if((err == ENOBUFS) && (nio->tx == NIO_TX_ZEROCOPY)) {
+        /* Out of room to pin pages; collect what's finished */
+        zc_reap(nio, c);
+        c->ready = 0;
+        break;
       }
-
-      /* Writability on one socket.  But is it success? */
-      optlen = sizeof(ecode);
-      rc = getsockopt(sock, SOL_SOCKET, SO_ERROR, &ecode, &optlen);
-      if((rc < 0) || (ecode != 0)) {
-        goto fail_out;
+      else if((err == ECONNREFUSED)
+              && (nio->protocol == IPPROTO_UDP))
+      {
+        /* Nobody listening yet; try again next epoch */
+        break;
       }
+      else if((err == ECONNRESET) || (err == EPIPE)) {
+        return 0;
+      }
+      errno = err;
+      return -1;
     }
-
-    /*
-     * Regardless of what we did, clear any O_NONBLOCK flags.
-     */
-    flags = fcntl(sock, F_GETFL);
-    if(flags < 0) {
-      goto fail_out;
+    else if(!rc && (ioname == C_IOREAD)) {
+      return 0;
     }
 
-    flags &= ~O_NONBLOCK;
-    rc     = fcntl(sock, F_SETFL, flags);
-    if(rc < 0) {
-      goto fail_out;
-    }
-  }  /* End O_WRONLY */
-  else { /* O_RDONLY */
-    int rc;
-    int flags;
-    struct sockaddr_in my_addr;
+    c->usec    += calculate_timediff(&bt, &ft);
+    c->partial += (uint32_t)rc;
+    if(c->partial < nio->pktsize)
+      continue;
 
-    memset(&my_addr, 0, sizeof(my_addr));
-    my_addr.sin_family      = AF_INET;
-    my_addr.sin_port        = htons(nio->port);
-    my_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    timediff    = c->usec;
+    c->usec     = 0;
+    c->partial  = 0;
+    c->done++;
 
-    rc = bind(sock, (struct sockaddr *)&my_addr, sizeof(my_addr));
-    if(rc < 0) {
-      goto fail_out;
-    }
+    nio->io_usec[ioname] += timediff;
+    lat_hist_record(&nio->io_lat[ioname], (uint64_t)timediff);
+    count_pkts(nio, 1, budget, target_netio);
+  }
 
-    if(socktype == SOCK_STREAM) {
-      int newsock;
-      time_t timeout;
-      time_t currtime;
+  return 1;
+}
 
-      newsock = -1;
+/*
+ * conn_io() for UDP sockets that move up to 'batch' packets a call
+ *   with sendmmsg() or recvmmsg().  With GSO each message carries
+ *   several packets for the kernel (or the NIC) to split up; with
+ *   GRO the kernel may hand several back as one.  Latency and the
+ *   batch counters are per call.
+ */
+static int conn_io_batch(nio_opts *nio, nio_conns *nc, nio_conn *c,
+                         char *buf, uint32_t share, uint64_t *budget,
+                         int64_t *target_netio)
+{
+  int err;
+  int flags;
+  int ioname;
+  int rc;
+  int i;
+  int seg;
+  uint32_t want;
+  uint32_t left;
+  uint32_t nmsgs;
+  uint32_t npkts;
+  struct msghdr *mh;
+#ifdef UDP_GRO
+  struct cmsghdr *cm;
+#endif
+  struct timeval bt;
+  struct timeval ft;
 
-      rc = listen(sock, LISTEN_BACKLOG);
-      if(rc < 0) {
-        goto fail_out;
+  ioname = (nio->mode == O_WRONLY) ? C_IOWRITE : C_IOREAD;
+  flags  = MSG_NOSIGNAL | ((nio->tx == NIO_TX_ZEROCOPY) ? MSG_ZEROCOPY : 0);
+
+  while(c->ready && (c->done < share) && *budget) {
+    want = nio->batch;
+    if(want > (share - c->done))
+      want = share - c->done;
+    if(want > *budget)
+      want = (uint32_t)*budget;
+
+    /* Lay out this call's messages */
+    nmsgs = 0;
+    for(left = want;left;nmsgs++) {
+      mh = &nc->msgs[nmsgs].msg_hdr;
+      memset(mh, 0, sizeof(*mh));
+      mh->msg_iov    = &nc->iov[nmsgs];
+      mh->msg_iovlen = 1;
+      nc->iov[nmsgs].iov_base = buf;
+
+      if(ioname == C_IOWRITE) {
+        npkts = (left < nc->segs) ? left : nc->segs;
+        nc->iov[nmsgs].iov_len = (size_t)npkts * nio->pktsize;
+        left -= npkts;
       }
-
-      /*
-       * Set an absolute deadline for getting the correct connection.
-       *   This is to make sure we don't get a "bad" connection and
-       *   have to redo how long we're waiting.
-       */
-      currtime = time(NULL);
-      timeout  = currtime + CONN_WAIT + 1;
-      while(timeout > (currtime = time(NULL))) {
-        socklen_t slen;
-        struct sockaddr_in saddr;
-
-        slen = sizeof(saddr);
-        memset(&saddr, 0, sizeof(saddr));
-
-        newsock = accept(sock, (struct sockaddr *)&saddr, &slen);
-        if(newsock < 0) {
-          goto fail_out;
-        }
-
-        /*
-         * Did we hear from the right people?
-         */
-        if((nio->addr != INADDR_ANY)
-           && (saddr.sin_addr.s_addr != nio->addr)
-          )
-        {
-            /* Wrong person.  Try again */
-            continue;
+      else {
+        nc->iov[nmsgs].iov_len = nio_buf_size(nio);
+        mh->msg_name           = &nc->names[nmsgs];
+        mh->msg_namelen        = sizeof(nc->names[nmsgs]);
+        if(nio->gro) {
+          mh->msg_control    = nc->ctl + (nmsgs * CMSG_SPACE(sizeof(int)));
+          mh->msg_controllen = CMSG_SPACE(sizeof(int));
         }
-
-        /*
-         * Yep.  Now close the old socket and hand back the new socket.
-         */
-        (void)close(sock);
-        sock = newsock;
+        left--;
       }
     }
 
-    flags = fcntl(sock, F_GETFL);
-    if(flags < 0) {
-      goto fail_out;
-    }
+    (void)gettimeofday(&bt, NULL);
+    if(ioname == C_IOWRITE)
+      rc = sendmmsg(c->fd, nc->msgs, nmsgs, flags);
+    else
+      rc = recvmmsg(c->fd, nc->msgs, nmsgs, MSG_DONTWAIT, NULL);
+    err = (rc < 0) ? errno : 0;
+    (void)gettimeofday(&ft, NULL);
+    s_log(G_DLOOP, "%smmsg(%d, %u) = %d (%d).\n",
+                   (ioname == C_IOWRITE) ? "send" : "recv", c->fd,
+                   nmsgs, rc, err);
 
-    flags |= O_NONBLOCK;
-    s_log(G_DEBUG, "Setting mode on %d to %x.\n", sock, flags);
-    rc = fcntl(sock, F_SETFL, flags);
     if(rc < 0) {
-      goto fail_out;
+      if((err == EAGAIN) || (err == EWOULDBLOCK)) {
+        c->ready = 0;
+        break;
+      }
+      else if(err == EINTR) {
+        continue;
+      }
+      else if(err == ECONNREFUSED) {
+        /* Nobody listening yet; try again next epoch */
+        break;
+      }
+      else if((err == ENOBUFS) && (nio->tx == NIO_TX_ZEROCOPY)) {
+        zc_reap(nio, c);
+        c->ready = 0;
+        break;
+      }
+      errno = err;
+      return -1;
     }
-  } /* End O_RDONLY */
 
-  {
-    int flags;
+    /*
+     * Count whole packets.  A read from the wrong host, or that
+     *   isn't made of packets our size, is thrown away.
+     */
+    npkts = 0;
+    for(i = 0;i < rc;i++) {
+      if(ioname == C_IOWRITE) {
+        npkts += (uint32_t)(nc->iov[i].iov_len / nio->pktsize);
+        continue;
+      }
 
-    flags = fcntl(sock, F_GETFL);
-    s_log(G_DEBUG, "fcntl(%d, F_GETFL) = %x (%x).\n",
-                   sock, flags, (flags & O_NONBLOCK));
-  }
+      if((nio->addr != INADDR_ANY)
+         && (nc->names[i].sin_addr.s_addr != nio->addr))
+      {
+        continue;
+      }
 
-clean_out:
+      seg = (int)nc->msgs[i].msg_len;
+      mh  = &nc->msgs[i].msg_hdr;
+#ifdef UDP_GRO
+      for(cm = CMSG_FIRSTHDR(mh);nio->gro && cm;cm = CMSG_NXTHDR(mh, cm)) {
+        if((cm->cmsg_level == SOL_UDP) && (cm->cmsg_type == UDP_GRO))
+          memcpy(&seg, CMSG_DATA(cm), sizeof(seg));
+      }
+#endif
+      if(seg == (int)nio->pktsize)
+        npkts += nc->msgs[i].msg_len / nio->pktsize;
+    }
 
-  return sock;
+    if((ioname == C_IOWRITE) && (nio->tx == NIO_TX_ZEROCOPY))
+      nio->zc_sends += rc;
 
-fail_out:
-  if(sock >= 0)
-    (void)close(sock);
+    nio->batches[ioname]++;
+    nio->io_usec[ioname] += calculate_timediff(&bt, &ft);
+    lat_hist_record(&nio->io_lat[ioname],
+                    (uint64_t)calculate_timediff(&bt, &ft));
+    c->done += npkts;
+    count_pkts(nio, npkts, budget, target_netio);
+  }
 
-  return -1;
+  return 1;
 }
 
-static int do_dataio(int sock, char *buf, nio_opts *nio)
+/*
+ * Charge 'npkts' moved packets to the worker, the epoch's budget,
+ *   and the total the worker was asked to do.
+ */
+static void count_pkts(nio_opts *nio, uint32_t npkts,
+                       uint64_t *budget, int64_t *target_netio)
 {
-  int rc;
-  int frc;
+  int ioname;
 
-  if((sock < 0) || !buf || !nio)
-    return -1;
+  ioname = (nio->mode == O_WRONLY) ? C_IOWRITE : C_IOREAD;
 
-  frc = -1;
-  if(nio->mode == O_WRONLY) {
-    rc = send_data(sock, buf, nio);
-    s_log(G_DLOOP, "send_data(%d, %p, %p) = %d\n",
-                   sock, buf, (void *)nio, rc);
-    if(rc < 0) {
-      s_log(G_WARNING, "%s error sending data.\n", nio->shopts.label);
-      nio->shopts.exiting = 1;
-    }
-    else if((nio->protocol == IPPROTO_TCP) && !rc) {
-      s_log(G_WARNING, "%s remote end closed.\n", nio->shopts.label);
-      nio->shopts.exiting = 1;
-    }
-    else { /* Successful send */
-      frc = 1;
-    }
-  }
-  else {  /* mode == O_RDONLY */
-    rc = recv_data(sock, buf, nio);
-    s_log(G_DLOOP, "recv_data(%d, %p, %p) = %d\n",
-                   sock, buf, (void *)nio, rc);
-    if(rc < 0) {
-      if(rc != -EAGAIN) {
-        s_log(G_WARNING, "%s error getting data.\n", nio->shopts.label);
-        nio->shopts.exiting = 1;
-      }
-    }
-    else if((nio->protocol == IPPROTO_TCP) && !rc) {
-      s_log(G_WARNING, "%s remote end closed.\n", nio->shopts.label);
+  nio->netio_bytes[ioname] += npkts;
+  nio->total_netio         += (int64_t)npkts * nio->pktsize;
+  *budget -= (npkts < *budget) ? npkts : *budget;
+
+  if(*target_netio > 0) {
+    if(*target_netio <= (int64_t)npkts) {
+      *target_netio       = 0;
       nio->shopts.exiting = 1;
+      *budget             = 0;
     }
     else {
-      /*
-       * We'll allow UDP with no data to be a success (somehow?)
-       *   because we've done the bookkeeping correctly in the
-       *   lower-level functions.
-       */
-      frc = 1;
+      *target_netio -= npkts;
     }
   }
-
-  return frc;
 }
 
 /*
- * Wrapper for sending data.
- * This function returns <  0 on error,
- *                       >= 0 on success (the number of bytes sent).
+ * Writers open 'conns' sockets to the remote end.  TCP readers listen
+ *   and take connections as they come in; UDP readers bind 'conns'
+ *   sockets to the same port and let the kernel spread the flows.
  */
-static int send_data(int sock, char *buf, nio_opts *nio)
+static int open_conns(nio_opts *nio, nio_conns *nc)
 {
-  int rc;
-  int err;
-  int frc;
-  struct sockaddr_in cdata;  /* connection data */
-  socklen_t slen;
-  struct timeval bt;
-  struct timeval ft;
+  int fd;
+  int one;
+  int socktype;
+  uint32_t i;
+  struct sockaddr_in saddr;
+  struct epoll_event ev;
 
-  if((sock < 0) || !buf || !nio) {
+  if(!nio || !nc)
     return -1;
-  }
 
-  /*
-   * If the socket is a TCP stream, just use send().
-   * If the socket is a UDP stream, use sendto.
-   */
-  rc  = -1;
-  err = 0;
-  frc = -1;
-  memset(&cdata, 0, sizeof(cdata));
   switch(nio->protocol) {
     case IPPROTO_TCP:
-      (void)gettimeofday(&bt, NULL);
-      errno = 0;
-      rc    = send(sock, buf, (size_t)nio->pktsize, 0);
-      err   = errno;
-      (void)gettimeofday(&ft, NULL);
-      s_log(G_DLOOP, "send(%d, %p, %u, %u) = %d (%d).\n",
-                     sock, buf, nio->pktsize, 0, rc, err);
+      socktype = SOCK_STREAM;
       break;
 
     case IPPROTO_UDP:
-      cdata.sin_addr.s_addr = nio->addr;
-      cdata.sin_port        = htons(nio->port);
-      cdata.sin_family      = AF_INET;
-      slen                  = sizeof(cdata);
-
-      (void)gettimeofday(&bt, NULL);
-      errno = 0;
-      rc    = sendto(sock, buf, (size_t)nio->pktsize, 0,
-                     (struct sockaddr *)&cdata, slen);
-      err   = errno;
-      s_log(G_DLOOP, "sendto(%d, %p, %d, %d, %p, %p) = %d (%d).\n",
-                     sock, buf, nio->pktsize, 0, (void *)&cdata,
-                     (void *)&slen, rc, err);
+      socktype = SOCK_DGRAM;
       break;
 
     default:
-      rc  = -1;
-      err = 1;
-      break;
+      return -1;
   }
 
-  if(rc < 0) {
-    frc = -err;
-  }
-  else if(rc != nio->pktsize) {
-    frc = 0;
-  }
-  else { /* rc == nio->pktsize */
-    int64_t timediff;
+  if((nio->mode != O_RDONLY) && (nio->mode != O_WRONLY))
+    return -1;
 
-    timediff = calculate_timediff(&bt, &ft);
-    nio->netio_bytes[C_IOWRITE] += 1;
-    nio->io_usec[C_IOWRITE]     += timediff;
+  if(raise_fd_limit(nio) < 0)
+    return -1;
 
-    frc = 1;
+  nc->nconns   = 0;
+  nc->accepted = 0;
+  nc->conn     = (nio_conn *)calloc(nio->conns, sizeof(nio_conn));
+  if(!nc->conn) {
+    s_log(G_WARNING, "%s could not allocate %u connections.\n",
+                     nio->shopts.label, nio->conns);
+    goto fail_out;
   }
 
-  return frc;
-}
+  if(batch_open(nio, nc) < 0)
+    goto fail_out;
 
-/*
- * Wrapper for receiving data.
- * This function returns <  0 on error,
- *                       == 0 if the remote end closed (TCP only),
- *                       >  0 on success (the number of bytes read).
- */
-static int recv_data(int sock, char *buf, nio_opts *nio)
+  nc->ep = epoll_create1(0);
+  if(nc->ep < 0) {
+    s_log(G_WARNING, "%s error creating epoll set: %s.\n",
+                     nio->shopts.label, strerror(errno));
+    goto fail_out;
+  }
+
+  one = 1;
+  memset(&saddr, 0, sizeof(saddr));
+  saddr.sin_family = AF_INET;
+  saddr.sin_port   = htons(nio->port);
+
+  if(nio->mode == O_WRONLY) {
+    nc->events            = EPOLLOUT | EPOLLET;
+    saddr.sin_addr.s_addr = nio->addr;
+
+    if(((nio->tx == NIO_TX_SENDFILE) || (nio->tx == NIO_TX_SPLICE))
+       && (tx_file_open(nio, nc) < 0))
+    {
+      goto fail_out;
+    }
+
+    /*
+     * Start every connect() at once, then wait for them together.
+     *   A UDP connect() just fixes the destination.
+     */
+    for(i = 0;i < nio->conns;i++) {
+      fd = socket(AF_INET, socktype | SOCK_NONBLOCK, nio->protocol);
+      if(fd < 0) {
+        s_log(G_WARNING, "%s error getting socket: %s.\n",
+                         nio->shopts.label, strerror(errno));
+        goto fail_out;
+      }
+
+      if(((connect(fd, (struct sockaddr *)&saddr, sizeof(saddr)) < 0)
+          && (errno != EINPROGRESS))
+         || (add_conn(nc, fd) < 0))
+      {
+        s_log(G_WARNING, "%s error connecting to %s:%hu: %s.\n",
+                         nio->shopts.label, inet_ntoa(saddr.sin_addr),
+                         nio->port, strerror(errno));
+        (void)close(fd);
+        goto fail_out;
+      }
+
+      if(conn_setup(nio, &nc->conn[nc->nconns - 1]) < 0)
+        goto fail_out;
+    }
+
+    if((socktype == SOCK_STREAM) && (wait_connects(nio, nc) < 0))
+      goto fail_out;
+  }
+  else {
+    nc->events            = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    saddr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if(socktype == SOCK_STREAM) {
+      int backlog;
+
+      nc->lsock = socket(AF_INET, socktype | SOCK_NONBLOCK,
+                         nio->protocol);
+      if(nc->lsock < 0) {
+        s_log(G_WARNING, "%s error getting socket: %s.\n",
+                         nio->shopts.label, strerror(errno));
+        goto fail_out;
+      }
+
+      /* A big fan-in shouldn't overflow the accept queue */
+      backlog = (nio->conns > LISTEN_BACKLOG) ? (int)nio->conns
+                                              : LISTEN_BACKLOG;
+
+      memset(&ev, 0, sizeof(ev));
+      ev.events   = EPOLLIN;
+      ev.data.u32 = NIO_LISTEN_TAG;
+      if((setsockopt(nc->lsock, SOL_SOCKET, SO_REUSEADDR,
+                     &one, sizeof(one)) < 0)
+         || (bind(nc->lsock, (struct sockaddr *)&saddr,
+                  sizeof(saddr)) < 0)
+         || (listen(nc->lsock, backlog) < 0)
+         || (epoll_ctl(nc->ep, EPOLL_CTL_ADD, nc->lsock, &ev) < 0))
+      {
+        s_log(G_WARNING, "%s error listening on port %hu: %s.\n",
+                         nio->shopts.label, nio->port, strerror(errno));
+        goto fail_out;
+      }
+    }
+    else {
+      for(i = 0;i < nio->conns;i++) {
+        fd = socket(AF_INET, socktype | SOCK_NONBLOCK, nio->protocol);
+        if(fd < 0) {
+          s_log(G_WARNING, "%s error getting socket: %s.\n",
+                           nio->shopts.label, strerror(errno));
+          goto fail_out;
+        }
+        if(add_conn(nc, fd) < 0) {
+          (void)close(fd);
+          goto fail_out;
+        }
+        if(conn_setup(nio, &nc->conn[nc->nconns - 1]) < 0)
+          goto fail_out;
+
+        if(((nio->conns > 1)
+            && (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT,
+                           &one, sizeof(one)) < 0))
+           || (bind(fd, (struct sockaddr *)&saddr, sizeof(saddr)) < 0))
+        {
+          s_log(G_WARNING, "%s error binding port %hu: %s.\n",
+                           nio->shopts.label, nio->port,
+                           strerror(errno));
+          goto fail_out;
+        }
+      }
+    }
+  }
+
+  nio->live_conns = nc->nconns;
+  s_log(G_DEBUG, "%s has %u sockets open.\n",
+                 nio->shopts.label, nc->nconns);
+
+  return 0;
+
+fail_out:
+  close_conns(nc);
+  return -1;
+}
+
+static void close_conns(nio_conns *nc)
 {
-  int rc;
+  if(!nc)
+    return;
+
+  while(nc->nconns) {
+    nc->nconns--;
+    (void)close(nc->conn[nc->nconns].fd);
+    test_and_close(nc->conn[nc->nconns].pipe[0]);
+    test_and_close(nc->conn[nc->nconns].pipe[1]);
+  }
+  test_and_close(nc->lsock);
+  test_and_close(nc->ep);
+  test_and_close(nc->txfd);
+  free(nc->msgs);
+  free(nc->iov);
+  free(nc->names);
+  free(nc->ctl);
+  nc->msgs  = NULL;
+  nc->iov   = NULL;
+  nc->names = NULL;
+  nc->ctl   = NULL;
+  if(nc->conn) {
+    free(nc->conn);
+    nc->conn = NULL;
+  }
+  nc->accepted = 0;
+}
+
+/*
+ * Watch a new socket.  Its slot number is its epoll tag.
+ */
+static int add_conn(nio_conns *nc, int fd)
+{
+  nio_conn *c;
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events   = nc->events;
+  ev.data.u32 = nc->nconns;
+  if(epoll_ctl(nc->ep, EPOLL_CTL_ADD, fd, &ev) < 0)
+    return -1;
+
+  c = &nc->conn[nc->nconns++];
+  memset(c, 0, sizeof(*c));
+  c->fd      = fd;
+  c->ready   = 1;
+  c->pipe[0] = -1;
+  c->pipe[1] = -1;
+
+  return 0;
+}
+
+/*
+ * Close a socket and move the last one into its slot.
+ */
+static void drop_conn(nio_conns *nc, uint32_t idx)
+{
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  (void)epoll_ctl(nc->ep, EPOLL_CTL_DEL, nc->conn[idx].fd, &ev);
+  (void)close(nc->conn[idx].fd);
+  test_and_close(nc->conn[idx].pipe[0]);
+  test_and_close(nc->conn[idx].pipe[1]);
+
+  nc->nconns--;
+  if(idx < nc->nconns) {
+    nc->conn[idx] = nc->conn[nc->nconns];
+    ev.events     = nc->events;
+    ev.data.u32   = idx;
+    (void)epoll_ctl(nc->ep, EPOLL_CTL_MOD, nc->conn[idx].fd, &ev);
+  }
+}
+
+/*
+ * Give every connect() CONN_WAIT seconds to finish.
+ */
+static int wait_connects(nio_opts *nio, nio_conns *nc)
+{
+  int i;
   int err;
-  int frc;
-  int32_t num_tries;
-  struct sockaddr_in cdata;  /* connection data */
+  int nev;
+  uint32_t j;
+  uint32_t pending;
+  time_t timeout;
+  socklen_t elen;
+  struct in_addr raddr;
+  struct epoll_event ev[NIO_EVENTS];
+
+  for(j = 0;j < nc->nconns;j++) {
+    nc->conn[j].ready = 0;
+  }
+
+  raddr.s_addr = nio->addr;
+  pending      = nc->nconns;
+  timeout      = time(NULL) + CONN_WAIT;
+  while(pending) {
+    if(time(NULL) >= timeout) {
+      s_log(G_WARNING, "%s: only %u of %u connections to %s:%hu "
+                       "came up.\n", nio->shopts.label,
+                       nc->nconns - pending, nc->nconns,
+                       inet_ntoa(raddr), nio->port);
+      return -1;
+    }
+
+    nev = epoll_wait(nc->ep, ev, NIO_EVENTS, 100);
+    if(nev < 0) {
+      if(errno == EINTR)
+        continue;
+      return -1;
+    }
+
+    for(i = 0;i < nev;i++) {
+      j = ev[i].data.u32;
+      if((j >= nc->nconns) || nc->conn[j].ready)
+        continue;
+
+      /* Writability on the socket.  But is it success? */
+      err  = 0;
+      elen = sizeof(err);
+      if((getsockopt(nc->conn[j].fd, SOL_SOCKET, SO_ERROR,
+                     &err, &elen) < 0) || err)
+      {
+        s_log(G_WARNING, "%s error connecting to %s:%hu: %s.\n",
+                         nio->shopts.label, inet_ntoa(raddr),
+                         nio->port, strerror(err ? err : errno));
+        return -1;
+      }
+
+      nc->conn[j].ready = 1;
+      pending--;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Take every connection waiting on the listening socket.  Ones from
+ *   the wrong host, or past 'conns' of them, are turned away.
+ */
+static int accept_conns(nio_opts *nio, nio_conns *nc)
+{
+  int fd;
   socklen_t slen;
-  struct timeval bt;
-  struct timeval ft;
+  struct sockaddr_in saddr;
+
+  for(;;) {
+    slen = sizeof(saddr);
+    memset(&saddr, 0, sizeof(saddr));
+    fd = accept4(nc->lsock, (struct sockaddr *)&saddr, &slen,
+                 SOCK_NONBLOCK);
+    if(fd < 0) {
+      if((errno == EINTR) || (errno == ECONNABORTED))
+        continue;
+      if((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        break;
+      if((errno == EMFILE) || (errno == ENFILE)) {
+        s_log(G_WARNING, "%s is out of descriptors.\n",
+                         nio->shopts.label);
+        break;
+      }
+
+      s_log(G_WARNING, "%s error accepting a connection: %s.\n",
+                       nio->shopts.label, strerror(errno));
+      return -1;
+    }
+
+    if(((nio->addr != INADDR_ANY) && (saddr.sin_addr.s_addr != nio->addr))
+       || (nc->nconns >= nio->conns))
+    {
+      s_log(G_DEBUG, "%s turned away a connection from %s.\n",
+                     nio->shopts.label, inet_ntoa(saddr.sin_addr));
+      (void)close(fd);
+      continue;
+    }
+
+    if(add_conn(nc, fd) < 0) {
+      (void)close(fd);
+      return -1;
+    }
+    nc->accepted++;
+  }
+
+  nio->live_conns = nc->nconns;
+
+  return 0;
+}
+
+/*
+ * Write a file for sendfile() and splice() to send from.  It's
+ *   unlinked right away and small enough to stay in the page cache,
+ *   and a whole number of packets long, so no packet wraps.
+ */
+static int tx_file_open(nio_opts *nio, nio_conns *nc)
+{
+  char path[BUFSIZE];
+  char *dir;
+  char *fill;
+  uint64_t i;
+  uint64_t rstate;
+  ssize_t rc;
+
+  dir = getenv("TMPDIR");
+  if(!dir || !*dir)
+    dir = "/tmp";
+  (void)snprintf(path, sizeof(path), "%s/gamut-tx.XXXXXX", dir);
+
+  nc->txfd = mkstemp(path);
+  if(nc->txfd < 0) {
+    s_log(G_WARNING, "%s could not make a file in %s to send from: %s.\n",
+                     nio->shopts.label, dir, strerror(errno));
+    return -1;
+  }
+  (void)unlink(path);
+
+  nc->txsize  = (NIO_TX_FILE / nio->pktsize) * (uint64_t)nio->pktsize;
+  if(!nc->txsize)
+    nc->txsize = nio->pktsize;
+  nc->txoff   = 0;
+
+  fill = (char *)malloc(DIO_PREP_CHUNK);
+  if(!fill)
+    return -1;
+  rstate = ((uint64_t)RandInt(0x7fffffff) << 32)
+           | (uint64_t)(nio->shopts.wid + 1);
+  for(i = 0;i < DIO_PREP_CHUNK / sizeof(uint64_t);i++) {
+    ((uint64_t *)fill)[i] = pattern_rand(&rstate);
+  }
+
+  for(i = 0;i < nc->txsize;i += (uint64_t)rc) {
+    rc = write(nc->txfd, fill, ((nc->txsize - i) < DIO_PREP_CHUNK)
+                               ? (size_t)(nc->txsize - i) : DIO_PREP_CHUNK);
+    if(rc <= 0) {
+      s_log(G_WARNING, "%s error writing its tx file: %s.\n",
+                       nio->shopts.label, strerror(errno));
+      free(fill);
+      return -1;
+    }
+  }
+  free(fill);
+
+  return 0;
+}
 
-  if((sock < 0) || !buf || !nio) {
+/*
+ * Per-socket setup for the way we move packets.
+ */
+static int conn_setup(nio_opts *nio, nio_conn *c)
+{
+#if defined(HAVE_ZEROCOPY) || defined(UDP_GRO)
+  int one;
+
+  one = 1;
+#endif
+#ifdef HAVE_ZEROCOPY
+  if((nio->tx == NIO_TX_ZEROCOPY)
+     && (setsockopt(c->fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0))
+  {
+    s_log(G_WARNING, "%s cannot use MSG_ZEROCOPY: %s.\n",
+                     nio->shopts.label, strerror(errno));
+    return -1;
+  }
+#endif
+
+  if((nio->tx == NIO_TX_SPLICE) && (pipe2(c->pipe, O_NONBLOCK) < 0)) {
+    s_log(G_WARNING, "%s error making a pipe: %s.\n",
+                     nio->shopts.label, strerror(errno));
     return -1;
   }
 
   /*
-   * If the socket is a TCP stream, just use recv().
-   * If the socket is a UDP stream, use recvfrom.
+   * GSO won't fragment the datagrams it cuts, so each packet has to
+   *   fit the path MTU with its IP and UDP headers, or every send
+   *   fails with EINVAL.  A writer's UDP socket is connected by now.
    */
-  err       = 0;
-  frc       = -1;
-  num_tries = 0;
-  memset(&cdata, 0, sizeof(cdata));
-  switch(nio->protocol) {
-    case IPPROTO_TCP:
-      (void)gettimeofday(&bt, NULL);
-      errno = 0;
-      rc    = recv(sock, buf, nio->pktsize, 0);
-      err   = errno;
-      (void)gettimeofday(&ft, NULL);
-      s_log(G_DLOOP, "recv(%d, %p, %u, %u) = %d (%d).\n",
-                     sock, buf, nio->pktsize, 0, rc, err);
-      break;
+#ifdef IP_MTU
+  if(nio->gso) {
+    int mtu;
+    socklen_t mlen;
+
+    mlen = sizeof(mtu);
+    if(!getsockopt(c->fd, IPPROTO_IP, IP_MTU, &mtu, &mlen)
+       && (nio->pktsize + NIO_UDP_HDRS > (uint32_t)mtu))
+    {
+      s_log(G_WARNING, "%s: gso=1 needs pktsize=%d or less for the "
+                       "path MTU of %d.\n", nio->shopts.label,
+                       mtu - NIO_UDP_HDRS, mtu);
+      return -1;
+    }
+  }
+#endif
 
-    case IPPROTO_UDP:
-      {
-        int flags;
+#ifdef UDP_SEGMENT
+  if(nio->gso) {
+    int gso_size;
 
-        flags = fcntl(sock, F_GETFL);
-        s_log(G_DLOOP, "fcntl(%d, F_GETFL) = %x (%x).\n",
-                       sock, flags, (flags & O_NONBLOCK));
-      }
+    gso_size = (int)nio->pktsize;
+    if(setsockopt(c->fd, SOL_UDP, UDP_SEGMENT,
+                  &gso_size, sizeof(gso_size)) < 0)
+    {
+      s_log(G_WARNING, "%s cannot use UDP GSO: %s.\n", nio->shopts.label,
+                       strerror(errno));
+      return -1;
+    }
+  }
+#endif
+#ifdef UDP_GRO
+  if(nio->gro && (setsockopt(c->fd, SOL_UDP, UDP_GRO,
+                             &one, sizeof(one)) < 0))
+  {
+    s_log(G_WARNING, "%s cannot use UDP GRO: %s.\n", nio->shopts.label,
+                     strerror(errno));
+    return -1;
+  }
+#endif
+
+  /*
+   * Each socket gets its share of the rate, and a little more, since
+   *   the kernel counts headers too.  If the kernel won't pace, we do.
+   */
+#ifdef SO_MAX_PACING_RATE
+  if(nio->paced == NIO_PACE_KERNEL) {
+    uint64_t rate;
+    unsigned int pacing;
+
+    rate  = nio->iorate / (nio->conns ? nio->conns : 1);
+    rate += rate / 16;
+    if(!rate)
+      rate = 1;
+    pacing = (rate > 0xffffffffULL) ? 0xffffffffU : (unsigned int)rate;
+    if(setsockopt(c->fd, SOL_SOCKET, SO_MAX_PACING_RATE,
+                  &pacing, sizeof(pacing)) < 0)
+    {
+      s_log(G_WARNING, "%s cannot use SO_MAX_PACING_RATE (%s); "
+                       "pacing in user space.\n", nio->shopts.label,
+                       strerror(errno));
+      nio->paced = NIO_PACE_USER;
+    }
+  }
+#endif
+
+  return 0;
+}
+
+/*
+ * What pace=auto means here.  TCP paces itself once it's given a
+ *   rate; UDP is only held to one by the fq qdisc, which we take the
+ *   default to be on anything but loopback.
+ */
+static uint16_t pace_pick(nio_opts *nio)
+{
+  char qdisc[SMBUFSIZE];
+  FILE *fp;
+
+  if(!nio_pacing_supported())
+    return NIO_PACE_USER;
+  if(nio->protocol == IPPROTO_TCP)
+    return NIO_PACE_KERNEL;
+  if((ntohl(nio->addr) >> 24) == 127)
+    return NIO_PACE_USER;
+
+  fp = fopen(NIO_QDISC_FILE, "r");
+  if(!fp)
+    return NIO_PACE_USER;
+  if(!fgets(qdisc, sizeof(qdisc), fp))
+    qdisc[0] = '\0';
+  (void)fclose(fp);
+
+  if(strncmp(qdisc, "fq", 2) || ((qdisc[2] != '\n') && qdisc[2]))
+    return NIO_PACE_USER;
+
+  return NIO_PACE_KERNEL;
+}
+
+static void ts_add(struct timespec *ts, uint64_t nsec)
+{
+  nsec        += ts->tv_nsec;
+  ts->tv_sec  += nsec / 1000000000ULL;
+  ts->tv_nsec  = nsec % 1000000000ULL;
+}
+
+/*
+ * Is 'ts' no later than 'now'?
+ */
+static int ts_passed(struct timespec *ts, struct timespec *now)
+{
+  if(ts->tv_sec != now->tv_sec)
+    return (ts->tv_sec < now->tv_sec);
+
+  return (ts->tv_nsec <= now->tv_nsec);
+}
+
+/*
+ * How many packets go in one message.  GSO can't make a datagram
+ *   bigger than IP allows, or split one more ways than the kernel
+ *   will.
+ */
+static uint32_t gso_segs(nio_opts *nio)
+{
+  uint32_t segs;
+
+  if(!nio->gso)
+    return 1;
+
+  segs = 65507 / nio->pktsize;
+  if(segs > NIO_GSO_SEGS)
+    segs = NIO_GSO_SEGS;
+  if(segs > nio->batch)
+    segs = nio->batch;
+
+  return segs ? segs : 1;
+}
+
+/*
+ * A packet, a GSO message's worth of them, or the biggest read GRO
+ *   may hand back.
+ */
+static uint32_t nio_buf_size(nio_opts *nio)
+{
+  if(nio->gro && (nio->pktsize < NIO_GRO_BYTES))
+    return NIO_GRO_BYTES;
+
+  return gso_segs(nio) * nio->pktsize;
+}
 
+/*
+ * Set up the message arrays sendmmsg() and recvmmsg() use.  Every
+ *   message points into the same buffer; what we send doesn't
+ *   change and what we read is thrown away.
+ */
+static int batch_open(nio_opts *nio, nio_conns *nc)
+{
+  if((nio->batch <= 1) && !nio->gso && !nio->gro)
+    return 0;
+
+  nc->segs  = gso_segs(nio);
+  nc->msgs  = (struct mmsghdr *)calloc(nio->batch, sizeof(struct mmsghdr));
+  nc->iov   = (struct iovec *)calloc(nio->batch, sizeof(struct iovec));
+  nc->names = (struct sockaddr_in *)calloc(nio->batch,
+                                           sizeof(struct sockaddr_in));
+  nc->ctl   = (char *)calloc(nio->batch, CMSG_SPACE(sizeof(int)));
+  if(!nc->msgs || !nc->iov || !nc->names || !nc->ctl) {
+    s_log(G_WARNING, "%s could not allocate a batch of %u.\n",
+                     nio->shopts.label, nio->batch);
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Send what's left of the current packet, the way 'tx' says to.
+ *   Returns what the underlying call does, with errno set.
+ */
+static ssize_t tx_send(nio_opts *nio, nio_conns *nc, nio_conn *c,
+                       char *buf)
+{
+  off_t off;
+  ssize_t rc;
+  size_t left;
+
+  left = nio->pktsize - c->partial;
+
+  /* Each packet comes from the next spot in the file */
+  if(!c->partial && !c->piped && (nc->txfd >= 0)) {
+    c->foff   = nc->txoff;
+    nc->txoff = (nc->txoff + nio->pktsize) % nc->txsize;
+  }
+
+  switch(nio->tx) {
+#ifdef __linux__
+    case NIO_TX_SENDFILE:
+      off = (off_t)(c->foff + c->partial);
+      return sendfile(c->fd, nc->txfd, &off, left);
+
+    case NIO_TX_SPLICE:
       /*
-       * For UDP, we read data in a loop because we need to make sure
-       *   we're getting our packet from the correct remote end.
-       *   It's possible for an invalid host to send something, so
-       *   make sure we ignore that data.
-       * Cap the number of tries, so we don't get stuck in this loop.
+       * Whatever went into the pipe has to come out on this socket,
+       *   so only refill it once it's empty.
        */
-      do {
-        memset(&cdata, 0, sizeof(cdata));
-        slen = sizeof(cdata);
-        (void)gettimeofday(&bt, NULL);
-        errno = 0;
-        rc    = recvfrom(sock, buf, nio->pktsize, 0,
-                         (struct sockaddr *)&cdata, &slen);
-        err   = errno;
-        (void)gettimeofday(&ft, NULL);
-        s_log(G_DLOOP, "recvfrom(%d, %p, %d, %d, %p, %p) = %d (%d).\n",
-                       sock, buf, nio->pktsize, 0, (void *)&cdata,
-                       (void *)&slen, rc, err);
-        if(rc > 0)
-        { /* We got some data */
-          if((nio->addr == INADDR_ANY)
-             || (nio->addr == cdata.sin_addr.s_addr))
-          {    /* We got data from the right people */
-            break;
-          }
-          else {
-            num_tries++;
-          }
+      if(!c->piped) {
+        off = (off_t)(c->foff + c->partial);
+        rc  = splice(nc->txfd, &off, c->pipe[1], NULL, left,
+                     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if(rc <= 0) {
+          if(!rc)
+            errno = EIO;
+          return -1;
         }
-        else
-        { /* Error of some sort (rc <= 0) */
-          break;
-        }
-      } while(num_tries < MAX_RECV_TRIES);
-      break;
+        c->piped = (uint32_t)rc;
+      }
+      rc = splice(c->pipe[0], NULL, c->fd, NULL, c->piped,
+                  SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if(rc > 0)
+        c->piped -= (uint32_t)rc;
+      return rc;
+#endif
+
+    case NIO_TX_ZEROCOPY:
+      rc = send(c->fd, buf + c->partial, left,
+                MSG_NOSIGNAL | MSG_ZEROCOPY);
+      if(rc >= 0)
+        nio->zc_sends++;
+      return rc;
 
     default:
-      rc  = -1;
-      err = 1;
+      return send(c->fd, buf + c->partial, left, MSG_NOSIGNAL);
+  }
+}
+
+/*
+ * Collect MSG_ZEROCOPY completions from the socket's error queue.
+ *   Each covers a range of sends, and says whether the kernel had
+ *   to copy them after all (it always does over loopback).
+ */
+static void zc_reap(nio_opts *nio, nio_conn *c)
+{
+#ifdef HAVE_ZEROCOPY
+  char control[CMSG_SPACE(sizeof(struct sock_extended_err)
+                          + sizeof(struct sockaddr_in))];
+  struct msghdr msg;
+  struct cmsghdr *cm;
+  struct sock_extended_err serr;
+
+  for(;;) {
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+    if(recvmsg(c->fd, &msg, MSG_ERRQUEUE) < 0)
       break;
+
+    for(cm = CMSG_FIRSTHDR(&msg);cm;cm = CMSG_NXTHDR(&msg, cm)) {
+      if((cm->cmsg_level != SOL_IP) || (cm->cmsg_type != IP_RECVERR))
+        continue;
+
+      memcpy(&serr, CMSG_DATA(cm), sizeof(serr));
+      if(serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        continue;
+
+      nio->zc_done += (int64_t)(serr.ee_data - serr.ee_info) + 1;
+      if(serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+        nio->zc_copied += (int64_t)(serr.ee_data - serr.ee_info) + 1;
+    }
   }
+#endif
+}
 
-  if(rc < 0) {
-    frc = -err;
+/*
+ * CPU time this thread has used since 'base'.
+ */
+static void update_cpu(nio_opts *nio, struct rusage *base)
+{
+  struct rusage ru;
+
+  if(getrusage(RUSAGE_THREAD, &ru) < 0)
+    return;
+
+  nio->cpu_usec[0] = calculate_timediff(&base->ru_utime, &ru.ru_utime);
+  nio->cpu_usec[1] = calculate_timediff(&base->ru_stime, &ru.ru_stime);
+}
+
+/*
+ * Was this way of sending compiled in?
+ */
+int nio_tx_supported(uint16_t tx)
+{
+  switch(tx) {
+    case NIO_TX_SENDFILE:
+    case NIO_TX_SPLICE:
+#ifdef __linux__
+      return 1;
+#else
+      return 0;
+#endif
+    case NIO_TX_ZEROCOPY:
+#ifdef HAVE_ZEROCOPY
+      return 1;
+#else
+      return 0;
+#endif
+    default:
+      return 1;
   }
-  else if(rc != nio->pktsize) { /* Incomplete data */
-    frc = 0;
+}
+
+/*
+ * Were UDP GSO and GRO compiled in?
+ */
+int nio_gso_supported(void)
+{
+#ifdef UDP_SEGMENT
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+int nio_gro_supported(void)
+{
+#ifdef UDP_GRO
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+/*
+ * Was SO_MAX_PACING_RATE (pace=kernel) compiled in?
+ */
+int nio_pacing_supported(void)
+{
+#ifdef SO_MAX_PACING_RATE
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+static char* get_tx_label(uint16_t tx)
+{
+  switch(tx) {
+    case NIO_TX_SENDFILE:
+      return "sendfile";
+    case NIO_TX_SPLICE:
+      return "splice";
+    case NIO_TX_ZEROCOPY:
+      return "zerocopy";
+    default:
+      return "copy";
+  }
+}
+
+/*
+ * Start the other end of the worker.  A sink binds its sockets
+ *   here, so the worker can connect as soon as we return; a source
+ *   connects from its own thread while the worker accepts.
+ */
+static int start_peer(gamut_opts *gopts, nio_opts *nio, nio_peer *peer)
+{
+  int rc;
+
+  memcpy(&peer->nio, nio, sizeof(peer->nio));
+  memset(&peer->nc, 0, sizeof(peer->nc));
+  peer->gopts                = gopts;
+  peer->nio.mode             = (nio->mode == O_WRONLY) ? O_RDONLY
+                                                       : O_WRONLY;
+  peer->nio.peer             = NIO_PEER_NONE;
+  peer->nio.tx               = NIO_TX_COPY;
+  peer->nio.gso              = nio->gro;
+  peer->nio.gro              = nio->gso;
+  if(peer->nio.gso && (peer->nio.batch < 2))
+    peer->nio.batch = NIO_GSO_SEGS;
+  peer->nio.pace             = NIO_PACE_NONE;
+  peer->nio.paced            = NIO_PACE_NONE;
+  peer->nio.shopts.exiting   = 0;
+  peer->nio.shopts.max_work  = 0;
+  peer->nio.conns_closed     = 0;
+  peer->nc.ep                = -1;
+  peer->nc.lsock             = -1;
+  peer->nc.txfd              = -1;
+  (void)snprintf(peer->nio.shopts.label, SMBUFSIZE, "%.*s.peer",
+                 SMBUFSIZE - 6, nio->shopts.label);
+
+  if((peer->nio.mode == O_RDONLY) && (open_conns(&peer->nio, &peer->nc) < 0))
+    return -1;
+
+  rc = pthread_create(&peer->tid, (pthread_attr_t *)NULL,
+                      run_peer, (void *)peer);
+  if(rc) {
+    s_log(G_WARNING, "%s could not start its peer: %s.\n",
+                     nio->shopts.label, strerror(rc));
+    close_conns(&peer->nc);
+    return -1;
+  }
+  peer->running = 1;
+
+  s_log(G_DEBUG, "%s started a local %s on %s.\n", nio->shopts.label,
+                 (peer->nio.mode == O_RDONLY) ? "sink" : "source",
+                 inet_ntoa(*(struct in_addr *)&nio->addr));
+
+  return 0;
+}
+
+/*
+ * Tell the peer to finish its epoch and wait for it.  It closes its
+ *   own sockets, before the worker closes the other ends.
+ */
+static void stop_peer(nio_peer *peer)
+{
+  if(!peer->running)
+    return;
+
+  peer->nio.shopts.exiting = 1;
+  (void)pthread_join(peer->tid, NULL);
+  peer->running = 0;
+}
+
+/*
+ * A sink reads everything it's sent, as soon as it's sent.  A source
+ *   sends at the worker's rate; over TCP it offers twice that, so a
+ *   reader is never waiting on us and flow control holds us back.
+ */
+static void* run_peer(void *arg)
+{
+  char *buf;
+  int rc;
+  int64_t target_netio;
+  uint64_t deadline;
+  double curr_pkts;
+  double pkts_per_epoch;
+  nio_peer *peer;
+  struct timeval tv;
+
+  peer = (nio_peer *)arg;
+  buf  = NULL;
+
+  if((peer->nio.mode == O_WRONLY)
+     && (open_conns(&peer->nio, &peer->nc) < 0))
+  {
+    s_log(G_WARNING, "%s could not reach its worker.\n",
+                     peer->nio.shopts.label);
+    goto clean_out;
+  }
+
+  buf = (char *)calloc(1, nio_buf_size(&peer->nio));
+  if(!buf)
+    goto clean_out;
+
+  if(peer->nio.mode == O_RDONLY) {
+    pkts_per_epoch = NIO_SINK_PKTS;
+  }
+  else {
+    pkts_per_epoch  = (double)peer->nio.iorate / peer->nio.pktsize;
+    pkts_per_epoch /= WORKER_EPOCHS_PER_SEC;
+    if(peer->nio.protocol == IPPROTO_TCP)
+      pkts_per_epoch *= 2;
+  }
+
+  curr_pkts    = 0.0;
+  target_netio = -1;
+  while(!peer->nio.shopts.exiting) {
+    (void)gettimeofday(&tv, NULL);
+    deadline  = (uint64_t)tv.tv_sec * US_SEC + tv.tv_usec;
+    deadline += US_PER_WORKER_EPOCH;
+
+    rc = network(peer->gopts, &peer->nio, &peer->nc, buf, &target_netio,
+                 pkts_per_epoch, &curr_pkts, deadline);
+    if(rc <= 0)
+      break;
+
+    /* A sink goes straight back to waiting on its sockets */
+    if(peer->nio.mode == O_RDONLY)
+      continue;
+
+    (void)gettimeofday(&tv, NULL);
+    if(deadline > (uint64_t)tv.tv_sec * US_SEC + tv.tv_usec + MIN_SLEEP_US)
+    {
+      struct timeval sleeptv;
+      uint64_t time_diff;
+
+      time_diff       = deadline - ((uint64_t)tv.tv_sec * US_SEC
+                                    + tv.tv_usec);
+      sleeptv.tv_sec  = time_diff / US_SEC;
+      sleeptv.tv_usec = time_diff - (sleeptv.tv_sec * US_SEC);
+      (void)select(0, (fd_set *)NULL, (fd_set *)NULL,
+                   (fd_set *)NULL, &sleeptv);
+    }
   }
-  else { /* rc == nio->pktsize */
-    int64_t timediff;
 
-    timediff = calculate_timediff(&bt, &ft);
-    nio->netio_bytes[C_IOREAD] += 1;
-    nio->io_usec[C_IOREAD]     += timediff;
+  s_log(G_DEBUG, "%s moved %lld packets.\n", peer->nio.shopts.label,
+                 (long long)(peer->nio.netio_bytes[C_IOREAD]
+                             + peer->nio.netio_bytes[C_IOWRITE]));
+
+clean_out:
+  close_conns(&peer->nc);
+  if(buf)
+    free(buf);
+
+  return NULL;
+}
+
+/*
+ * Thousands of sockets need more descriptors than most shells
+ *   allow, and other net workers in this process may want theirs
+ *   too, so raise the soft limit all the way to the hard one.
+ */
+static int raise_fd_limit(nio_opts *nio)
+{
+  rlim_t want;
+  struct rlimit rl;
+
+  if(nio->conns <= DEF_NIO_CONNS)
+    return 0;
+
+  if(getrlimit(RLIMIT_NOFILE, &rl) < 0)
+    return -1;
 
-    frc = 1;
+  want = (rlim_t)nio->conns * ((nio->tx == NIO_TX_SPLICE) ? 3 : 1)
+         + NIO_SPARE_FDS;
+  if((rl.rlim_max != RLIM_INFINITY) && (rl.rlim_max < want)) {
+    s_log(G_WARNING, "%s needs %lu descriptors, but may only have "
+                     "%lu.\n", nio->shopts.label, (unsigned long)want,
+                     (unsigned long)rl.rlim_max);
+    return -1;
+  }
+  if(rl.rlim_cur == rl.rlim_max)
+    return 0;
+
+  rl.rlim_cur = rl.rlim_max;
+  if(setrlimit(RLIMIT_NOFILE, &rl) < 0) {
+    s_log(G_WARNING, "%s could not raise its descriptor limit: %s.\n",
+                     nio->shopts.label, strerror(errno));
+    return -1;
   }
 
-  return frc;
+  return 0;
 }
 
 static void print_iostats(int64_t total_usec, nio_opts *nio, char *tag)
 {
+  char lat[BUFSIZE];
   char iorate[SMBUFSIZE];
+  int i;
   int64_t total_io;
   double iotime;
 
@@ -976,6 +2083,9 @@ static void print_iostats(int64_t total_usec, nio_opts *nio, char *tag)
    * 1. Overall I/O and I/O rates
    * 2. Read I/O and I/O rates
    * 3. Write I/O and I/O rates
+   * 4. Receive and send latencies
+   * 5. Connections lost along the way
+   * 6. CPU time, and how zero-copy sends went
    */
   total_io   = nio->netio_bytes[C_IOREAD] + nio->netio_bytes[C_IOWRITE];
   total_io  *= nio->pktsize;
@@ -1017,4 +2127,53 @@ static void print_iostats(int64_t total_usec, nio_opts *nio, char *tag)
                     "at %sps (%s).\n", nio->shopts.label, write_io,
                     writetime, iorate, tag);
   }
+
+  /* Number 4 */
+  if(nio->io_lat[C_IOREAD].count) {
+    lat_hist_print(&nio->io_lat[C_IOREAD], lat, BUFSIZE);
+    s_log(G_NOTICE, "%s receive latency %s (%s).\n",
+                    nio->shopts.label, lat, tag);
+  }
+  if(nio->io_lat[C_IOWRITE].count) {
+    lat_hist_print(&nio->io_lat[C_IOWRITE], lat, BUFSIZE);
+    s_log(G_NOTICE, "%s send latency %s (%s).\n",
+                    nio->shopts.label, lat, tag);
+  }
+
+  /* Number 5 */
+  if(nio->conns_closed) {
+    s_log(G_NOTICE, "%s saw %lld of its connections close (%s).\n",
+                    nio->shopts.label, (long long)nio->conns_closed, tag);
+  }
+
+  /* Number 6 */
+  s_log(G_NOTICE, "%s used %.4f sec user, %.4f sec system CPU "
+                  "with tx=%s (%s).\n", nio->shopts.label,
+                  (double)nio->cpu_usec[0] / US_SEC,
+                  (double)nio->cpu_usec[1] / US_SEC,
+                  get_tx_label(nio->tx), tag);
+  if(nio->zc_sends) {
+    s_log(G_NOTICE, "%s made %lld zero-copy sends; %lld completed, "
+                    "%lld copied anyway (%s).\n", nio->shopts.label,
+                    (long long)nio->zc_sends, (long long)nio->zc_done,
+                    (long long)nio->zc_copied, tag);
+  }
+  if(nio->pace != NIO_PACE_NONE) {
+    s_log(G_NOTICE, "%s paced with pace=%s, burst %u, sleeping %lld "
+                    "times (%s).\n", nio->shopts.label,
+                    (nio->paced == NIO_PACE_KERNEL) ? "kernel" : "user",
+                    nio->burst, (long long)nio->pace_waits, tag);
+  }
+
+  /* Number 7 */
+  for(i = C_IOREAD;i <= C_IOWRITE;i++) {
+    if(!nio->batches[i])
+      continue;
+    s_log(G_NOTICE, "%s made %lld %smmsg() calls of %.2f packets "
+                    "(batch=%u gso=%u gro=%u) (%s).\n",
+                    nio->shopts.label, (long long)nio->batches[i],
+                    (i == C_IOWRITE) ? "send" : "recv",
+                    (double)nio->netio_bytes[i] / nio->batches[i],
+                    nio->batch, nio->gso, nio->gro, tag);
+  }
 }
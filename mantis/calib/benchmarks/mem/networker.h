@@ -12,9 +12,27 @@
 #ifndef GAMUT_NETWORKER_H
 #define GAMUT_NETWORKER_H
 
+#include <netdb.h>  /* for uint16_t */
+
 /*
  * Establish a socket to do a certain number of I/Os per second.
  */
 extern void* networker(void *opts);
 
+/*
+ * Was tx= mode 'tx' (NIO_TX_*) compiled in?
+ */
+extern int nio_tx_supported(uint16_t tx);
+
+/*
+ * Were UDP GSO (gso=1) and GRO (gro=1) compiled in?
+ */
+extern int nio_gso_supported(void);
+extern int nio_gro_supported(void);
+
+/*
+ * Can the kernel pace sockets (pace=kernel)?
+ */
+extern int nio_pacing_supported(void);
+
 #endif /* GAMUT_NETWORKER_H */
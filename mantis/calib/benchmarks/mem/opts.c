@@ -39,6 +39,7 @@ unsigned int load_benchmarks = 0;  /* Restore calibration from a file */
 unsigned int save_benchmarks = 0;  /* Save new calibration to a file  */
 unsigned int quit_benchmarks = 0;  /* Exit after running benchmarks   */
 unsigned int debug_sync      = 0;  /* Debug synchronization order     */
+unsigned int server_port     = 0;  /* netgamut's command port         */
 
 /*
  * The input file and log file names are global since they're needed 
@@ -46,6 +47,9 @@ unsigned int debug_sync      = 0;  /* Debug synchronization order     */
  */
 char log_file[BUFSIZE];
 char input_file[BUFSIZE];
+char server_path[BUFSIZE];
+char server_addr[BUFSIZE];
+char coord_file[BUFSIZE];
 
 static char benchmark_infile[BUFSIZE];
 static char benchmark_outfile[BUFSIZE];
@@ -77,6 +81,7 @@ void usage(char *progname)
   fprintf(stderr, "\n"
                   "Usage: %s [-l logfile] [-r restore_bmark_file] [-s save_bmark_file]\n"
                   "            [-t tracefile] [-d debug_level] [-T <y|yes|n|no>]\n"
+                  "            [-a addr] [-p port] [-u socket] [-c coordfile]\n"
                   "            [-S] [-b] [-q] [-h] [-V]\n\n"
                   "-l logfile:             Log output to the given logfile (default: stdout).\n"
                   "-r restore_bmark_file:  Restore benchmark data from the given file.\n"
@@ -89,12 +94,20 @@ void usage(char *progname)
                   "                        (0 <= debug_level <= %d, default: %d)\n"
                   "-T <y|yes|n|no>:        Will input have timestamps?\n"
                   "                        Tracefiles have timestamps by default.\n"
+                  "-a addr:                netgamut: serve commands on this address\n"
+                  "                        (default: %s; 0.0.0.0 for all).\n"
+                  "-p port:                netgamut: serve commands on this TCP port.\n"
+                  "-u socket:              netgamut: also serve them on this Unix socket.\n"
+                  "-c coordfile:           Start tracefiles on the netgamut nodes listed in\n"
+                  "                        coordfile at one shared instant, report the skew,\n"
+                  "                        and exit.\n"
                   "-b:                     Run the benchmark cycle 10 times.\n"
                   "-S:                     Debug synchronization operations (adds overhead).\n"
                   "-q:                     Quit after saving benchmark data to a file.\n"
                   "-h:                     Print this help screen and exit.\n"
                   "-V:                     Print version information and exit.\n"
-                  "\n" , progname, G_MAX_DEBUG - 1, (int)get_log_level());
+                  "\n" , progname, G_MAX_DEBUG - 1, (int)get_log_level(),
+                  NETGAMUT_ADDR);
 
   return;
 }
@@ -121,9 +134,13 @@ int parse_opts(int argc, char *argv[], gamut_opts *opts)
   memset(benchmark_outfile, 0, BUFSIZE);
   memset(log_file,          0, BUFSIZE);
   memset(input_file,        0, BUFSIZE);
-  while((opt = getopt(argc, argv, "l:r:s:t:d:T:SVbqh")) != EOF) {
+  memset(server_path,       0, BUFSIZE);
+  memset(server_addr,       0, BUFSIZE);
+  memset(coord_file,        0, BUFSIZE);
+  while((opt = getopt(argc, argv, "l:r:s:t:d:T:a:p:u:c:SVbqh")) != EOF) {
     if(((opt == 'l') || (opt == 'r') || (opt == 's')
         || (opt == 't') || (opt == 'd') || (opt == 'T')
+        || (opt == 'a') || (opt == 'p') || (opt == 'u') || (opt == 'c')
        )
        && !optarg
       )
@@ -182,6 +199,27 @@ int parse_opts(int argc, char *argv[], gamut_opts *opts)
         }
         break;
 
+      case 'a': /* netgamut's command address */
+        strncpy(server_addr, optarg, BUFSIZE - 1);
+        break;
+
+      case 'p': /* netgamut's command port */
+        errno = 0;
+        server_port = (unsigned int)strtoul(optarg, &q, 10);
+        if(errno || (optarg == q) || !server_port || (server_port > 65535)) {
+          s_log(G_ERR, "Invalid port: %s.\n", optarg);
+          return -1;
+        }
+        break;
+
+      case 'u': /* netgamut's command socket */
+        strncpy(server_path, optarg, BUFSIZE - 1);
+        break;
+
+      case 'c': /* Coordinate the nodes in this file */
+        strncpy(coord_file, optarg, BUFSIZE - 1);
+        break;
+
       case 'S': /* Enable synchronization debugging */
         debug_sync = 1;
         break;
@@ -211,6 +249,8 @@ int parse_opts(int argc, char *argv[], gamut_opts *opts)
     return -1;
   if(quit_benchmarks && strlen(input_file))
     return -1;
+  if(strlen(coord_file) && strlen(input_file))
+    return -1;
 
   /* Set the debugging level */
   set_log_level(debug_level);
@@ -267,6 +307,7 @@ int load_benchmark_data(void)
 
   second_count        = 0;
   prng_count          = 0;
+  mem_ceiling         = 0;
 
   while((rc = get_line(buf, BUFSIZE, fp, (uint64_t)0)) > 0) {
     char *q;
@@ -301,6 +342,14 @@ int load_benchmark_data(void)
         goto close_out;
       }
     }
+    else if(!strcasecmp("mem_ceiling", args[0])) {
+      mem_ceiling = (unsigned long long)strtoull(args[1], &q, 10);
+      if(errno || (args[1] == q)) {
+        s_log(G_WARNING, "Invalid mem_ceiling value: %s\n", args[1]);
+        rc = 0;
+        goto close_out;
+      }
+    }
     else {
       s_log(G_WARNING, "Unknown benchmark option in %s: %s\n",
                        benchmark_infile, args[0]);
@@ -340,6 +389,7 @@ int save_benchmark_data(void)
 
   fprintf(fp, "second_count = %llu\n", second_count);
   fprintf(fp, "prng_count = %llu\n", prng_count);
+  fprintf(fp, "mem_ceiling = %llu\n", mem_ceiling);
 
   fclose(fp);
 
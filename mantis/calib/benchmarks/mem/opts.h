@@ -50,6 +50,18 @@ extern char log_file[];
 /* The input file name is global since it's needed outside this file. */
 extern char input_file[];
 
+/* netgamut: TCP port to serve commands on (0 for the default) */
+extern unsigned int server_port;
+
+/* netgamut: address to serve them on (empty for NETGAMUT_ADDR) */
+extern char server_addr[];
+
+/* netgamut: Unix socket to serve commands on as well (if not empty) */
+extern char server_path[];
+
+/* gamut: coordinate the nodes in this file, then exit (if not empty) */
+extern char coord_file[];
+
 /************************** End global variables **********************/
 
 /********************** Begin function declarations *******************/
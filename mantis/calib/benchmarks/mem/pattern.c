@@ -0,0 +1,615 @@
+/*
+ * Copyright 2005 Justin Moore, justin@cs.duke.edu
+ *
+ * This software may be freely redistributed under the terms of the GNU
+ * public license.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pattern.h"
+#include "utilio.h"
+#include "utillog.h"
+
+/*
+ * Each generator fills pr->ring with pr->size block numbers and
+ *   tells us how to move the ring along each lap.
+ */
+typedef int (*pattern_fill_func)(pattern_ring *pr, pattern_opts *popts);
+
+static int ring_fill(pattern_ring *pr);
+
+static int fill_linear(pattern_ring *pr, pattern_opts *popts);
+static int fill_runs(pattern_ring *pr, pattern_opts *popts);
+static int fill_uniform(pattern_ring *pr, pattern_opts *popts);
+static int fill_zipf(pattern_ring *pr, pattern_opts *popts);
+static int fill_hotcold(pattern_ring *pr, pattern_opts *popts);
+
+typedef struct {
+  char              *pat_label;
+  pattern_type       type;
+  pattern_fill_func  ffunc;
+} pattern_gen;
+
+static pattern_gen pattern_gens[] = {
+  { "default", PAT_DEFAULT, NULL         },
+  { "seq",     PAT_SEQ,     fill_linear  },
+  { "runs",    PAT_RUNS,    fill_runs    },
+  { "stride",  PAT_STRIDE,  fill_linear  },
+  { "page",    PAT_PAGE,    fill_linear  },
+  { "uniform", PAT_UNIFORM, fill_uniform },
+  { "zipf",    PAT_ZIPF,    fill_zipf    },
+  { "hotcold", PAT_HOTCOLD, fill_hotcold }
+};
+static uint32_t num_pattern_gens = sizeof(pattern_gens)
+                                   / sizeof(pattern_gens[0]);
+
+/*
+ * Get a random number in [0, 1).
+ */
+static double pattern_rand_dec(uint64_t *state)
+{
+  return (double)(pattern_rand(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * Parse a pattern description such as "zipf:0.99" or "hotcold:10/90".
+ *   Returns 0 on success, -1 on a bad description.
+ */
+int pattern_parse(char *str, pattern_opts *popts)
+{
+  char *q;
+  char *arg;
+  char name[SMBUFSIZE];
+  uint32_t i;
+  int len;
+
+  if(!str || !popts)
+    return -1;
+
+  memset(popts, 0, sizeof(*popts));
+
+  arg = strchr(str, ':');
+  len = arg ? (int)(arg - str) : (int)strlen(str);
+  if(!len || (len >= SMBUFSIZE))
+    return -1;
+  memcpy(name, str, len);
+  name[len] = '\0';
+  if(arg)
+    arg++;
+
+  if(!strcmp(name, "random"))
+    strcpy(name, "uniform");
+
+  for(i = 1;i < num_pattern_gens;i++) {
+    if(!strcmp(name, pattern_gens[i].pat_label))
+      break;
+  }
+  if(i == num_pattern_gens)
+    return -1;
+  popts->type = pattern_gens[i].type;
+
+  switch(popts->type) {
+    case PAT_RUNS:
+    case PAT_STRIDE:
+      if(!arg)
+        return -1;
+      errno = 0;
+      popts->step = (uint64_t)strtoull(arg, &q, 10);
+      if(errno || (arg == q) || *q || !popts->step)
+        return -1;
+      break;
+    case PAT_ZIPF:
+      if(!arg)
+        return -1;
+      errno = 0;
+      popts->alpha = strtod(arg, &q);
+      if(errno || (arg == q) || *q || (popts->alpha <= 0.0))
+        return -1;
+      break;
+    case PAT_HOTCOLD:
+      if(!arg)
+        return -1;
+      errno = 0;
+      popts->hot_pct = (uint16_t)strtoul(arg, &q, 10);
+      if(errno || (arg == q) || (*q != '/'))
+        return -1;
+      arg = q + 1;
+      popts->hot_hits = (uint16_t)strtoul(arg, &q, 10);
+      if(errno || (arg == q) || *q)
+        return -1;
+      if(!popts->hot_pct || (popts->hot_pct >= 100)
+         || (popts->hot_hits > 100))
+      {
+        return -1;
+      }
+      break;
+    default:
+      if(arg)
+        return -1;
+      break;
+  }
+
+  return 0;
+}
+
+/*
+ * Print a pattern description into 'buf'.
+ */
+void pattern_print(pattern_opts *popts, char *buf, int len)
+{
+  char *label;
+
+  if(!popts || !buf || (len <= 0))
+    return;
+
+  label = get_pattern_label(popts->type);
+  if(!label)
+    label = "unknown";
+
+  switch(popts->type) {
+    case PAT_RUNS:
+    case PAT_STRIDE:
+      (void)snprintf(buf, len, "%s:%llu", label,
+                     (unsigned long long)popts->step);
+      break;
+    case PAT_ZIPF:
+      (void)snprintf(buf, len, "%s:%.3f", label, popts->alpha);
+      break;
+    case PAT_HOTCOLD:
+      (void)snprintf(buf, len, "%s:%hu/%hu", label,
+                     popts->hot_pct, popts->hot_hits);
+      break;
+    default:
+      (void)snprintf(buf, len, "%s", label);
+      break;
+  }
+}
+
+/*
+ * Get the label of a pattern type.
+ */
+char* get_pattern_label(pattern_type type)
+{
+  uint32_t i;
+
+  for(i = 0;i < num_pattern_gens;i++) {
+    if(pattern_gens[i].type == type)
+      return pattern_gens[i].pat_label;
+  }
+
+  return NULL;
+}
+
+/*
+ * Fill a ring with 'size' entries of a pattern over 'nblks' blocks
+ *   of 'unit' bytes.  Returns 0 on success, -1 on error.
+ */
+int pattern_ring_init(pattern_ring *pr, pattern_opts *popts,
+                      uint64_t nblks, uint64_t unit,
+                      uint32_t size, uint64_t seed)
+{
+  int rc;
+
+  if(!pr || !popts || !nblks || !unit || !size)
+    return -1;
+
+  memset(pr, 0, sizeof(*pr));
+  pr->ring = (uint64_t *)malloc(size * sizeof(uint64_t));
+  if(!pr->ring) {
+    s_log(G_WARNING, "Could not allocate a %u-entry pattern ring.\n", size);
+    return -1;
+  }
+  pr->size   = size;
+  pr->nblks  = nblks;
+  pr->unit   = unit;
+  pr->span   = nblks * unit;
+  pr->rstate = seed | 1;
+  memcpy(&pr->opts, popts, sizeof(pr->opts));
+
+  rc = ring_fill(pr);
+  if(rc < 0) {
+    pattern_ring_free(pr);
+    return -1;
+  }
+
+  if(pr->lap_refill) {
+    pr->spare = (uint64_t *)malloc(size * sizeof(uint64_t));
+    if(!pr->spare) {
+      s_log(G_WARNING, "Could not allocate a %u-entry pattern ring.\n",
+                       size);
+      pattern_ring_free(pr);
+      return -1;
+    }
+    pattern_ring_refill(pr);
+  }
+
+  return 0;
+}
+
+/*
+ * Free the ring's memory.
+ */
+void pattern_ring_free(pattern_ring *pr)
+{
+  if(!pr)
+    return;
+
+  if(pr->ring)
+    free(pr->ring);
+  if(pr->spare)
+    free(pr->spare);
+  pr->ring  = NULL;
+  pr->spare = NULL;
+  pr->size  = 0;
+  pr->pos   = 0;
+  pr->have_spare = 0;
+}
+
+/*
+ * Move on to the next lap around the ring.
+ */
+void pattern_ring_lap(pattern_ring *pr)
+{
+  pr->pos = 0;
+
+  /*
+   * No sampling here; we're in the middle of the timed accesses.
+   *   If the spare isn't ready yet, go around the same ring again.
+   */
+  if(pr->lap_refill) {
+    if(pr->have_spare) {
+      uint64_t *tmp;
+
+      tmp       = pr->ring;
+      pr->ring  = pr->spare;
+      pr->spare = tmp;
+      pr->have_spare = 0;
+    }
+  }
+  else if(pr->lap_random) {
+    pr->shift = pattern_rand_range(&pr->rstate, pr->nblks) * pr->unit;
+  }
+  else {
+    pr->shift += pr->lap_step;
+    if(pr->shift >= pr->span) {
+      pr->shift -= pr->span;
+
+      /*
+       * Strided patterns move over one block each time they wrap,
+       *   so sooner or later every block gets touched.
+       */
+      if(pr->lap_bump) {
+        pr->shift += pr->unit;
+        if(pr->shift >= pr->span)
+          pr->shift -= pr->span;
+      }
+    }
+  }
+}
+
+/*
+ * Draw the next ring into the spare.
+ */
+void pattern_ring_refill(pattern_ring *pr)
+{
+  uint64_t *tmp;
+
+  if(!pr || !pr->ring || !pr->spare || !pr->lap_refill || pr->have_spare)
+    return;
+
+  /* The generators fill pr->ring, so point it at the spare for now. */
+  tmp       = pr->ring;
+  pr->ring  = pr->spare;
+  if(!ring_fill(pr))
+    pr->have_spare = 1;
+  pr->spare = pr->ring;
+  pr->ring  = tmp;
+}
+
+/*******************************************************************/
+/********************** End of extern funcs ************************/
+/*******************************************************************/
+
+/*
+ * Run the generator for the ring's pattern.
+ *   Returns 0 on success, -1 on error.
+ */
+static int ring_fill(pattern_ring *pr)
+{
+  int rc;
+  uint32_t i;
+  uint32_t gidx;
+
+  for(gidx = 0;gidx < num_pattern_gens;gidx++) {
+    if(pattern_gens[gidx].type == pr->opts.type)
+      break;
+  }
+  if((gidx == num_pattern_gens) || !pattern_gens[gidx].ffunc)
+    return -1;
+
+  rc = pattern_gens[gidx].ffunc(pr, &pr->opts);
+  if(rc < 0)
+    return -1;
+
+  /*
+   * Generators work in blocks; scale everything up to units.
+   */
+  for(i = 0;i < pr->size;i++) {
+    pr->ring[i] *= pr->unit;
+  }
+  pr->lap_step *= pr->unit;
+
+  return 0;
+}
+
+/*
+ * Sequential, fixed stride, and page stride: block i*step, wrapping.
+ */
+static int fill_linear(pattern_ring *pr, pattern_opts *popts)
+{
+  uint32_t i;
+  uint64_t v;
+  uint64_t step;
+
+  switch(popts->type) {
+    case PAT_STRIDE:
+      step = popts->step;
+      break;
+    case PAT_PAGE:
+      {
+        long pagesize;
+
+        pagesize = sysconf(_SC_PAGESIZE);
+        if(pagesize <= 0)
+          pagesize = 4096;
+        step = (uint64_t)pagesize / pr->unit;
+      }
+      break;
+    default:
+      step = 1;
+      break;
+  }
+  if(!step)
+    step = 1;
+  step %= pr->nblks;
+  if(!step)
+    step = 1;
+
+  /*
+   * A stride that wraps around moves over by one block, the same
+   *   as the lap shift does, so we don't keep hitting the same
+   *   few blocks when the ring is bigger than one pass.
+   */
+  pr->lap_bump = (step > 1);
+
+  v = 0;
+  for(i = 0;i < pr->size;i++) {
+    pr->ring[i] = v;
+    v += step;
+    if(v >= pr->nblks) {
+      v -= pr->nblks;
+      if(pr->lap_bump) {
+        v++;
+        if(v == pr->nblks)
+          v = 0;
+      }
+    }
+  }
+
+  pr->lap_step = v;
+
+  return 0;
+}
+
+/*
+ * Runs of 'step' sequential blocks, each starting at a random block.
+ */
+static int fill_runs(pattern_ring *pr, pattern_opts *popts)
+{
+  uint32_t i;
+  uint64_t v;
+  uint64_t left;
+
+  v    = 0;
+  left = 0;
+  for(i = 0;i < pr->size;i++) {
+    if(!left) {
+      v    = pattern_rand_range(&pr->rstate, pr->nblks);
+      left = popts->step;
+    }
+    pr->ring[i] = v;
+    v++;
+    if(v == pr->nblks)
+      v = 0;
+    left--;
+  }
+
+  pr->lap_random = 1;
+
+  return 0;
+}
+
+/*
+ * Uniformly random blocks.
+ */
+static int fill_uniform(pattern_ring *pr, pattern_opts *popts)
+{
+  uint32_t i;
+
+  for(i = 0;i < pr->size;i++) {
+    pr->ring[i] = pattern_rand_range(&pr->rstate, pr->nblks);
+  }
+
+  pr->lap_random = 1;
+
+  return 0;
+}
+
+/*
+ * Helpers for the Zipf sampler; these stay accurate near zero.
+ */
+static double zipf_helper1(double x)
+{
+  if(fabs(x) > 1e-8)
+    return log1p(x) / x;
+  else
+    return 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+}
+
+static double zipf_helper2(double x)
+{
+  if(fabs(x) > 1e-8)
+    return expm1(x) / x;
+  else
+    return 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x));
+}
+
+static double zipf_h(double x, double alpha)
+{
+  return exp(-alpha * log(x));
+}
+
+static double zipf_hint(double x, double alpha)
+{
+  double lx;
+
+  lx = log(x);
+  return zipf_helper2((1.0 - alpha) * lx) * lx;
+}
+
+static double zipf_hint_inv(double x, double alpha)
+{
+  double t;
+
+  t = x * (1.0 - alpha);
+  if(t < -1.0)
+    t = -1.0;
+  return exp(zipf_helper1(t) * x);
+}
+
+/*
+ * Zipf(alpha) over the blocks, sampled by rejection-inversion
+ *   (Hormann and Derflinger), which needs no tables however many
+ *   blocks there are.  Rank 1 is the most popular.  Ranks are then
+ *   scattered over the blocks so the hot set isn't one contiguous
+ *   chunk of memory.
+ */
+static int fill_zipf(pattern_ring *pr, pattern_opts *popts)
+{
+  uint32_t i;
+  uint64_t n;
+  uint64_t mult;
+  double alpha;
+  double hx1;
+  double hn;
+  double s;
+
+  n     = pr->nblks;
+  alpha = popts->alpha;
+
+  hx1 = zipf_hint(1.5, alpha) - 1.0;
+  hn  = zipf_hint((double)n + 0.5, alpha);
+  s   = 2.0 - zipf_hint_inv(zipf_hint(2.5, alpha) - zipf_h(2.0, alpha), alpha);
+
+  /*
+   * Pick a multiplier that's relatively prime to n, so that
+   *   rank -> (rank * mult) mod n hits every block exactly once.
+   */
+  mult = (uint64_t)((double)n * 0.6180339887) | 1;
+  while(1) {
+    uint64_t a;
+    uint64_t b;
+
+    a = mult;
+    b = n;
+    while(b) {
+      uint64_t t;
+
+      t = a % b;
+      a = b;
+      b = t;
+    }
+    if(a == 1)
+      break;
+    mult += 2;
+  }
+
+  for(i = 0;i < pr->size;i++) {
+    uint64_t k;
+
+    while(1) {
+      double u;
+      double x;
+
+      u = hn + pattern_rand_dec(&pr->rstate) * (hx1 - hn);
+      x = zipf_hint_inv(u, alpha);
+      k = (uint64_t)(x + 0.5);
+      if(k < 1)
+        k = 1;
+      else if(k > n)
+        k = n;
+
+      if(((double)k - x <= s)
+         || (u >= zipf_hint((double)k + 0.5, alpha) - zipf_h((double)k, alpha)))
+      {
+        break;
+      }
+    }
+
+#ifdef __SIZEOF_INT128__
+    pr->ring[i] = (uint64_t)(((unsigned __int128)(k - 1) * mult) % n);
+#else
+    pr->ring[i] = k - 1;
+#endif
+  }
+
+  /*
+   * A ring only holds a sample of the distribution; the tail needs
+   *   fresh ones or it's the same few thousand blocks.
+   */
+  pr->lap_refill = 1;
+
+  return 0;
+}
+
+/*
+ * The first hot_pct percent of the blocks get hot_hits percent
+ *   of the accesses; the rest are spread over the cold blocks.
+ */
+static int fill_hotcold(pattern_ring *pr, pattern_opts *popts)
+{
+  uint32_t i;
+  uint64_t nhot;
+  uint64_t ncold;
+
+  nhot = (pr->nblks * popts->hot_pct) / 100;
+  if(!nhot)
+    nhot = 1;
+  ncold = pr->nblks - nhot;
+
+  for(i = 0;i < pr->size;i++) {
+    if(!ncold
+       || ((pattern_rand(&pr->rstate) % 100) < popts->hot_hits))
+    {
+      pr->ring[i] = pattern_rand_range(&pr->rstate, nhot);
+    }
+    else {
+      pr->ring[i] = nhot + pattern_rand_range(&pr->rstate, ncold);
+    }
+  }
+
+  /* Likewise for the cold blocks. */
+  pr->lap_refill = 1;
+
+  return 0;
+}
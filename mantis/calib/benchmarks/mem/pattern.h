@@ -0,0 +1,204 @@
+/*
+ * Copyright 2005 Justin Moore, justin@cs.duke.edu
+ *
+ * This software may be freely redistributed under the terms of the GNU
+ * public license.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef GAMUT_PATTERN_H
+#define GAMUT_PATTERN_H
+
+#include <netdb.h>  /* for uint{16,32,64}_t */
+
+/*
+ * Access patterns over a set of blocks.
+ */
+typedef enum {
+  PAT_DEFAULT = 0, /* Not given; the worker picks one           */
+  PAT_SEQ,         /* Sequential                                */
+  PAT_RUNS,        /* Sequential runs, then a random jump        */
+  PAT_STRIDE,      /* Every N'th block                           */
+  PAT_PAGE,        /* One block per page, page after page        */
+  PAT_UNIFORM,     /* Uniformly random                           */
+  PAT_ZIPF,        /* Zipfian popularity with exponent alpha     */
+  PAT_HOTCOLD,     /* Some percent of blocks get most accesses   */
+  PAT_LAST
+} pattern_type;
+
+typedef struct {
+  pattern_type type;
+  uint64_t     step;     /* Run length (runs) or stride (stride) */
+  double       alpha;    /* Exponent for zipf */
+  uint16_t     hot_pct;  /* Percent of the blocks that are hot */
+  uint16_t     hot_hits; /* Percent of accesses that go to them */
+} pattern_opts;
+
+/*
+ * A precomputed sequence of offsets.  Generating the pattern is done
+ *   up front, so handing out an offset is just a load and an add.
+ *   Each time we go around the ring, every entry can be shifted so
+ *   we don't keep touching the same handful of blocks.  Shifting
+ *   would move a skewed pattern's hot set around, so those draw a
+ *   fresh ring from the distribution into a spare instead, between
+ *   epochs, and swap it in at the next lap.
+ */
+typedef struct {
+  pattern_opts opts;    /* What the ring was filled with */
+  uint64_t *ring;       /* Offsets (in units) */
+  uint32_t  size;       /* Number of entries */
+  uint32_t  pos;        /* Next entry to hand out */
+  uint64_t  nblks;      /* Number of blocks in the pattern */
+  uint64_t  unit;       /* Size of a block */
+  uint64_t  span;       /* nblks * unit */
+  uint64_t  shift;      /* Added to every entry on this lap (in units) */
+  uint64_t  lap_step;   /* How far the shift moves each lap (in units) */
+  uint16_t  lap_random; /* Pick a random shift each lap instead */
+  uint16_t  lap_bump;   /* Move over a block each time the shift wraps */
+  uint16_t  lap_refill; /* Swap in a freshly drawn ring instead */
+  uint16_t  have_spare; /* The spare holds a ring we haven't used */
+  uint64_t *spare;      /* Next ring for lap_refill patterns */
+  uint64_t  rstate;     /* PRNG state */
+} pattern_ring;
+
+/*
+ * Small, fast PRNG (xorshift64*).  Threads keep their own state
+ *   rather than fight over the global Mersenne Twister.
+ */
+static inline uint64_t pattern_rand(uint64_t *state)
+{
+  uint64_t x;
+
+  x  = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+
+  return x * 0x2545F4914F6CDD1DULL;
+}
+
+/*
+ * A uniformly random number in [0, n), without the bias that
+ *   taking the remainder has when n is large.
+ */
+static inline uint64_t pattern_rand_range(uint64_t *state, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+  uint64_t lo;
+  uint64_t floor;
+  unsigned __int128 m;
+
+  if(!n)
+    return 0;
+
+  m  = (unsigned __int128)pattern_rand(state) * n;
+  lo = (uint64_t)m;
+  if(lo < n) {
+    floor = -n % n;
+    while(lo < floor) {
+      m  = (unsigned __int128)pattern_rand(state) * n;
+      lo = (uint64_t)m;
+    }
+  }
+
+  return (uint64_t)(m >> 64);
+#else
+  uint64_t x;
+  uint64_t top;
+  uint64_t limit;
+
+  if(!n)
+    return 0;
+
+  /* Throw away draws from the short last stretch of the range. */
+  top   = ~(uint64_t)0;
+  limit = top - top % n;
+  do {
+    x = pattern_rand(state);
+  } while(x >= limit);
+
+  return x % n;
+#endif
+}
+
+/*
+ * Turn a ring entry into an offset for this lap.
+ */
+static inline uint64_t pattern_offset(pattern_ring *pr, uint64_t entry)
+{
+  entry += pr->shift;
+  if(entry >= pr->span)
+    entry -= pr->span;
+
+  return entry;
+}
+
+/*
+ * Parse a pattern description such as "zipf:0.99" or "hotcold:10/90".
+ *   Returns 0 on success, -1 on a bad description.
+ */
+extern int pattern_parse(char *str, pattern_opts *popts);
+
+/*
+ * Print a pattern description into 'buf'.
+ */
+extern void pattern_print(pattern_opts *popts, char *buf, int len);
+
+/*
+ * Get the label of a pattern type.
+ */
+extern char* get_pattern_label(pattern_type type);
+
+/*
+ * Fill a ring with 'size' entries of a pattern over 'nblks' blocks
+ *   of 'unit' bytes.  Returns 0 on success, -1 on error.
+ */
+extern int pattern_ring_init(pattern_ring *pr, pattern_opts *popts,
+                             uint64_t nblks, uint64_t unit,
+                             uint32_t size, uint64_t seed);
+
+/*
+ * Free the ring's memory.
+ */
+extern void pattern_ring_free(pattern_ring *pr);
+
+/*
+ * Move on to the next lap around the ring.
+ */
+extern void pattern_ring_lap(pattern_ring *pr);
+
+/*
+ * Draw the next ring into the spare, if the pattern needs one and
+ *   the last one has been swapped in.  This runs the sampler, so
+ *   call it between epochs, not while the accesses are being timed.
+ */
+extern void pattern_ring_refill(pattern_ring *pr);
+
+/*
+ * Look at the next offset without taking it.
+ */
+static inline uint64_t pattern_ring_peek(pattern_ring *pr)
+{
+  return pattern_offset(pr, pr->ring[pr->pos]);
+}
+
+/*
+ * Hand out the next offset from the ring.
+ */
+static inline uint64_t pattern_ring_next(pattern_ring *pr)
+{
+  uint64_t off;
+
+  off = pattern_offset(pr, pr->ring[pr->pos]);
+  pr->pos++;
+  if(pr->pos == pr->size)
+    pattern_ring_lap(pr);
+
+  return off;
+}
+
+#endif /* GAMUT_PATTERN_H */
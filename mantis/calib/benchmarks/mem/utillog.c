@@ -28,6 +28,14 @@ static s_log_level log_level = G_NOTICE;
 static FILE *log_stream = NULL;
 static char hname[BUFSIZE+1] = { 0 };
 
+static pthread_key_t  tee_key;
+static pthread_once_t tee_once = PTHREAD_ONCE_INIT;
+
+static void tee_key_init(void)
+{
+  (void)pthread_key_create(&tee_key, NULL);
+}
+
 void set_log_level(s_log_level level)
 {
   if(log_stream == NULL)
@@ -52,11 +60,23 @@ s_log_level get_log_level(void)
   return log_level;
 }
 
+void set_log_tee(FILE *fp)
+{
+  (void)pthread_once(&tee_once, tee_key_init);
+  (void)pthread_setspecific(tee_key, fp);
+}
+
 int s_log(s_log_level level, char *format, ...)
 {
   int rc = 0;
+  FILE *tee;
+
+  (void)pthread_once(&tee_once, tee_key_init);
+  tee = (FILE *)pthread_getspecific(tee_key);
+  if(tee && (level > G_INFO))
+    tee = NULL;
 
-  if(log_stream && (level <= log_level)) {
+  if((log_stream && (level <= log_level)) || tee) {
     char buf[BUFSIZE + 1];
     char vbuf[BUFSIZE + 1];
     va_list ap;
@@ -80,12 +100,18 @@ int s_log(s_log_level level, char *format, ...)
     {
       int len = strlen(vbuf);
       if(len && (vbuf[len - 1] != '\n')) {
-        vbuf[len] = '\n';
+        vbuf[len]     = '\n';
+        vbuf[len + 1] = '\0';
       }
     }
 
-    fprintf(log_stream, "%d: %s %lu %s.%06d %s", level, hname,
-            pthread_self(), buf, (int) tv.tv_usec, vbuf);
+    if(log_stream && (level <= log_level)) {
+      fprintf(log_stream, "%d: %s %lu %s.%06d %s", level, hname,
+              pthread_self(), buf, (int) tv.tv_usec, vbuf);
+    }
+    if(tee) {
+      fputs(vbuf, tee);
+    }
   }
 
   return rc;
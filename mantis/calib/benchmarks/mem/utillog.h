@@ -32,6 +32,12 @@ extern void set_log_level(s_log_level level);
 extern void set_log_stream(FILE *fp);
 extern s_log_level get_log_level(void);
 extern void set_log_label(char *label);
+
+/*
+ * Also copy what this thread logs at G_INFO or above, without the
+ *   prefix, to 'fp' (NULL to stop).  The log level doesn't apply.
+ */
+extern void set_log_tee(FILE *fp);
 extern int s_log(s_log_level level, char *format, ...)
                  __attribute__ ((format (printf, 2, 3)));
 
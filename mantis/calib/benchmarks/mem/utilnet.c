@@ -27,6 +27,7 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/un.h>
    
 #include "utilarr.h"
 #include "utilio.h"
@@ -318,7 +319,10 @@ int get_client_sock(const char *node, uint16_t port)
   return sock;
 }
 
-int get_server_sock(uint16_t port)
+/*
+ * A listening TCP socket on 'port' of 'addr' (network byte order).
+ */
+int get_server_sock(uint32_t addr, uint16_t port)
 {
   int rc;
   int optval;
@@ -340,8 +344,54 @@ int get_server_sock(uint16_t port)
 
   saddr.sin_family = AF_INET;
   saddr.sin_port = htons(port);
-  saddr.sin_addr.s_addr = htonl(INADDR_ANY);
+  saddr.sin_addr.s_addr = addr;
+
+  rc = bind(sock, (struct sockaddr *)&saddr, sizeof(saddr));
+  if(rc < 0) {
+    close(sock);
+    return -1;
+  }
+
+  rc = listen(sock, 32);
+  if(rc < 0) {
+    close(sock);
+    return -1;
+  }
+  else
+    return sock;
+}
 
+/*
+ * A listening Unix-domain stream socket at 'path'.  A socket left
+ *   there from before is removed first; anything else is left alone,
+ *   and we fail with EEXIST.
+ */
+int get_unix_server_sock(const char *path)
+{
+  int rc;
+  int sock;
+  struct stat sbuf;
+  struct sockaddr_un saddr;
+
+  if(!path || !(*path) || (strlen(path) >= sizeof(saddr.sun_path)))
+    return -1;
+
+  sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(sock < 0)
+    return -1;
+
+  memset(&saddr, 0, sizeof(saddr));
+  saddr.sun_family = AF_UNIX;
+  strncpy(saddr.sun_path, path, sizeof(saddr.sun_path) - 1);
+
+  if(!lstat(path, &sbuf)) {
+    if(!S_ISSOCK(sbuf.st_mode)) {
+      close(sock);
+      errno = EEXIST;
+      return -1;
+    }
+    (void)unlink(path);
+  }
   rc = bind(sock, (struct sockaddr *)&saddr, sizeof(saddr));
   if(rc < 0) {
     close(sock);
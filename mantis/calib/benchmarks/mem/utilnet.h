@@ -58,7 +58,8 @@ extern int del_socket(growArray *s_arr, int sock);
 extern int accept_connection(growArray *s_arr, uint32_t usec_timeout);
 
 extern int get_client_sock(const char *node, uint16_t port);
-extern int get_server_sock(uint16_t port);
+extern int get_server_sock(uint32_t addr, uint16_t port);
+extern int get_unix_server_sock(const char *path);
 
 /*
  * Build (cache) the list of network interfaces.
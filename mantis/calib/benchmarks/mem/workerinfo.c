@@ -16,6 +16,7 @@
 #include <unistd.h>
 
 #include "opts.h"
+#include "pattern.h"
 #include "utilio.h"
 #include "utillog.h"
 #include "workerinfo.h"
@@ -27,6 +28,7 @@
 static void print_shared_opts(shared_opts *shopts, int detail);
 static void print_cpu_opts(cpu_opts *cpu, int detail);
 static void print_mem_opts(mem_opts *mem, int detail);
+static void print_mem_epochs(mem_opts *mem, int detail);
 static void print_dio_opts(dio_opts *dio, int detail);
 static void print_nio_opts(nio_opts *nio, int detail);
 
@@ -336,6 +338,9 @@ static void print_cpu_opts(cpu_opts *cpu, int detail)
 
 static void print_mem_opts(mem_opts *mem, int detail)
 {
+  uint32_t t;
+  uint64_t memio;
+  uint64_t dirio[2];
   char total[SMBUFSIZE];
   char wset[SMBUFSIZE];
   char rate[SMBUFSIZE];
@@ -343,15 +348,27 @@ static void print_mem_opts(mem_opts *mem, int detail)
   char io_max[SMBUFSIZE];
   char mdlines[SMBUFSIZE];
   char tdlines[SMBUFSIZE];
+  char pattern[SMBUFSIZE];
 
   if(!mem || (detail < 0))
     return;
 
+  /*
+   * Each thread keeps its own count; add them up here.
+   */
+  dirio[C_IOREAD]  = 0;
+  dirio[C_IOWRITE] = 0;
+  for(t = 0;t < MAX_MEM_THREADS;t++) {
+    dirio[C_IOREAD]  += mem->tstats[t].memio[C_IOREAD];
+    dirio[C_IOWRITE] += mem->tstats[t].memio[C_IOWRITE];
+  }
+  memio = dirio[C_IOREAD] + dirio[C_IOWRITE];
+
   print_shared_opts(&mem->shopts, detail);
   print_scaled_number(total,   SMBUFSIZE, mem->total_ram, 1);
   print_scaled_number(wset,    SMBUFSIZE, mem->working_ram, 1);
   print_scaled_number(rate,    SMBUFSIZE, mem->iorate, 1);
-  print_scaled_number(io_done, SMBUFSIZE, mem->total_memio, 1);
+  print_scaled_number(io_done, SMBUFSIZE, memio, 1);
   print_scaled_number(io_max,  SMBUFSIZE, mem->shopts.max_work, 1);
   print_scaled_number(mdlines, SMBUFSIZE, mem->shopts.missed_deadlines, 0);
   print_scaled_number(tdlines, SMBUFSIZE, mem->shopts.total_deadlines, 0);
@@ -361,10 +378,30 @@ static void print_mem_opts(mem_opts *mem, int detail)
   s_log(G_INFO, "Working set:   %12llu (%9s)\n",
                 mem->working_ram, wset);
   s_log(G_INFO, "Stride length: %12u pages\n", mem->stride);
+  pattern_print(&mem->pattern, pattern, SMBUFSIZE);
+  s_log(G_INFO, "Pattern:       %12s\n", pattern);
+  s_log(G_INFO, "Threads:       %12u\n", mem->nthreads);
+  s_log(G_INFO, "R/W mix:       %5hu rd/%4hu wr\n",
+                mem->rwmix.numrds, mem->rwmix.numwrs);
   s_log(G_INFO, "I/O rate:      %12llu/s (%9s)\n",
                 mem->iorate, rate);
   s_log(G_INFO, "I/O done:      %12llu   (%9s)\n",
-                mem->total_memio, io_done);
+                memio, io_done);
+  print_scaled_number(io_done, SMBUFSIZE, dirio[C_IOREAD], 1);
+  s_log(G_INFO, "  Reads:       %12llu   (%9s)\n",
+                (unsigned long long)dirio[C_IOREAD], io_done);
+  print_scaled_number(io_done, SMBUFSIZE, dirio[C_IOWRITE], 1);
+  s_log(G_INFO, "  Writes:      %12llu   (%9s)\n",
+                (unsigned long long)dirio[C_IOWRITE], io_done);
+  if(detail && (mem->nthreads > 1)) {
+    for(t = 0;t < mem->nthreads;t++) {
+      memio = mem->tstats[t].memio[C_IOREAD]
+              + mem->tstats[t].memio[C_IOWRITE];
+      print_scaled_number(io_done, SMBUFSIZE, memio, 1);
+      s_log(G_INFO, "  Thread %2u:   %12llu   (%9s)  CPU %d\n", t,
+                    (unsigned long long)memio, io_done, mem->tstats[t].cpu);
+    }
+  }
   s_log(G_INFO, "Max. I/O:      %12llu   (%9s)\n",
                 mem->shopts.max_work, io_max);
   s_log(G_INFO, "Missed deadlines: %12llu (%9s)\n",
@@ -373,6 +410,184 @@ static void print_mem_opts(mem_opts *mem, int detail)
                 mem->shopts.missed_usecs);
   s_log(G_INFO, "Total deadlines:  %12llu (%9s)\n",
                 mem->shopts.total_deadlines, tdlines);
+
+  print_mem_epochs(mem, detail);
+}
+
+/*
+ * Which epochs in the history can we look at?  The worker fills in
+ *   a slot under its lock, which we hold, so all of the ring.
+ */
+static uint64_t mem_epoch_range(mem_opts *mem, uint64_t *first)
+{
+  uint64_t count;
+
+  count = mem->nepochs;
+  if(count > MEM_EPOCH_SAMPLES)
+    count = MEM_EPOCH_SAMPLES;
+  *first = mem->nepochs - count;
+
+  return count;
+}
+
+/*
+ * Bytes per second achieved in epoch 'i'.  An epoch lasts until the
+ *   next one starts, which is longer than usual if it missed its
+ *   deadline; the newest epoch is assumed to be on time.
+ */
+static uint64_t mem_epoch_rate(mem_opts *mem, uint64_t i, uint64_t last)
+{
+  uint64_t len;
+  mem_epoch_sample *sample;
+
+  sample = &mem->epochs[i % MEM_EPOCH_SAMPLES];
+  if(i < last) {
+    len = mem->epochs[(i + 1) % MEM_EPOCH_SAMPLES].start_usec
+          - sample->start_usec;
+  }
+  else {
+    len = US_PER_WORKER_EPOCH;
+  }
+  if(!len)
+    len = 1;
+
+  return (uint64_t)((double)sample->bytes * US_SEC / len);
+}
+
+/*
+ * Summarize a memory worker's epoch history.  With a detail level
+ *   above 1 the last second's worth of epochs are listed as well.
+ */
+static void print_mem_epochs(mem_opts *mem, int detail)
+{
+  char rate[SMBUFSIZE];
+  uint64_t i;
+  uint64_t first;
+  uint64_t last;
+  uint64_t count;
+  uint64_t recent;
+  uint64_t bytes;
+  uint64_t busy;
+  uint64_t span;
+  uint64_t r;
+  uint64_t min_rate;
+  uint64_t max_rate;
+
+  if(!mem->epochs)
+    return;
+
+  count = mem_epoch_range(mem, &first);
+  if(!count)
+    return;
+  last = first + count - 1;
+
+  /*
+   * The last second (or however much we have).
+   */
+  recent = (count > WORKER_EPOCHS_PER_SEC) ? WORKER_EPOCHS_PER_SEC : count;
+  bytes  = 0;
+  busy   = 0;
+  for(i = last + 1 - recent;i <= last;i++) {
+    bytes += mem->epochs[i % MEM_EPOCH_SAMPLES].bytes;
+    busy  += mem->epochs[i % MEM_EPOCH_SAMPLES].busy_usec;
+  }
+  span = mem->epochs[last % MEM_EPOCH_SAMPLES].start_usec
+         - mem->epochs[(last + 1 - recent) % MEM_EPOCH_SAMPLES].start_usec
+         + US_PER_WORKER_EPOCH;
+
+  print_scaled_number(rate, SMBUFSIZE,
+                      (uint64_t)((double)bytes * US_SEC / span), 1);
+  s_log(G_INFO, "Epochs kept:   %12llu\n", (unsigned long long)count);
+  s_log(G_INFO, "Recent rate:   %12s/s (%.1f%% busy)\n",
+                rate, (double)busy * 100.0 / span);
+
+  min_rate = (uint64_t)-1;
+  max_rate = 0;
+  for(i = first;i <= last;i++) {
+    r = mem_epoch_rate(mem, i, last);
+    if(r < min_rate)
+      min_rate = r;
+    if(r > max_rate)
+      max_rate = r;
+  }
+  print_scaled_number(rate, SMBUFSIZE, min_rate, 1);
+  s_log(G_INFO, "  Epoch min:   %12s/s\n", rate);
+  print_scaled_number(rate, SMBUFSIZE, max_rate, 1);
+  s_log(G_INFO, "  Epoch max:   %12s/s\n", rate);
+
+  if(detail > 1) {
+    for(i = last + 1 - recent;i <= last;i++) {
+      mem_epoch_sample *sample;
+
+      sample = &mem->epochs[i % MEM_EPOCH_SAMPLES];
+      print_scaled_number(rate, SMBUFSIZE, mem_epoch_rate(mem, i, last), 1);
+      s_log(G_INFO, "  Epoch %6llu: %llu.%06llu %9s/s busy %6u us\n",
+                    (unsigned long long)i,
+                    (unsigned long long)(sample->start_usec / US_SEC),
+                    (unsigned long long)(sample->start_usec % US_SEC),
+                    rate, sample->busy_usec);
+    }
+  }
+}
+
+/*
+ * Write a memory worker's epoch history to a file as CSV.
+ */
+int dump_mem_epochs(gamut_opts *gopts, int widx, char *fname)
+{
+  int rc;
+  uint64_t i;
+  uint64_t first;
+  uint64_t last;
+  uint64_t count;
+  mem_opts *mem;
+  FILE *outfp;
+
+  if(!gopts || (widx < 0) || (widx >= MAX_MEMS) || !fname)
+    return -1;
+
+  rc = lock_worker(gopts, CLS_MEM, widx);
+  if(rc < 0)
+    return -1;
+
+  mem = &gopts->mem[widx];
+  if(!mem->shopts.used || !mem->epochs) {
+    s_log(G_WARNING, "Memory worker %d has no epoch history.\n", widx);
+    (void)unlock_worker(gopts, CLS_MEM, widx);
+    return -1;
+  }
+
+  outfp = fopen(fname, "w");
+  if(!outfp) {
+    s_log(G_WARNING, "Could not open %s: %s.\n", fname, strerror(errno));
+    (void)unlock_worker(gopts, CLS_MEM, widx);
+    return -1;
+  }
+
+  fprintf(outfp, "epoch,start_usec,bytes,busy_usec,bytes_per_sec\n");
+  count = mem_epoch_range(mem, &first);
+  last  = first + count - 1;
+  for(i = first;i < (first + count);i++) {
+    mem_epoch_sample *sample;
+
+    sample = &mem->epochs[i % MEM_EPOCH_SAMPLES];
+    fprintf(outfp, "%llu,%llu,%llu,%u,%llu\n", (unsigned long long)i,
+                   (unsigned long long)sample->start_usec,
+                   (unsigned long long)sample->bytes, sample->busy_usec,
+                   (unsigned long long)mem_epoch_rate(mem, i, last));
+  }
+
+  (void)unlock_worker(gopts, CLS_MEM, widx);
+
+  s_log(G_NOTICE, "Wrote %llu epochs for %s to %s.\n",
+                  (unsigned long long)count, mem->shopts.label, fname);
+
+  if(fclose(outfp)) {
+    s_log(G_WARNING, "Error closing %s: %s.\n", fname, strerror(errno));
+    return -1;
+  }
+
+  return 0;
 }
 
 static void print_dio_opts(dio_opts *dio, int detail)
@@ -389,6 +604,14 @@ static void print_dio_opts(dio_opts *dio, int detail)
   char seek_us[SMBUFSIZE];
   char mdlines[SMBUFSIZE];
   char tdlines[SMBUFSIZE];
+  char offsets[SMBUFSIZE];
+  char stripe[SMBUFSIZE];
+  char lat[BUFSIZE];
+  char *engine;
+  int i;
+  static char *meta_names[NUM_DIO_META_OPS] = {
+    "Creates", "Stats", "Renames", "Unlinks"
+  };
 
   if(!dio || (detail < 0))
     return;
@@ -410,11 +633,73 @@ static void print_dio_opts(dio_opts *dio, int detail)
 
   s_log(G_INFO, "I/O file:   %s\n", dio->file);
   s_log(G_INFO, "Block size: %u (%9s)\n", dio->blksize, bsize);
-  s_log(G_INFO, "Blocks:     %8u\n", dio->nblks);
+  s_log(G_INFO, "Blocks:     %8llu\n",
+                (unsigned long long)dio->nblks);
+  if(dio->nfiles > 1) {
+    print_scaled_number(stripe, SMBUFSIZE, dio->stripe, 1);
+    s_log(G_INFO, "Files:      %8hu  Stripe: %u (%9s)\n",
+                  dio->nfiles, dio->stripe, stripe);
+  }
   s_log(G_INFO, "Mode:       %2hu  I/O mix: %4hu rd/%4hu wr/%4hu sk\n",
                 dio->create, dio->iomix.numrds, dio->iomix.numwrs,
                 dio->iomix.numsks);
-  s_log(G_INFO, "I/O rate:   %8u/s (%9s/s)\n", dio->iorate, rate);
+  switch(dio->engine) {
+    case DIO_ENGINE_URING:
+      engine = "uring";
+      break;
+    case DIO_ENGINE_MMAP:
+      engine = "mmap";
+      break;
+    case DIO_ENGINE_META:
+      engine = "meta";
+      break;
+    default:
+      engine = "sync";
+      break;
+  }
+  s_log(G_INFO, "Engine:     %8s  Queue depth: %4u\n", engine, dio->qdepth);
+  if(dio->engine == DIO_ENGINE_META) {
+    s_log(G_INFO, "Tree:       %4hu wide/%hu deep  Op mix: %hu cr/%hu st/"
+                  "%hu mv/%hu rm\n", dio->meta_width, dio->meta_depth,
+                  dio->metamix[DIO_META_CREATE], dio->metamix[DIO_META_STAT],
+                  dio->metamix[DIO_META_RENAME], dio->metamix[DIO_META_UNLINK]);
+    for(i = 0;i < NUM_DIO_META_OPS;i++) {
+      lat_hist_print(&dio->meta_lat[i], lat, BUFSIZE);
+      s_log(G_INFO, "# %-8s %8llu  uSecs: %10llu  %s\n", meta_names[i],
+                    (unsigned long long)dio->num_meta[i],
+                    (unsigned long long)dio->meta_usec[i], lat);
+    }
+  }
+  if(dio->engine == DIO_ENGINE_MMAP) {
+    s_log(G_INFO, "Msync:      %8s  Page faults: %llu minor/%llu major\n",
+                  ((dio->msync == DIO_MSYNC_ASYNC) ? "async" : "sync"),
+                  (unsigned long long)dio->faults[0],
+                  (unsigned long long)dio->faults[1]);
+  }
+  s_log(G_INFO, "Direct I/O: %8s  Fadvise: %8s\n",
+                (dio->direct ? "yes" : "no"),
+                ((dio->fadvise == DIO_FADV_DONTNEED) ? "dontneed" : "none"));
+  s_log(G_INFO, "Sync:       %8s  Every: %u blks  Syncs: %llu in %llu usec\n",
+                get_sync_label(dio->sync_mode), dio->sync_f,
+                (unsigned long long)dio->num_syncs,
+                (unsigned long long)dio->sync_usec);
+  pattern_print(&dio->offset, offsets, SMBUFSIZE);
+  s_log(G_INFO, "Offsets:    %s\n", offsets);
+  if(dio->trace[0]) {
+    s_log(G_INFO, "Trace:      %s  Time scale: %.3f\n",
+                  dio->trace, dio->tscale);
+    s_log(G_INFO, "Trace lag:  %8lld usec total/%lld usec max\n",
+                  (long long)dio->trace_lag_usec,
+                  (long long)dio->trace_lag_max);
+  }
+  s_log(G_INFO, "Data pool:  %8u blocks\n", dio->pool);
+  s_log(G_INFO, "Prep:       %8s  Fill threads: %3hu\n",
+                ((dio->prep == DIO_PREP_FILL)
+                 ? "fill" : ((dio->prep == DIO_PREP_ALLOC) ? "alloc"
+                                                           : "sparse")),
+                dio->prep_threads);
+  s_log(G_INFO, "I/O rate:   %8llu/s (%9s/s)\n",
+                (unsigned long long)dio->iorate, rate);
   s_log(G_INFO, "Total I/O:  %8llu   (%9s)\n",
                 dio->total_diskio, total_io);
   s_log(G_INFO, "Max I/O:    %8llu   (%9s)\n",
@@ -428,6 +713,20 @@ static void print_dio_opts(dio_opts *dio, int detail)
   s_log(G_INFO, "# Seeks:    %8llu   (%9s)  uSecs: %10llu (%9s)\n",
                 dio->num_diskio[C_IOSEEK], seeks,
                 dio->io_usec[C_IOSEEK], seek_us);
+  lat_hist_print(&dio->io_lat[C_IOREAD], lat, BUFSIZE);
+  s_log(G_INFO, "Read latency:  %s\n", lat);
+  lat_hist_print(&dio->io_lat[C_IOWRITE], lat, BUFSIZE);
+  s_log(G_INFO, "Write latency: %s\n", lat);
+  s_log(G_INFO, "Calls:      %8llu rd/%8llu wr  (latency is per call)\n",
+                (unsigned long long)dio->io_calls[C_IOREAD],
+                (unsigned long long)dio->io_calls[C_IOWRITE]);
+  for(i = 0;(dio->nfiles > 1) && (i < dio->nfiles);i++) {
+    s_log(G_INFO, "  File %2d:  %8llu rd/%8llu wr  uSecs: %10llu\n", i,
+                  (unsigned long long)dio->dev[i].num_diskio[C_IOREAD],
+                  (unsigned long long)dio->dev[i].num_diskio[C_IOWRITE],
+                  (unsigned long long)(dio->dev[i].io_usec[C_IOREAD]
+                                       + dio->dev[i].io_usec[C_IOWRITE]));
+  }
   s_log(G_INFO, "Missed deadlines: %12llu (%9s)\n",
                 dio->shopts.missed_deadlines, mdlines);
   s_log(G_INFO, "Missed by usecs:  %12llu\n",
@@ -438,8 +737,42 @@ static void print_dio_opts(dio_opts *dio, int detail)
 
 static void print_nio_opts(nio_opts *nio, int detail)
 {
+  char lat[BUFSIZE];
+
   if(!nio || (detail < 0))
     return;
 
   print_shared_opts(&nio->shopts, detail);
+
+  s_log(G_INFO, "Conns:         %u of %u open, %lld closed  Peer: %s\n",
+                nio->live_conns, nio->conns,
+                (long long)nio->conns_closed,
+                (nio->peer == NIO_PEER_LOCAL) ? "local" : "remote");
+  s_log(G_INFO, "Tx:            %-8s  CPU: %.3f sec user/%.3f sec sys\n",
+                (nio->tx == NIO_TX_SENDFILE) ? "sendfile"
+                : ((nio->tx == NIO_TX_SPLICE) ? "splice"
+                   : ((nio->tx == NIO_TX_ZEROCOPY) ? "zerocopy" : "copy")),
+                (double)nio->cpu_usec[0] / US_SEC,
+                (double)nio->cpu_usec[1] / US_SEC);
+  if(nio->zc_sends) {
+    s_log(G_INFO, "Zero-copy:     %lld sent, %lld done, %lld copied\n",
+                  (long long)nio->zc_sends, (long long)nio->zc_done,
+                  (long long)nio->zc_copied);
+  }
+  if((nio->batch > 1) || nio->gso || nio->gro) {
+    s_log(G_INFO, "Batch:         %u  GSO: %u  GRO: %u  "
+                  "Calls: %lld recv/%lld send\n",
+                  nio->batch, nio->gso, nio->gro,
+                  (long long)nio->batches[C_IOREAD],
+                  (long long)nio->batches[C_IOWRITE]);
+  }
+  if(nio->pace != NIO_PACE_NONE) {
+    s_log(G_INFO, "Pace:          %-8s  Burst: %u  Waits: %lld\n",
+                  (nio->paced == NIO_PACE_KERNEL) ? "kernel" : "user",
+                  nio->burst, (long long)nio->pace_waits);
+  }
+  lat_hist_print(&nio->io_lat[C_IOREAD], lat, BUFSIZE);
+  s_log(G_INFO, "Recv latency:  %s\n", lat);
+  lat_hist_print(&nio->io_lat[C_IOWRITE], lat, BUFSIZE);
+  s_log(G_INFO, "Send latency:  %s\n", lat);
 }
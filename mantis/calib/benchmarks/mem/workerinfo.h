@@ -25,4 +25,9 @@ extern void print_stats_info(gamut_opts *gopts, int detail);
 extern void print_worker_info(gamut_opts *gopts, worker_class wcls,
                               int widx, int detail);
 
+/*
+ * Write a memory worker's epoch history to a file as CSV.
+ */
+extern int dump_mem_epochs(gamut_opts *gopts, int widx, char *fname);
+
 #endif /* GAMUT_WORKERINFO_H */
@@ -21,10 +21,17 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#ifdef __linux__
+#include <linux/fs.h>   /* BLKGETSIZE64 */
+#include <sys/ioctl.h>
+#endif
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include "calibrate.h"
+#include "diskuring.h"
+#include "networker.h"
 #include "utilio.h"
 #include "utillog.h"
 #include "utilnet.h"
@@ -72,6 +79,10 @@ static int copy_nio_opts(nio_opts *src, nio_opts *dest, int keepID);
 static int validate_cpu_opts(gamut_opts *gopts, cpu_opts *cpu);
 static int validate_mem_opts(gamut_opts *gopts, mem_opts *mem);
 static int validate_dio_opts(gamut_opts *gopts, dio_opts *dio);
+static int validate_dio_file(char *fname, int create, int dowrite,
+                             int rawdev, uint64_t *fsize, int *isdev);
+static int validate_dio_meta(dio_opts *dio);
+static int validate_dio_trace(dio_opts *dio);
 static int validate_nio_opts(gamut_opts *gopts, nio_opts *nio);
 
 /*
@@ -141,6 +152,10 @@ void init_opts(gamut_opts *gopts)
 
   gopts->mctl.mcmd = MCMD_FREE;
   memset(gopts->mctl.mbuf, 0, sizeof(gopts->mctl.mbuf));
+  gopts->mctl.mout  = NULL;
+  gopts->mctl.mseq  = 0;
+  gopts->mctl.mdone = 0;
+  gopts->mctl.mrc   = 0;
 
   gopts->mctl.t_sync.curr_lock = 0;
   memset(gopts->mctl.t_sync.lock_order, 0,
@@ -525,6 +540,73 @@ shared_opts* get_shared_opts(gamut_opts *gopts,
   return shopts;
 }
 
+/*
+ * Split a disk worker's file list on ':', in place.  Returns the
+ *   number of files, or -1 if there are too many or one is empty.
+ */
+int split_dio_files(char *list, char *names[])
+{
+  int i;
+  int n;
+  char *p;
+
+  if(!list || !names)
+    return -1;
+
+  n = 0;
+  p = list;
+  while(p) {
+    if(n >= MAX_DIO_FILES)
+      return -1;
+    names[n++] = p;
+
+    p = strchr(p, ':');
+    if(p)
+      *p++ = '\0';
+  }
+
+  for(i = 0;i < n;i++) {
+    if(!*names[i])
+      return -1;
+  }
+
+  return n;
+}
+
+/*
+ * Names for the sync= modes, indexed by DIO_SYNC_*.
+ */
+static char *dio_sync_labels[] = {
+  "fsync", "fdatasync", "range", "dsync", "none"
+};
+#define NUM_DIO_SYNC_LABELS \
+  (sizeof(dio_sync_labels) / sizeof(dio_sync_labels[0]))
+
+char* get_sync_label(uint16_t mode)
+{
+  if(mode >= NUM_DIO_SYNC_LABELS)
+    return NULL;
+
+  return dio_sync_labels[mode];
+}
+
+/*
+ * Find the sync mode named by the first 'len' characters of
+ *   'name'.  Returns the DIO_SYNC_* value, or -1.
+ */
+static int get_sync_mode(char *name, size_t len)
+{
+  uint32_t i;
+
+  for(i = 0;i < NUM_DIO_SYNC_LABELS;i++) {
+    if((strlen(dio_sync_labels[i]) == len)
+       && !strncmp(dio_sync_labels[i], name, len))
+      return (int)i;
+  }
+
+  return -1;
+}
+
 static workerID get_next_workerID(void)
 {
   return next_workerID++;
@@ -951,8 +1033,50 @@ static int parse_mem_opts(gamut_opts *gopts, mem_opts *mem, char *attrs)
       if(errno || (pargs[1] == q))
         goto fail_out;
     }
+    else if(!strcmp("threads", pargs[0])) {
+#define MEM_THREADS_ARG (MEM_STRIDE_ARG + 1)
+      if(args_done[MEM_THREADS_ARG]++)
+        goto fail_out;
+
+      errno = 0;
+      tmem.nthreads = (uint32_t)strtoul(pargs[1], &q, 10);
+      if(errno || (pargs[1] == q))
+        goto fail_out;
+    }
+    else if(!strcmp("rwmix", pargs[0])) {
+      char *spargs[2];
+      int nspargs;
+
+#define MEM_RWMIX_ARG (MEM_THREADS_ARG + 1)
+      if(args_done[MEM_RWMIX_ARG]++)
+        goto fail_out;
+
+      nspargs = split("/", pargs[1], spargs, 2, ws_is_delim);
+      if(nspargs != 2)
+        goto fail_out;
+
+      errno = 0;
+      tmem.rwmix.numrds = (uint16_t)strtoul(spargs[0], &q, 10);
+      if(errno || (spargs[0] == q))
+        goto fail_out;
+
+      errno = 0;
+      tmem.rwmix.numwrs = (uint16_t)strtoul(spargs[1], &q, 10);
+      if(errno || (spargs[1] == q))
+        goto fail_out;
+    }
+    else if(!strcmp("pattern", pargs[0])) {
+#define MEM_PATTERN_ARG (MEM_RWMIX_ARG + 1)
+      if(args_done[MEM_PATTERN_ARG]++)
+        goto fail_out;
+
+      if(pattern_parse(pargs[1], &tmem.pattern) < 0) {
+        s_log(G_WARNING, "Bad access pattern \"%s\".\n", pargs[1]);
+        goto fail_out;
+      }
+    }
     else if(!strcmp("etime", pargs[0])) {
-#define MEM_ETIME_ARG (MEM_STRIDE_ARG + 1)
+#define MEM_ETIME_ARG (MEM_PATTERN_ARG + 1)
       if(args_done[MEM_ETIME_ARG]++)
         goto fail_out;
 
@@ -1017,6 +1141,27 @@ static int parse_mem_opts(gamut_opts *gopts, mem_opts *mem, char *attrs)
   if(rc <= 0)
     goto fail_out;
 
+  /*
+   * We'll still run the worker, but let the user know it's not
+   *   going to keep up.  The ceiling is in blocks touched per second
+   *   by a sequential sweep, the best case, so only a block rate
+   *   above it is sure to be missed.
+   */
+  if(mem_ceiling
+     && ((tmem.iorate / tmem.blksize) > (mem_ceiling * tmem.nthreads)))
+  {
+    char rate[SMBUFSIZE];
+    char ceiling[SMBUFSIZE];
+
+    print_scaled_number(rate, SMBUFSIZE, tmem.iorate / tmem.blksize, 0);
+    print_scaled_number(ceiling, SMBUFSIZE,
+                        mem_ceiling * tmem.nthreads, 0);
+    s_log(G_WARNING, "%s: %s blocks/s is more than %u thread(s) "
+                     "reached sweeping memory sequentially (%s blocks/s); "
+                     "it won't be met.\n", tmem.shopts.label, rate,
+                     tmem.nthreads, ceiling);
+  }
+
   if(!tmem.shopts.used) {
     tmem.shopts.used = 1;
     gopts->wstats.workers_parsed++;
@@ -1060,6 +1205,7 @@ static int parse_dio_opts(gamut_opts *gopts, dio_opts *dio, char *attrs)
     goto fail_out;
 
   for(i = 0;i < nargs;i++) {
+    char *p;
     char *q;
     char *pargs[2];
     int npargs;
@@ -1107,7 +1253,7 @@ static int parse_dio_opts(gamut_opts *gopts, dio_opts *dio, char *attrs)
         goto fail_out;
 
       errno = 0;
-      tdio.nblks = (uint32_t)strtoul(pargs[1], &q, 10);
+      tdio.nblks = (uint64_t)strtoull(pargs[1], &q, 10);
       if(errno || (pargs[1] == q))
         goto fail_out;
       tdio.nblks *= get_multiplier(q);
@@ -1118,7 +1264,7 @@ static int parse_dio_opts(gamut_opts *gopts, dio_opts *dio, char *attrs)
         goto fail_out;
 
       errno = 0;
-      tdio.iorate = (uint32_t)strtoul(pargs[1], &q, 10);
+      tdio.iorate = (uint64_t)strtoull(pargs[1], &q, 10);
       if(errno || (pargs[1] == q))
         goto fail_out;
       tdio.iorate *= get_multiplier(q);
@@ -1128,11 +1274,36 @@ static int parse_dio_opts(gamut_opts *gopts, dio_opts *dio, char *attrs)
       if(args_done[DIO_SYNC_ARG]++)
         goto fail_out;
 
-      errno = 0;
-      tdio.sync_f = (uint32_t)strtoul(pargs[1], &q, 10);
-      if(errno || (pargs[1] == q))
-        goto fail_out;
-      tdio.sync_f *= get_multiplier(q);
+      /*
+       * Either a count of blocks between fsync()s, as it has
+       *   always been, or a mode with an optional count after it.
+       */
+      p = pargs[1];
+      if(!isdigit((int)*p)) {
+        size_t len;
+        int smode;
+
+        len   = strcspn(p, ":");
+        smode = get_sync_mode(p, len);
+        if(smode < 0) {
+          s_log(G_WARNING, "Unknown sync mode: %s\n", pargs[1]);
+          goto fail_out;
+        }
+        tdio.sync_mode = (uint16_t)smode;
+        p += len;
+        if(*p)
+          p++;
+        else
+          p = NULL;
+      }
+
+      if(p) {
+        errno = 0;
+        tdio.sync_f = (uint32_t)strtoul(p, &q, 10);
+        if(errno || (p == q))
+          goto fail_out;
+        tdio.sync_f *= get_multiplier(q);
+      }
     }
     else if(!strcmp("mode", pargs[0])) {
 #define DIO_MODE_ARG (DIO_SYNC_ARG + 1)
@@ -1171,8 +1342,221 @@ static int parse_dio_opts(gamut_opts *gopts, dio_opts *dio, char *attrs)
       if(errno || (spargs[2] == q))
         goto fail_out;
     }
+    else if(!strcmp("engine", pargs[0])) {
+#define DIO_ENGINE_ARG (DIO_IOMIX_ARG + 1)
+      if(args_done[DIO_ENGINE_ARG]++)
+        goto fail_out;
+
+      if(!strcmp("sync", pargs[1])) {
+        tdio.engine = DIO_ENGINE_SYNC;
+      }
+      else if(!strcmp("uring", pargs[1])) {
+        if(!dio_uring_supported()) {
+          s_log(G_WARNING, "This gamut was built without io_uring.\n");
+          goto fail_out;
+        }
+        tdio.engine = DIO_ENGINE_URING;
+      }
+      else if(!strcmp("mmap", pargs[1])) {
+        tdio.engine = DIO_ENGINE_MMAP;
+      }
+      else if(!strcmp("meta", pargs[1])) {
+        tdio.engine = DIO_ENGINE_META;
+      }
+      else {
+        s_log(G_WARNING, "Unknown disk engine: %s\n", pargs[1]);
+        goto fail_out;
+      }
+    }
+    else if(!strcmp("qd", pargs[0])) {
+#define DIO_QDEPTH_ARG (DIO_ENGINE_ARG + 1)
+      if(args_done[DIO_QDEPTH_ARG]++)
+        goto fail_out;
+
+      errno = 0;
+      tdio.qdepth = (uint32_t)strtoul(pargs[1], &q, 10);
+      if(errno || (pargs[1] == q))
+        goto fail_out;
+    }
+    else if(!strcmp("direct", pargs[0])) {
+#define DIO_DIRECT_ARG (DIO_QDEPTH_ARG + 1)
+      if(args_done[DIO_DIRECT_ARG]++)
+        goto fail_out;
+
+      errno = 0;
+      tdio.direct = (uint16_t)strtoul(pargs[1], &q, 10);
+      if(errno || (pargs[1] == q) || (tdio.direct > 1))
+        goto fail_out;
+    }
+    else if(!strcmp("rawdev", pargs[0])) {
+#define DIO_RAWDEV_ARG (DIO_DIRECT_ARG + 1)
+      if(args_done[DIO_RAWDEV_ARG]++)
+        goto fail_out;
+
+      errno = 0;
+      tdio.rawdev = (uint16_t)strtoul(pargs[1], &q, 10);
+      if(errno || (pargs[1] == q) || (tdio.rawdev > 1))
+        goto fail_out;
+    }
+    else if(!strcmp("fadvise", pargs[0])) {
+#define DIO_FADVISE_ARG (DIO_RAWDEV_ARG + 1)
+      if(args_done[DIO_FADVISE_ARG]++)
+        goto fail_out;
+
+      if(!strcmp("none", pargs[1])) {
+        tdio.fadvise = DIO_FADV_NONE;
+      }
+      else if(!strcmp("dontneed", pargs[1])) {
+        tdio.fadvise = DIO_FADV_DONTNEED;
+      }
+      else {
+        s_log(G_WARNING, "Unknown fadvise mode: %s\n", pargs[1]);
+        goto fail_out;
+      }
+    }
+    else if(!strcmp("prep", pargs[0])) {
+#define DIO_PREP_ARG (DIO_FADVISE_ARG + 1)
+      if(args_done[DIO_PREP_ARG]++)
+        goto fail_out;
+
+      /* 'fill' can be followed by a thread count, as in 'fill:8' */
+      tdio.prep_threads = 0;
+      p = strchr(pargs[1], ':');
+      if(p) {
+        *p++ = '\0';
+        errno = 0;
+        tdio.prep_threads = (uint16_t)strtoul(p, &q, 10);
+        if(errno || (p == q) || *q || strcmp("fill", pargs[1]))
+          goto fail_out;
+      }
+
+      if(!strcmp("sparse", pargs[1])) {
+        tdio.prep = DIO_PREP_SPARSE;
+      }
+      else if(!strcmp("alloc", pargs[1])) {
+        tdio.prep = DIO_PREP_ALLOC;
+      }
+      else if(!strcmp("fill", pargs[1])) {
+        tdio.prep = DIO_PREP_FILL;
+      }
+      else {
+        s_log(G_WARNING, "Unknown file preparation: %s\n", pargs[1]);
+        goto fail_out;
+      }
+    }
+    else if(!strcmp("offset", pargs[0])) {
+#define DIO_OFFSET_ARG (DIO_PREP_ARG + 1)
+      if(args_done[DIO_OFFSET_ARG]++)
+        goto fail_out;
+
+      if(pattern_parse(pargs[1], &tdio.offset) < 0) {
+        s_log(G_WARNING, "Bad offset pattern \"%s\".\n", pargs[1]);
+        goto fail_out;
+      }
+    }
+    else if(!strcmp("pool", pargs[0])) {
+#define DIO_POOL_ARG (DIO_OFFSET_ARG + 1)
+      if(args_done[DIO_POOL_ARG]++)
+        goto fail_out;
+
+      errno = 0;
+      tdio.pool = (uint32_t)strtoul(pargs[1], &q, 10);
+      if(errno || (pargs[1] == q))
+        goto fail_out;
+    }
+    else if(!strcmp("stripe", pargs[0])) {
+#define DIO_STRIPE_ARG (DIO_POOL_ARG + 1)
+      if(args_done[DIO_STRIPE_ARG]++)
+        goto fail_out;
+
+      errno = 0;
+      tdio.stripe = (uint32_t)strtoul(pargs[1], &q, 10);
+      if(errno || (pargs[1] == q))
+        goto fail_out;
+      tdio.stripe *= get_multiplier(q);
+    }
+    else if(!strcmp("msync", pargs[0])) {
+#define DIO_MSYNC_ARG (DIO_STRIPE_ARG + 1)
+      if(args_done[DIO_MSYNC_ARG]++)
+        goto fail_out;
+
+      if(!strcmp("sync", pargs[1])) {
+        tdio.msync = DIO_MSYNC_SYNC;
+      }
+      else if(!strcmp("async", pargs[1])) {
+        tdio.msync = DIO_MSYNC_ASYNC;
+      }
+      else {
+        s_log(G_WARNING, "Unknown msync mode: %s\n", pargs[1]);
+        goto fail_out;
+      }
+    }
+    else if(!strcmp("metamix", pargs[0])) {
+      char *spargs[NUM_DIO_META_OPS];
+      int nspargs;
+      int j;
+
+#define DIO_METAMIX_ARG (DIO_MSYNC_ARG + 1)
+      if(args_done[DIO_METAMIX_ARG]++)
+        goto fail_out;
+
+      nspargs = split("/", pargs[1], spargs, NUM_DIO_META_OPS, ws_is_delim);
+      if(nspargs != NUM_DIO_META_OPS)
+        goto fail_out;
+
+      for(j = 0;j < NUM_DIO_META_OPS;j++) {
+        errno = 0;
+        tdio.metamix[j] = (uint16_t)strtoul(spargs[j], &q, 10);
+        if(errno || (spargs[j] == q))
+          goto fail_out;
+      }
+    }
+    else if(!strcmp("dirs", pargs[0])) {
+      char *spargs[2];
+      int nspargs;
+
+#define DIO_DIRS_ARG (DIO_METAMIX_ARG + 1)
+      if(args_done[DIO_DIRS_ARG]++)
+        goto fail_out;
+
+      nspargs = split("/", pargs[1], spargs, 2, ws_is_delim);
+      if((nspargs != 1) && (nspargs != 2))
+        goto fail_out;
+
+      errno = 0;
+      tdio.meta_width = (uint16_t)strtoul(spargs[0], &q, 10);
+      if(errno || (spargs[0] == q) || !tdio.meta_width)
+        goto fail_out;
+
+      tdio.meta_depth = DEF_META_DEPTH;
+      if(nspargs == 2) {
+        errno = 0;
+        tdio.meta_depth = (uint16_t)strtoul(spargs[1], &q, 10);
+        if(errno || (spargs[1] == q) || !tdio.meta_depth)
+          goto fail_out;
+      }
+    }
+    else if(!strcmp("trace", pargs[0])) {
+#define DIO_TRACE_ARG (DIO_DIRS_ARG + 1)
+      if(args_done[DIO_TRACE_ARG]++)
+        goto fail_out;
+
+      if(!strlen(pargs[1]) || (strlen(pargs[1]) >= BUFSIZE))
+        goto fail_out;
+      strcpy(tdio.trace, pargs[1]);
+    }
+    else if(!strcmp("tscale", pargs[0])) {
+#define DIO_TSCALE_ARG (DIO_TRACE_ARG + 1)
+      if(args_done[DIO_TSCALE_ARG]++)
+        goto fail_out;
+
+      errno = 0;
+      tdio.tscale = strtod(pargs[1], &q);
+      if(errno || (pargs[1] == q) || *q || (tdio.tscale <= 0.0))
+        goto fail_out;
+    }
     else if(!strcmp("etime", pargs[0])) {
-#define DIO_ETIME_ARG (DIO_IOMIX_ARG + 1)
+#define DIO_ETIME_ARG (DIO_TSCALE_ARG + 1)
       if(args_done[DIO_ETIME_ARG]++)
         goto fail_out;
 
@@ -1273,10 +1657,9 @@ static int parse_nio_opts(gamut_opts *gopts, nio_opts *nio, char *attrs)
   }
   else {
     memset(&tnio, 0, sizeof(tnio));
+    tnio.protocol = (uint16_t)-1;
   }
 
-  tnio.protocol = (uint16_t)-1;
-
   nargs = split(",", attrs, args, NUM_NIO_OPTS, ws_is_delim);
   if(nargs < 1)
     goto fail_out;
@@ -1362,8 +1745,121 @@ static int parse_nio_opts(gamut_opts *gopts, nio_opts *nio, char *attrs)
         goto fail_out;
       tnio.iorate *= get_multiplier(q);
     }
+    else if(!strcmp("conns", pargs[0])) {
+#define NIO_CONNS_ARG (NIO_IORATE_ARG + 1)
+      if(args_done[NIO_CONNS_ARG]++)
+        goto fail_out;
+
+      errno = 0;
+      tnio.conns = (uint32_t)strtoul(pargs[1], &q, 10);
+      if(errno || (pargs[1] == q))
+        goto fail_out;
+    }
+    else if(!strcmp("peer", pargs[0])) {
+#define NIO_PEER_ARG (NIO_CONNS_ARG + 1)
+      if(args_done[NIO_PEER_ARG]++)
+        goto fail_out;
+
+      if(!strcmp("local", pargs[1]))
+        tnio.peer = NIO_PEER_LOCAL;
+      else if(!strcmp("none", pargs[1]))
+        tnio.peer = NIO_PEER_NONE;
+      else
+        goto fail_out;
+    }
+    else if(!strcmp("tx", pargs[0])) {
+#define NIO_TX_ARG (NIO_PEER_ARG + 1)
+      if(args_done[NIO_TX_ARG]++)
+        goto fail_out;
+
+      if(!strcmp("copy", pargs[1]))
+        tnio.tx = NIO_TX_COPY;
+      else if(!strcmp("sendfile", pargs[1]))
+        tnio.tx = NIO_TX_SENDFILE;
+      else if(!strcmp("splice", pargs[1]))
+        tnio.tx = NIO_TX_SPLICE;
+      else if(!strcmp("zerocopy", pargs[1]))
+        tnio.tx = NIO_TX_ZEROCOPY;
+      else
+        goto fail_out;
+
+      if(!nio_tx_supported(tnio.tx)) {
+        s_log(G_WARNING, "This gamut was built without tx=%s.\n", pargs[1]);
+        goto fail_out;
+      }
+    }
+    else if(!strcmp("batch", pargs[0])) {
+#define NIO_BATCH_ARG (NIO_TX_ARG + 1)
+      if(args_done[NIO_BATCH_ARG]++)
+        goto fail_out;
+
+      errno = 0;
+      tnio.batch = (uint32_t)strtoul(pargs[1], &q, 10);
+      if(errno || (pargs[1] == q))
+        goto fail_out;
+    }
+    else if(!strcmp("gso", pargs[0])) {
+#define NIO_GSO_ARG (NIO_BATCH_ARG + 1)
+      if(args_done[NIO_GSO_ARG]++)
+        goto fail_out;
+
+      errno = 0;
+      tnio.gso = (uint16_t)strtoul(pargs[1], &q, 10);
+      if(errno || (pargs[1] == q) || (tnio.gso > 1))
+        goto fail_out;
+      if(tnio.gso && !nio_gso_supported()) {
+        s_log(G_WARNING, "This gamut was built without UDP GSO.\n");
+        goto fail_out;
+      }
+    }
+    else if(!strcmp("gro", pargs[0])) {
+#define NIO_GRO_ARG (NIO_GSO_ARG + 1)
+      if(args_done[NIO_GRO_ARG]++)
+        goto fail_out;
+
+      errno = 0;
+      tnio.gro = (uint16_t)strtoul(pargs[1], &q, 10);
+      if(errno || (pargs[1] == q) || (tnio.gro > 1))
+        goto fail_out;
+      if(tnio.gro && !nio_gro_supported()) {
+        s_log(G_WARNING, "This gamut was built without UDP GRO.\n");
+        goto fail_out;
+      }
+    }
+    else if(!strcmp("pace", pargs[0])) {
+#define NIO_PACE_ARG (NIO_GRO_ARG + 1)
+      if(args_done[NIO_PACE_ARG]++)
+        goto fail_out;
+
+      if(!strcmp("none", pargs[1]))
+        tnio.pace = NIO_PACE_NONE;
+      else if(!strcmp("kernel", pargs[1])) {
+        if(!nio_pacing_supported()) {
+          s_log(G_WARNING, "This gamut was built without "
+                           "SO_MAX_PACING_RATE.\n");
+          goto fail_out;
+        }
+        tnio.pace = NIO_PACE_KERNEL;
+      }
+      else if(!strcmp("user", pargs[1]))
+        tnio.pace = NIO_PACE_USER;
+      else if(!strcmp("auto", pargs[1]))
+        tnio.pace = NIO_PACE_AUTO;
+      else
+        goto fail_out;
+    }
+    else if(!strcmp("burst", pargs[0])) {
+#define NIO_BURST_ARG (NIO_PACE_ARG + 1)
+      if(args_done[NIO_BURST_ARG]++)
+        goto fail_out;
+
+      errno = 0;
+      tnio.burst = (uint32_t)strtoul(pargs[1], &q, 10);
+      if(errno || (pargs[1] == q))
+        goto fail_out;
+    }
     else if(!strcmp("etime", pargs[0])) {
-#define NIO_ETIME_ARG (NIO_IORATE_ARG + 1)
+#define NIO_ETIME_ARG (NIO_BURST_ARG + 1)
       if(args_done[NIO_ETIME_ARG]++)
         goto fail_out;
 
@@ -1422,7 +1918,7 @@ static int parse_nio_opts(gamut_opts *gopts, nio_opts *nio, char *attrs)
     }
   }
 
-  rc = validate_nio_opts(gopts, nio);
+  rc = validate_nio_opts(gopts, &tnio);
   if(rc <= 0)
     goto fail_out;
 
@@ -1515,6 +2011,10 @@ static int copy_mem_opts(mem_opts *src, mem_opts *dest, int keepID)
   dest->blksize     = src->blksize;
   dest->iorate      = src->iorate;
   dest->stride      = src->stride;
+  dest->nthreads    = src->nthreads;
+  dest->rwmix.numrds = src->rwmix.numrds;
+  dest->rwmix.numwrs = src->rwmix.numwrs;
+  dest->pattern     = src->pattern;
   dest->ntblks      = src->ntblks;
   dest->nwblks      = src->nwblks;
 
@@ -1540,12 +2040,42 @@ static int copy_dio_opts(dio_opts *src, dio_opts *dest, int keepID)
   dest->create  = src->create;
   dest->iorate  = src->iorate;
   dest->sync_f  = src->sync_f;
+  dest->sync_mode = src->sync_mode;
   dest->iomix.numrds = src->iomix.numrds;
   dest->iomix.numwrs = src->iomix.numwrs;
   dest->iomix.numsks = src->iomix.numsks;
+  dest->engine  = src->engine;
+  dest->msync   = src->msync;
+  dest->qdepth  = src->qdepth;
+  dest->direct  = src->direct;
+  dest->rawdev  = src->rawdev;
+  dest->fadvise = src->fadvise;
+  dest->prep    = src->prep;
+  dest->prep_threads = src->prep_threads;
+  dest->offset  = src->offset;
+  dest->pool    = src->pool;
+  dest->nfiles  = src->nfiles;
+  dest->stripe  = src->stripe;
+  memcpy(dest->metamix, src->metamix, sizeof(dest->metamix));
+  dest->meta_width = src->meta_width;
+  dest->meta_depth = src->meta_depth;
+  memcpy(dest->trace, src->trace, sizeof(dest->trace));
+  dest->tscale  = src->tscale;
   dest->total_diskio = src->total_diskio;
   memcpy(dest->num_diskio, src->num_diskio, sizeof(dest->num_diskio));
+  memcpy(dest->io_calls,   src->io_calls,   sizeof(dest->io_calls));
   memcpy(dest->io_usec,    src->io_usec,    sizeof(dest->io_usec));
+  memcpy(dest->io_lat,     src->io_lat,     sizeof(dest->io_lat));
+  memcpy(dest->dev,        src->dev,        sizeof(dest->dev));
+  memcpy(dest->faults,     src->faults,     sizeof(dest->faults));
+  dest->num_syncs = src->num_syncs;
+  dest->sync_usec = src->sync_usec;
+  memcpy(dest->num_meta,  src->num_meta,  sizeof(dest->num_meta));
+  memcpy(dest->meta_usec, src->meta_usec, sizeof(dest->meta_usec));
+  memcpy(dest->meta_lat,  src->meta_lat,  sizeof(dest->meta_lat));
+  memcpy(dest->trace_bytes, src->trace_bytes, sizeof(dest->trace_bytes));
+  dest->trace_lag_usec = src->trace_lag_usec;
+  dest->trace_lag_max  = src->trace_lag_max;
 
   copy_shared(src, dest);
   if(!keepID) {
@@ -1566,6 +2096,14 @@ static int copy_nio_opts(nio_opts *src, nio_opts *dest, int keepID)
   dest->mode     = src->mode;
   dest->pktsize  = src->pktsize;
   dest->iorate   = src->iorate;
+  dest->conns    = src->conns;
+  dest->peer     = src->peer;
+  dest->tx       = src->tx;
+  dest->batch    = src->batch;
+  dest->gso      = src->gso;
+  dest->gro      = src->gro;
+  dest->pace     = src->pace;
+  dest->burst    = src->burst;
 
   copy_shared(src, dest);
   if(!keepID) {
@@ -1683,6 +2221,30 @@ static int validate_mem_opts(gamut_opts *gopts, mem_opts *mem)
   mem->ntblks = mem->total_ram / mem->blksize;
   mem->nwblks = mem->working_ram / mem->blksize;
 
+  /*
+   * Each thread gets its own slice of the working set, so make
+   *   sure there's at least one block to go around.
+   */
+  if(mem->nthreads == 0)
+    mem->nthreads = 1;
+  else if(mem->nthreads > MAX_MEM_THREADS)
+    return 0;
+
+  if(mem->nwblks < mem->nthreads)
+    return 0;
+
+  /*
+   * With no read/write mix given, keep the old write-only behavior.
+   */
+  if(!mem->rwmix.numrds && !mem->rwmix.numwrs)
+    mem->rwmix.numwrs = 1;
+
+  /*
+   * The old stride option is its own pattern; don't mix the two.
+   */
+  if(mem->stride && (mem->pattern.type != PAT_DEFAULT))
+    return 0;
+
   rc = label_count(gopts, mem->shopts.label);
   if((rc < 0) || (rc > 1)) {
     return 0;
@@ -1730,34 +2292,29 @@ static int validate_mem_opts(gamut_opts *gopts, mem_opts *mem)
 }
 
 /*
+ * Check one of a disk worker's files.
+ *
  * fname:   file/path name
  * create:  the create/modify permissions on this path;
  *            0 - don't create the file or modify its contents
  *            1 - create only if it doesn't exist (don't overwrite)
  *            2 - create and overwrite if necessary
  * dowrite: are we going to write to this file?
+ * rawdev:  may we write to it if it's a block device?
+ * fsize:   gets the size of whatever is already there
+ * isdev:   gets whether it's a block device
+ *
+ * Returns 1 if the file will do, 0 if not, -1 on error.
  */
-static int validate_dio_opts(gamut_opts *gopts, dio_opts *dio)
+static int validate_dio_file(char *fname, int create, int dowrite,
+                             int rawdev, uint64_t *fsize, int *isdev)
 {
-  char *fname;
-  int i;
+  int fd;
   int rc;
   int bail;
-  int create;
-  int dowrite;
   int f_exists;
   struct stat sbuf;
 
-  if(!gopts || !dio)
-    return -1;
-
-  fname   = dio->file;
-  create  = dio->create;
-  dowrite = !!dio->iomix.numwrs;
-
-  if(!fname || !strlen(fname))
-    return 0;
-
   /*
    * Can we find the file that we've been given?
    */
@@ -1786,6 +2343,14 @@ static int validate_dio_opts(gamut_opts *gopts, dio_opts *dio)
       /* If we can't overwrite a file that exists, bail */
       bail = 1;
     }
+    else if(f_exists && S_ISBLK(sbuf.st_mode)) {
+      /* Writing to a device wipes whatever is on it; ask first */
+      if(!rawdev) {
+        s_log(G_WARNING, "Won't write to device \"%s\" without "
+                         "rawdev=1.\n", fname);
+        bail = 1;
+      }
+    }
     else {
       /*
        * Make sure the base path exists so we can write
@@ -1831,8 +2396,8 @@ static int validate_dio_opts(gamut_opts *gopts, dio_opts *dio)
       /* If we're just reading, but nothing to read, bail */
       bail = 1;
     }
-    else if(!S_ISREG(sbuf.st_mode)) {
-      /* If we're just reading but it's not a regular file, bail */
+    else if(!S_ISREG(sbuf.st_mode) && !S_ISBLK(sbuf.st_mode)) {
+      /* If we're just reading, it has to be a file or a device */
       bail = 1;
     }
     /* If we've gotten here, everything is OK */
@@ -1841,42 +2406,396 @@ static int validate_dio_opts(gamut_opts *gopts, dio_opts *dio)
     return 0;
 
   /*
-   * Validate the rest of the dio opts
+   * A device's size comes from the device itself.
    */
-  if(!dio->blksize || !dio->iorate
-     || !(dio->iomix.numrds || dio->iomix.numwrs || dio->iomix.numsks)
-    )
+  *fsize = 0;
+  *isdev = (f_exists && S_ISBLK(sbuf.st_mode));
+  if(*isdev) {
+    fd = open(fname, O_RDONLY);
+#ifdef BLKGETSIZE64
+    rc = (fd < 0) ? -1 : ioctl(fd, BLKGETSIZE64, fsize);
+#else
+    rc = -1;
+    if(fd >= 0) {
+      off_t end;
+
+      end = lseek(fd, 0, SEEK_END);
+      if(end >= 0) {
+        *fsize = (uint64_t)end;
+        rc = 0;
+      }
+    }
+#endif
+    if(rc < 0) {
+      s_log(G_WARNING, "Error getting the size of device \"%s\": %s.\n",
+                       fname, strerror(errno));
+      if(fd >= 0)
+        (void)close(fd);
+      return 0;
+    }
+    (void)close(fd);
+  }
+  else if(f_exists) {
+    *fsize = (uint64_t)sbuf.st_size;
+  }
+
+  return 1;
+}
+
+/*
+ * Check the options that matter to the meta engine, and turn
+ *   off the ones that don't.  The root of the tree is 'file'.
+ *
+ * Returns 1 if they'll do, 0 if not.
+ */
+static int validate_dio_meta(dio_opts *dio)
+{
+  int i;
+  int dowrite;
+  uint32_t total;
+  uint64_t ndirs;
+  struct stat sbuf;
+
+  total = 0;
+  for(i = 0;i < NUM_DIO_META_OPS;i++) {
+    total += dio->metamix[i];
+  }
+  if(!total || !dio->blksize || !dio->iorate || !dio->nblks
+     || (dio->nblks > MAX_META_FILES))
+  {
+    return 0;
+  }
+
+  /*
+   * None of the data I/O options mean anything here.
+   */
+  if(strchr(dio->file, ':')
+     || dio->iomix.numrds || dio->iomix.numwrs || dio->iomix.numsks
+     || dio->direct || (dio->fadvise != DIO_FADV_NONE)
+     || (dio->offset.type != PAT_DEFAULT)
+     || (dio->stripe && (dio->stripe != dio->blksize))
+     || (dio->qdepth > 1) || (dio->prep == DIO_PREP_ALLOC)
+     || dio->trace[0] || dio->tscale)
   {
     return 0;
   }
+  dio->nfiles = 1;
+
+  /*
+   * A sync point commits the whole file system, so there are
+   *   none unless a count was asked for.
+   */
+  if((dio->sync_mode != DIO_SYNC_FSYNC) && (dio->sync_mode != DIO_SYNC_NONE))
+    return 0;
+  if(!dio->sync_f)
+    dio->sync_mode = DIO_SYNC_NONE;
+
+  if(!dio->meta_width) {
+    dio->meta_width = DEF_META_WIDTH;
+    dio->meta_depth = DEF_META_DEPTH;
+  }
+  /* A tree with no levels has nowhere to put the files */
+  if(!dio->meta_depth || (dio->meta_depth > MAX_META_DEPTH))
+    return 0;
+  ndirs = 1;
+  for(i = 0;i < dio->meta_depth;i++) {
+    ndirs *= dio->meta_width;
+    if(ndirs > MAX_META_DIRS)
+      return 0;
+  }
+
+  /*
+   * Same rules as a file: mode 1 makes its own tree, and only
+   *   stats can be done on a tree we may not change.
+   */
+  dowrite = dio->metamix[DIO_META_CREATE] || dio->metamix[DIO_META_RENAME]
+            || dio->metamix[DIO_META_UNLINK] || (dio->prep != DIO_PREP_SPARSE);
+  if(!stat(dio->file, &sbuf)) {
+    if(!S_ISDIR(sbuf.st_mode))
+      return 0;
+    if(dowrite && (dio->create != C_OVERWRITE))
+      return 0;
+  }
+  else if(!dowrite || (dio->create == C_RDONLY)) {
+    return 0;
+  }
+
+  return 1;
+}
+
+/*
+ * A trace brings its own rate, mix and offsets; all we need is
+ *   room for its largest I/O, which the worker checks on loading.
+ */
+static int validate_dio_trace(dio_opts *dio)
+{
+  if(!dio->blksize || dio->iorate
+     || dio->iomix.numrds || dio->iomix.numwrs || dio->iomix.numsks
+     || (dio->offset.type != PAT_DEFAULT)
+     || (dio->stripe && (dio->stripe != dio->blksize)))
+  {
+    return 0;
+  }
+
+  /*
+   * Replay keeps as many I/Os in flight as the trace had, so it
+   *   has to be able to queue them.
+   */
+  if(dio->engine != DIO_ENGINE_URING) {
+    s_log(G_WARNING, "Replaying a trace takes engine=uring.\n");
+    return 0;
+  }
+
+  if(access(dio->trace, R_OK) < 0) {
+    s_log(G_WARNING, "Cannot read trace \"%s\": %s.\n",
+                     dio->trace, strerror(errno));
+    return 0;
+  }
+  if(!dio->tscale)
+    dio->tscale = 1.0;
+
+  return 1;
+}
+
+static int validate_dio_opts(gamut_opts *gopts, dio_opts *dio)
+{
+  char *fname;
+  char *list;
+  char *names[MAX_DIO_FILES];
+  int i;
+  int rc;
+  int create;
+  int dowrite;
+  int nfiles;
+  int isdev;
+  int ndevs;
+  uint64_t fsize;
+  uint64_t minsize;
+  uint64_t devsize;
+
+  if(!gopts || !dio)
+    return -1;
+
+  fname   = dio->file;
+  create  = dio->create;
+  dowrite = !!dio->iomix.numwrs || (dio->prep != DIO_PREP_SPARSE);
+
+  /*
+   * We don't know if a trace writes until the worker reads it, so
+   *   take the mode at its word: 0 only reads, the others may write.
+   */
+  if(dio->trace[0] && (create != C_RDONLY))
+    dowrite = 1;
+
+  if(!fname || !strlen(fname))
+    return 0;
+
+  /*
+   * The meta engine works on a directory tree instead of files.
+   */
+  minsize = 0;
+  devsize = 0;
+  ndevs   = 0;
+  if(dio->engine == DIO_ENGINE_META) {
+    rc = validate_dio_meta(dio);
+    if(rc <= 0)
+      return rc;
+  }
+  else {
+    /*
+     * Check every file we've been given, and keep track of the
+     *   smallest one; a stripe can't go past the end of any of them.
+     */
+    list = strdup(fname);
+    if(!list)
+      return -1;
+    nfiles = split_dio_files(list, names);
+    if(nfiles < 1) {
+      s_log(G_WARNING, "Bad file list \"%s\" (at most %d files).\n",
+                       fname, MAX_DIO_FILES);
+      free(list);
+      return 0;
+    }
+
+    for(i = 0;i < nfiles;i++) {
+      rc = validate_dio_file(names[i], create, dowrite, dio->rawdev,
+                             &fsize, &isdev);
+      if(rc <= 0) {
+        free(list);
+        return rc;
+      }
+      if(!i || (fsize < minsize))
+        minsize = fsize;
+      if(isdev) {
+        if(!ndevs || (fsize < devsize))
+          devsize = fsize;
+        ndevs++;
+      }
+    }
+    free(list);
+    dio->nfiles = (uint16_t)nfiles;
+
+    /*
+     * Validate the rest of the dio opts
+     */
+    if(dio->trace[0]) {
+      rc = validate_dio_trace(dio);
+      if(rc <= 0)
+        return rc;
+    }
+    else if(!dio->blksize || !dio->iorate
+            || !(dio->iomix.numrds || dio->iomix.numwrs
+                 || dio->iomix.numsks)
+            || dio->tscale)
+    {
+      return 0;
+    }
+    if(dio->meta_width || dio->meta_depth)
+      return 0;
+    for(i = 0;i < NUM_DIO_META_OPS;i++) {
+      if(dio->metamix[i])
+        return 0;
+    }
+  }
+
+  /*
+   * A mapping is written back with msync() or not at all, and
+   *   O_DSYNC does nothing for stores into it.
+   */
+  if(dio->sync_mode > DIO_SYNC_NONE)
+    return 0;
+  if((dio->engine == DIO_ENGINE_MMAP)
+     && (dio->sync_mode != DIO_SYNC_FSYNC)
+     && (dio->sync_mode != DIO_SYNC_NONE))
+    return 0;
 
   /*
-   * If we're just reading, set the number of blocks
+   * The synchronous and mmap engines only ever have one I/O
+   *   outstanding.  A mapping always goes through the page cache.
    */
-  if(!dowrite) {
-    uint32_t nblks;
+  if(dio->engine == DIO_ENGINE_MMAP) {
+    if(dio->direct)
+      return 0;
+  }
+  else if(dio->msync != DIO_MSYNC_SYNC) {
+    return 0;
+  }
+  if(dio->engine != DIO_ENGINE_URING) {
+    if(dio->qdepth > 1)
+      return 0;
+    dio->qdepth = 1;
+  }
+  else {
+    if(!dio->qdepth)
+      dio->qdepth = DEF_DIO_QDEPTH;
+    else if(dio->qdepth > MAX_DIO_QDEPTH)
+      return 0;
+  }
+
+  /*
+   * Whole blocks go to one file before the next.  The queue depth
+   *   is per file, and they all share one ring.
+   */
+  if(!dio->stripe)
+    dio->stripe = dio->blksize;
+  else if(dio->stripe % dio->blksize)
+    return 0;
+  if((uint64_t)dio->qdepth * dio->nfiles > MAX_DIO_QDEPTH)
+    return 0;
+
+  /*
+   * O_DIRECT needs whole sectors, and dropping the page cache
+   *   makes no sense when we never go through it.  The exact
+   *   alignment depends on the device, so the worker checks
+   *   that once it has the file open.
+   */
+  if(dio->direct) {
+    if(dio->blksize % MIN_DIO_ALIGN)
+      return 0;
+    if(dio->fadvise != DIO_FADV_NONE)
+      return 0;
+  }
+
+  /*
+   * An offset pattern decides where every I/O goes, so there's
+   *   nothing left for a seek to do.
+   */
+  if((dio->offset.type != PAT_DEFAULT) && dio->iomix.numsks)
+    return 0;
+
+  /*
+   * Only a fill uses more than one thread.
+   */
+  if(dio->prep == DIO_PREP_FILL) {
+    if(!dio->prep_threads)
+      dio->prep_threads = DEF_PREP_THREADS;
+    else if(dio->prep_threads > MAX_PREP_THREADS)
+      return 0;
+  }
+  else if(dio->prep_threads) {
+    return 0;
+  }
+
+  /*
+   * Keep the pool of random blocks to a sane amount of memory.
+   *   A pool that was asked for has to fit; the default one is
+   *   cut down to fit big blocks.
+   */
+  if(!dio->pool) {
+    dio->pool = DEF_DIO_POOL;
+    if((uint64_t)dio->pool * dio->blksize > MAX_DIO_POOL_BYTES) {
+      dio->pool = MAX_DIO_POOL_BYTES / dio->blksize;
+      if(!dio->pool)
+        dio->pool = 1;
+    }
+  }
+  else if(dio->pool > MAX_DIO_POOL) {
+    return 0;
+  }
+  else if((uint64_t)dio->pool * dio->blksize > MAX_DIO_POOL_BYTES) {
+    s_log(G_WARNING, "A pool of %u blocks of %u KiB is more than "
+                     "%u MiB.\n", dio->pool, (uint32_t)(dio->blksize / KILO),
+                     (uint32_t)(MAX_DIO_POOL_BYTES / MEGA));
+    return 0;
+  }
+
+  /*
+   * If we're just reading, set the number of blocks.  Writes make
+   *   a file as big as it has to be, but a device is only so big.
+   */
+  if((!dowrite || ndevs) && (dio->engine != DIO_ENGINE_META)) {
+    uint64_t nblks;
     uint32_t remain;
 
-    nblks  = (uint32_t)(sbuf.st_size / dio->blksize);
-    remain = (uint32_t)(sbuf.st_size % dio->blksize);
+    if(dowrite)
+      minsize = devsize;
+
+    /* Only whole stripes on every file count */
+    if(dio->nfiles > 1)
+      minsize = (minsize / dio->stripe) * dio->stripe * dio->nfiles;
+
+    nblks  = (uint64_t)(minsize / dio->blksize);
+    remain = (uint32_t)(minsize % dio->blksize);
     if(!nblks) {
       s_log(G_WARNING, "File \"%s\": Requested block size of %u KiB "
                        "is larger than filesize of %u KiB.\n",
                        fname, (uint32_t)(dio->blksize / KILO),
-                       (uint32_t)(sbuf.st_size / KILO));
+                       (uint32_t)(minsize / KILO));
       return 0;
     }
     else if(dio->nblks > nblks) {
-      s_log(G_WARNING, "File \"%s\": Asked to use %u blocks, but only "
-                       "%u blocks exist (blocksize = %u KiB).\n",
-                       fname, dio->nblks, nblks,
+      s_log(G_WARNING, "File \"%s\": Asked to use %llu blocks, but only "
+                       "%llu blocks exist (blocksize = %u KiB).\n",
+                       fname, (unsigned long long)dio->nblks,
+                       (unsigned long long)nblks,
                        (uint32_t)(dio->blksize / KILO));
       return 0;
     }
     else if(!dio->nblks) {
       if(remain) {
-        s_log(G_DEBUG, "File \"%s\": %u bytes remain after %u blocks "
-                       "of size %u B.\n", fname, remain, nblks,
+        s_log(G_DEBUG, "File \"%s\": %u bytes remain after %llu blocks "
+                       "of size %u B.\n", fname, remain,
+                       (unsigned long long)nblks,
                        dio->blksize);
         return 0;
       }
@@ -1886,6 +2805,13 @@ static int validate_dio_opts(gamut_opts *gopts, dio_opts *dio)
     }
   }
 
+  /*
+   * A trace's offsets wrap around the blocks we have, so there
+   *   have to be some.
+   */
+  if(dio->trace[0] && !dio->nblks)
+    return 0;
+
   rc = label_count(gopts, dio->shopts.label);
   if((rc < 0) || (rc > 1)) {
     return 0;
@@ -1943,6 +2869,13 @@ static int validate_nio_opts(gamut_opts *gopts, nio_opts *nio)
   if((nio->mode != O_RDONLY) && (nio->mode != O_WRONLY))
     nio->mode = O_RDONLY;
 
+  if((nio->peer != NIO_PEER_NONE) && (nio->peer != NIO_PEER_LOCAL))
+    return 0;
+
+  /* A local peer is on loopback unless told to use another address */
+  if((nio->peer == NIO_PEER_LOCAL) && (nio->addr == INADDR_ANY))
+    nio->addr = htonl(INADDR_LOOPBACK);
+
   /* If we're going to have I/O with 0.0.0.0, it can be read-only. */
   if((nio->addr == INADDR_ANY) && (nio->mode != O_RDONLY))
     return 0;
@@ -1963,6 +2896,80 @@ static int validate_nio_opts(gamut_opts *gopts, nio_opts *nio)
   if(!nio->iorate)
     return 0;
 
+  if(!nio->conns)
+    nio->conns = DEF_NIO_CONNS;
+  if(nio->conns > MAX_NIO_CONNS) {
+    s_log(G_WARNING, "%s asks for %u connections; at most %u allowed.\n",
+                     nio->shopts.label, nio->conns, MAX_NIO_CONNS);
+    return 0;
+  }
+
+  /* A datagram has to fit in one IP packet */
+  if((nio->protocol == IPPROTO_UDP) && (nio->pktsize > 65507))
+    return 0;
+
+  /*
+   * Only writers send.  sendfile() and splice() don't keep datagram
+   *   boundaries, so they're for TCP.
+   */
+  if(nio->tx > NIO_TX_ZEROCOPY)
+    return 0;
+  if((nio->tx != NIO_TX_COPY) && (nio->mode != O_WRONLY)) {
+    s_log(G_WARNING, "%s: tx= is only for writers.\n", nio->shopts.label);
+    return 0;
+  }
+  if(((nio->tx == NIO_TX_SENDFILE) || (nio->tx == NIO_TX_SPLICE))
+     && (nio->protocol != IPPROTO_TCP))
+  {
+    s_log(G_WARNING, "%s: tx=sendfile and tx=splice need TCP.\n",
+                     nio->shopts.label);
+    return 0;
+  }
+
+  /*
+   * Batching is for UDP; GSO splits what a writer sends and GRO
+   *   joins what a reader gets.  A GSO message only carries as many
+   *   packets as a call moves, so gso=1 batches by default.
+   */
+  if(!nio->batch)
+    nio->batch = nio->gso ? NIO_GSO_SEGS : 1;
+  if(nio->batch > MAX_NIO_BATCH)
+    return 0;
+  if(((nio->batch > 1) || nio->gso || nio->gro)
+     && (nio->protocol != IPPROTO_UDP))
+  {
+    s_log(G_WARNING, "%s: batch=, gso= and gro= need UDP.\n",
+                     nio->shopts.label);
+    return 0;
+  }
+  if((nio->gso && (nio->mode != O_WRONLY))
+     || (nio->gro && (nio->mode != O_RDONLY)))
+  {
+    s_log(G_WARNING, "%s: gso= is for writers and gro= for readers.\n",
+                     nio->shopts.label);
+    return 0;
+  }
+  if(nio->gso && (nio->batch < 2)) {
+    s_log(G_WARNING, "%s: gso=1 needs batch=2 or more.\n",
+                     nio->shopts.label);
+    return 0;
+  }
+
+  /*
+   * Pacing is for writers; a reader takes what it's sent.
+   */
+  if(nio->pace > NIO_PACE_AUTO)
+    return 0;
+  if((nio->pace != NIO_PACE_NONE) && (nio->mode != O_WRONLY)) {
+    s_log(G_WARNING, "%s: pace= is only for writers.\n",
+                     nio->shopts.label);
+    return 0;
+  }
+  if(!nio->burst)
+    nio->burst = DEF_NIO_BURST;
+  if(nio->burst > MAX_NIO_BURST)
+    return 0;
+
   rc = label_count(gopts, nio->shopts.label);
   if((rc < 0) || (rc > 1)) {
     return 0;
@@ -2070,6 +3077,10 @@ static void clean_mem_opts(mem_opts *mem, int keepID)
   mem->working_ram = 0;
   mem->iorate      = 0;
   mem->stride      = 0;
+  mem->nthreads    = 0;
+  mem->rwmix.numrds = 0;
+  mem->rwmix.numwrs = 0;
+  memset(&mem->pattern, 0, sizeof(mem->pattern));
   mem->blksize     = 0;
   mem->ntblks      = 0;
   mem->nwblks      = 0;
@@ -2082,6 +3093,8 @@ static void clean_mem_opts(mem_opts *mem, int keepID)
 
 static void clean_dio_opts(dio_opts *dio, int keepID)
 {
+  int i;
+
   if(!dio || (keepID < 0))
     return;
 
@@ -2093,12 +3106,45 @@ static void clean_dio_opts(dio_opts *dio, int keepID)
   dio->create  = 0;
   dio->iorate  = 0;
   dio->sync_f  = 0;
+  dio->sync_mode = DIO_SYNC_FSYNC;
   dio->iomix.numrds = 0;
   dio->iomix.numwrs = 0;
   dio->iomix.numsks = 0;
+  dio->engine  = DIO_ENGINE_SYNC;
+  dio->msync   = DIO_MSYNC_SYNC;
+  dio->qdepth  = 0;
+  dio->direct  = 0;
+  dio->rawdev  = 0;
+  dio->fadvise = DIO_FADV_NONE;
+  dio->prep    = DIO_PREP_SPARSE;
+  dio->prep_threads = 0;
+  memset(&dio->offset, 0, sizeof(dio->offset));
+  dio->pool    = 0;
+  dio->nfiles  = 0;
+  dio->stripe  = 0;
+  memset(dio->metamix, 0, sizeof(dio->metamix));
+  dio->meta_width = 0;
+  dio->meta_depth = 0;
+  memset(dio->trace, 0, sizeof(dio->trace));
+  dio->tscale  = 0.0;
   dio->total_diskio = 0;
   memset(dio->num_diskio, 0, sizeof(dio->num_diskio));
+  memset(dio->io_calls,   0, sizeof(dio->io_calls));
   memset(dio->io_usec,    0, sizeof(dio->io_usec));
+  lat_hist_reset(&dio->io_lat[C_IOREAD]);
+  lat_hist_reset(&dio->io_lat[C_IOWRITE]);
+  memset(dio->dev,        0, sizeof(dio->dev));
+  memset(dio->faults,     0, sizeof(dio->faults));
+  dio->num_syncs = 0;
+  dio->sync_usec = 0;
+  memset(dio->num_meta,  0, sizeof(dio->num_meta));
+  memset(dio->meta_usec, 0, sizeof(dio->meta_usec));
+  for(i = 0;i < NUM_DIO_META_OPS;i++) {
+    lat_hist_reset(&dio->meta_lat[i]);
+  }
+  memset(dio->trace_bytes, 0, sizeof(dio->trace_bytes));
+  dio->trace_lag_usec = 0;
+  dio->trace_lag_max  = 0;
 
   clean_shared(dio);
   if(!keepID) {
@@ -2117,6 +3163,14 @@ static void clean_nio_opts(nio_opts *nio, int keepID)
   nio->mode     = 0;
   nio->pktsize  = 0;
   nio->iorate   = 0;
+  nio->conns    = 0;
+  nio->peer     = NIO_PEER_NONE;
+  nio->tx       = NIO_TX_COPY;
+  nio->batch    = 0;
+  nio->gso      = 0;
+  nio->gro      = 0;
+  nio->pace     = NIO_PACE_NONE;
+  nio->burst    = 0;
 
   clean_shared(nio);
   if(!keepID) {
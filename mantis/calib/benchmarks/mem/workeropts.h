@@ -15,9 +15,12 @@
 
 #include <netdb.h>     /* for uint{16,32}_t        */
 #include <pthread.h>   /* for the pthread_t struct */
+#include <stdio.h>     /* for FILE                 */
 #include <sys/time.h>  /* For struct timeval       */
 
 #include "constants.h" /* for several #define's    */
+#include "lathist.h"   /* for lat_hist             */
+#include "pattern.h"   /* for pattern_opts           */
 #include "utilio.h"    /* for SMBUFSIZE              */
 
 /********************** Begin option data structures ******************/
@@ -130,6 +133,10 @@ typedef struct {
 
   master_cmd      mcmd;          /* Type of command we were given */
   char            mbuf[BUFSIZE]; /* Command buffer (for options) */
+  FILE           *mout;          /* Where to copy what the command logs */
+  uint64_t        mseq;          /* Commands sent so far */
+  uint64_t        mdone;         /* The last one of them to finish */
+  int             mrc;           /* What it returned */
 } master_ctl;
 
 /*
@@ -248,6 +255,23 @@ typedef struct {
 /******************************************************************/
 /******************************************************************/
 
+/*
+ * Per-thread statistics for a memory worker.
+ */
+typedef struct {
+  int32_t  cpu;         /* CPU the thread is pinned to (-1 if none) */
+  uint64_t memio[2];    /* Memory I/O by this thread (read and write) */
+} mem_thread_stats;
+
+/*
+ * What a memory worker did in one epoch.
+ */
+typedef struct {
+  uint64_t start_usec;  /* Start of the epoch (usecs since the Epoch) */
+  uint64_t bytes;       /* Bytes read and written */
+  uint32_t busy_usec;   /* Time spent touching memory */
+} mem_epoch_sample;
+
 typedef struct {
   shared_opts shopts;   /* Shared options */
 
@@ -256,6 +280,12 @@ typedef struct {
   uint64_t blksize;     /* Size of a block (defaults to 1 page) */
   uint64_t iorate;      /* Rate to touch memory */
   uint32_t stride;      /* Number of sequential blks per random blk */
+  uint32_t nthreads;    /* Number of threads sharing the buffer */
+  struct {              /* START read/write ratio */
+    uint16_t numrds;    /* Number of reads */
+    uint16_t numwrs;    /* Number of writes */
+  } rwmix;              /* END read/write ratio */
+  pattern_opts pattern; /* Order in which blocks are touched */
 
   /*
    * These last two are not set by the user, but instead calculated.
@@ -264,34 +294,81 @@ typedef struct {
   uint64_t nwblks;      /* Number of blocks in the working set */
 
   uint64_t total_memio; /* Total amount of memory I/O performed */
+  mem_thread_stats tstats[MAX_MEM_THREADS]; /* Stats for each thread */
+
+  /*
+   * A ring of the last MEM_EPOCH_SAMPLES epochs.  Only the worker
+   *   writes it; anyone else reads it with the worker locked.
+   */
+  mem_epoch_sample *epochs;
+  uint64_t nepochs;     /* Epochs recorded so far */
 } mem_opts;
 
-#define NUM_MEM_OPTS (5 + NUM_SHD_OPTS)
+#define NUM_MEM_OPTS (8 + NUM_SHD_OPTS)
 
 /******************************************************************/
 /******************************************************************/
 
+/*
+ * Per-file statistics for a disk worker striping over several files.
+ */
+typedef struct {
+  int64_t num_diskio[2]; /* Reads and writes done on this file */
+  int64_t io_calls[2];   /* Calls that did them */
+  int64_t io_usec[2];    /* Usecs spent on them */
+} dio_dev_stats;
+
 typedef struct {
   shared_opts shopts;   /* Shared options */
 
-  char *file;           /* File name */
+  char *file;           /* File name, or names separated by ':' */
   uint32_t blksize;     /* Blocksize */
-  uint32_t nblks;       /* Total number of blocks in the file */
+  uint64_t nblks;       /* Total number of blocks in the file */
   uint16_t create;      /* Create the file? */
-  uint32_t iorate;      /* I/O rate */
+  uint64_t iorate;      /* I/O rate */
   uint32_t sync_f;      /* How often to sync buffers? */
+  uint16_t sync_mode;   /* How to sync them (DIO_SYNC_*) */
   struct {              /* START I/O ratio statistics */
     uint16_t numrds;    /* Number of reads */
     uint16_t numwrs;    /* Number of writes */
     uint16_t numsks;    /* Number of seeks */
   } iomix;              /* END I/O ratio statistics */
+  uint16_t engine;      /* How to issue the I/O (DIO_ENGINE_*) */
+  uint16_t msync;       /* How the mmap engine syncs (DIO_MSYNC_*) */
+  uint32_t qdepth;      /* I/Os in flight at once (async engines) */
+  uint16_t direct;      /* Bypass the page cache with O_DIRECT? */
+  uint16_t rawdev;      /* May writes go to a block device? */
+  uint16_t fadvise;     /* Page cache advice for buffered I/O (DIO_FADV_*) */
+  uint16_t prep;        /* How to prepare the file (DIO_PREP_*) */
+  uint16_t prep_threads; /* Threads used to fill the file */
+  pattern_opts offset;  /* Where reads and writes go in the file */
+  uint32_t pool;        /* Random blocks that writes rotate through */
+  uint16_t nfiles;      /* How many files are named in 'file' */
+  uint32_t stripe;      /* Bytes on one file before moving to the next */
+  uint16_t metamix[NUM_DIO_META_OPS]; /* Weights of the meta engine's ops */
+  uint16_t meta_width;  /* Subdirectories per directory (meta engine) */
+  uint16_t meta_depth;  /* Levels of subdirectories (meta engine) */
+  char trace[BUFSIZE];  /* Block I/O trace to replay instead of the mix */
+  double tscale;        /* Multiplies every time in the trace */
 
   int64_t total_diskio;  /* Total amount of work done so far */
   int64_t num_diskio[3]; /* Number of disk I/Os by category */
+  int64_t io_calls[2];   /* Read and write calls (may cover several I/Os) */
   int64_t io_usec[3];    /* Usecs per each category of I/O */
+  lat_hist io_lat[2];    /* Latency of each read and write call */
+  dio_dev_stats dev[MAX_DIO_FILES]; /* The same, for each striped file */
+  int64_t faults[2];     /* Minor and major page faults (mmap engine) */
+  int64_t num_syncs;     /* Sync points reached */
+  int64_t sync_usec;     /* Usecs spent in the sync calls */
+  int64_t num_meta[NUM_DIO_META_OPS];  /* Metadata operations done */
+  int64_t meta_usec[NUM_DIO_META_OPS]; /* Usecs spent on them */
+  lat_hist meta_lat[NUM_DIO_META_OPS]; /* Latency of each one */
+  int64_t trace_bytes[2];  /* Bytes read and written replaying a trace */
+  int64_t trace_lag_usec;  /* How late the trace's I/Os went out, in all */
+  int64_t trace_lag_max;   /* The latest any one of them went out */
 } dio_opts;
 
-#define NUM_DIO_OPTS (8 + NUM_SHD_OPTS)
+#define NUM_DIO_OPTS (22 + NUM_SHD_OPTS)
 
 /******************************************************************/
 /******************************************************************/
@@ -305,13 +382,31 @@ typedef struct {
   int32_t  protocol;      /* Protocol number (a la getprotobyname) */
   uint32_t pktsize;       /* Packet size */
   uint64_t iorate;        /* I/O rate */
+  uint32_t conns;         /* Connections (UDP: sockets) to spread it over */
+  uint16_t peer;          /* Who's on the other end (NIO_PEER_*) */
+  uint16_t tx;            /* How packets are sent (NIO_TX_*) */
+  uint32_t batch;         /* UDP packets per sendmmsg() or recvmmsg() */
+  uint16_t gso;           /* Let the kernel split sends (UDP_SEGMENT) */
+  uint16_t gro;           /* Let the kernel coalesce reads (UDP_GRO) */
+  uint16_t pace;          /* How a writer spreads out packets (NIO_PACE_*) */
+  uint32_t burst;         /* Packets let out at once by pace=user */
 
   int64_t total_netio;    /* Total amount of work remaining */
   int64_t netio_bytes[2]; /* Number of I/O bytes (read and write) */
   int64_t io_usec[2];     /* How long did it take to do the I/O? */
+  lat_hist io_lat[2];     /* Latency of each receive and send */
+  uint32_t live_conns;    /* Connections open right now */
+  int64_t conns_closed;   /* Connections the other end closed or broke */
+  int64_t cpu_usec[2];    /* User and system CPU time the worker used */
+  int64_t zc_sends;       /* Sends made with MSG_ZEROCOPY */
+  int64_t zc_done;        /* Of those, ones the kernel says are done */
+  int64_t zc_copied;      /* Of those, ones it copied after all */
+  int64_t batches[2];     /* recvmmsg() and sendmmsg() calls that moved data */
+  uint16_t paced;         /* The NIO_PACE_* 'pace' turned into */
+  int64_t pace_waits;     /* Times pace=user slept between bursts */
 } nio_opts;
 
-#define NUM_NIO_OPTS (6 + NUM_SHD_OPTS)
+#define NUM_NIO_OPTS (14 + NUM_SHD_OPTS)
 
 /******************************************************************/
 /******************************************************************/
@@ -382,6 +477,17 @@ extern void clean_worker_opts(gamut_opts *gopts, worker_class wcls,
 extern shared_opts* get_shared_opts(gamut_opts *gopts,
                                     worker_class wcls, int widx);
 
+/*
+ * Split a disk worker's file list on ':', in place.  Returns the
+ *   number of files, or -1 if there are too many or one is empty.
+ */
+extern int split_dio_files(char *list, char *names[]);
+
+/*
+ * The name of a DIO_SYNC_* mode, or NULL if there's no such mode.
+ */
+extern char* get_sync_label(uint16_t mode);
+
 /*********************** End function declarations ********************/
 
 #endif /* GAMUT_WORKEROPTS_H */